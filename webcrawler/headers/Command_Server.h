@@ -0,0 +1,64 @@
+#ifndef COMMAND_SERVER_H
+#define COMMAND_SERVER_H
+
+#include <cstddef>
+#include <poll.h>
+
+#define COMMAND_LINE_SIZE 4096               // a command line (the command and its arguments) is cut off there - a request for the jobExecutor must fit in it (and in PIPE_BUF, so that it is written at once)
+#define COMMAND_MAX_CLIENTS 1024             // command connections open at once (the others wait to be accepted until one of them is closed)
+#define COMMAND_INITIAL_CLIENTS 16           // connection slots at first (doubled whenever they are all taken)
+#define COMMAND_RETRY_INTERVAL 10            // ms before a request that could not be written to the jobExecutor (its pipe was busy with a page, or full) is tried again
+#define ANSWER_READ_SIZE 2048                // bytes of the jobExecutor's answers read at a time
+#define ANSWER_HEADER_SIZE 32                // "#<request id>\n" that comes before each of its answers
+
+
+class Command_Server {          // the crawler's command port, served by one thread that only ever blocks in poll: any number of connections at once, each one sending a command line and getting
+                                // its answer (then it is closed). Requests for the jobExecutor are queued and written to it as "#<request id> <request>\n" whenever its pipe is free, and it answers
+                                // each one with "#<request id>\n" + the answer + "<\n", so that every answer is relayed to its own connection while the other connections go on being served
+    enum client_state { FREE, READING, COMMAND, QUEUED, SENT, REPLIED };
+    struct client {
+        int fd;
+        client_state state;                  // READING the command line, COMMAND to be handled, request QUEUED for or SENT to the jobExecutor, REPLIED (closed once out has been sent)
+        char line[COMMAND_LINE_SIZE];        // the command line (and then the request for the jobExecutor)
+        size_t line_len;
+        unsigned int request_id;             // (QUEUED, SENT) requests are written to the jobExecutor in the order of their ids
+        char *out;                           // the answer, as much of it as has not been sent yet (grows as needed)
+        size_t out_len, out_sent, out_capacity;
+    };
+    int listening_fd;
+    bool accepting;
+    client *clients;
+    unsigned int num_slots, num_open;
+    struct pollfd *pfds;
+    int *polled;                             // the client slot of every pfds entry (negative for the listening socket and the jobExecutor's pipe)
+    unsigned int num_polled;                 // (the size of both)
+    unsigned int next_request_id;
+    unsigned int num_queued, num_sent;       // requests waiting to be written to the jobExecutor, and written but not answered yet
+    // the answer being read from the jobExecutor
+    char header[ANSWER_HEADER_SIZE];
+    size_t header_len;
+    bool in_body, pending_lt;                // the header has been read / the last byte read was a '<' (that may start the end of the answer)
+    int answering;                           // the client slot it goes to (-1 if its connection was closed in the meantime)
+    bool jobExecutor_gone;                   // its pipe was closed: requests are answered with an error right away
+public:
+    Command_Server(int listening_socket);
+    ~Command_Server();                       // closes every connection still open (but not the listening socket)
+    int serve();                             // waits for events and handles them: returns poll's result (-1 with errno set if it failed, ex: EINTR)
+    int next_command(char *&command, char *&arguments, bool &has_arguments);     // the slot of a connection whose command line was read, or -1 if there is none
+    void reply(int slot, const char *answer);        // answer is the connection's whole answer: it is closed once it is sent
+    void forward(int slot, const char *request);     // the jobExecutor's answer to request (one line, without the '\n') is the connection's answer
+    void stop_accepting();
+    bool idle() const;                       // no request is waiting for the jobExecutor's answer, and every answer has been sent
+private:
+    void accept_connections();
+    void read_command(int slot);
+    void send_answer(int slot);              // as much of out as the connection takes without blocking
+    void append_answer(int slot, const char *data, size_t len);
+    void close_connection(int slot);
+    void send_requests();                    // as many queued requests as the jobExecutor's pipe takes without blocking
+    void read_answers();
+    void end_answer();
+};
+
+
+#endif //COMMAND_SERVER_H
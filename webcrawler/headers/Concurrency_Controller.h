@@ -0,0 +1,49 @@
+#ifndef CONCURRENCY_CONTROLLER_H
+#define CONCURRENCY_CONTROLLER_H
+
+#include <pthread.h>
+
+#define CONCURRENCY_EPOCH_MIN_EVENTS 16      // answers (or errors) an epoch needs at least before the window is adjusted (an epoch also needs as many as the window, ~ one round trip of every fetch)
+#define CONCURRENCY_TOLERANCE 1.5            // an epoch's mean time to first byte up to this many times the baseline (plus CONCURRENCY_SLACK_USEC) counts as flat
+#define CONCURRENCY_SLACK_USEC 1000          // (so that the jitter of a server that answers in microseconds is not taken for congestion)
+#define CONCURRENCY_LATENCY_BACKOFF 0.75     // the window is multiplied by this when the time to first byte rose
+#define CONCURRENCY_ERROR_BACKOFF 0.5        // and by this when fetches failed or timed out, or the server answered 5xx
+#define CONCURRENCY_BASELINE_DRIFT 16        // the baseline moves up by 1/this of the difference after an epoch slower than it (and down to any faster epoch at once)
+
+
+class Concurrency_Controller {  // (--adaptive) an AIMD limit on the fetches in flight over all crawler threads: it doubles (slow start) and then grows by one fetch per epoch while
+                                // the server's time to first byte stays flat, and shrinks multiplicatively as soon as it rises or errors show up, between min_window and max_window
+    unsigned int window;                     // (atomic) fetches allowed in flight
+    unsigned int in_flight;                  // (atomic)
+    unsigned int min_window, max_window;
+    unsigned int num_waiting;                // (atomic) crawler threads with nothing in flight waiting for a fetch to be allowed
+    bool slow_start;
+    // the current epoch (lock protected):
+    unsigned int epoch_samples, epoch_errors;
+    unsigned long long epoch_usec;
+    unsigned long long baseline_usec, last_mean_usec;        // (0 until the first epoch)
+    unsigned long long increases, decreases;
+    pthread_mutex_t lock;
+    pthread_cond_t allowed;
+public:
+    Concurrency_Controller(unsigned int initial_fetches, unsigned int min_fetches, unsigned int max_fetches);
+    ~Concurrency_Controller();
+    // thread safe:
+    bool acquire();                          // true if one more fetch may start now (it must be given back with release when it is over)
+    void release();
+    void wait(int timeout_msecs);            // for a crawler thread with nothing in flight: waits until a fetch may start (or timeout_msecs pass)
+    void sample(unsigned long long first_byte_usec);     // a fetch got its answer's header after that long
+    void error();                            // a fetch failed, timed out, or got a 5xx answer
+    unsigned int get_window() const;
+    unsigned int get_in_flight() const;
+    unsigned int get_min() const;
+    unsigned int get_max() const;
+    void get_latencies(unsigned long long &mean_usec, unsigned long long &baseline);    // the last epoch's mean time to first byte and the baseline it was compared with
+    void get_adjustments(unsigned long long &num_increases, unsigned long long &num_decreases);
+private:
+    void end_epoch();                        // (lock MUST be held)
+    void set_window(unsigned int new_window);      // (lock MUST be held)
+};
+
+
+#endif //CONCURRENCY_CONTROLLER_H
@@ -0,0 +1,60 @@
+#ifndef CRAWL_CHECKPOINT_H
+#define CRAWL_CHECKPOINT_H
+
+#include <pthread.h>
+#include <cstddef>
+#include "URL_Frontier.h"
+#include "hash_history.h"
+#include "str_history.h"
+
+#define CHECKPOINT_DIR ".checkpoint"         // created inside the save directory
+#define CHECKPOINT_SYNC_INTERVAL 1           // seconds between two batches of records being made durable (one write + fdatasync per batch)
+#define CHECKPOINT_BUFFER_LIMIT (1 << 20)    // if this many bytes of records are waiting, the batch is written out early
+#define CHECKPOINT_COMPACT_SIZE (64 << 20)   // a log that grows this big is merged into a new snapshot
+
+// what queued() is told about a url's entry in the history
+#define NOT_IN_HISTORY 0
+#define IN_HISTORY 1                         // its root-relative part was added (a url of the crawled server)
+#define IN_HISTORY_AS_IS 2                   // the whole url was added (a url of another host, see Crawl_Hosts)
+
+
+class Crawl_Checkpoint {        // keeps the crawl's frontier, history and directories on disk so that a crawl can be resumed after a crash or a shutdown
+                                // crawler threads only append records to a memory buffer: a sync thread writes them to an append-only log in batches,
+                                // and every CHECKPOINT_COMPACT_SIZE bytes of log it merges the old snapshot and that log into a new snapshot (the log is then deleted)
+    char *dir;
+    char *buffer, *spare;                    // records are appended to buffer, which is swapped with spare when the sync thread writes it out
+    size_t buffer_len, buffer_capacity, spare_capacity;
+    bool must_stop;
+    pthread_mutex_t lock;                    // protects buffer and must_stop
+    pthread_cond_t flushNow;
+    // only used by the sync thread (or before it starts):
+    int log_fd;
+    unsigned int log_index;                  // the log being written is dir/log.<log_index>
+    size_t log_size;
+    unsigned int snapshot_next_log;          // the first log that is not included in the current snapshot
+    pthread_t syncer;
+    bool syncer_started;
+public:
+    Crawl_Checkpoint(const char *save_dir);
+    ~Crawl_Checkpoint();                     // makes every record appended so far durable and stops the sync thread
+    // (before start) loads the last checkpoint of save_dir: the history, the directories and the urls that were not done yet (which are pushed back to frontier)
+    // returns the number of urls pushed back, or < 0 if there was no checkpoint to resume from
+    int resume(URL_Frontier *frontier, hash_history *history, str_history *dirs);
+    bool start(bool fresh);                  // starts logging (if fresh, any previous checkpoint is thrown away first)
+    // thread safe, never block on disk:
+    void queued(const char *url, int in_history);      // url is about to be pushed to the frontier (in_history: one of the *_HISTORY above)
+    void queued_batch(const char *const *urls, const int *in_history, unsigned int num_of_urls);     // the same for many urls, locking once
+    void done(const char *url);              // url has been downloaded (or will never be): a resumed crawl must not fetch it again
+    void new_dir(const char *dir);           // a directory that pages have been saved to
+private:
+    void append(char type, const char *str);
+    void append_locked(char type, const char *str, size_t len);     // (lock MUST be held)
+    static char queued_record(int in_history);
+    static void *sync_records(void *checkpoint);
+    bool open_log(unsigned int index);
+    bool compact(unsigned int up_to_log);    // merges the snapshot and logs [snapshot_next_log, up_to_log) into a new snapshot and deletes those logs
+    void path_of(char *path, size_t size, const char *name, int index) const;     // dir/name or dir/name.index (if index >= 0)
+};
+
+
+#endif //CRAWL_CHECKPOINT_H
@@ -0,0 +1,57 @@
+#ifndef CRAWL_HOSTS_H
+#define CRAWL_HOSTS_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <netinet/in.h>
+#include "URL_Frontier.h"
+
+#define MAX_HOSTS 64                         // hosts one crawl may fetch from (the crawled server included): urls of any more allowed hosts are ignored
+#define HOST_DIR_SIZE 300                    // the maximum size of a host's directory name in save_dir ("/<host>_<port>")
+#define DEFAULT_HTTP_PORT 8080               // the port of a full http url that does not give one
+
+
+struct crawl_host {
+    char *name;                              // as first found in a url (the crawled server's is host_or_IP from the command line)
+    unsigned short port;                     // (host byte order)
+    struct sockaddr_in sa;
+    char dir[HOST_DIR_SIZE];                 // its pages are saved in save_dir<dir>/... ("" for the crawled server, whose sites are directly in save_dir)
+    unsigned int connections;                // (atomic) fetches to this host in flight
+    URL_Frontier *deferred;                  // urls that were popped while every connection this host may have was taken, waiting for one
+};
+
+
+class Crawl_Hosts {             // the hosts a crawl fetches from: the crawled server and any other host that matches the allow-list (added as their urls show up)
+                                // each host may have at most max_connections fetches in flight (over all threads), so that a slow host cannot take every fetch slot
+                                // and the urls that find their host busy wait in its own queue, from which the hosts with a free connection are served round-robin
+    crawl_host *hosts[MAX_HOSTS];
+    unsigned int num_hosts;                  // (atomic) a host is fully set up before it is counted, so that readers never lock
+    char **allowed;                          // "<host>:<port>" patterns (with fnmatch wildcards)
+    unsigned int num_allowed;
+    unsigned int max_connections;            // per host (0 for no limit)
+    unsigned int num_deferred;               // (atomic) urls in all hosts' deferred queues
+    unsigned int next;                       // (atomic) where the next round-robin over the deferred queues starts
+    pthread_mutex_t lock;                    // (only taken to add a host)
+public:
+    Crawl_Hosts(const char *server_name, const struct sockaddr_in &server_sa, unsigned int max_connections_per_host);
+    ~Crawl_Hosts();
+    void allow(const char *pattern);         // (before crawling) "<host>[:<port>]": a missing port allows any, '*' and '?' match like in a shell
+    // thread safe:
+    bool is_allowed(const char *name, unsigned short port) const;
+    crawl_host *server() const;
+    crawl_host *get(const char *name, const struct sockaddr_in &sa);      // the host at sa (added as name if it is not known yet) - NULL if there are MAX_HOSTS already
+    bool acquire(crawl_host *host);          // take one of host's connections - false if they are all taken
+    bool release(crawl_host *host);          // give it back - returns true if urls are waiting for one
+    void defer(crawl_host *host, const char *url);
+    bool pop_deferred(char *url, size_t url_size, crawl_host *&host);     // a waiting url of the next host (round-robin) with a free connection, which is taken for it
+    bool has_ready() const;                  // there is a waiting url whose host has a free connection (without locking, so it may be out of date by the time it returns)
+    unsigned int deferred() const;
+    unsigned int size() const;
+    const crawl_host *host(unsigned int i) const;
+    unsigned int get_max_connections() const;
+private:
+    crawl_host *add(const char *name, const struct sockaddr_in &sa);
+};
+
+
+#endif //CRAWL_HOSTS_H
@@ -0,0 +1,67 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <pthread.h>
+#include <ctime>
+#include <netinet/in.h>
+#include "Fetch_Metrics.h"
+
+#define DNS_CACHE_BUCKETS 64                 // hosts are few (usually just the server's), so a small fixed table is enough
+#define DNS_POSITIVE_TTL 300                 // seconds a resolved address is trusted before it is refreshed (getaddrinfo does not tell us the record's real TTL)
+#define DNS_NEGATIVE_TTL 30                  // seconds a failed lookup is remembered before the host is tried again
+
+// lookup results
+#define DNS_RESOLVED 1
+#define DNS_PENDING 0
+#define DNS_FAILED -1
+
+
+typedef void (*dns_callback)(char *url, bool resolved, void *arg);      // called by the resolver thread for a url that had to wait for its host to be resolved
+
+
+class DNS_Cache {               // host -> IPv4 address cache shared by all crawler threads, with its own resolver thread so that lookups never block on DNS
+    struct waiter{
+        char *url;
+        dns_callback callback;
+        void *arg;
+        waiter *next;
+    };
+    struct entry{
+        char *host;
+        struct in_addr addr;
+        int status;                          // DNS_RESOLVED, DNS_FAILED or DNS_PENDING (not resolved even once yet)
+        time_t expires;                      // (time_t) -1 for entries that never expire
+        bool queued;                         // waiting for the resolver thread (either for the first time or for a refresh)
+        waiter *waiters;
+        entry *next;                         // next entry in the same bucket
+        entry *next_request;                 // next entry in the resolver's queue
+    } *buckets[DNS_CACHE_BUCKETS];
+    entry *requests_head, *requests_tail;    // FIFO queue of hosts for the resolver thread
+    unsigned int num_waiting;                // urls handed to lookup() that have not been given back to their callback yet
+    bool must_stop;
+    pthread_rwlock_t rwlock;
+    pthread_mutex_t requests_lock;           // protects the resolver's queue and must_stop (always locked after rwlock, if both are needed)
+    pthread_cond_t hasRequests;
+    pthread_t resolver;
+    bool resolver_started;
+public:
+    DNS_Cache();                             // starts the resolver thread
+    ~DNS_Cache();                            // stops it (urls still waiting are dropped without calling their callback)
+    void add(const char *host, struct in_addr addr);       // an address that never expires (ex: the server's, already resolved at start up)
+    // Never blocks on DNS - returns:
+    //  DNS_RESOLVED with addr set if host is an IP or has been resolved (a stale address is returned while it is being refreshed)
+    //  DNS_FAILED if host could not be resolved recently
+    //  DNS_PENDING if host is being resolved: url is then copied and given to callback(url, resolved, arg) by the resolver thread when that is done (no callback if NULL)
+    int lookup(const char *host, struct in_addr &addr, const char *url, dns_callback callback, void *arg);
+    unsigned int waiting();                  // number of urls waiting for their host to be resolved
+    Latency_Histogram lookup_times;          // of the resolver thread's getaddrinfo calls (only it adds to it)
+private:
+    static void *resolve_hosts(void *cache);
+    entry *find(const char *host) const;     // rwlock MUST be held
+    entry *insert(const char *host);         // rwlock MUST be held for writing
+    void request(entry *e);                  // rwlock MUST be held for writing
+    static unsigned int hash(const char *host);
+};
+
+
+#endif //DNS_CACHE_H
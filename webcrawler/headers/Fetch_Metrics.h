@@ -0,0 +1,61 @@
+#ifndef FETCH_METRICS_H
+#define FETCH_METRICS_H
+
+#include <ctime>
+
+#define METRICS_BUCKETS 32                   // bucket b of a latency histogram counts durations of [2^b - 1, 2^(b+1) - 1) microseconds (the last one also counts anything longer)
+#define METRICS_WINDOW 512                   // seconds of per-second page counts kept for the pages per second of the last 10, 60 and 300 seconds
+
+// the phases of a fetch that are timed
+#define PHASE_DNS 0                          // resolving a host that was not in the DNS cache (by its resolver thread)
+#define PHASE_CONNECT 1                      // opening a new connection (kept-alive ones are not counted)
+#define PHASE_FIRST_BYTE 2                   // from the request being sent to the answer's header being received
+#define PHASE_TRANSFER 3                     // from the header to the last byte of the page
+#define PHASE_DISK_WRITE 4                   // saving the page (its file or its segment)
+#define PHASE_LINK_PARSE 5                   // picking up the page's links
+#define NUM_PHASES 6
+
+
+unsigned long long monotonic_usec();        // microseconds since some fixed point in the past (for measuring durations only)
+
+
+class Latency_Histogram {       // written by a single thread without locks or atomic read-modify-writes: any thread may read it meanwhile (a reader may miss the samples being added)
+    unsigned long long counts[METRICS_BUCKETS];
+    unsigned long long total_usec;
+    unsigned long long num_samples;
+public:
+    Latency_Histogram();
+    void add(unsigned long long usec);       // (owner thread only)
+    void add_to(unsigned long long *merged_counts, unsigned long long &merged_usec, unsigned long long &merged_samples) const;
+};
+
+
+struct phase_summary {
+    unsigned long long samples, mean_usec;
+    unsigned long long p50_usec, p90_usec, p99_usec;       // (upper bounds of the buckets they fall in)
+    unsigned long long counts[METRICS_BUCKETS];
+};
+
+
+class Fetch_Metrics {           // every crawler thread's latency histograms (one per phase) and the number of pages saved per second, all updated without locks
+    struct thread_histograms{
+        Latency_Histogram phases[NUM_PHASES];
+        char padding[64];                    // (so that no two threads write to the same cache line)
+    } *threads;
+    unsigned int num_threads;
+    const Latency_Histogram *extra[NUM_PHASES];          // a histogram of a phase kept by someone else (ex: the DNS cache's resolver thread) - NULL if none
+    unsigned long long window[METRICS_WINDOW];           // (atomic) window[t % METRICS_WINDOW]: second t (its low 32 bits) in the high 32 bits, the pages saved during it in the low 32 bits
+public:
+    Fetch_Metrics(unsigned int num_of_threads);
+    ~Fetch_Metrics();
+    Latency_Histogram *histograms_of(unsigned int thread);     // the NUM_PHASES histograms that only thread may add to
+    void attach(int phase, const Latency_Histogram *histogram);
+    // thread safe:
+    void page_saved(time_t now);
+    double pages_per_second(unsigned int seconds, time_t now) const;     // over the last seconds (< METRICS_WINDOW) whole seconds
+    void summarize(int phase, phase_summary &summary) const;
+    static const char *phase_name(int phase);
+};
+
+
+#endif //FETCH_METRICS_H
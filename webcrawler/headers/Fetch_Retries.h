@@ -0,0 +1,30 @@
+#ifndef FETCH_RETRIES_H
+#define FETCH_RETRIES_H
+
+#include <pthread.h>
+
+#define FETCH_MAX_RETRIES 3                  // times a url whose download timed out is queued again before it is given up on
+#define RETRIES_INITIAL_CAPACITY 256         // urls (the table doubles whenever it is half full)
+
+
+class Fetch_Retries {           // how many times the download of each url has timed out, so that a timed-out url is queued again a bounded number of times:
+                                // only the urls that did time out are kept, by the 64-bit hash of the url, in an open-addressing table
+    unsigned long long *hashes;              // 0 for an empty place
+    unsigned int *timeouts;
+    unsigned int capacity, num_urls;
+    unsigned long long retried, given_up;
+    pthread_mutex_t lock;
+public:
+    Fetch_Retries();
+    ~Fetch_Retries();
+    // thread safe:
+    bool retry(const char *url, unsigned int &attempt);     // (url's download just timed out) true if it may be queued again (attempt: which retry that is), false if it is given up on
+    unsigned long long get_retried();
+    unsigned long long get_given_up();
+private:
+    unsigned int find(unsigned long long hash) const;      // lock MUST be held: where hash is, or the empty place it would go to
+    void grow();                             // lock MUST be held
+};
+
+
+#endif //FETCH_RETRIES_H
@@ -0,0 +1,91 @@
+#ifndef GRAPH_ANALYTICS_H
+#define GRAPH_ANALYTICS_H
+
+#include <pthread.h>
+#include "Link_Graph.h"
+
+#define ANALYTICS_BLOCK_SIZE 4096            // pages a thread takes at a time when a step goes over every page
+#define FRONTIER_CHUNK_SIZE 64               // frontier pages a thread takes at a time when a traversal expands a level
+#define PARALLEL_FRONTIER_SIZE 1024          // a smaller level is expanded by the calling thread alone (so that a long chain of pages does not start threads for every page of it)
+#define NEXT_BUFFER_SIZE 256                 // pages a thread collects for the next level before it appends them to it
+#define MAX_TRIM_PASSES 8                    // passes taking out the pages with no links in or out (the ones left are found by Tarjan's algorithm)
+#define DEGREE_BUCKETS 33                    // bucket 0 counts the pages of degree 0 and bucket b the pages of degree [2^(b-1), 2^b)
+#define MAX_ORPHANS_LISTED 10                // orphan pages reported by name (all of them are counted)
+#define UNREACHED 0xFFFFFFFFU
+
+
+struct degree_summary {
+    unsigned long long pages[DEGREE_BUCKETS];
+    unsigned int max;
+};
+
+
+class Graph_Analytics {         // the connectivity of a built Link_Graph, computed with num_threads threads: degree distributions, orphan pages, strongly connected components
+                                // (trimming, one forward-backward search from the page most likely in the largest one, then Tarjan's algorithm on the 3 parts left, in parallel)
+                                // and the depth of every page from a start page (a level-synchronous breadth-first search)
+    const Link_Graph &graph;
+    unsigned int num_pages;
+    unsigned int num_threads;
+    // results
+    degree_summary in_degrees, out_degrees;
+    unsigned int num_saved, num_orphans;
+    unsigned int orphans[MAX_ORPHANS_LISTED];
+    unsigned int num_components, largest_component, num_single;
+    unsigned int *level_sizes, num_levels;   // pages at every depth from the start page
+    unsigned int num_reached;
+    // per page
+    unsigned int *depths;                    // (UNREACHED, or atomically claimed by the thread that reached it first)
+    unsigned char *assigned;                 // the page's strongly connected component has been found
+    unsigned char *reached;                  // (forward-backward) REACHED_FORWARD | REACHED_BACKWARD, atomically or'ed
+    unsigned int *indices, *lowlinks;        // (Tarjan's algorithm: 0 while not visited)
+    unsigned char *on_stack;
+    unsigned int part_pages[3];              // the pages left in each part after the forward-backward search
+    // the step being run, shared by its threads
+    int step;
+    unsigned int next_block;                 // (atomic) the next block (or chunk of the frontier) to be taken
+    unsigned int level;
+    int direction;
+    unsigned int *frontier, frontier_size, *next, next_size;   // (next_size is atomic)
+    struct partial{
+        degree_summary in, out;
+        unsigned int saved, orphans, trimmed;
+        unsigned int pivot;
+        unsigned long long pivot_weight;
+        unsigned int component_pages[3];     // the pages left in each part after the forward-backward search
+        unsigned int components, largest, single;
+        char padding[64];                    // (each on its own cache line)
+    } *partials;
+public:
+    Graph_Analytics(const Link_Graph &link_graph, unsigned int num_of_threads);
+    ~Graph_Analytics();
+    void analyze(unsigned int start_page);   // (start_page may be UNREACHED, then no depths are computed)
+    const degree_summary &get_in_degrees() const;
+    const degree_summary &get_out_degrees() const;
+    unsigned int get_num_pages() const;
+    unsigned int get_num_saved() const;
+    unsigned int get_num_orphans() const;
+    unsigned int get_orphan(unsigned int i) const;       // (the i-th orphan page by id, i < min(num_orphans, MAX_ORPHANS_LISTED))
+    unsigned int get_num_components() const;
+    unsigned int get_largest_component() const;
+    unsigned int get_num_single() const;                 // components of a single page
+    unsigned int get_num_levels() const;
+    unsigned int get_level_size(unsigned int depth) const;
+    unsigned int get_num_reached() const;
+private:
+    void degrees();
+    void depths_from(unsigned int start_page);
+    void components();
+    void traverse(int traversal, unsigned int source);   // breadth-first, one level at a time
+    bool claim(unsigned int page);                       // (thread safe) true for the one thread that reaches page first in the current traversal
+    void run(int new_step);                              // runs new_step on num_threads threads (the calling one included)
+    void run_step(unsigned int thread);
+    void degrees_of_block(unsigned int b, partial &p);
+    void trim_block(unsigned int b, partial &p);
+    void expand();
+    void split_block(unsigned int b, partial &p);
+    void tarjan(unsigned int part, partial &p);
+    static void *step_thread(void *job);
+};
+
+
+#endif //GRAPH_ANALYTICS_H
@@ -0,0 +1,72 @@
+#ifndef HTTP_CONNECTION_H
+#define HTTP_CONNECTION_H
+
+#include <ctime>
+#include <netinet/in.h>
+
+#define HTTP_REQUEST_SIZE 1024               // the maximum size of a GET request we send (room for the validators of a conditional GET)
+#define HTTP_MAX_HEADER_SIZE 1024            // the maximum size an http response header can have for us to support it
+#define HTTP_BODY_READ_SIZE 4096             // how much of an answer's body we read from the socket at a time
+#define HTTP_VALIDATOR_SIZE 128              // the maximum size of an "ETag:" or a "Last-Modified:" value we keep
+#define HTTP_FETCH_TIMEOUT 60                // seconds a fetch may take (including waiting for the server to get to us) before it is abandoned
+
+// what HTTP_Connection::step() reports
+#define FETCH_PENDING 0                      // nothing more can be done until epoll reports the socket ready again
+#define FETCH_HEADER 1                       // the answer's header was just received: see get_status(), get_content_length() and the validators
+#define FETCH_BODY 2                         // a chunk of the answer's body was just received
+#define FETCH_DONE 3                         // the whole answer was received (the socket is kept for the next request if the server allows it)
+#define FETCH_FAILED -1                      // the fetch failed and the socket was closed
+#define FETCH_RETRY -2                       // a reused kept-alive socket failed before any answer came back (most likely closed by the server meanwhile): begin() again
+
+
+struct fetch_timings {                       // when (by monotonic_usec()) each step of the current fetch was reached (0 if not yet)
+    unsigned long long begun, connected, request_sent, header_received;
+    bool reused;                             // the kept-alive socket was reused, so there was no connect
+};
+
+
+class HTTP_Connection {         // a non-blocking (keep-alive) HTTP/1.1 connection to one server, driven by epoll through a connect -> send -> header -> body state machine
+                                // NOT thread safe: every crawler thread owns its own connections along with the epoll instance they are registered to
+    int fd;                                  // < 0 if there is no open socket at the moment
+    int state;
+    int epoll_fd, id;                        // the epoll instance watching fd and the value it reports for fd's events
+    unsigned int watched_events;
+    struct sockaddr_in server_sa;
+    bool reused, keep_alive;
+    char request[HTTP_REQUEST_SIZE];
+    size_t request_len, request_sent;
+    char header[HTTP_MAX_HEADER_SIZE];
+    size_t header_len;
+    size_t leftover_len;                     // body bytes that were read along with the header (they are moved to body[] until reported)
+    char body[HTTP_BODY_READ_SIZE];
+    int status, content_length, body_received;
+    char etag[HTTP_VALIDATOR_SIZE], last_modified[HTTP_VALIDATOR_SIZE];    // the answer's validators ("" if it had none)
+    time_t deadline;
+    fetch_timings timings;
+public:
+    HTTP_Connection();
+    ~HTTP_Connection();
+    void init(const struct sockaddr_in &sa, int epoll_instance, int epoll_id);
+    void retarget(const struct sockaddr_in &sa);       // the next begin() is for the server at sa (a socket kept alive with another server is closed)
+    // start a GET request (on the kept-alive socket if it is still healthy, else on a new one) - returns < 0 on failure
+    // if the validators of a copy we already have are given (NULL or "" if not), the GET is conditional: a 304 answer (with no body) means the copy is still valid
+    int begin(const char *root_relative_url, const char *if_none_match = NULL, const char *if_modified_since = NULL);
+    int step(const char *&chunk, size_t &chunk_len);   // advance the state machine as far as the socket allows and report the first thing that happened (one of the FETCH_* above)
+    void reset();                                      // close the socket (ex: after a failure or to abandon an answer)
+    bool is_busy() const;                              // a fetch is in progress
+    bool is_idle() const;                              // no fetch in progress but the socket is open (kept alive by the server)
+    bool has_expired(time_t now) const;
+    int get_status() const;
+    int get_content_length() const;
+    const char *get_etag() const;
+    const char *get_last_modified() const;
+    const fetch_timings &get_timings() const;
+private:
+    void watch(unsigned int events);
+    int parse_header();
+    static void copy_field_value(const char *value, char *to);
+    bool healthy() const;
+};
+
+
+#endif //HTTP_CONNECTION_H
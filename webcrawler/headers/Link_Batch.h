@@ -0,0 +1,34 @@
+#ifndef LINK_BATCH_H
+#define LINK_BATCH_H
+
+#include <cstddef>
+
+#define LINK_BATCH_SIZE 256                  // links of a page collected before they are added together (a page with more links is added in several batches)
+#define LINK_BATCH_TABLE_SIZE 512            // slots of the table that finds the links already in the batch (must be a power of 2, at least twice LINK_BATCH_SIZE)
+#define LINK_BATCH_INITIAL_TEXT 8192         // bytes for the links' text at first (doubled whenever they do not fit)
+
+
+class Link_Batch {              // the distinct links found in a page so far, along with the part of each one that is kept in the urlHistory, so that they can all be looked up
+                                // and queued together: a link that is in the batch already is dropped before it costs any lock (only its owner slot uses a batch)
+    char *text;                              // the links, one after the other and '\0' terminated (allocated on the first add)
+    size_t text_used, text_size;
+    unsigned int link_at[LINK_BATCH_SIZE];   // where each link starts in text
+    unsigned int key_at[LINK_BATCH_SIZE];    // and where its urlHistory key starts (inside it)
+    int histories[LINK_BATCH_SIZE];          // what the urlHistory is told about each (one of the *_HISTORY of Crawl_Checkpoint.h)
+    unsigned long long hashes[LINK_BATCH_SIZE];
+    unsigned short table[LINK_BATCH_TABLE_SIZE];     // index + 1 of the link in each slot, 0 for an empty one (open addressing by the link's hash)
+    unsigned int count;
+public:
+    Link_Batch();
+    ~Link_Batch();
+    bool add(const char *link, const char *key, int history);    // key points inside link - returns false (and adds nothing) if link is in the batch already
+    bool is_full() const;
+    unsigned int size() const;
+    const char *link(unsigned int i) const;
+    const char *key(unsigned int i) const;
+    int history(unsigned int i) const;
+    void clear();                            // (the text's buffer is kept for the next page)
+};
+
+
+#endif //LINK_BATCH_H
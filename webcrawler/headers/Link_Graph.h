@@ -0,0 +1,79 @@
+#ifndef LINK_GRAPH_H
+#define LINK_GRAPH_H
+
+#include <pthread.h>
+#include "URL_Interner.h"
+
+#define PAGERANK_FILE ".pagerank"            // kept inside the save directory, next to the pages it ranks
+#define EDGE_BLOCK_SIZE 8192                 // links a crawler thread collects in a block before it starts a new one
+#define PAGERANK_DAMPING 0.85
+#define PAGERANK_MAX_ITERATIONS 100
+#define PAGERANK_TOLERANCE 1e-9              // the power iteration stops once the ranks move by less than this in total (L1) in an iteration
+#define PAGERANK_BLOCK_SIZE 4096             // pages a thread takes at a time in each step of an iteration (their ranks and links are next to each other in memory)
+#define PAGE_SAVED 0xFFFFFFFFU               // (as the target of an edge) marks its source as saved rather than linking it to anything
+
+
+class Edge_Buffer {             // the links found by one crawler thread, appended without locking (and only read once that thread is done)
+    struct block{
+        unsigned int from[EDGE_BLOCK_SIZE], to[EDGE_BLOCK_SIZE];
+        unsigned int used;
+        block *next;                         // the thread's previous block
+    } *last;
+    unsigned long long num_edges;            // (atomic) for STATS
+    char padding[64];                        // (so that no two threads write to the same cache line)
+    friend class Link_Graph;
+public:
+    Edge_Buffer();
+    ~Edge_Buffer();
+    void add(unsigned int from, unsigned int to);
+    unsigned long long size() const;         // (thread safe) edges added so far
+private:
+    void free_blocks();                      // (the edges are still counted)
+};
+
+
+class Link_Graph {              // (--link-graph) the pages found by the crawl and the links between them: every page is given a dense id (by its save_url), every thread records the links it finds
+                                // in its own Edge_Buffer, and once crawling is over they are turned into a compressed sparse row graph (both ways) that PageRank runs on
+    URL_Interner pages;
+    Edge_Buffer *buffers;                    // one per crawler thread, and the DNS resolver thread's last
+    unsigned int num_buffers;
+    // (once built)
+    unsigned int num_pages;
+    unsigned long long num_links;            // (distinct, without links from a page to itself)
+    unsigned long long *out_offsets, *in_offsets;        // the links from (to) page p are out_links[out_offsets[p] .. out_offsets[p+1]) (in_links[in_offsets[p] .. in_offsets[p+1])), sorted
+    unsigned int *out_links, *in_links;
+    bool *saved;                             // the page was saved (the others are links the crawl could not save: not found, not allowed, near-duplicates...)
+    double *ranks;                           // (NULL until PageRank has run)
+    unsigned int iterations;
+    bool built;                              // (atomic)
+public:
+    Link_Graph(unsigned int num_of_threads);
+    ~Link_Graph();
+    Edge_Buffer *edges_of(unsigned int thread);          // the buffer that only thread may add to
+    Edge_Buffer *resolved_edges();                       // the buffer that only the DNS resolver thread may add to (the links that waited for their host to be resolved)
+    unsigned int page_id(const char *save_url);          // (thread safe) the id of the page saved as save_url
+    bool find_page(const char *save_url, unsigned int &id);     // (thread safe) false if no page is saved as save_url
+    const char *save_url_of(unsigned int id) const;
+    unsigned long long edges_found() const;              // (thread safe) links recorded so far (duplicates included)
+    unsigned int size() const;                           // (thread safe) pages found so far
+    bool is_built() const;                               // (thread safe) the get_ methods below may be called
+    // once no thread adds to its buffer anymore:
+    void build();                            // (empties the buffers)
+    void pagerank(unsigned int num_of_threads);
+    bool save_ranks(const char *save_dir);   // (atomically) replaces save_dir's PAGERANK_FILE with the rank of every saved page
+    // (once built)
+    unsigned int get_num_pages() const;
+    unsigned long long get_num_links() const;
+    unsigned int get_iterations() const;
+    const unsigned long long *get_out_offsets() const;
+    const unsigned int *get_out_links() const;
+    const unsigned long long *get_in_offsets() const;
+    const unsigned int *get_in_links() const;
+    bool is_saved(unsigned int page) const;
+    double rank_of(unsigned int page) const;
+private:
+    static void *pagerank_thread(void *job);
+};
+
+
+#endif //LINK_GRAPH_H
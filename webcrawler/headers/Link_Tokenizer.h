@@ -0,0 +1,29 @@
+#ifndef LINK_TOKENIZER_H
+#define LINK_TOKENIZER_H
+
+#include <cstddef>
+
+#define MAX_LINK_SIZE 512                    // the maximum size a link can have. Overflowing links will not be saved in their entirety so set this wisely
+
+
+class Link_Tokenizer {          // finds the links of <a ... href="link" ...> tags in an html page that is given in chunks of any size (ex: as they arrive from a socket)
+                                // it is a state machine which remembers where it stopped at the end of each chunk, so a tag (or a link) may be split between any two chunks
+                                // runs of bytes that cannot change its state (ex: text between tags) are skipped 16 or 32 at a time with SIMD (see simd_scan.h)
+    int state;
+    int matched;                             // how many characters of "href" have been matched so far
+    char link[MAX_LINK_SIZE];
+    size_t link_len;
+public:
+    Link_Tokenizer();
+    void reset();                            // start over for a new page
+    // scans chunk (advancing it and decreasing chunk_len) until the next link is found and returns true with that link '\0' terminated in found_link[MAX_LINK_SIZE]
+    // returns false when the whole chunk has been scanned (any unfinished tag is remembered for the next chunk)
+    bool next_link(const char *&chunk, size_t &chunk_len, char *found_link);
+private:
+    bool link_char(char c, char *found_link);
+    static void skip_to(const char *&chunk, size_t &chunk_len, char c1, char c2);
+    void copy_link_run(const char *&chunk, size_t &chunk_len);
+};
+
+
+#endif //LINK_TOKENIZER_H
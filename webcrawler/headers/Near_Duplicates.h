@@ -0,0 +1,55 @@
+#ifndef NEAR_DUPLICATES_H
+#define NEAR_DUPLICATES_H
+
+#include <pthread.h>
+#include <cstddef>
+
+#define SIMHASH_BITS 64
+#define SIMHASH_SHINGLE 3                    // words per shingle: pages are compared by the runs of words they share, not just by their vocabulary
+#define MAX_NEAR_DUPLICATE_DISTANCE 3        // a fingerprint is split in MAX_NEAR_DUPLICATE_DISTANCE + 1 blocks, one of which any fingerprint this close must share exactly
+#define NEAR_DUPLICATE_BLOCK_BITS 16         // (SIMHASH_BITS / (MAX_NEAR_DUPLICATE_DISTANCE + 1))
+
+
+class SimHash {                 // the SimHash fingerprint of a page, built from its chunks as they arrive: each shingle of words (outside of html tags) votes for the bits of its own hash
+    unsigned int ones[SIMHASH_BITS];         // how many shingles' hashes have each bit set (a bit of the fingerprint is set if more than half of them do)
+    unsigned long long lanes[8];             // byte j of lanes[i] counts bit 8 * i + j for the last few shingles (added to ones before it can overflow), so a shingle costs 8 additions instead of 64
+    unsigned int num_shingles;
+    unsigned long long word;                 // hash of the word being read (it may go on in the next chunk)
+    bool in_word, in_tag;
+    unsigned long long previous[SIMHASH_SHINGLE - 1];   // hashes of the words before it
+    unsigned int num_words;
+public:
+    SimHash();
+    void reset();
+    void add(const char *chunk, size_t chunk_len);
+    bool fingerprint(unsigned long long &fingerprint);      // (ends the last word) false if the page has fewer than SIMHASH_SHINGLE words
+private:
+    void end_word();
+    void flush_lanes();
+};
+
+
+class Near_Duplicate_Index {    // the fingerprints of the pages saved so far, looked up by Hamming distance: each one is chained in MAX_NEAR_DUPLICATE_DISTANCE + 1 tables,
+                                // one per block of its bits, so only the fingerprints that have at least one block in common with the one looked up are compared with it
+    struct entry{
+        unsigned long long fingerprint;
+        char *page;                          // where the page is saved (the index's own copy, so that it does not take up urlIds' share of --memory-limit)
+        unsigned int next[MAX_NEAR_DUPLICATE_DISTANCE + 1];     // the next entry in the same chain of each table (NO_ENTRY at the end)
+    } *entries;
+    unsigned int num_entries, capacity;
+    unsigned int *heads[MAX_NEAR_DUPLICATE_DISTANCE + 1];      // heads[t][block t of a fingerprint]: the last entry with that block
+    int max_distance;
+    unsigned int num_duplicates;
+    pthread_mutex_t lock;
+public:
+    Near_Duplicate_Index(int max_distance_bits);
+    ~Near_Duplicate_Index();
+    // thread safe:
+    bool find_or_add(unsigned long long fingerprint, const char *page, const char *&original);       // true (and the page it is a near-duplicate of, valid as long as the index is) if a fingerprint within max_distance bits is in already, else it is added
+    unsigned int size() const;
+    unsigned int duplicates() const;
+    int get_max_distance() const;
+};
+
+
+#endif //NEAR_DUPLICATES_H
@@ -0,0 +1,75 @@
+#ifndef PAGE_SEGMENTS_H
+#define PAGE_SEGMENTS_H
+
+#include <cstddef>
+
+#define SEGMENTS_DIR ".segments"                 // (in save_dir) each <number>.seg file holds pages back to back and its <number>.idx file says where each one is
+#define SEGMENT_MAX_SIZE (64 * 1024 * 1024)      // bytes: a writer starts a new segment instead of growing its current one past this
+#define SEGMENT_INITIAL_BUCKETS 1024             // (must be a power of 2) of the url -> page hash table, which doubles whenever it holds more pages than buckets
+#define SEGMENT_CHECKSUM_SEED 14695981039346656037ULL     // FNV-1a 64, the same hash (and seed) as the crawler's content hashes
+
+
+struct index_record {                        // one per page in an .idx file, followed by the page's url (url_len chars, without a '\0')
+    unsigned long long offset;               // of the page in the .seg file
+    unsigned long long checksum;             // of the page's content
+    unsigned int length;
+    unsigned int url_len;
+};
+
+struct page_location {
+    unsigned int segment;
+    unsigned long long offset;
+    unsigned int length;
+    unsigned long long checksum;
+};
+
+
+class Segment_Store {           // the pages saved in save_dir's segments, by (root-relative) url: a url saved more than once (ex: by a re-crawl) maps to its latest copy
+    struct page{
+        char *url;
+        page_location where;
+        page *next;
+    };
+    char *dir;                               // save_dir/SEGMENTS_DIR
+    page **buckets;
+    unsigned int num_buckets, size;
+    int *fds;                                // fds[s] reads segment s (-1 if there is no such segment)
+    unsigned int num_segments;
+    unsigned int next_segment;               // (atomic) the number of the next segment a writer starts
+public:
+    Segment_Store();
+    ~Segment_Store();
+    int open(const char *save_dir, bool create);     // loads the index of every segment in save_dir (creating SEGMENTS_DIR if asked to) - returns the number of pages or -1
+    // thread safe once open:
+    bool find(const char *url, page_location &where) const;
+    char *read(const page_location &where) const;    // a new[]'ed, '\0' terminated copy of the page (where.length bytes) - NULL if it could not be read or its checksum is wrong
+    char **list(const char *prefix, int &count) const;       // the urls of all pages that start with prefix (a new[]'ed table of new[]'ed copies)
+    unsigned int get_size() const;
+    const char *get_dir() const;
+    unsigned int new_segment();              // the number of a segment that does not exist yet
+    static unsigned long long checksum(const char *data, size_t len, unsigned long long h = SEGMENT_CHECKSUM_SEED);
+private:
+    int load_index(unsigned int segment);
+    void insert(const char *url, size_t url_len, const page_location &where);
+    page *find_page(const char *url, size_t url_len) const;
+    void grow();
+    static unsigned int bucket_of(const char *url, size_t url_len, unsigned int num_buckets);
+};
+
+
+class Segment_Writer {          // appends pages to a segment of its own and their records to that segment's index: one per crawler thread, so it is NOT thread safe
+    Segment_Store &store;
+    int seg_fd, idx_fd;                      // -1 until the first page is appended
+    unsigned long long seg_size;
+public:
+    Segment_Writer(Segment_Store &segment_store);
+    ~Segment_Writer();
+    bool append(const char *url, const char *data, size_t len);     // (a page is only in the index once both its content and its record have been written)
+private:
+    bool rotate();                           // close the current segment (if any) and start a new one
+    void close_segment();
+    static bool write_all(int fd, const char *data, size_t len);
+};
+
+
+#endif //PAGE_SEGMENTS_H
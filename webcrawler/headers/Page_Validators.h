@@ -0,0 +1,41 @@
+#ifndef PAGE_VALIDATORS_H
+#define PAGE_VALIDATORS_H
+
+#include <pthread.h>
+#include <cstddef>
+#include "HTTP_Connection.h"
+
+#define VALIDATORS_FILE ".validators"        // kept inside the save directory, next to the pages it describes
+#define VALIDATORS_INITIAL_BUCKETS 1024      // (must be a power of 2) the table doubles whenever it holds more pages than buckets
+#define CONTENT_HASH_SEED 14695981039346656037ULL     // FNV-1a 64-bit offset basis: the hash of an empty page
+
+
+class Page_Validators {         // root-relative url -> what we know about the copy of that page in the save directory: the server's validators (ETag, Last-Modified)
+                                // and a hash of its content, so that a re-crawl can ask for it conditionally and tell whether a page that was sent again actually changed
+    struct page{
+        char *url;
+        unsigned long long content_hash;
+        char etag[HTTP_VALIDATOR_SIZE];
+        char last_modified[HTTP_VALIDATOR_SIZE];
+        page *next;
+    } **buckets;
+    unsigned int num_buckets, size;
+    pthread_mutex_t lock;
+public:
+    Page_Validators();
+    ~Page_Validators();
+    int load(const char *save_dir);          // returns the number of pages loaded from save_dir's VALIDATORS_FILE, or < 0 if there was none
+    bool save(const char *save_dir);         // (atomically) replaces save_dir's VALIDATORS_FILE with what is in memory
+    // thread safe:
+    bool get(const char *url, char *etag, char *last_modified, unsigned long long &content_hash);     // copies url's validators ("" if the server sent none) - false if url is unknown
+    void set(const char *url, const char *etag, const char *last_modified, unsigned long long content_hash);
+    unsigned int get_size();
+    static unsigned long long hash(const char *data, size_t len, unsigned long long h = CONTENT_HASH_SEED);     // continues the content hash h with len more bytes of a page
+private:
+    page *find(const char *url) const;       // lock MUST be held
+    void grow();                             // lock MUST be held
+    static unsigned int bucket_of(const char *url, unsigned int num_buckets);
+};
+
+
+#endif //PAGE_VALIDATORS_H
@@ -0,0 +1,54 @@
+#ifndef PAGE_WRITERS_H
+#define PAGE_WRITERS_H
+
+#include <pthread.h>
+#include <cstddef>
+#include "Fetch_Metrics.h"
+#include "Crawl_Checkpoint.h"
+
+#define DEFAULT_WRITERS 0                    // writer threads, unless --writers says otherwise (0: every page is saved on the crawler thread that downloads it)
+#define WRITE_QUEUE_SIZE 256                 // pages waiting for a writer thread at most: a crawler thread that finds the queue full waits for a free place
+#define WRITE_QUEUE_MAX_BYTES (64 << 20)     // bytes of pages waiting for a writer thread at most (a page bigger than that still goes in an empty queue)
+#define WRITE_BATCH_SIZE 16                  // pages a writer thread takes from the queue at once
+
+
+struct page_write {
+    char *path;                              // the file the page is written to (created, or truncated if it exists)
+    char *final_path;                        // if not NULL, path is renamed to it once written, so that the copy there is replaced atomically
+    char *data;
+    size_t len;
+    char *done_url;                          // if not NULL, it is logged as done in the checkpoint once the page is on disk (a page that could not be written is fetched again by a resumed crawl)
+};
+
+
+class Page_Writers {            // a pool of writer threads that save the crawler threads' pages behind their backs, so that the crawler threads go on fetching while the disk is busy:
+                                // pages are handed over in a bounded queue and each writer thread takes a batch of them at a time, writing every page with a single write(2)
+    page_write *queue;                       // circular, WRITE_QUEUE_SIZE places
+    unsigned int first, count;
+    unsigned long long queued_bytes;
+    unsigned int num_busy;                   // writer threads writing a batch
+    unsigned long long pages_written, full_waits;
+    bool must_stop;
+    pthread_mutex_t lock;
+    pthread_cond_t notFull, notEmpty, idle;
+    pthread_t *threads;
+    unsigned int num_threads;
+    Crawl_Checkpoint *checkpoint;
+public:
+    Page_Writers(unsigned int num_of_threads, Crawl_Checkpoint *crawl_checkpoint);     // starts the writer threads
+    ~Page_Writers();                         // writes every page still queued, then stops them
+    // thread safe:
+    void push(char *path, char *final_path, char *data, size_t len, char *done_url);     // (the four buffers are the writers' to delete[] from now on) waits while the queue is full
+    void drain();                            // waits until every page pushed so far has been written
+    unsigned int queued(unsigned long long &bytes);
+    unsigned long long written();
+    unsigned long long waits();              // how many times a crawler thread had to wait for a free place
+    unsigned int size() const;
+    Latency_Histogram write_times;           // of every page's write (added to under lock, by one writer thread at a time)
+private:
+    static void *write_pages(void *writers);
+    static bool write_page(const page_write &page);     // true if the page was written whole (and renamed over its copy)
+};
+
+
+#endif //PAGE_WRITERS_H
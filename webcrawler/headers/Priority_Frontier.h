@@ -0,0 +1,67 @@
+#ifndef PRIORITY_FRONTIER_H
+#define PRIORITY_FRONTIER_H
+
+#include <pthread.h>
+#include <cstddef>
+
+#define PRIORITY_LEVELS 256                  // scores are in [0, PRIORITY_LEVELS): urls with a higher score are popped first, urls with the same score in FIFO order
+#define PRIORITY_WORDS (PRIORITY_LEVELS / 64)
+#define PRIORITY_INITIAL_BUCKETS 1024        // (must be a power of 2) of the url -> entry hash table, which doubles whenever it holds more urls than buckets
+#define PRIORITY_SITE_BUCKETS 256            // (must be a power of 2) of the site -> number of urls table (sites are few)
+
+
+struct url_info {                            // what a scorer knows about a queued url
+    const char *url;
+    unsigned int depth;                      // number of links followed from starting_url to find it
+    unsigned int inlinks;                    // number of times a link to it has been found so far
+    unsigned int site_rank;                  // number of urls of the same site (the first directory of its root-relative part) queued before it
+};
+
+typedef unsigned int (*url_scorer)(const url_info &info);     // must return a score < PRIORITY_LEVELS
+
+
+class Priority_Frontier {       // bucketed priority queue of urls: one FIFO list per score and a bitmap of the non-empty ones, so that push, pop and rescoring are O(1)
+                                // a url that is still queued when another link to it is found is rescored (ex: by its in-link count) and moved to its new bucket
+    struct entry{
+        char *url;
+        url_info info;
+        unsigned int score;
+        entry *prev, *next;                  // in its bucket's list
+        entry *hnext;                        // next entry in the same hash table bucket
+    };
+    struct site{
+        char *name;
+        unsigned int num_queued;
+        site *hnext;
+    };
+    url_scorer scorer;
+    entry *heads[PRIORITY_LEVELS], *tails[PRIORITY_LEVELS];
+    unsigned long long nonempty[PRIORITY_WORDS];     // bit s is set if bucket s is not empty
+    entry **table;                           // url -> queued entry
+    unsigned int table_size;
+    site **sites;                            // site -> number of urls queued so far (never shrinks)
+    unsigned int count;                      // also read without the lock by size()
+    pthread_mutex_t lock;
+public:
+    Priority_Frontier(url_scorer url_scorer);
+    ~Priority_Frontier();
+    // thread safe:
+    void push(const char *url, unsigned int depth);
+    void link_seen(const char *url);         // another link to url was found: if it is still queued, it is rescored
+    void push_batch(const char *const *urls, unsigned int num_of_urls, unsigned int depth, const char *const *seen_urls, unsigned int num_seen);    // push and link_seen for many urls, locking once
+    bool pop(char *url, size_t url_size, unsigned int &depth);     // copies the url with the highest score into url[url_size] - returns false if empty
+    unsigned int size() const;               // (without locking, so it may be out of date by the time it returns)
+    static url_scorer scorer_named(const char *name);     // "depth", "inlinks" or "sites" - NULL for anything else
+private:
+    void link(entry *e);                     // lock MUST be held for all of these
+    void unlink(entry *e);
+    entry *find(const char *url) const;
+    void insert(entry *e);                   // (scores it and queues it)
+    void rescore(const char *url);           // (another link to url was found)
+    void grow();
+    unsigned int site_rank(const char *url);
+    static unsigned int hash(const char *str, size_t len);
+};
+
+
+#endif //PRIORITY_FRONTIER_H
@@ -0,0 +1,69 @@
+#ifndef URL_FRONTIER_H
+#define URL_FRONTIER_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <cstdio>
+
+#define FRONTIER_SEGMENT_SLOTS 1024          // urls per segment
+#define FRONTIER_SEGMENT_ARENA 65536         // bytes of url characters per segment (a url longer than this gets a segment of its own)
+#define FRONTIER_RUN_SIZE (16 << 20)         // (limited memory) bytes of urls per run file the frontier spills to
+
+
+class URL_Frontier {            // FIFO ring of segments: push and pop are O(1) and urls are copied once into their segment's arena (no node allocations)
+                                // with limited memory, once the segments are full every url pushed goes to the end of a run file on disk instead (until all of them are read back),
+                                // and whenever the segments run out they are refilled with the oldest runs' urls, so the urls are still popped in the order they were pushed
+    struct segment{
+        char *arena;
+        size_t arena_size, arena_used;
+        unsigned int offsets[FRONTIER_SEGMENT_SLOTS];   // offsets[i] is where the i-th url of this segment starts in its arena
+        unsigned int head, tail;                        // urls in [head, tail) have not been popped yet
+        segment *next;
+        segment(size_t size);
+        ~segment();
+        bool fits(size_t len) const;
+    } *first, *last, *spare;    // pop from first, push to last, keep one drained segment around for reuse
+    unsigned int count;         // (the spilled urls included)
+    size_t memory_used, max_memory;          // bytes of segments (max_memory is 0 for no limit)
+    char *spill_dir;
+    FILE *writing, *reading;                 // the last run (being appended to) and the first one (being read back) - NULL if none
+    unsigned int first_run, last_run;        // the runs are the files <spill_dir>/frontier_<n> for n in [first_run, last_run)
+    size_t run_size;                         // bytes written to the last run
+    unsigned int spilled;                    // urls in the runs
+    unsigned int *run_urls, run_urls_size;   // run_urls[n]: urls of run n not read back yet (so that a run that cannot be read is taken out of count and spilled)
+    unsigned int parked;        // number of threads between begin_parking() and end_parking() (also read without the lock by num_parked())
+    pthread_cond_t notEmpty;
+public:
+    pthread_mutex_t lock;
+    URL_Frontier();
+    ~URL_Frontier();
+    bool limit_memory(size_t max_bytes, const char *dir);            // (before anything is pushed) keep at most about max_bytes of urls in memory and spill the rest to run files in dir
+    unsigned int get_spilled() const;                                 // (does not need the lock, so it may be out of date by the time it returns)
+    bool isEmpty() const;
+    unsigned int size() const;
+    bool looks_empty() const;                                         // isEmpty() without locking (so it may be out of date by the time it returns)
+    // Important: push and pop do NOT lock / unlock the mutex-lock, this has to happen separately
+    void push(const char *url);                                       // wakes up a parked thread, but only if there is one
+    void push_batch(const char *const *urls, int num_of_urls);        // wakes up as many parked threads as urls pushed
+    bool pop(char *url, size_t url_size);                             // copies the oldest url into url[url_size] - returns false if empty
+    // Parking (must be called while holding the lock, just like pthread_cond_wait): a thread with nothing to do calls begin_parking(),
+    // checks (one last time) every place a url could come from and only then wait()s - until it is woken up - before it calls end_parking()
+    void begin_parking();
+    void wait();
+    void end_parking();
+    unsigned int num_parked() const;                                  // (does not need the lock)
+    void wake(unsigned int num_of_urls);                              // wakes up at most one parked thread per url
+    void wake_all();
+    // Locking happens with:
+    void acquire();
+    void release();
+private:
+    void append(const char *url);
+    void append_to_memory(const char *url, size_t len);
+    bool spill(const char *url, size_t len);                          // appends url to the last run - false if it could not
+    void refill();                                                    // reads the oldest spilled urls back into segments
+    void drop_first_run();                                            // the first run is done (or could not be read): deletes it and forgets whatever urls of it were not read back
+    void run_path(unsigned int run, char *path, size_t size) const;
+};
+
+#endif //URL_FRONTIER_H
@@ -0,0 +1,50 @@
+#ifndef URL_INTERNER_H
+#define URL_INTERNER_H
+
+#include <pthread.h>
+#include <cstddef>
+
+#define INTERNER_STRIPES 64                  // number of independently locked sub-tables (must be a power of 2)
+#define INTERNER_STRIPE_INITIAL_CAPACITY 256 // slots per sub-table at start (must be a power of 2)
+#define INTERNER_ARENA_BLOCK_SIZE 16384      // bytes: the urls are copied one after the other into blocks of this size (one being filled per stripe)
+#define INTERNER_CHUNK_SIZE 65536            // ids per chunk of the id -> url table (chunks are allocated as ids reach them and never move)
+#define INTERNER_MAX_CHUNKS 65536            // so there can be up to 2^32 - 1 ids
+
+
+// rewrites url (a link as found in a page) in its canonical form into canonical[size], so that the different spellings of the same page are interned (and crawled) once:
+// "http://" and the host in lower case, the port always given (default_port if there is none), "." and ".." path segments resolved, repeated '/'s merged and any "#fragment" dropped.
+// Root-relative urls only get their path cleaned up, anything else is copied as is - returns false if canonical[size] is too small
+bool canonicalize_url(const char *url, char *canonical, size_t size, unsigned short default_port);
+
+
+class URL_Interner {            // gives every distinct url a dense 32-bit id (0, 1, 2... in the order they are interned), so that url structures can hold 4-byte ids instead of copies of the urls:
+                                // each url is stored once in an arena, found by a lock-striped open addressing hash table, and an id is turned back into its url without locking
+    struct stripe{
+        pthread_mutex_t lock;
+        unsigned long long *table;           // (32 bits of the url's hash << 32) | (id + 1): 0 marks an empty slot
+        unsigned int capacity, size;
+        char *block;                         // the arena block being filled (its first bytes point to the stripe's previous block)
+        size_t block_used, block_size;
+        char padding[64];                    // keep each stripe's lock on its own cache line
+    } stripes[INTERNER_STRIPES];
+    const char **chunks[INTERNER_MAX_CHUNKS];     // (atomic) chunks[id / INTERNER_CHUNK_SIZE][id % INTERNER_CHUNK_SIZE] is the url of id
+    unsigned int next_id;                    // (atomic)
+    unsigned long long arena_bytes;          // (atomic) bytes of all arena blocks and chunks, for STATS
+public:
+    URL_Interner();
+    ~URL_Interner();
+    // thread safe (they only lock the url's stripe, if at all):
+    bool intern(const char *url, unsigned int &id);     // id of url, which is given the next id if it did not have one - returns true if it was just given one by this call
+    bool find(const char *url, unsigned int &id);       // id of url, without giving it one - returns false if it has none
+    const char *url_of(unsigned int id) const;          // (id must have been returned by intern) the url stays where it is until the interner is deleted
+    unsigned int size() const;
+    unsigned long long memory() const;
+private:
+    char *store(stripe &s, const char *url, size_t url_len);      // copies url into s's arena (s's lock MUST be held)
+    void publish(unsigned int id, const char *url);
+    bool probe(const stripe &s, unsigned int tag, const char *url, unsigned int &pos) const;      // returns true if found, else pos is the empty slot where url belongs
+    static void grow(stripe &s);
+};
+
+
+#endif //URL_INTERNER_H
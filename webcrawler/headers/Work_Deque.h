@@ -0,0 +1,29 @@
+#ifndef WORK_DEQUE_H
+#define WORK_DEQUE_H
+
+#include <pthread.h>
+
+#define DEQUE_INITIAL_CAPACITY 256           // urls (must be a power of 2) - the ring doubles whenever it is full
+#define STEAL_BATCH_MAX 64                   // a thief takes half of its victim's urls, but never more than this many at a time
+
+
+class Work_Deque {              // one crawler thread's own urls: the owner pushes and pops at the bottom (LIFO: the links of the page it just fetched come next,
+                                // while its connections are still warm), other threads steal from the top (FIFO: the oldest urls, furthest from what the owner is doing)
+    unsigned int *ring;                      // the ids of the urls (see URL_Interner) in [top, bottom) (positions modulo capacity)
+    unsigned int capacity, top, bottom;
+    unsigned int count;                      // bottom - top, also read without the lock by size()
+    pthread_mutex_t lock;                    // only contended when another thread steals from this one
+public:
+    Work_Deque();
+    ~Work_Deque();
+    void push(unsigned int url_id);          // (owner) to the bottom
+    void push_batch(const unsigned int *url_ids, unsigned int num_of_urls);     // (owner) the same for many urls, locking once
+    bool pop(unsigned int &url_id);          // (owner) the newest url - returns false if empty
+    unsigned int steal_into(Work_Deque &thief);     // moves up to half (at most STEAL_BATCH_MAX) of the oldest urls to the bottom of thief - returns how many
+    unsigned int size() const;               // (without locking, so it may be out of date by the time it returns)
+private:
+    void push_owned(unsigned int url_id);    // lock MUST be held
+};
+
+
+#endif //WORK_DEQUE_H
@@ -5,13 +5,15 @@
 struct args{
     const struct sockaddr_in *server_sa;
     int num_of_threads;
-    args(struct sockaddr_in *param, int threads_num) : server_sa(param), num_of_threads(threads_num) {}
+    int max_fetches;                         // per thread
+    args(struct sockaddr_in *param, int threads_num, int fetches_num) : server_sa(param), num_of_threads(threads_num), max_fetches(fetches_num) {}
 };
 
 
 void *crawl(void *arguement);
 
 int findRootRelativeUrl(const char *possibly_full_url, char *&root_relative_url);   // useful for main too
+int parse_url(const char *possibly_full_url, char *&root_relative_url, char *&host_or_IP, char *&port_number_str);     // (host_or_IP and port_number_str are new[]'ed, NULL if the url has none) - useful for main too
 
 
 #endif //CRAWL_H
@@ -5,10 +5,13 @@
 struct monitor_args{
     int num_of_threads, num_of_workers;
     pthread_t *threadpool;
+    const char *starting_url;                // (--link-graph) where GRAPH's depths are counted from
 };
 
 
 void *monitor_crawling(void *args);        // monitor thread
+void init_jobExecutor(int numOfWorkers);   // (also called by main, before crawling starts, with --pipeline)
+void send_page_to_jobExecutor(const char *root_relative_url, const char *content, size_t len);     // (--pipeline) thread safe: called by the crawling threads for every page they save
 
 
 #endif //CRAWLING_MONITORING_H
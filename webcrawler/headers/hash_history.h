@@ -0,0 +1,54 @@
+#ifndef HASH_HISTORY_H
+#define HASH_HISTORY_H
+
+#include <pthread.h>
+#include <cstddef>
+
+#define HISTORY_STRIPES 64                   // number of independently locked sub-tables (must be a power of 2)
+#define HISTORY_STRIPE_INITIAL_CAPACITY 256  // slots per sub-table at start (must be a power of 2)
+#define HISTORY_BLOOM_BITS (1 << 23)         // 1 MB bloom filter: ~1% false positives at 800K urls with 4 hash functions (must be a power of 2, sized by limit_memory() instead if the memory is limited)
+#define HISTORY_SPILL_INDEX_INTERVAL 512     // (limited memory) one in this many hashes of a stripe's spill file is kept in memory, so that looking one up reads a single 4KB block of it
+
+
+class hash_history {            // set of strings stored as 64-bit hashes: open addressing hash table split in lock-striped sub-tables with a bloom filter in front
+                                // with limited memory, a stripe that would grow past its share merges its hashes into its own sorted file on disk instead, and starts over empty
+    struct stripe{
+        pthread_mutex_t lock;
+        unsigned long long *table;           // 0 marks an empty slot
+        unsigned int capacity, size;
+        int spill_fd;                        // the stripe's sorted spill file (-1 until it first spills)
+        unsigned long long spilled;          // hashes in it
+        unsigned long long *spill_index;     // spill_index[i] is its (i * HISTORY_SPILL_INDEX_INTERVAL)-th hash
+        char padding[64];                    // keep each stripe's lock on its own cache line
+    } stripes[HISTORY_STRIPES];
+    unsigned long long *bloom;               // bloom_bits bits, set (atomically) on insertion and read without locking
+    unsigned long long bloom_bits;
+    unsigned int total_size;
+    unsigned int max_capacity;               // (limited memory) slots a stripe may have before it spills instead of growing - 0 for no limit
+    char *spill_dir;
+public:
+    hash_history();
+    ~hash_history();
+    bool limit_memory(size_t max_memory, const char *dir);  // (before anything is inserted) keep about max_memory bytes in memory (half of them for the bloom filter) and spill the rest to files in dir
+    // all of the following are thread safe (they only lock the url's stripe, if at all)
+    bool insert_if_absent(const char *str);  // returns true if str was not in the set and was just inserted by this call
+    bool contains(const char *str);          // a negative answer from the bloom filter does not need any locking
+    void add(const char *str);
+    bool insert_hash_if_absent(unsigned long long h);       // for a hash(str) saved earlier (ex: by a checkpoint)
+    // absent[i] = hashes[i] was not in the set (nor earlier in hashes), and it is inserted if insert[i] (else it is only looked up), locking each stripe at most once
+    void insert_batch_if_absent(const unsigned long long *hashes, const bool *insert, unsigned int num_of_hashes, bool *absent);
+    unsigned int get_size() const;
+    unsigned long long get_spilled() const;  // how many of them are on disk (without locking, so it may be out of date by the time it returns)
+    static unsigned long long hash(const char *str);
+private:
+    bool bloom_may_contain(unsigned long long h) const;
+    void bloom_add(unsigned long long h);
+    bool insert_locked(stripe &s, unsigned long long h);     // (stripe's lock must be held) returns true if h was not in the set
+    static bool probe(const stripe &s, unsigned long long h, unsigned int &pos);    // returns true if found, else pos is the empty slot where h belongs
+    static void grow(stripe &s);
+    bool spilled_contains(const stripe &s, unsigned long long h) const;
+    void spill(stripe &s);                   // (stripe's lock must be held)
+};
+
+
+#endif //HASH_HISTORY_H
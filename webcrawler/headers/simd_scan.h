@@ -0,0 +1,18 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+
+// implementations of scan_for (the best one this cpu supports is picked at program start)
+#define SCAN_SCALAR 0
+#define SCAN_SSE2 1                          // 16 bytes at a time
+#define SCAN_AVX2 2                          // 32 bytes at a time
+
+
+const char *scan_for(const char *from, const char *end, char c1, char c2);     // returns the first position in [from, end) that holds c1 or c2 (end if none does) - thread safe
+bool set_scan_method(int method);            // force an implementation (ex: for benchmarking) - returns false if the cpu does not support it. NOT thread safe
+int get_scan_method();
+const char *scan_method_name(int method);
+
+
+#endif //SIMD_SCAN_H
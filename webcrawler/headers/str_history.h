@@ -15,7 +15,7 @@ public:
     str_history();
     ~str_history();
     // add and search ARE ATOMIC because they lock the struct's mutex
-    void add(const char *str);
+    bool add(const char *str);               // returns true if str was not already stored
     bool search(const char *str);
     char **get_all_strings_as_table();       // returns a this->size big table of all C Strings on the tree (in the heap)
     unsigned int get_size() const;
@@ -6,17 +6,17 @@ class Map{
     char **filepath;  // where filepath[i] is the filepath (path + name) for the i-th text file for this worker
     char ***lines;    // where lines[i][j] is the j-th line in the i-th text file for this worker
     int *linecounts;  // where linecounts[i] is how many lines the i-th text file has
-    int filecount;    // total number of text files (possibly across different directories) for this worker
+    int capacity;     // number of text files the tables have room for (they double when a text file is added to a full map)
     int current;      // index of the currently last added textfile file
 public:
-    Map(const int num_of_files);
+    Map(const int num_of_files);      // (num_of_files is only the initial capacity)
     ~Map();
     void add_new_textfile(const char *fpath, int num_of_lines);
     bool insert_line_to_textfile(int fileID, int lineID, const char *line, int line_length);
     /* Accessors */
     const char *getPTRforline(int fileID, const int lineID) const;
     char *getFilePath(int fileID) const;
-    int getFileCount() const;
+    int getFileCount() const;         // total number of text files (possibly across different directories) for this worker
     int getFileLinesCount(int fileID) const;
     /* Public members */
     unsigned int byteCount;     // how many bytes in all textfiles on the map
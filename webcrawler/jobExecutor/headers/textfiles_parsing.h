@@ -4,5 +4,6 @@
 #define MAX_WORD_LEN 512
 
 int parse_subdirectories();                // parse all text files in all your directories
+int parse_page(const char *filepath, const char *content, unsigned int length);     // parse a single page that is already in memory (as if it was the text file filepath)
 
 #endif //TEXTFILES_PARSING_H
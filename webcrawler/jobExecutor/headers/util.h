@@ -21,6 +21,7 @@ enum Type {
     MINCOUNT = 6,              // the message after this header is a request / answer for a /mincount command
     WORDCOUNT = 7,             // the message after this header is a request / answer for a /wc command
     INIT = 8,                  // a header used when trying to initialize the worker by passing him its directories
+    ADD_PAGE = 9,              // (pipelined crawl) the message after this header is a page's filepath, then a NOT_USED header and the page itself, for the worker to index right away
 };
 
 struct Header{
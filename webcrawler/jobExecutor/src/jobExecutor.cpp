@@ -33,9 +33,12 @@ using namespace std;
 /* Global variables */
 char **directories = NULL;       // a table containing all of the docfile's directory paths in C strings
 int dirfilesize = -1;            // its count
+int dircapacity = 0;             // the size of the directories table (which grows as a pipelined crawl finds new directories)
 int *workerNum_to_pid = NULL;    // a table of size numWorkers in which: workerNum_to_pid[*worker_num*] = *its_pid*
 int numWorkers = -1;             // number of workers
 int term_width = -1;
+char *segments_dir = NULL;       // (-s <segments_dir>) the save directory whose segments hold the pages, if the webcrawler did not save each page to its own file - passed on to the workers
+bool pipelined = false;          // (-p) the webcrawler started us before crawling and sends us every page it saves ("/page"), which we pass on to the worker of its directory
 
 
 /* Global variables used by signal handlers */
@@ -46,6 +49,9 @@ volatile bool* volatile worker_is_dead = NULL;
 
 /* Local functions */
 void distribute_directories_to_workers(int numWorkers, int *Rfds);
+int directories_of_worker(int worker_num);
+int worker_of_page(const char *filepath);
+bool write_all(int fd, const char *data, size_t len);
 bool search_management(const int numWorkers, const int *Afds, const int deadline, char **query, int query_size);
 bool replace_worker(int worker_num, char **Rpipes, char **Apipes, int *Rfds, int *Afds, char *range_in_str);
 
@@ -61,6 +67,11 @@ int main(int argc, char *argv[]) {
         return -1;
     }
     numWorkers = atoi(argv[1]);
+    for (int i = 2 ; i < argc ; i++){
+        if ( strcmp(argv[i], "-s") == 0 && i + 1 < argc ) segments_dir = argv[++i];
+        else if ( strcmp(argv[i], "-p") == 0 ) pipelined = true;
+        else numWorkers = -1;
+    }
     if (numWorkers <= 0){
         cerr << "Invalid jobExecutor parameters" << endl;
         return -1;
@@ -71,11 +82,12 @@ int main(int argc, char *argv[]) {
 
     // read directories from cin (webcrawler)
     CHECK_PERROR(read(STDIN_FILENO, &dirfilesize, sizeof(int)), "read from cin", )
-    if (dirfilesize <= 0 ){
+    if ( dirfilesize < 0 || (dirfilesize == 0 && !pipelined) ){        // (a pipelined crawl usually has not found any directories yet)
     	cerr << "Invalid jobExecutor number of directories (<=0)" << endl;
     	return -1;
     }
-    directories = new char*[dirfilesize];
+    dircapacity = (dirfilesize > 0) ? dirfilesize : 16;
+    directories = new char*[dircapacity];
     for (int i = 0 ; i < dirfilesize ; i++){
         int len = 0;
         CHECK_PERROR(read(STDIN_FILENO, &len, sizeof(int)), "read from cin", )
@@ -84,7 +96,7 @@ int main(int argc, char *argv[]) {
         directories[i][len] = '\0';
     }
 
-    if ( numWorkers > dirfilesize ) {             // can't have more workers than directories
+    if ( numWorkers > dirfilesize && !pipelined ) {        // can't have more workers than directories (but a pipelined crawl's workers get more of them later)
         numWorkers = dirfilesize;
     }
 
@@ -194,7 +206,8 @@ int main(int argc, char *argv[]) {
             perror("Failed to create a child process");
             break;
         } else if ( pid == 0 ) {         // child process
-            execl(WORKER_PATH, "worker", range_in_str, Rpipes[i], Apipes[i], NULL);
+            if (pipelined) sprintf(range_in_str, "%d", directories_of_worker(i));     // (some may get none)
+            execl(WORKER_PATH, "worker", range_in_str, Rpipes[i], Apipes[i], segments_dir, NULL);
             /* Code continues to run only if exec fails: (most likely because the executable file could not be found) */
             perror("exec() failed");
             // cleanup
@@ -321,6 +334,10 @@ int main(int argc, char *argv[]) {
                 continue;                                     // re-read a command by skipping this loop
             }
         }
+        if ( !cin.fail() && command[0] == '#' ){             // "#<request id> <command>": the answer is preceded by "#<request id>\n", so that the webcrawler knows whose answer it is
+            cout << command << "\n";
+            cin >> command;
+        }
         if ( cin.fail() || strcmp(command, "/exit") == 0 ){   // command "/exit" or cin failed to read a command
             cin.clear();
             break;
@@ -700,6 +717,38 @@ int main(int argc, char *argv[]) {
                  << "Lines: " << linesum << endl;
             if (deadcount > 0) cout << deadcount << " out of " << numWorkers << " workers did not answer because they were forced to terminate" << endl;
         }
+        else if ( pipelined && strcmp(command, "/page") == 0 ){    // "/page <path_len> <content_len>\n" followed by the page's filepath and content: pass it on to the worker of its directory
+            size_t path_len = 0, content_len = 0;
+            cin >> path_len >> content_len;
+            cin.ignore(1);                                    // ('\n')
+            char *fpath = new char[path_len + 1];
+            char *content = new char[content_len];
+            cin.read(fpath, path_len);
+            cin.read(content, content_len);
+            fpath[path_len] = '\0';
+            if ( cin.fail() || strchr(fpath, '/') == NULL ){
+                cerr << "Error: could not read a page from the webcrawler" << endl;
+                cin.clear();
+            } else {
+                int w = worker_of_page(fpath);
+                if (worker_is_dead[w]) {
+                    worker_is_dead[w] = false;
+                    if (replace_worker(w, Rpipes, Apipes, Rfds, Afds, range_in_str) == false) {
+                        cerr << "Failed to replace a worker!" << endl;
+                        worker_is_dead[w] = true;
+                    }
+                }
+                // (the worker answers nothing, so writing the next page only blocks while it is still busy indexing the previous ones)
+                Header pathhdr(ADD_PAGE, path_len + 1), contenthdr(NOT_USED, content_len);
+                if ( !write_all(Rfds[w], (const char *) &pathhdr, sizeof(Header)) || !write_all(Rfds[w], fpath, path_len + 1) ||
+                     !write_all(Rfds[w], (const char *) &contenthdr, sizeof(Header)) || !write_all(Rfds[w], content, content_len) ){
+                    cerr << "Warning: a worker did not get page " << fpath << endl;
+                }
+            }
+            delete[] content;
+            delete[] fpath;
+            continue;                                         // (nothing is printed for "/page", not even the end of answer "<")
+        }
         else{
             cout << "Unrecognized command\n";
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
@@ -796,6 +845,48 @@ void distribute_directories_to_workers(int numWorkers, int *Rfds) {
 }
 
 
+int directories_of_worker(int worker_num) {         // how many directories the round-robin of distribute_directories_to_workers() assigns to worker_num
+    return (dirfilesize > worker_num) ? (dirfilesize - worker_num - 1) / numWorkers + 1 : 0;
+}
+
+
+int worker_of_page(const char *filepath) {          // the worker of filepath's directory, which (if new) is added to directories and so to the round-robin
+    size_t len = strrchr(filepath, '/') - filepath;  // (filepath always has a '/')
+    int i;
+    for (i = 0 ; i < dirfilesize ; i++){
+        if ( strncmp(directories[i], filepath, len) == 0 && directories[i][len] == '\0' ) break;
+    }
+    if ( i == dirfilesize ){
+        if ( dirfilesize == dircapacity ){
+            char **new_directories = new char*[2 * dircapacity];
+            for (int j = 0 ; j < dirfilesize ; j++){
+                new_directories[j] = directories[j];
+            }
+            delete[] directories;
+            directories = new_directories;
+            dircapacity *= 2;
+        }
+        directories[i] = new char[len + 1];
+        strncpy(directories[i], filepath, len);
+        directories[i][len] = '\0';
+        dirfilesize++;
+    }
+    return i % numWorkers;
+}
+
+
+bool write_all(int fd, const char *data, size_t len) {     // (a page may not fit in the pipe, and a SIGCHLD may interrupt the write)
+    while ( len > 0 ){
+        ssize_t nbytes = write(fd, data, len);
+        if ( nbytes < 0 && errno == EINTR ) continue;
+        if ( nbytes < 0 ) return false;
+        data += nbytes;
+        len -= (size_t) nbytes;
+    }
+    return true;
+}
+
+
 bool search_management(const int numWorkers, const int *Afds, const int deadline, char **query, int query_size) {
     bool *responded = new bool[numWorkers];                         // a bool table for which of the workers have responded
     for (int j = 0 ; j < numWorkers ; j++) responded[j] = false;
@@ -943,6 +1034,11 @@ bool search_management(const int numWorkers, const int *Afds, const int deadline
 
 
 bool replace_worker(int worker_num, char **Rpipes, char **Apipes, int *Rfds, int *Afds, char *range_in_str) {
+    char count_str[128];
+    if (pipelined) {                 // the replacement gets all the directories its predecessor got, including the ones found after the range was computed
+        sprintf(count_str, "%d", directories_of_worker(worker_num));
+        range_in_str = count_str;
+    }
     // close previous named pipes before forking (!!!)
     if (Rfds[worker_num] != -1) {
         close(Rfds[worker_num]);
@@ -972,7 +1068,7 @@ bool replace_worker(int worker_num, char **Rpipes, char **Apipes, int *Rfds, int
     } else if ( pid == 0 ){    // child process
         // Should I flush Rpipe here? I though I should but it broke stuff so instead
         // I made the worker not terminate in the middle of reading a request
-        execl("./bin/worker", "worker", range_in_str, Rpipes[worker_num], Apipes[worker_num], NULL);
+        execl("./bin/worker", "worker", range_in_str, Rpipes[worker_num], Apipes[worker_num], segments_dir, NULL);
         /* Code continues to run only if exec fails: (most likely because the executable file could not be found) */
         perror("exec() failed");
         exit(-4);             // in this case the child process will exit with memory leaks but this is not supposed to happen normally anyway
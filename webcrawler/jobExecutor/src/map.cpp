@@ -7,7 +7,7 @@ using namespace std;
 
 
 /* Map implementation */
-Map::Map(const int num_of_files) : current(-1), filecount(num_of_files), byteCount(0), wordCount(0), lineCount(0) {
+Map::Map(const int num_of_files) : current(-1), capacity(num_of_files), byteCount(0), wordCount(0), lineCount(0) {
     linecounts = new int[num_of_files];
     for (int i = 0 ; i < num_of_files ; i++) linecounts[i] = 0;   // initial value
     lines = new char**[num_of_files];
@@ -30,6 +30,24 @@ Map::~Map() {
 }
 
 void Map::add_new_textfile(const char *fpath, const int num_of_lines) {
+    if ( current + 1 >= capacity ){                               // (only a worker of a pipelined crawl gets more text files than it counted at start)
+        int new_capacity = (capacity > 0) ? 2 * capacity : 16;
+        int *new_linecounts = new int[new_capacity];
+        char ***new_lines = new char**[new_capacity];
+        char **new_filepath = new char*[new_capacity];
+        for (int i = 0 ; i < new_capacity ; i++){
+            new_linecounts[i] = (i < capacity) ? linecounts[i] : 0;
+            new_lines[i] = (i < capacity) ? lines[i] : NULL;
+            new_filepath[i] = (i < capacity) ? filepath[i] : NULL;
+        }
+        delete[] linecounts;
+        delete[] lines;
+        delete[] filepath;
+        linecounts = new_linecounts;
+        lines = new_lines;
+        filepath = new_filepath;
+        capacity = new_capacity;
+    }
     ++current;
     filepath[current] = new char[strlen(fpath) + 1];
     strcpy(filepath[current], fpath);
@@ -74,7 +92,7 @@ char *Map::getFilePath(const int fileID) const {
 }
 
 int Map::getFileCount() const {
-    return filecount;
+    return current + 1;
 }
 
 int Map::getFileLinesCount(int fileID) const {
@@ -1,11 +1,13 @@
 #include <iostream>
 #include <cstring>
 #include <fstream>
+#include <sstream>
 #include <dirent.h>               // for directory traversing
 #include "../headers/inverted_index.h"
 #include "../headers/util.h"
 #include "../headers/textfiles_parsing.h"
 #include "../headers/map.h"
+#include "../../headers/Page_Segments.h"
 
 
 using namespace std;
@@ -16,11 +18,14 @@ extern char **subdirectories;             // a table containing ONLY this worker
 extern int subdirfilesize;                // its count
 extern Trie *inverted_index;              // the inverted_index (Trie) for this worker
 extern Map *map;
+extern char *segments_dir;                // if not NULL, the pages are in this save directory's segments instead of in subdirectories
 
 
 /* Local Functions */
+int parse_segments();
 int parse_text(int subdir_num, char *name);
-int count_lines(char *filepath, intnode *&line_sizes);
+int parse_text(const char *filepath, std::istream &textfile);
+int count_lines(std::istream &textfile, intnode *&line_sizes);
 
 
 int parse_subdirectories(){                         // parse all text (ascii) files in all your directories
@@ -28,6 +33,7 @@ int parse_subdirectories(){                         // parse all text (ascii) fi
         cerr << "Error parsing subdirectories: subdirectories not initialized yet" << endl;
         return -3;
     }
+    if ( segments_dir != NULL ) return parse_segments();
     // First count how many text files at our jurisdiction
     int filecount = 0;
     for (int i = 0 ; i < subdirfilesize && subdirectories[i] != NULL ; i++) {    // for each directory assigned to this worker
@@ -71,32 +77,110 @@ int parse_subdirectories(){                         // parse all text (ascii) fi
 }
 
 
+int parse_segments(){                               // parse all pages of all your directories from segments_dir's segments
+    Segment_Store segments;
+    if ( segments.open(segments_dir, false) < 0 ){
+        cerr << "Error parsing subdirectories: could not open the segments in " << segments_dir << endl;
+        return -1;
+    }
+    // a directory's pages are those whose (root-relative) url starts with "/<directory's name>/"
+    int filecount = 0;
+    int *pagecounts = new int[subdirfilesize];
+    char ***pages = new char**[subdirfilesize];
+    for (int i = 0 ; i < subdirfilesize && subdirectories[i] != NULL ; i++) {
+        size_t len = strlen(segments_dir);
+        if ( strncmp(subdirectories[i], segments_dir, len) != 0 ) len = 0;      // (should not happen: all directories are in the save directory)
+        char *prefix = new char[strlen(subdirectories[i]) - len + 2];
+        strcpy(prefix, subdirectories[i] + len);
+        strcat(prefix, "/");
+        pages[i] = segments.list(prefix, pagecounts[i]);
+        filecount += pagecounts[i];
+        delete[] prefix;
+    }
+    // Create inverted_index and map structures
+    inverted_index = new Trie();
+    map = new Map(filecount);
+    // Parse each page, adding its contents to inverted_index and map (under the path it would have been saved to)
+    int result = 0;
+    for (int i = 0 ; i < subdirfilesize && subdirectories[i] != NULL && result == 0 ; i++) {
+        for (int j = 0 ; j < pagecounts[i] && result == 0 ; j++) {
+            page_location where;
+            char *content = (segments.find(pages[i][j], where)) ? segments.read(where) : NULL;
+            if ( content == NULL ){
+                cerr << "Cannot read page " << pages[i][j] << " from its segment" << endl;
+                result = -1;
+                break;
+            }
+            istringstream textfile(string(content, where.length));
+            delete[] content;
+            char *filepath = new char[strlen(segments_dir) + strlen(pages[i][j]) + 1];
+            strcpy(filepath, segments_dir);
+            strcat(filepath, pages[i][j]);
+            int feedback = parse_text(filepath, textfile);
+            if (feedback < 0) {
+                cerr << "Something went wrong parsing a page. Feedback: " << feedback << "\n"
+                     << "page: " << filepath << endl;
+                result = -2;
+            }
+            delete[] filepath;
+        }
+    }
+    for (int i = 0 ; i < subdirfilesize && subdirectories[i] != NULL ; i++) {
+        for (int j = 0 ; j < pagecounts[i] ; j++) {
+            delete[] pages[i][j];
+        }
+        delete[] pages[i];
+    }
+    delete[] pages;
+    delete[] pagecounts;
+    return result;
+}
+
+
+int parse_page(const char *filepath, const char *content, unsigned int length){    // parses a single page (a pipelined crawl's), which is not read from a file
+    istringstream textfile(string(content, length));
+    return parse_text(filepath, textfile);
+}
+
+
 int parse_text(int subdir_num, char *name){    // parses a single textfile
-    static int fileID = 0;                     // the fileID for each file we parse with this function
     char *filepath = new char[strlen(subdirectories[subdir_num]) + strlen(name) + 2];  // +1 for '/' and +1 for '\0'
     strcpy(filepath, subdirectories[subdir_num]);
     strcat(filepath, "/");
     strcat(filepath, name);
+    ifstream textfile(filepath);
+    if (!textfile){                            // if we can not open the textfile return error
+        cerr << "Cannot open textfile" << endl;
+        delete[] filepath;
+        return -1;
+    }
+    int feedback = parse_text(filepath, textfile);
+    delete[] filepath;
+    return feedback;
+}
+
+
+int parse_text(const char *filepath, istream &textfile){    // parses a single text (from a file or a page kept in memory), which map will know as filepath
+    static int fileID = 0;                     // the fileID for each file we parse with this function
     intnode *line_sizes = NULL;                // a list of the sizes of each line (needed for the dynamic allocation of them in our "map" structure)
-    int linecount = count_lines(filepath, line_sizes);
+    int linecount = count_lines(textfile, line_sizes);
     if ( linecount <= 0 ) {                    // if count_lines failed then return error
         while (line_sizes != NULL){            // after cleaning up the already created int list
             intnode *tmp = line_sizes->next;
             delete line_sizes;
             line_sizes = tmp;
         }
-        delete[] filepath;
         return -1;
     }
-    ifstream textfile(filepath);
-    if ( !line_sizes ) {                       // should not fail since it must have worked on count_lines()
-        cerr << "Unexpected error reopening a textfile!\n";
+    textfile.clear();                          // (rewind it for the 2nd pass)
+    textfile.seekg(0);
+    if ( !line_sizes || !textfile ) {          // should not fail since it must have worked on count_lines()
+        cerr << "Unexpected error rereading a textfile!\n";
         while (line_sizes != NULL){            // cleanup int list
             intnode *tmp = line_sizes->next;
             delete line_sizes;
             line_sizes = tmp;
         }
-        delete[] filepath;
         return -2;
     }
     map->add_new_textfile(filepath, linecount);  // add a new entry for this textfile on our map structure
@@ -162,17 +246,11 @@ int parse_text(int subdir_num, char *name){    // parses a single textfile
         delete line_sizes;
         line_sizes = tmp;
     }
-    delete[] filepath;
     return 0;
 }
 
 
-int count_lines(char *filepath, intnode *&line_sizes) {   // This is the 1st pass of each textfile
-    ifstream textfile(filepath);
-    if (!textfile){                              // if we can not open the textfile return error
-        cerr << "Cannot open textfile" << endl;
-        return -1;
-    }
+int count_lines(istream &textfile, intnode *&line_sizes) {   // This is the 1st pass of each textfile
     int line_count = 0;                          // the number of lines aka documents
     int char_count;                              // the count of the (C String) document in each line, which is saved on an int list
     char ch;
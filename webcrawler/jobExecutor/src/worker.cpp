@@ -22,6 +22,7 @@ using namespace std;
 /* Global variables */
 char **subdirectories = NULL;             // a table containing ONLY this worker's directory paths in C strings
 int subdirfilesize = -1;                  // its count
+char *segments_dir = NULL;                // (optional 4th argument) if given, the pages of this worker's directories are read from this save directory's segments instead
 Trie *inverted_index = NULL;
 Map *map = NULL;
 int TotalWordsFound = 0;
@@ -33,6 +34,7 @@ volatile bool worker_must_terminate = false;
 
 /* Local functions */
 void search(char **query, int query_size, const int answer_fd, ofstream &log);
+bool read_all(int fd, char *buffer, size_t len);
 
 
 /* Signal Handlers */
@@ -42,8 +44,9 @@ static void handle_sig_termination(int sig);
 
 int main(int argc, char *argv[]){
     subdirfilesize = atoi(argv[1]);
-    if (subdirfilesize <= 0){
-        cerr << "Error: Created a worker with no directories\n";
+    if ( argc > 4 ) segments_dir = argv[4];
+    if (subdirfilesize < 0){                        // (a worker of a pipelined crawl may start with no directories and get all of its pages with ADD_PAGE)
+        cerr << "Error: Created a worker with a negative number of directories\n";
         return -1;
     }
     // open (and create if 404) your logs file
@@ -287,6 +290,25 @@ int main(int argc, char *argv[]){
             // update log
             log << get_current_time() << " : wc : " << bytecount << " : " << wordcount << " : " << linecount << endl;
         }
+        else if ( header.type == ADD_PAGE ){        // (pipelined crawl) a page that was just crawled: index it now, without answering
+            char *fpath = new char[header.message_size];
+            Header contenthdr;
+            char *content = NULL;
+            bool ok = read_all(request_fd, fpath, header.message_size) && read_all(request_fd, (char *) &contenthdr, sizeof(Header));
+            if (ok) {
+                content = new char[contenthdr.message_size];
+                ok = read_all(request_fd, content, contenthdr.message_size);
+            }
+            if ( !ok ){
+                perror("read page on worker");      // should not happen
+            } else if ( parse_page(fpath, content, contenthdr.message_size) < 0 ){
+                cerr << "Worker" << getpid() << " could not parse page " << fpath << " (empty?)" << endl;
+            } else {
+                log << get_current_time() << " : page : " << fpath << " : " << contenthdr.message_size << endl;
+            }
+            delete[] content;
+            delete[] fpath;
+        }
         else if ( !worker_must_terminate ){
             cerr << "Unrecognized command (" << header.type <<  ")given to a worker\n";
         }
@@ -419,6 +441,18 @@ void search(char **query, int query_size, const int answer_fd, ofstream &log) {
 }
 
 
+bool read_all(int fd, char *buffer, size_t len){      // a page may be larger than what the pipe holds, so it can take more than one read (which a signal could also interrupt)
+    while ( len > 0 ){
+        ssize_t nbytes = read(fd, buffer, len);
+        if ( nbytes < 0 && errno == EINTR ) continue;
+        if ( nbytes <= 0 ) return false;
+        buffer += nbytes;
+        len -= (size_t) nbytes;
+    }
+    return true;
+}
+
+
 /* Signal Handlers Implemenation */
 static void stop_searching(int sig){
     search_canceled = true;
@@ -428,4 +462,3 @@ static void stop_searching(int sig){
 static void handle_sig_termination(int sig){       // signal handler for when terminated via signal
     worker_must_terminate = true;                  // the worker will try to terminate asap
 }
-
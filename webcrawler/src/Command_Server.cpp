@@ -0,0 +1,384 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../headers/Command_Server.h"
+
+
+using namespace std;
+
+
+/* useful macros */
+#define CHECK_PERROR(call, callname, handle_code) { if ( ( call ) < 0 ) { perror(callname); handle_code } }
+
+#define POLLED_LISTENING -1                  // (polled entries that are not a connection)
+#define POLLED_ANSWERS -2
+
+
+/* Global Variables (explained at crawling_monitoring.cpp) */
+extern int toJobExecutor_pipe, fromJobExecutor_pipe;
+extern pthread_mutex_t toJobExecutor_lock;
+
+
+Command_Server::Command_Server(int listening_socket) : listening_fd(listening_socket), accepting(true), num_slots(COMMAND_INITIAL_CLIENTS), num_open(0), next_request_id(1),
+                                                       num_queued(0), num_sent(0), header_len(0), in_body(false), pending_lt(false), answering(-1), jobExecutor_gone(false) {
+    clients = new client[num_slots];
+    for (unsigned int i = 0 ; i < num_slots ; i++){
+        clients[i].fd = -1;
+        clients[i].state = FREE;
+        clients[i].out = NULL;
+    }
+    num_polled = num_slots + 2;
+    pfds = new struct pollfd[num_polled];
+    polled = new int[num_polled];
+    // (accept is called until there is no connection left to accept, so it must not block then)
+    CHECK_PERROR( fcntl(listening_fd, F_SETFL, fcntl(listening_fd, F_GETFL) | O_NONBLOCK), "fcntl on command socket", )
+}
+
+Command_Server::~Command_Server() {
+    for (unsigned int i = 0 ; i < num_slots ; i++){
+        if ( clients[i].state != FREE ) close_connection((int) i);
+    }
+    delete[] clients;
+    delete[] pfds;
+    delete[] polled;
+}
+
+int Command_Server::serve() {
+    send_requests();
+    if ( num_polled < num_slots + 2 ){
+        delete[] pfds;
+        delete[] polled;
+        num_polled = num_slots + 2;
+        pfds = new struct pollfd[num_polled];
+        polled = new int[num_polled];
+    }
+    nfds_t n = 0;
+    if ( accepting && num_open < COMMAND_MAX_CLIENTS ){
+        pfds[n].fd = listening_fd;
+        pfds[n].events = POLLIN;
+        polled[n++] = POLLED_LISTENING;
+    }
+    if ( num_sent > 0 ){
+        pfds[n].fd = fromJobExecutor_pipe;
+        pfds[n].events = POLLIN;
+        polled[n++] = POLLED_ANSWERS;
+    }
+    for (unsigned int i = 0 ; i < num_slots ; i++){
+        if ( clients[i].state == FREE ) continue;
+        pfds[n].fd = clients[i].fd;              // (a connection that waits for its answer is still polled, so that it is closed if it is hung up)
+        pfds[n].events = (short) (((clients[i].state == READING) ? POLLIN : 0) | ((clients[i].out_sent < clients[i].out_len) ? POLLOUT : 0));
+        polled[n++] = (int) i;
+    }
+    if ( n == 0 ) return 0;
+    int ready = poll(pfds, n, (num_queued > 0) ? COMMAND_RETRY_INTERVAL : -1);
+    if ( ready <= 0 ) return ready;
+    for (nfds_t k = 0 ; k < n ; k++){
+        if ( pfds[k].revents == 0 ) continue;
+        if ( polled[k] == POLLED_LISTENING ) accept_connections();
+        else if ( polled[k] == POLLED_ANSWERS ) read_answers();
+        else {
+            int slot = polled[k];
+            if ( clients[slot].state == FREE || clients[slot].fd != pfds[k].fd ) continue;     // (closed while the answers were read)
+            if ( pfds[k].revents & (POLLERR | POLLNVAL) ){
+                close_connection(slot);
+                continue;
+            }
+            if ( (pfds[k].revents & (POLLIN | POLLHUP)) && clients[slot].state == READING ) read_command(slot);
+            else if ( pfds[k].revents & POLLHUP ){
+                close_connection(slot);
+                continue;
+            }
+            if ( clients[slot].state != FREE && (pfds[k].revents & POLLOUT) ) send_answer(slot);
+        }
+    }
+    send_requests();
+    return ready;
+}
+
+int Command_Server::next_command(char *&command, char *&arguments, bool &has_arguments) {
+    for (unsigned int i = 0 ; i < num_slots ; i++){
+        if ( clients[i].state != COMMAND ) continue;
+        clients[i].state = REPLIED;              // (until it is forwarded)
+        char *p = clients[i].line;
+        while ( *p == ' ' ) p++;                 // ignore white space at start
+        command = p;
+        while ( *p != '\0' && *p != ' ' ) p++;
+        has_arguments = ( *p == ' ' );           // (the command line did not end right after the command)
+        if ( *p != '\0' ) *p++ = '\0';
+        arguments = p;
+        return (int) i;
+    }
+    return -1;
+}
+
+void Command_Server::reply(int slot, const char *answer) {
+    append_answer(slot, answer, strlen(answer));
+    send_answer(slot);
+}
+
+void Command_Server::forward(int slot, const char *request) {
+    if ( jobExecutor_gone ){
+        reply(slot, "the jobExecutor is not running anymore\n");
+        return;
+    }
+    client &c = clients[slot];
+    char text[COMMAND_LINE_SIZE];                // (request may point into c.line)
+    int len = snprintf(text, sizeof(text), "#%u %s\n", next_request_id, request);
+    if ( len >= (int) sizeof(text) ){
+        cerr << "Warning: a request for the jobExecutor was cut off (too big)" << endl;
+        len = (int) sizeof(text) - 1;
+        text[len - 1] = '\n';
+    }
+    memcpy(c.line, text, (size_t) len);
+    c.line_len = (size_t) len;
+    c.request_id = next_request_id++;
+    if ( next_request_id == 0 ) next_request_id = 1;
+    c.state = QUEUED;
+    num_queued++;
+}
+
+void Command_Server::stop_accepting() {
+    accepting = false;
+}
+
+bool Command_Server::idle() const {
+    if ( num_queued > 0 || num_sent > 0 ) return false;
+    for (unsigned int i = 0 ; i < num_slots ; i++){
+        if ( clients[i].state == REPLIED ) return false;
+    }
+    return true;
+}
+
+void Command_Server::accept_connections() {
+    while ( num_open < COMMAND_MAX_CLIENTS ){
+        struct sockaddr_in incoming_sa;
+        socklen_t len = sizeof(incoming_sa);
+        int fd = accept(listening_fd, (struct sockaddr *) &incoming_sa, &len);
+        if ( fd < 0 ){
+            if ( errno == EINTR ) continue;
+            if ( errno != EAGAIN && errno != EWOULDBLOCK ) perror("accept on command socket failed unexpectedly");
+            return;
+        }
+        CHECK_PERROR( fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK), "fcntl on accepted command socket", )
+        cout << "> Crawler accepted a (command) connection from " << inet_ntoa(incoming_sa.sin_addr) << " : " << incoming_sa.sin_port << endl;
+        if ( num_open == num_slots ){            // all slots are taken: double them
+            unsigned int new_slots = (num_slots * 2 < COMMAND_MAX_CLIENTS) ? num_slots * 2 : COMMAND_MAX_CLIENTS;
+            client *new_clients = new client[new_slots];
+            for (unsigned int i = 0 ; i < new_slots ; i++){
+                if ( i < num_slots ) new_clients[i] = clients[i];
+                else {
+                    new_clients[i].fd = -1;
+                    new_clients[i].state = FREE;
+                    new_clients[i].out = NULL;
+                }
+            }
+            delete[] clients;
+            clients = new_clients;
+            num_slots = new_slots;               // (pfds grows with them before the next poll)
+        }
+        unsigned int slot = 0;
+        while ( clients[slot].state != FREE ) slot++;
+        client &c = clients[slot];
+        c.fd = fd;
+        c.state = READING;
+        c.line_len = 0;
+        c.request_id = 0;
+        c.out = NULL;
+        c.out_len = c.out_sent = c.out_capacity = 0;
+        num_open++;
+    }
+}
+
+void Command_Server::read_command(int slot) {    // reads whatever the connection sent so far, until its command line is complete
+    client &c = clients[slot];
+    for (;;) {
+        ssize_t nbytes = read(c.fd, c.line + c.line_len, COMMAND_LINE_SIZE - 1 - c.line_len);
+        if ( nbytes < 0 ){
+            if ( errno == EINTR ) continue;
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) return;
+            perror("read from accepted command socket");
+            close_connection(slot);
+            return;
+        }
+        if ( nbytes == 0 ){                      // the connection was closed (for writing) without a '\n': whatever it sent is the command line
+            if ( c.line_len == 0 ) close_connection(slot);
+            else {
+                c.line[c.line_len] = '\0';
+                c.state = COMMAND;
+            }
+            return;
+        }
+        char *newline = (char *) memchr(c.line + c.line_len, '\n', (size_t) nbytes);
+        c.line_len += (size_t) nbytes;
+        if ( newline != NULL ){                  // (anything sent after it is ignored)
+            c.line_len = (size_t) (newline - c.line);
+            if ( c.line_len > 0 && c.line[c.line_len - 1] == '\r' ) c.line_len--;
+            c.line[c.line_len] = '\0';
+            c.state = COMMAND;
+            return;
+        }
+        if ( c.line_len == COMMAND_LINE_SIZE - 1 ){
+            cerr << "Warning: might not have read the whole command line (it is too big)" << endl;
+            c.line[c.line_len] = '\0';
+            c.state = COMMAND;
+            return;
+        }
+    }
+}
+
+void Command_Server::send_answer(int slot) {
+    client &c = clients[slot];
+    while ( c.out_sent < c.out_len ){
+        ssize_t nbytes = write(c.fd, c.out + c.out_sent, c.out_len - c.out_sent);
+        if ( nbytes < 0 ){
+            if ( errno == EINTR ) continue;
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) return;     // (the rest is sent once the connection takes more)
+            perror("write to accepted command socket");
+            close_connection(slot);
+            return;
+        }
+        c.out_sent += (size_t) nbytes;
+    }
+    c.out_len = c.out_sent = 0;                  // (the buffer is kept for the rest of a jobExecutor's answer)
+    if ( c.state == REPLIED ) close_connection(slot);
+}
+
+void Command_Server::append_answer(int slot, const char *data, size_t len) {
+    client &c = clients[slot];
+    if ( c.out_len + len > c.out_capacity ){
+        size_t new_capacity = (c.out_capacity > 0) ? c.out_capacity : ANSWER_READ_SIZE;
+        while ( new_capacity < c.out_len + len ) new_capacity *= 2;
+        char *new_out = new char[new_capacity];
+        if ( c.out_len > 0 ) memcpy(new_out, c.out, c.out_len);
+        delete[] c.out;
+        c.out = new_out;
+        c.out_capacity = new_capacity;
+    }
+    memcpy(c.out + c.out_len, data, len);
+    c.out_len += len;
+}
+
+void Command_Server::close_connection(int slot) {
+    client &c = clients[slot];
+    CHECK_PERROR( close(c.fd), "closing accepted command connection", )
+    if ( c.state == QUEUED ) num_queued--;
+    if ( slot == answering ) answering = -1;    // (the rest of its answer is read and dropped; so is the answer to a request already sent)
+    delete[] c.out;
+    c.out = NULL;
+    c.out_len = c.out_sent = c.out_capacity = 0;
+    c.fd = -1;
+    c.state = FREE;
+    num_open--;
+}
+
+void Command_Server::send_requests() {
+    if ( num_queued == 0 ) return;
+    // (--pipeline) if a crawler thread is writing a page to the jobExecutor, the requests are tried again later rather than waiting for it: the pipe may be full,
+    // and the jobExecutor may not empty it before its answers to the requests already sent are read
+    if ( pthread_mutex_trylock(&toJobExecutor_lock) != 0 ) return;
+    while ( num_queued > 0 ){
+        struct pollfd pfd;
+        pfd.fd = toJobExecutor_pipe;
+        pfd.events = POLLOUT;
+        if ( poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLOUT) ) break;      // (the pipe is full: a request, not longer than PIPE_BUF, is only written once it fits whole)
+        int slot = -1;
+        for (unsigned int i = 0 ; i < num_slots ; i++){          // the oldest request first
+            if ( clients[i].state == QUEUED && (slot < 0 || clients[i].request_id < clients[slot].request_id) ) slot = (int) i;
+        }
+        client &c = clients[slot];
+        ssize_t nbytes = write(toJobExecutor_pipe, c.line, c.line_len);
+        if ( nbytes < 0 && errno == EINTR ) continue;
+        num_queued--;
+        if ( nbytes < (ssize_t) c.line_len ){
+            perror("write to jobExecutor");
+            c.state = REPLIED;
+            reply(slot, "could not send the command to the jobExecutor\n");
+            continue;
+        }
+        c.state = SENT;
+        num_sent++;
+    }
+    pthread_mutex_unlock(&toJobExecutor_lock);
+}
+
+void Command_Server::read_answers() {     // relays the answers read from the jobExecutor, each one to the connection of its request id ("#<request id>\n" + the answer + "<\n")
+    char buffer[ANSWER_READ_SIZE];
+    ssize_t nbytes = read(fromJobExecutor_pipe, buffer, sizeof(buffer));
+    if ( nbytes < 0 ){
+        if ( errno != EINTR && errno != EAGAIN ) perror("read from jobExecutor");
+        return;
+    }
+    if ( nbytes == 0 ){                          // the jobExecutor exited: no answer will come anymore
+        cerr << "Warning: the jobExecutor closed its pipe, its answers are lost" << endl;
+        jobExecutor_gone = true;
+        for (unsigned int i = 0 ; i < num_slots ; i++){
+            if ( clients[i].state == QUEUED || clients[i].state == SENT ){
+                clients[i].state = REPLIED;
+                reply((int) i, "the jobExecutor is not running anymore\n");
+            }
+        }
+        num_queued = num_sent = 0;
+        return;
+    }
+    ssize_t i = 0;
+    while ( i < nbytes ){
+        if ( !in_body ){                         // "#<request id>\n"
+            char byte = buffer[i++];
+            if ( byte != '\n' ){
+                if ( header_len < ANSWER_HEADER_SIZE - 1 ) header[header_len++] = byte;
+                continue;
+            }
+            header[header_len] = '\0';
+            answering = -1;
+            if ( header[0] == '#' ){
+                unsigned int id = (unsigned int) strtoul(header + 1, NULL, 10);
+                for (unsigned int s = 0 ; s < num_slots ; s++){
+                    if ( clients[s].state == SENT && clients[s].request_id == id ) answering = (int) s;
+                }
+            } else cerr << "Warning: an answer from the jobExecutor did not start with its request id" << endl;
+            in_body = true;
+            header_len = 0;
+            continue;
+        }
+        // IMPORTANT: the jobExecutor prints "<\n" after each answer, which is not relayed. Since html tags are ignored, it will not be anywhere else in its answers!
+        if ( pending_lt ){                       // (the previous read ended with a '<')
+            pending_lt = false;
+            if ( buffer[i] == '\n' ){
+                i++;
+                end_answer();
+                continue;
+            }
+            if ( answering >= 0 ) append_answer(answering, "<", 1);
+        }
+        ssize_t start = i;
+        while ( i < nbytes && !(buffer[i] == '<' && (i + 1 == nbytes || buffer[i + 1] == '\n')) ) i++;
+        if ( answering >= 0 && i > start ) append_answer(answering, buffer + start, (size_t) (i - start));
+        if ( i == nbytes ) break;
+        if ( i + 1 == nbytes ){                  // whether it ends the answer is known with the next read
+            pending_lt = true;
+            i++;
+        } else {
+            i += 2;
+            end_answer();
+        }
+    }
+    if ( answering >= 0 ) send_answer(answering);
+}
+
+void Command_Server::end_answer() {
+    if ( answering >= 0 ){
+        clients[answering].state = REPLIED;
+        send_answer(answering);                  // (which closes the connection once all of it is sent)
+    }
+    answering = -1;
+    num_sent--;
+    in_body = false;
+}
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <ctime>
+#include <cerrno>
+#include "../headers/Concurrency_Controller.h"
+
+
+using namespace std;
+
+
+Concurrency_Controller::Concurrency_Controller(unsigned int initial_fetches, unsigned int min_fetches, unsigned int max_fetches)
+        : in_flight(0), min_window(min_fetches), max_window(max_fetches), num_waiting(0), slow_start(true), epoch_samples(0), epoch_errors(0), epoch_usec(0),
+          baseline_usec(0), last_mean_usec(0), increases(0), decreases(0) {
+    if ( max_window < min_window ) max_window = min_window;
+    window = initial_fetches;
+    if ( window < min_window ) window = min_window;
+    if ( window > max_window ) window = max_window;
+    if ( pthread_mutex_init(&lock, NULL) != 0 || pthread_cond_init(&allowed, NULL) != 0 ){
+        cerr << "Warning: concurrency controller's lock initialization failed!" << endl;
+    }
+}
+
+Concurrency_Controller::~Concurrency_Controller() {
+    pthread_cond_destroy(&allowed);
+    pthread_mutex_destroy(&lock);
+}
+
+bool Concurrency_Controller::acquire() {
+    unsigned int n = __atomic_load_n(&in_flight, __ATOMIC_RELAXED);
+    while ( n < __atomic_load_n(&window, __ATOMIC_RELAXED) ){
+        if ( __atomic_compare_exchange_n(&in_flight, &n, n + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) ) return true;
+    }
+    return false;
+}
+
+void Concurrency_Controller::release() {
+    __sync_fetch_and_sub(&in_flight, 1);
+    if ( __atomic_load_n(&num_waiting, __ATOMIC_SEQ_CST) > 0 ){
+        pthread_mutex_lock(&lock);
+        pthread_cond_broadcast(&allowed);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void Concurrency_Controller::wait(int timeout_msecs) {
+    // (a release between our check and the wait is not seen until the timeout, which only delays this thread's next fetch by that much)
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += timeout_msecs / 1000;
+    until.tv_nsec += (long) (timeout_msecs % 1000) * 1000000L;
+    if ( until.tv_nsec >= 1000000000L ){
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&lock);
+    __sync_fetch_and_add(&num_waiting, 1);
+    while ( __atomic_load_n(&in_flight, __ATOMIC_SEQ_CST) >= window ){
+        if ( pthread_cond_timedwait(&allowed, &lock, &until) == ETIMEDOUT ) break;
+    }
+    __sync_fetch_and_sub(&num_waiting, 1);
+    pthread_mutex_unlock(&lock);
+}
+
+void Concurrency_Controller::sample(unsigned long long first_byte_usec) {
+    pthread_mutex_lock(&lock);
+    epoch_samples++;
+    epoch_usec += first_byte_usec;
+    if ( epoch_samples + epoch_errors >= CONCURRENCY_EPOCH_MIN_EVENTS && epoch_samples + epoch_errors >= window ) end_epoch();
+    pthread_mutex_unlock(&lock);
+}
+
+void Concurrency_Controller::error() {
+    pthread_mutex_lock(&lock);
+    epoch_errors++;
+    if ( epoch_samples + epoch_errors >= CONCURRENCY_EPOCH_MIN_EVENTS && epoch_samples + epoch_errors >= window ) end_epoch();
+    pthread_mutex_unlock(&lock);
+}
+
+unsigned int Concurrency_Controller::get_window() const {
+    return __atomic_load_n(&window, __ATOMIC_RELAXED);
+}
+
+unsigned int Concurrency_Controller::get_in_flight() const {
+    return __atomic_load_n(&in_flight, __ATOMIC_RELAXED);
+}
+
+unsigned int Concurrency_Controller::get_min() const {
+    return min_window;
+}
+
+unsigned int Concurrency_Controller::get_max() const {
+    return max_window;
+}
+
+void Concurrency_Controller::get_latencies(unsigned long long &mean_usec, unsigned long long &baseline) {
+    pthread_mutex_lock(&lock);
+    mean_usec = last_mean_usec;
+    baseline = baseline_usec;
+    pthread_mutex_unlock(&lock);
+}
+
+void Concurrency_Controller::get_adjustments(unsigned long long &num_increases, unsigned long long &num_decreases) {
+    pthread_mutex_lock(&lock);
+    num_increases = increases;
+    num_decreases = decreases;
+    pthread_mutex_unlock(&lock);
+}
+
+void Concurrency_Controller::end_epoch() {
+    unsigned long long mean_usec = (epoch_samples > 0) ? epoch_usec / epoch_samples : 0;
+    if ( epoch_errors > 0 ){                     // multiplicative decrease: the server is failing
+        slow_start = false;
+        set_window((unsigned int) (window * CONCURRENCY_ERROR_BACKOFF));
+    } else if ( baseline_usec > 0 && mean_usec > baseline_usec * CONCURRENCY_TOLERANCE + CONCURRENCY_SLACK_USEC ){     // multiplicative decrease: requests are queueing up at the server
+        slow_start = false;
+        set_window((unsigned int) (window * CONCURRENCY_LATENCY_BACKOFF));
+    } else {                                     // additive increase (or doubling, until the first decrease)
+        set_window((slow_start) ? 2 * window : window + 1);
+    }
+    if ( epoch_samples > 0 ){
+        if ( baseline_usec == 0 || mean_usec < baseline_usec ) baseline_usec = mean_usec;
+        else baseline_usec += (mean_usec - baseline_usec) / CONCURRENCY_BASELINE_DRIFT;     // (so that a server that got slower for good is not backed off from forever)
+        last_mean_usec = mean_usec;
+    }
+    epoch_samples = epoch_errors = 0;
+    epoch_usec = 0;
+}
+
+void Concurrency_Controller::set_window(unsigned int new_window) {
+    if ( new_window < min_window ) new_window = min_window;
+    if ( new_window > max_window ) new_window = max_window;
+    if ( new_window > window ){
+        increases++;
+        __atomic_store_n(&window, new_window, __ATOMIC_RELAXED);
+        if ( __atomic_load_n(&num_waiting, __ATOMIC_SEQ_CST) > 0 ) pthread_cond_broadcast(&allowed);
+    } else if ( new_window < window ){
+        decreases++;
+        __atomic_store_n(&window, new_window, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,445 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../headers/Crawl_Checkpoint.h"
+#include "../headers/crawl.h"
+
+
+using namespace std;
+
+
+#define SNAPSHOT_HEADER "crawl checkpoint v1"
+#define INITIAL_BUFFER_SIZE 65536
+
+// log records: one per line, "<type> <string>"
+#define RECORD_QUEUED_IN_HISTORY 'H'
+#define RECORD_QUEUED_IN_HISTORY_AS_IS 'F'
+#define RECORD_QUEUED 'Q'
+#define RECORD_DONE 'D'
+#define RECORD_DIR 'S'
+
+
+struct crawl_state {            // what a snapshot and the logs after it add up to
+    unsigned long long *history;             // hash_history hashes of the root-relative urls
+    unsigned int num_history, history_capacity;
+    char **dirs;
+    unsigned int num_dirs, dirs_capacity;
+    char **frontier;                         // every url queued, in order (including the ones that are done by now)
+    unsigned int num_frontier, frontier_capacity;
+    hash_history done;                       // (hashes of) the urls that are done
+    crawl_state();
+    ~crawl_state();
+};
+
+
+/* Local Functions */
+static void add_string(char **&table, unsigned int &count, unsigned int &capacity, const char *str, size_t len);
+static void add_hash(unsigned long long *&table, unsigned int &count, unsigned int &capacity, unsigned long long h);
+static bool read_snapshot(const char *path, crawl_state &state, unsigned int &next_log);
+static void read_log(const char *path, crawl_state &state);
+static bool write_snapshot(const char *path, const char *tmp_path, crawl_state &state, unsigned int next_log);
+static void sync_dir(const char *dir);
+
+
+Crawl_Checkpoint::Crawl_Checkpoint(const char *save_dir) : buffer_len(0), buffer_capacity(INITIAL_BUFFER_SIZE), spare_capacity(INITIAL_BUFFER_SIZE), must_stop(false),
+                                                           log_fd(-1), log_index(0), log_size(0), snapshot_next_log(0), syncer_started(false) {
+    dir = new char[strlen(save_dir) + strlen(CHECKPOINT_DIR) + 2];
+    sprintf(dir, "%s/%s", save_dir, CHECKPOINT_DIR);
+    buffer = new char[buffer_capacity];
+    spare = new char[spare_capacity];
+    if ( pthread_mutex_init(&lock, NULL) != 0 || pthread_cond_init(&flushNow, NULL) != 0 ){
+        cerr << "Warning: checkpoint lock initialization failed!" << endl;
+    }
+}
+
+Crawl_Checkpoint::~Crawl_Checkpoint() {
+    if ( syncer_started ){
+        pthread_mutex_lock(&lock);
+        must_stop = true;
+        pthread_cond_signal(&flushNow);
+        pthread_mutex_unlock(&lock);
+        if ( pthread_join(syncer, NULL) != 0 ){
+            cerr << "Warning: pthread_join on the checkpoint thread failed!" << endl;
+        }
+    }
+    if ( log_fd >= 0 && close(log_fd) < 0 ) perror("closing checkpoint log");
+    pthread_cond_destroy(&flushNow);
+    pthread_mutex_destroy(&lock);
+    delete[] buffer;
+    delete[] spare;
+    delete[] dir;
+}
+
+int Crawl_Checkpoint::resume(URL_Frontier *frontier, hash_history *history, str_history *dirs) {
+    char path[4096];
+    crawl_state state;
+    unsigned int next_log = 0;
+    path_of(path, sizeof(path), "snapshot", -1);
+    bool have_snapshot = read_snapshot(path, state, next_log);
+
+    // find the logs written after that snapshot (older ones are left over from a compaction that was interrupted: they are already in the snapshot)
+    int last_log = -1;
+    DIR *d = opendir(dir);
+    if ( d != NULL ){
+        struct dirent *entry;
+        while ( (entry = readdir(d)) != NULL ){
+            if ( strncmp(entry->d_name, "log.", 4) != 0 ) continue;
+            int index = atoi(entry->d_name + 4);
+            if ( (unsigned int) index < next_log ){
+                path_of(path, sizeof(path), "log", index);
+                unlink(path);
+            } else if ( index > last_log ) last_log = index;
+        }
+        closedir(d);
+    }
+    if ( !have_snapshot && last_log < 0 ) return -1;
+    for (int i = (int) next_log ; i <= last_log ; i++){
+        path_of(path, sizeof(path), "log", i);
+        read_log(path, state);
+    }
+
+    // rebuild the crawl's structures (no other threads exist yet)
+    for (unsigned int i = 0 ; i < state.num_history ; i++){
+        history->insert_hash_if_absent(state.history[i]);
+    }
+    for (unsigned int i = 0 ; i < state.num_dirs ; i++){
+        dirs->add(state.dirs[i]);
+    }
+    int num_pushed = 0;
+    for (unsigned int i = 0 ; i < state.num_frontier ; i++){
+        if ( state.done.contains(state.frontier[i]) ) continue;
+        frontier->push(state.frontier[i]);
+        num_pushed++;
+    }
+    snapshot_next_log = next_log;
+    log_index = (last_log >= 0) ? (unsigned int) last_log + 1 : next_log;       // (never append to a log that may end with a torn record)
+    return num_pushed;
+}
+
+bool Crawl_Checkpoint::start(bool fresh) {
+    if ( mkdir(dir, 0755) < 0 && errno != EEXIST ){
+        perror("mkdir checkpoint directory");
+        return false;
+    }
+    if ( fresh ){                                // throw away any previous crawl's checkpoint
+        DIR *d = opendir(dir);
+        if ( d != NULL ){
+            char path[4096];
+            struct dirent *entry;
+            while ( (entry = readdir(d)) != NULL ){
+                if ( strncmp(entry->d_name, "log.", 4) != 0 && strncmp(entry->d_name, "snapshot", 8) != 0 ) continue;
+                snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+                unlink(path);
+            }
+            closedir(d);
+        }
+        snapshot_next_log = 0;
+        log_index = 0;
+    }
+    if ( !open_log(log_index) ) return false;
+    if ( pthread_create(&syncer, NULL, sync_records, (void *) this) != 0 ){
+        cerr << "Warning: could not create the checkpoint thread, this crawl will not be resumable!" << endl;
+        return false;
+    }
+    syncer_started = true;
+    return true;
+}
+
+void Crawl_Checkpoint::queued(const char *url, int in_history) {
+    append(queued_record(in_history), url);
+}
+
+void Crawl_Checkpoint::queued_batch(const char *const *urls, const int *in_history, unsigned int num_of_urls) {
+    if ( !syncer_started || num_of_urls == 0 ) return;
+    pthread_mutex_lock(&lock);
+    for (unsigned int i = 0 ; i < num_of_urls ; i++){
+        if ( strchr(urls[i], '\n') == NULL ) append_locked(queued_record(in_history[i]), urls[i], strlen(urls[i]));
+    }
+    if ( buffer_len >= CHECKPOINT_BUFFER_LIMIT ) pthread_cond_signal(&flushNow);
+    pthread_mutex_unlock(&lock);
+}
+
+void Crawl_Checkpoint::done(const char *url) {
+    append(RECORD_DONE, url);
+}
+
+void Crawl_Checkpoint::new_dir(const char *dir) {
+    append(RECORD_DIR, dir);
+}
+
+
+void Crawl_Checkpoint::append(char type, const char *str) {
+    if ( !syncer_started ) return;               // (checkpoints are disabled: do not let records pile up in memory)
+    if ( strchr(str, '\n') != NULL ) return;    // (cannot be a valid url anyway, and would break the log's lines)
+    pthread_mutex_lock(&lock);
+    append_locked(type, str, strlen(str));
+    if ( buffer_len >= CHECKPOINT_BUFFER_LIMIT ) pthread_cond_signal(&flushNow);
+    pthread_mutex_unlock(&lock);
+}
+
+void Crawl_Checkpoint::append_locked(char type, const char *str, size_t len) {
+    if ( buffer_len + len + 3 > buffer_capacity ){
+        while ( buffer_len + len + 3 > buffer_capacity ) buffer_capacity *= 2;
+        char *temp = new char[buffer_capacity];
+        memcpy(temp, buffer, buffer_len);
+        delete[] buffer;
+        buffer = temp;
+    }
+    buffer[buffer_len++] = type;
+    buffer[buffer_len++] = ' ';
+    memcpy(buffer + buffer_len, str, len);
+    buffer_len += len;
+    buffer[buffer_len++] = '\n';
+}
+
+char Crawl_Checkpoint::queued_record(int in_history) {
+    return (in_history == IN_HISTORY_AS_IS) ? RECORD_QUEUED_IN_HISTORY_AS_IS : (in_history == IN_HISTORY) ? RECORD_QUEUED_IN_HISTORY : RECORD_QUEUED;
+}
+
+void *Crawl_Checkpoint::sync_records(void *checkpoint) {      // the checkpoint thread: the only one writing to the checkpoint's files
+    Crawl_Checkpoint &c = *((Crawl_Checkpoint *) checkpoint);
+    pthread_mutex_lock(&c.lock);
+    for (;;) {
+        if ( !c.must_stop && c.buffer_len < CHECKPOINT_BUFFER_LIMIT ){
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += CHECKPOINT_SYNC_INTERVAL;
+            pthread_cond_timedwait(&c.flushNow, &c.lock, &until);
+        }
+        // take the batch and let the crawler threads keep appending to the other buffer while it is written
+        char *batch = c.buffer;
+        size_t batch_len = c.buffer_len, batch_capacity = c.buffer_capacity;
+        c.buffer = c.spare;
+        c.buffer_capacity = c.spare_capacity;
+        c.buffer_len = 0;
+        c.spare = batch;
+        c.spare_capacity = batch_capacity;
+        bool stop = c.must_stop;
+        pthread_mutex_unlock(&c.lock);
+
+        if ( batch_len > 0 ){
+            size_t written = 0;
+            while ( written < batch_len ){
+                ssize_t n = write(c.log_fd, batch + written, batch_len - written);
+                if ( n < 0 ){
+                    if ( errno == EINTR ) continue;
+                    perror("write to checkpoint log");
+                    break;
+                }
+                written += n;
+            }
+            if ( fdatasync(c.log_fd) < 0 ) perror("fdatasync checkpoint log");
+            c.log_size += written;
+        }
+        if ( c.log_size >= CHECKPOINT_COMPACT_SIZE ){        // start a new log and merge the full one into the snapshot
+            unsigned int full_log = c.log_index;
+            if ( c.open_log(full_log + 1) ) c.compact(full_log + 1);
+        }
+        if ( stop ) break;                                   // (!) only after the last batch has been written
+        pthread_mutex_lock(&c.lock);
+    }
+    return NULL;
+}
+
+bool Crawl_Checkpoint::open_log(unsigned int index) {
+    char path[4096];
+    path_of(path, sizeof(path), "log", (int) index);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if ( fd < 0 ){
+        perror("open checkpoint log");
+        return false;
+    }
+    if ( log_fd >= 0 && close(log_fd) < 0 ) perror("closing checkpoint log");
+    log_fd = fd;
+    log_index = index;
+    log_size = 0;
+    sync_dir(dir);                               // make the new log's directory entry durable too
+    return true;
+}
+
+bool Crawl_Checkpoint::compact(unsigned int up_to_log) {
+    char path[4096], tmp_path[4096];
+    crawl_state state;
+    unsigned int next_log = 0;
+    path_of(path, sizeof(path), "snapshot", -1);
+    read_snapshot(path, state, next_log);
+    for (unsigned int i = snapshot_next_log ; i < up_to_log ; i++){
+        path_of(tmp_path, sizeof(tmp_path), "log", (int) i);
+        read_log(tmp_path, state);
+    }
+    path_of(tmp_path, sizeof(tmp_path), "snapshot.tmp", -1);
+    if ( !write_snapshot(path, tmp_path, state, up_to_log) ) return false;
+    sync_dir(dir);                               // the rename must be durable before the logs it replaces are deleted
+    for (unsigned int i = snapshot_next_log ; i < up_to_log ; i++){
+        path_of(tmp_path, sizeof(tmp_path), "log", (int) i);
+        unlink(tmp_path);
+    }
+    snapshot_next_log = up_to_log;
+    return true;
+}
+
+void Crawl_Checkpoint::path_of(char *path, size_t size, const char *name, int index) const {
+    if ( index < 0 ) snprintf(path, size, "%s/%s", dir, name);
+    else snprintf(path, size, "%s/%s.%d", dir, name, index);
+}
+
+
+/* Local Functions Implementation */
+crawl_state::crawl_state() : history(NULL), num_history(0), history_capacity(0), dirs(NULL), num_dirs(0), dirs_capacity(0),
+                             frontier(NULL), num_frontier(0), frontier_capacity(0) {}
+
+crawl_state::~crawl_state() {
+    for (unsigned int i = 0 ; i < num_dirs ; i++) delete[] dirs[i];
+    for (unsigned int i = 0 ; i < num_frontier ; i++) delete[] frontier[i];
+    delete[] history;
+    delete[] dirs;
+    delete[] frontier;
+}
+
+static void add_string(char **&table, unsigned int &count, unsigned int &capacity, const char *str, size_t len) {
+    if ( count == capacity ){
+        capacity = (capacity == 0) ? 1024 : 2 * capacity;
+        char **temp = new char*[capacity];
+        if ( count > 0 ) memcpy(temp, table, count * sizeof(char *));
+        delete[] table;
+        table = temp;
+    }
+    table[count] = new char[len + 1];
+    memcpy(table[count], str, len);
+    table[count][len] = '\0';
+    count++;
+}
+
+static void add_hash(unsigned long long *&table, unsigned int &count, unsigned int &capacity, unsigned long long h) {
+    if ( count == capacity ){
+        capacity = (capacity == 0) ? 1024 : 2 * capacity;
+        unsigned long long *temp = new unsigned long long[capacity];
+        if ( count > 0 ) memcpy(temp, table, count * sizeof(unsigned long long));
+        delete[] table;
+        table = temp;
+    }
+    table[count++] = h;
+}
+
+static bool read_snapshot(const char *path, crawl_state &state, unsigned int &next_log) {     // returns false if there is no (complete) snapshot
+    FILE *f = fopen(path, "r");
+    if ( f == NULL ) return false;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t len;
+    unsigned int count = 0;
+    bool complete = false;
+    if ( (len = getline(&line, &line_capacity, f)) > 0 && strncmp(line, SNAPSHOT_HEADER, strlen(SNAPSHOT_HEADER)) == 0
+         && getline(&line, &line_capacity, f) > 0 && sscanf(line, "next_log %u", &next_log) == 1 ){
+        // sections: "history <count>" then <count> hex hashes, "dirs <count>" then <count> lines, "frontier <count>" then <count> urls, and "end"
+        if ( getline(&line, &line_capacity, f) > 0 && sscanf(line, "history %u", &count) == 1 ){
+            for (unsigned int i = 0 ; i < count && getline(&line, &line_capacity, f) > 0 ; i++){
+                add_hash(state.history, state.num_history, state.history_capacity, strtoull(line, NULL, 16));
+            }
+        }
+        if ( getline(&line, &line_capacity, f) > 0 && sscanf(line, "dirs %u", &count) == 1 ){
+            for (unsigned int i = 0 ; i < count && (len = getline(&line, &line_capacity, f)) > 0 ; i++){
+                add_string(state.dirs, state.num_dirs, state.dirs_capacity, line, len - 1);
+            }
+        }
+        if ( getline(&line, &line_capacity, f) > 0 && sscanf(line, "frontier %u", &count) == 1 ){
+            for (unsigned int i = 0 ; i < count && (len = getline(&line, &line_capacity, f)) > 0 ; i++){
+                add_string(state.frontier, state.num_frontier, state.frontier_capacity, line, len - 1);
+            }
+        }
+        complete = ( getline(&line, &line_capacity, f) > 0 && strcmp(line, "end\n") == 0 );
+    }
+    if ( !complete ) cerr << "Warning: checkpoint snapshot " << path << " is corrupted, ignoring it" << endl;
+    free(line);
+    fclose(f);
+    return complete;
+}
+
+static void read_log(const char *path, crawl_state &state) {
+    FILE *f = fopen(path, "r");
+    if ( f == NULL ) return;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t len;
+    while ( (len = getline(&line, &line_capacity, f)) > 0 ){
+        if ( line[len - 1] != '\n' || len < 3 || line[1] != ' ' ) break;     // a torn record at the end of the log (the crawler died while writing it)
+        line[--len] = '\0';
+        char *str = line + 2;
+        switch ( line[0] ){
+            case RECORD_QUEUED_IN_HISTORY: {
+                char *root_relative_url;
+                findRootRelativeUrl(str, root_relative_url);
+                add_hash(state.history, state.num_history, state.history_capacity, hash_history::hash((root_relative_url != NULL) ? root_relative_url : str));
+                add_string(state.frontier, state.num_frontier, state.frontier_capacity, str, len - 2);
+                break;
+            }
+            case RECORD_QUEUED_IN_HISTORY_AS_IS:
+                add_hash(state.history, state.num_history, state.history_capacity, hash_history::hash(str));
+                add_string(state.frontier, state.num_frontier, state.frontier_capacity, str, len - 2);
+                break;
+            case RECORD_QUEUED:
+                add_string(state.frontier, state.num_frontier, state.frontier_capacity, str, len - 2);
+                break;
+            case RECORD_DONE:
+                state.done.add(str);
+                break;
+            case RECORD_DIR:
+                add_string(state.dirs, state.num_dirs, state.dirs_capacity, str, len - 2);
+                break;
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+static bool write_snapshot(const char *path, const char *tmp_path, crawl_state &state, unsigned int next_log) {
+    FILE *f = fopen(tmp_path, "w");
+    if ( f == NULL ){
+        perror("fopen checkpoint snapshot");
+        return false;
+    }
+    fprintf(f, "%s\nnext_log %u\nhistory %u\n", SNAPSHOT_HEADER, next_log, state.num_history);
+    for (unsigned int i = 0 ; i < state.num_history ; i++){
+        fprintf(f, "%016llx\n", state.history[i]);
+    }
+    fprintf(f, "dirs %u\n", state.num_dirs);
+    for (unsigned int i = 0 ; i < state.num_dirs ; i++){
+        fprintf(f, "%s\n", state.dirs[i]);
+    }
+    unsigned int num_pending = 0;                // only the urls that are not done are kept
+    for (unsigned int i = 0 ; i < state.num_frontier ; i++){
+        if ( !state.done.contains(state.frontier[i]) ) num_pending++;
+    }
+    fprintf(f, "frontier %u\n", num_pending);
+    for (unsigned int i = 0 ; i < state.num_frontier ; i++){
+        if ( !state.done.contains(state.frontier[i]) ) fprintf(f, "%s\n", state.frontier[i]);
+    }
+    fprintf(f, "end\n");
+    bool ok = ( fflush(f) == 0 && fsync(fileno(f)) == 0 );
+    if ( fclose(f) != 0 ) ok = false;
+    if ( !ok ){
+        perror("writing checkpoint snapshot");
+        unlink(tmp_path);
+        return false;
+    }
+    if ( rename(tmp_path, path) < 0 ){           // atomically replace the old snapshot
+        perror("rename checkpoint snapshot");
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+static void sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if ( fd < 0 ) return;
+    if ( fsync(fd) < 0 ) perror("fsync checkpoint directory");
+    close(fd);
+}
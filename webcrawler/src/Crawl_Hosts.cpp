@@ -0,0 +1,159 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <fnmatch.h>
+#include "../headers/Crawl_Hosts.h"
+
+
+using namespace std;
+
+
+Crawl_Hosts::Crawl_Hosts(const char *server_name, const struct sockaddr_in &server_sa, unsigned int max_connections_per_host)
+        : num_hosts(0), allowed(NULL), num_allowed(0), max_connections(max_connections_per_host), num_deferred(0), next(0) {
+    if ( pthread_mutex_init(&lock, NULL) != 0 ){
+        cerr << "Warning: hosts lock initialization failed!" << endl;
+    }
+    crawl_host *server = add(server_name, server_sa);
+    server->dir[0] = '\0';                       // (the crawled server's sites are saved directly in save_dir, as always)
+}
+
+Crawl_Hosts::~Crawl_Hosts() {
+    for (unsigned int i = 0 ; i < num_hosts ; i++){
+        delete[] hosts[i]->name;
+        delete hosts[i]->deferred;
+        delete hosts[i];
+    }
+    for (unsigned int i = 0 ; i < num_allowed ; i++){
+        delete[] allowed[i];
+    }
+    delete[] allowed;
+    pthread_mutex_destroy(&lock);
+}
+
+void Crawl_Hosts::allow(const char *pattern) {
+    char **new_allowed = new char*[num_allowed + 1];
+    for (unsigned int i = 0 ; i < num_allowed ; i++){
+        new_allowed[i] = allowed[i];
+    }
+    delete[] allowed;
+    allowed = new_allowed;
+    bool has_port = ( strchr(pattern, ':') != NULL );
+    allowed[num_allowed] = new char[strlen(pattern) + 3];
+    sprintf(allowed[num_allowed], (has_port) ? "%s" : "%s:*", pattern);
+    num_allowed++;
+}
+
+bool Crawl_Hosts::is_allowed(const char *name, unsigned short port) const {
+    if ( num_allowed == 0 ) return false;
+    char host_port[HOST_DIR_SIZE];
+    if ( snprintf(host_port, sizeof(host_port), "%s:%hu", name, port) >= (int) sizeof(host_port) ) return false;
+    for (unsigned int i = 0 ; i < num_allowed ; i++){
+        if ( fnmatch(allowed[i], host_port, 0) == 0 ) return true;
+    }
+    return false;
+}
+
+crawl_host *Crawl_Hosts::server() const {
+    return hosts[0];
+}
+
+crawl_host *Crawl_Hosts::get(const char *name, const struct sockaddr_in &sa) {
+    unsigned int n = __atomic_load_n(&num_hosts, __ATOMIC_ACQUIRE);
+    for (unsigned int i = 0 ; i < n ; i++){
+        if ( hosts[i]->sa.sin_addr.s_addr == sa.sin_addr.s_addr && hosts[i]->sa.sin_port == sa.sin_port ) return hosts[i];
+    }
+    pthread_mutex_lock(&lock);
+    crawl_host *host = NULL;
+    for (unsigned int i = 0 ; i < num_hosts && host == NULL ; i++){      // (it may have been added since we looked)
+        if ( hosts[i]->sa.sin_addr.s_addr == sa.sin_addr.s_addr && hosts[i]->sa.sin_port == sa.sin_port ) host = hosts[i];
+    }
+    if ( host == NULL && num_hosts < MAX_HOSTS ){
+        host = add(name, sa);
+        cout << "Crawling a new host: " << name << ":" << host->port << " (its pages are saved in " << host->dir + 1 << ")" << endl;
+    } else if ( host == NULL ) cerr << "Warning: already crawling " << MAX_HOSTS << " hosts, ignoring host " << name << endl;
+    pthread_mutex_unlock(&lock);
+    return host;
+}
+
+bool Crawl_Hosts::acquire(crawl_host *host) {
+    if ( max_connections == 0 ){
+        __sync_fetch_and_add(&host->connections, 1);
+        return true;
+    }
+    unsigned int c = __atomic_load_n(&host->connections, __ATOMIC_RELAXED);
+    do {
+        if ( c >= max_connections ) return false;
+    } while ( !__atomic_compare_exchange_n(&host->connections, &c, c + 1, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) );
+    return true;
+}
+
+bool Crawl_Hosts::release(crawl_host *host) {
+    __sync_fetch_and_sub(&host->connections, 1);         // (a full barrier: a thread that parks after this sees the free connection, see crawl())
+    return !host->deferred->looks_empty();
+}
+
+void Crawl_Hosts::defer(crawl_host *host, const char *url) {
+    host->deferred->acquire();
+    host->deferred->push(url);
+    host->deferred->release();
+    __sync_fetch_and_add(&num_deferred, 1);
+}
+
+bool Crawl_Hosts::pop_deferred(char *url, size_t url_size, crawl_host *&host) {
+    if ( __atomic_load_n(&num_deferred, __ATOMIC_RELAXED) == 0 ) return false;
+    unsigned int n = __atomic_load_n(&num_hosts, __ATOMIC_ACQUIRE);
+    unsigned int start = __sync_fetch_and_add(&next, 1);
+    for (unsigned int i = 0 ; i < n ; i++){
+        crawl_host *h = hosts[(start + i) % n];
+        if ( h->deferred->looks_empty() || !acquire(h) ) continue;
+        h->deferred->acquire();
+        bool popped = h->deferred->pop(url, url_size);
+        h->deferred->release();
+        if ( popped ){
+            __sync_fetch_and_sub(&num_deferred, 1);
+            host = h;
+            return true;
+        }
+        release(h);                              // (another thread got there first)
+    }
+    return false;
+}
+
+bool Crawl_Hosts::has_ready() const {
+    if ( __atomic_load_n(&num_deferred, __ATOMIC_RELAXED) == 0 ) return false;
+    unsigned int n = __atomic_load_n(&num_hosts, __ATOMIC_ACQUIRE);
+    for (unsigned int i = 0 ; i < n ; i++){
+        if ( !hosts[i]->deferred->looks_empty() && (max_connections == 0 || __atomic_load_n(&hosts[i]->connections, __ATOMIC_RELAXED) < max_connections) ) return true;
+    }
+    return false;
+}
+
+unsigned int Crawl_Hosts::deferred() const {
+    return __atomic_load_n(&num_deferred, __ATOMIC_RELAXED);
+}
+
+unsigned int Crawl_Hosts::size() const {
+    return __atomic_load_n(&num_hosts, __ATOMIC_ACQUIRE);
+}
+
+const crawl_host *Crawl_Hosts::host(unsigned int i) const {
+    return hosts[i];
+}
+
+unsigned int Crawl_Hosts::get_max_connections() const {
+    return max_connections;
+}
+
+crawl_host *Crawl_Hosts::add(const char *name, const struct sockaddr_in &sa) {     // lock MUST be held (unless no thread runs yet)
+    crawl_host *host = new crawl_host;
+    host->name = new char[strlen(name) + 1];
+    strcpy(host->name, name);
+    host->sa = sa;
+    host->port = ntohs(sa.sin_port);
+    snprintf(host->dir, sizeof(host->dir), "/%s_%hu", name, host->port);
+    host->connections = 0;
+    host->deferred = new URL_Frontier();
+    hosts[num_hosts] = host;
+    __atomic_store_n(&num_hosts, num_hosts + 1, __ATOMIC_RELEASE);
+    return host;
+}
@@ -0,0 +1,221 @@
+#include <iostream>
+#include <cstring>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "../headers/DNS_Cache.h"
+
+
+using namespace std;
+
+
+#define NEVER_EXPIRES ((time_t) -1)
+#define HAS_EXPIRED(e, now) ( (e)->expires != NEVER_EXPIRES && (now) >= (e)->expires )
+
+
+DNS_Cache::DNS_Cache() : requests_head(NULL), requests_tail(NULL), num_waiting(0), must_stop(false), resolver_started(false) {
+    for (int i = 0 ; i < DNS_CACHE_BUCKETS ; i++){
+        buckets[i] = NULL;
+    }
+    if ( pthread_rwlock_init(&rwlock, NULL) != 0 || pthread_mutex_init(&requests_lock, NULL) != 0 || pthread_cond_init(&hasRequests, NULL) != 0 ){
+        cerr << "Warning: DNS cache lock initialization failed!" << endl;
+    }
+    if ( pthread_create(&resolver, NULL, resolve_hosts, (void *) this) != 0 ){
+        cerr << "Warning: could not create the DNS resolver thread, hosts that are not already known will not be resolved!" << endl;
+    } else resolver_started = true;
+}
+
+DNS_Cache::~DNS_Cache() {
+    pthread_mutex_lock(&requests_lock);
+    must_stop = true;
+    pthread_cond_signal(&hasRequests);
+    pthread_mutex_unlock(&requests_lock);
+    if ( resolver_started && pthread_join(resolver, NULL) != 0 ){
+        cerr << "Warning: pthread_join on the DNS resolver thread failed!" << endl;
+    }
+    for (int i = 0 ; i < DNS_CACHE_BUCKETS ; i++){
+        while ( buckets[i] != NULL ){
+            entry *e = buckets[i];
+            buckets[i] = e->next;
+            while ( e->waiters != NULL ){
+                waiter *w = e->waiters;
+                e->waiters = w->next;
+                delete[] w->url;
+                delete w;
+            }
+            delete[] e->host;
+            delete e;
+        }
+    }
+    pthread_cond_destroy(&hasRequests);
+    pthread_mutex_destroy(&requests_lock);
+    pthread_rwlock_destroy(&rwlock);
+}
+
+void DNS_Cache::add(const char *host, struct in_addr addr) {
+    pthread_rwlock_wrlock(&rwlock);
+    entry *e = find(host);
+    if ( e == NULL ) e = insert(host);
+    e->addr = addr;
+    e->status = DNS_RESOLVED;
+    e->expires = NEVER_EXPIRES;
+    pthread_rwlock_unlock(&rwlock);
+}
+
+int DNS_Cache::lookup(const char *host, struct in_addr &addr, const char *url, dns_callback callback, void *arg) {
+    if ( inet_aton(host, &addr) == 1 ) return DNS_RESOLVED;     // host is an IP: nothing to resolve
+    time_t now = time(NULL);
+
+    // the common case (a known host) only needs the read lock, so lookups from different threads do not serialize
+    pthread_rwlock_rdlock(&rwlock);
+    entry *e = find(host);
+    if ( e != NULL ){
+        if ( e->status == DNS_RESOLVED && (!HAS_EXPIRED(e, now) || e->queued) ){     // (an expired address that is already being refreshed is still returned)
+            addr = e->addr;
+            pthread_rwlock_unlock(&rwlock);
+            return DNS_RESOLVED;
+        }
+        if ( e->status == DNS_FAILED && !HAS_EXPIRED(e, now) ){                      // negative caching
+            pthread_rwlock_unlock(&rwlock);
+            return DNS_FAILED;
+        }
+    }
+    pthread_rwlock_unlock(&rwlock);
+
+    // else the resolver thread has to be involved: re-check everything with the write lock (another thread may have done this in between)
+    pthread_rwlock_wrlock(&rwlock);
+    e = find(host);
+    if ( e == NULL ) e = insert(host);
+    int result = DNS_PENDING;
+    if ( e->status == DNS_RESOLVED ){                    // stale-while-revalidate: keep using the old address until the new one arrives
+        addr = e->addr;
+        if ( HAS_EXPIRED(e, now) && !e->queued ) request(e);
+        result = DNS_RESOLVED;
+    } else if ( e->status == DNS_FAILED && !HAS_EXPIRED(e, now) ){
+        result = DNS_FAILED;
+    } else {                                             // never resolved or failed long ago: url has to wait for the resolver
+        if ( !e->queued ) request(e);
+        if ( callback != NULL ){
+            waiter *w = new waiter;
+            w->url = new char[strlen(url) + 1];
+            strcpy(w->url, url);
+            w->callback = callback;
+            w->arg = arg;
+            w->next = e->waiters;
+            e->waiters = w;
+            num_waiting++;
+        }
+    }
+    pthread_rwlock_unlock(&rwlock);
+    return result;
+}
+
+unsigned int DNS_Cache::waiting() {
+    pthread_rwlock_rdlock(&rwlock);
+    unsigned int result = num_waiting;
+    pthread_rwlock_unlock(&rwlock);
+    return result;
+}
+
+void *DNS_Cache::resolve_hosts(void *cache) {         // the resolver thread: the only one that ever calls getaddrinfo
+    DNS_Cache &c = *((DNS_Cache *) cache);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;                           // (the crawler only speaks IPv4)
+    hints.ai_socktype = SOCK_STREAM;
+    for (;;) {
+        pthread_mutex_lock(&c.requests_lock);
+        while ( c.requests_head == NULL && !c.must_stop ){
+            pthread_cond_wait(&c.hasRequests, &c.requests_lock);
+        }
+        if ( c.must_stop ){
+            pthread_mutex_unlock(&c.requests_lock);
+            break;
+        }
+        entry *e = c.requests_head;                      // (entries are never deleted before this thread is joined)
+        c.requests_head = e->next_request;
+        if ( c.requests_head == NULL ) c.requests_tail = NULL;
+        pthread_mutex_unlock(&c.requests_lock);
+
+        struct addrinfo *result = NULL;
+        unsigned long long started = monotonic_usec();
+        int ret_val = getaddrinfo(e->host, NULL, &hints, &result);      // (blocking, but no one is waiting on us)
+        c.lookup_times.add(monotonic_usec() - started);
+
+        pthread_rwlock_wrlock(&c.rwlock);
+        if ( ret_val == 0 && result != NULL ){
+            e->addr = ((struct sockaddr_in *) result->ai_addr)->sin_addr;      // arbitrarily pick the first address
+            e->status = DNS_RESOLVED;
+            e->expires = time(NULL) + DNS_POSITIVE_TTL;
+        } else {                                         // a host that was resolved before keeps its old address until the next try
+            if ( e->status != DNS_RESOLVED ) e->status = DNS_FAILED;
+            e->expires = time(NULL) + DNS_NEGATIVE_TTL;
+            cerr << "Warning: could not resolve host " << e->host << ": " << gai_strerror(ret_val) << endl;
+        }
+        if ( result != NULL ) freeaddrinfo(result);
+        e->queued = false;
+        bool resolved = (e->status == DNS_RESOLVED);
+        waiter *waiters = e->waiters;
+        e->waiters = NULL;
+        pthread_rwlock_unlock(&c.rwlock);
+
+        // give the waiting urls back without holding any locks (callbacks are free to call lookup() again)
+        unsigned int num_given_back = 0;
+        while ( waiters != NULL ){
+            waiter *w = waiters;
+            waiters = w->next;
+            w->callback(w->url, resolved, w->arg);
+            delete[] w->url;
+            delete w;
+            num_given_back++;
+        }
+        if ( num_given_back > 0 ){
+            pthread_rwlock_wrlock(&c.rwlock);
+            c.num_waiting -= num_given_back;
+            pthread_rwlock_unlock(&c.rwlock);
+        }
+    }
+    return NULL;
+}
+
+DNS_Cache::entry *DNS_Cache::find(const char *host) const {
+    for (entry *e = buckets[hash(host)] ; e != NULL ; e = e->next){
+        if ( strcmp(e->host, host) == 0 ) return e;
+    }
+    return NULL;
+}
+
+DNS_Cache::entry *DNS_Cache::insert(const char *host) {    // a new entry that has not been resolved yet
+    entry *e = new entry;
+    e->host = new char[strlen(host) + 1];
+    strcpy(e->host, host);
+    e->status = DNS_PENDING;
+    e->expires = 0;
+    e->queued = false;
+    e->waiters = NULL;
+    e->next_request = NULL;
+    unsigned int b = hash(host);
+    e->next = buckets[b];
+    buckets[b] = e;
+    return e;
+}
+
+void DNS_Cache::request(entry *e) {
+    e->queued = true;
+    e->next_request = NULL;
+    pthread_mutex_lock(&requests_lock);
+    if ( requests_tail == NULL ) requests_head = e;
+    else requests_tail->next_request = e;
+    requests_tail = e;
+    pthread_cond_signal(&hasRequests);
+    pthread_mutex_unlock(&requests_lock);
+}
+
+unsigned int DNS_Cache::hash(const char *host) {
+    unsigned int h = 2166136261u;
+    for ( ; *host != '\0' ; host++){
+        h ^= (unsigned char) *host;
+        h *= 16777619u;
+    }
+    return h % DNS_CACHE_BUCKETS;
+}
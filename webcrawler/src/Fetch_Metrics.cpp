@@ -0,0 +1,114 @@
+#include <cstring>
+#include <time.h>
+#include "../headers/Fetch_Metrics.h"
+
+
+using namespace std;
+
+
+static const char *phase_names[NUM_PHASES] = { "dns", "connect", "first_byte", "transfer", "disk_write", "link_parse" };
+
+
+unsigned long long monotonic_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000ULL + (unsigned long long) ts.tv_nsec / 1000;
+}
+
+
+Latency_Histogram::Latency_Histogram() : total_usec(0), num_samples(0) {
+    for (int b = 0 ; b < METRICS_BUCKETS ; b++){
+        counts[b] = 0;
+    }
+}
+
+void Latency_Histogram::add(unsigned long long usec) {
+    int b = 63 - __builtin_clzll(usec + 1);      // floor(log2(usec + 1))
+    if ( b >= METRICS_BUCKETS ) b = METRICS_BUCKETS - 1;
+    // (only this thread writes them, so a load and a store are enough: readers just must not see torn values)
+    __atomic_store_n(&counts[b], __atomic_load_n(&counts[b], __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&total_usec, __atomic_load_n(&total_usec, __ATOMIC_RELAXED) + usec, __ATOMIC_RELAXED);
+    __atomic_store_n(&num_samples, __atomic_load_n(&num_samples, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+void Latency_Histogram::add_to(unsigned long long *merged_counts, unsigned long long &merged_usec, unsigned long long &merged_samples) const {
+    for (int b = 0 ; b < METRICS_BUCKETS ; b++){
+        merged_counts[b] += __atomic_load_n(&counts[b], __ATOMIC_RELAXED);
+    }
+    merged_usec += __atomic_load_n(&total_usec, __ATOMIC_RELAXED);
+    merged_samples += __atomic_load_n(&num_samples, __ATOMIC_RELAXED);
+}
+
+
+Fetch_Metrics::Fetch_Metrics(unsigned int num_of_threads) : num_threads(num_of_threads) {
+    threads = new thread_histograms[num_threads];
+    for (int p = 0 ; p < NUM_PHASES ; p++){
+        extra[p] = NULL;
+    }
+    for (int s = 0 ; s < METRICS_WINDOW ; s++){
+        window[s] = 0;
+    }
+}
+
+Fetch_Metrics::~Fetch_Metrics() {
+    delete[] threads;
+}
+
+Latency_Histogram *Fetch_Metrics::histograms_of(unsigned int thread) {
+    return threads[thread].phases;
+}
+
+void Fetch_Metrics::attach(int phase, const Latency_Histogram *histogram) {
+    extra[phase] = histogram;
+}
+
+void Fetch_Metrics::page_saved(time_t now) {
+    unsigned long long *slot = &window[now % METRICS_WINDOW];
+    unsigned long long second = (unsigned long long) now & 0xFFFFFFFFULL;
+    unsigned long long old = __atomic_load_n(slot, __ATOMIC_RELAXED), updated;
+    do {                                         // the first page of a second also clears what the slot counted METRICS_WINDOW seconds ago
+        updated = ( (old >> 32) == second ) ? old + 1 : (second << 32) | 1;
+    } while ( !__atomic_compare_exchange_n(slot, &old, updated, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
+
+double Fetch_Metrics::pages_per_second(unsigned int seconds, time_t now) const {
+    if ( seconds == 0 || seconds >= METRICS_WINDOW ) return 0.0;
+    unsigned long long pages = 0;
+    for (unsigned int i = 1 ; i <= seconds ; i++){           // (the current second is not over yet)
+        time_t t = now - (time_t) i;
+        unsigned long long s = __atomic_load_n(&window[t % METRICS_WINDOW], __ATOMIC_RELAXED);
+        if ( (s >> 32) == ((unsigned long long) t & 0xFFFFFFFFULL) ) pages += s & 0xFFFFFFFFULL;
+    }
+    return (double) pages / seconds;
+}
+
+void Fetch_Metrics::summarize(int phase, phase_summary &summary) const {
+    unsigned long long total_usec = 0;
+    summary.samples = 0;
+    memset(summary.counts, 0, sizeof(summary.counts));
+    for (unsigned int t = 0 ; t < num_threads ; t++){
+        threads[t].phases[phase].add_to(summary.counts, total_usec, summary.samples);
+    }
+    if ( extra[phase] != NULL ) extra[phase]->add_to(summary.counts, total_usec, summary.samples);
+    summary.mean_usec = (summary.samples > 0) ? total_usec / summary.samples : 0;
+    // (the counts are read one by one while they may still be growing, so they are summed up again instead of trusting samples)
+    unsigned long long in_buckets = 0;
+    for (int b = 0 ; b < METRICS_BUCKETS ; b++){
+        in_buckets += summary.counts[b];
+    }
+    unsigned long long *percentiles[3] = { &summary.p50_usec, &summary.p90_usec, &summary.p99_usec };
+    const unsigned int per_mille[3] = { 500, 900, 990 };
+    for (int i = 0 ; i < 3 ; i++){
+        unsigned long long rank = (in_buckets * per_mille[i] + 999) / 1000, seen = 0;
+        int b = 0;
+        while ( b < METRICS_BUCKETS - 1 && seen + summary.counts[b] < rank ){
+            seen += summary.counts[b];
+            b++;
+        }
+        *percentiles[i] = (in_buckets > 0) ? (1ULL << (b + 1)) - 1 : 0;
+    }
+}
+
+const char *Fetch_Metrics::phase_name(int phase) {
+    return (phase >= 0 && phase < NUM_PHASES) ? phase_names[phase] : "unknown";
+}
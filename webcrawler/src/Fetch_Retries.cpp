@@ -0,0 +1,82 @@
+#include <iostream>
+#include <cstring>
+#include "../headers/Fetch_Retries.h"
+#include "../headers/Page_Validators.h"
+
+
+using namespace std;
+
+
+Fetch_Retries::Fetch_Retries() : capacity(RETRIES_INITIAL_CAPACITY), num_urls(0), retried(0), given_up(0) {
+    hashes = new unsigned long long[capacity];
+    timeouts = new unsigned int[capacity];
+    memset(hashes, 0, capacity * sizeof(unsigned long long));
+    if ( pthread_mutex_init(&lock, NULL) != 0 ){
+        cerr << "Warning: pthread_mutex_init failed!" << endl;
+    }
+}
+
+Fetch_Retries::~Fetch_Retries() {
+    delete[] hashes;
+    delete[] timeouts;
+    pthread_mutex_destroy(&lock);
+}
+
+bool Fetch_Retries::retry(const char *url, unsigned int &attempt) {
+    unsigned long long hash = Page_Validators::hash(url, strlen(url));
+    if ( hash == 0 ) hash = 1;                   // (0 marks an empty place)
+    pthread_mutex_lock(&lock);
+    unsigned int i = find(hash);
+    if ( hashes[i] == 0 ){
+        if ( 2 * (num_urls + 1) > capacity ){
+            grow();
+            i = find(hash);
+        }
+        hashes[i] = hash;
+        timeouts[i] = 0;
+        num_urls++;
+    }
+    attempt = ++timeouts[i];
+    bool again = ( attempt <= FETCH_MAX_RETRIES );
+    if (again) retried++;
+    else given_up++;
+    pthread_mutex_unlock(&lock);
+    return again;
+}
+
+unsigned long long Fetch_Retries::get_retried() {
+    pthread_mutex_lock(&lock);
+    unsigned long long n = retried;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+unsigned long long Fetch_Retries::get_given_up() {
+    pthread_mutex_lock(&lock);
+    unsigned long long n = given_up;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+unsigned int Fetch_Retries::find(unsigned long long hash) const {
+    unsigned int i = (unsigned int) (hash & (capacity - 1));        // (capacity is a power of 2)
+    while ( hashes[i] != 0 && hashes[i] != hash ) i = (i + 1) & (capacity - 1);
+    return i;
+}
+
+void Fetch_Retries::grow() {
+    unsigned long long *old_hashes = hashes;
+    unsigned int *old_timeouts = timeouts, old_capacity = capacity;
+    capacity *= 2;
+    hashes = new unsigned long long[capacity];
+    timeouts = new unsigned int[capacity];
+    memset(hashes, 0, capacity * sizeof(unsigned long long));
+    for (unsigned int j = 0 ; j < old_capacity ; j++){
+        if ( old_hashes[j] == 0 ) continue;
+        unsigned int i = find(old_hashes[j]);
+        hashes[i] = old_hashes[j];
+        timeouts[i] = old_timeouts[j];
+    }
+    delete[] old_hashes;
+    delete[] old_timeouts;
+}
@@ -0,0 +1,420 @@
+#include <iostream>
+#include <cstring>
+#include "../headers/Graph_Analytics.h"
+
+
+using namespace std;
+
+
+#define STEP_DEGREES 0
+#define STEP_TRIM 1
+#define STEP_EXPAND 2
+#define STEP_SPLIT 3
+#define STEP_TARJAN 4
+
+#define TRAVERSE_DEPTH 0                     // from the start page along the links, recording every page's depth
+#define TRAVERSE_FORWARD 1                   // from the pivot along the links, through the pages whose component is not known yet
+#define TRAVERSE_BACKWARD 2                  // the same against the links
+
+#define REACHED_FORWARD 1
+#define REACHED_BACKWARD 2                   // (so a page's part after the forward-backward search is 0, 1 or 2, and 3 for the pivot's component)
+
+
+struct analytics_job {
+    Graph_Analytics *analytics;
+    unsigned int thread;                     // (0 is the thread that called run)
+};
+
+
+/* Local Functions */
+unsigned int degree_bucket(unsigned long long degree);
+
+
+Graph_Analytics::Graph_Analytics(const Link_Graph &link_graph, unsigned int num_of_threads)
+        : graph(link_graph), num_pages(link_graph.get_num_pages()), num_threads((num_of_threads > 0) ? num_of_threads : 1), num_saved(0), num_orphans(0),
+          num_components(0), largest_component(0), num_single(0), level_sizes(NULL), num_levels(0), num_reached(0), depths(NULL), assigned(NULL), reached(NULL),
+          indices(NULL), lowlinks(NULL), on_stack(NULL), step(-1), next_block(0), level(0), direction(TRAVERSE_DEPTH), frontier(NULL), frontier_size(0), next(NULL), next_size(0) {
+    memset(&in_degrees, 0, sizeof(in_degrees));
+    memset(&out_degrees, 0, sizeof(out_degrees));
+    memset(part_pages, 0, sizeof(part_pages));
+    partials = new partial[num_threads];
+}
+
+Graph_Analytics::~Graph_Analytics() {
+    delete[] partials;
+    delete[] level_sizes;
+    delete[] depths;
+    delete[] assigned;
+    delete[] reached;
+    delete[] indices;
+    delete[] lowlinks;
+    delete[] on_stack;
+    delete[] frontier;
+    delete[] next;
+}
+
+void Graph_Analytics::analyze(unsigned int start_page) {
+    if ( num_pages == 0 ) return;
+    frontier = new unsigned int[num_pages];
+    next = new unsigned int[num_pages];
+    degrees();
+    if ( start_page < num_pages ) depths_from(start_page);
+    components();
+}
+
+const degree_summary &Graph_Analytics::get_in_degrees() const {
+    return in_degrees;
+}
+
+const degree_summary &Graph_Analytics::get_out_degrees() const {
+    return out_degrees;
+}
+
+unsigned int Graph_Analytics::get_num_pages() const {
+    return num_pages;
+}
+
+unsigned int Graph_Analytics::get_num_saved() const {
+    return num_saved;
+}
+
+unsigned int Graph_Analytics::get_num_orphans() const {
+    return num_orphans;
+}
+
+unsigned int Graph_Analytics::get_orphan(unsigned int i) const {
+    return orphans[i];
+}
+
+unsigned int Graph_Analytics::get_num_components() const {
+    return num_components;
+}
+
+unsigned int Graph_Analytics::get_largest_component() const {
+    return largest_component;
+}
+
+unsigned int Graph_Analytics::get_num_single() const {
+    return num_single;
+}
+
+unsigned int Graph_Analytics::get_num_levels() const {
+    return num_levels;
+}
+
+unsigned int Graph_Analytics::get_level_size(unsigned int depth) const {
+    return level_sizes[depth];
+}
+
+unsigned int Graph_Analytics::get_num_reached() const {
+    return num_reached;
+}
+
+void Graph_Analytics::degrees() {
+    run(STEP_DEGREES);
+    for (unsigned int t = 0 ; t < num_threads ; t++){
+        for (unsigned int b = 0 ; b < DEGREE_BUCKETS ; b++){
+            in_degrees.pages[b] += partials[t].in.pages[b];
+            out_degrees.pages[b] += partials[t].out.pages[b];
+        }
+        if ( partials[t].in.max > in_degrees.max ) in_degrees.max = partials[t].in.max;
+        if ( partials[t].out.max > out_degrees.max ) out_degrees.max = partials[t].out.max;
+        num_saved += partials[t].saved;
+        num_orphans += partials[t].orphans;
+    }
+    // (the first few are named: they are looked for again in order, which stops early unless there are very few)
+    const unsigned long long *in_offsets = graph.get_in_offsets();
+    for (unsigned int p = 0, n = 0 ; p < num_pages && n < num_orphans && n < MAX_ORPHANS_LISTED ; p++){
+        if ( in_offsets[p + 1] == in_offsets[p] ) orphans[n++] = p;
+    }
+}
+
+void Graph_Analytics::depths_from(unsigned int start_page) {
+    depths = new unsigned int[num_pages];
+    memset(depths, 0xFF, num_pages * sizeof(unsigned int));     // (UNREACHED)
+    depths[start_page] = 0;
+    traverse(TRAVERSE_DEPTH, start_page);
+    for (unsigned int d = 0 ; d < num_levels ; d++){
+        num_reached += level_sizes[d];
+    }
+}
+
+void Graph_Analytics::components() {
+    // 1. a page that no page left links to (or that links to no page left) is a component of its own, and taking it out may leave others like it
+    assigned = new unsigned char[num_pages];
+    memset(assigned, 0, num_pages);
+    unsigned int pivot = UNREACHED;
+    for (unsigned int pass = 0 ; pass < MAX_TRIM_PASSES ; pass++){
+        run(STEP_TRIM);
+        unsigned int trimmed = 0;
+        unsigned long long pivot_weight = 0;
+        pivot = UNREACHED;
+        for (unsigned int t = 0 ; t < num_threads ; t++){
+            trimmed += partials[t].trimmed;
+            if ( partials[t].pivot_weight > pivot_weight ){
+                pivot_weight = partials[t].pivot_weight;
+                pivot = partials[t].pivot;
+            }
+        }
+        num_components += trimmed;
+        num_single += trimmed;
+        if ( trimmed > 0 ) largest_component = 1;
+        if ( trimmed == 0 || pivot == UNREACHED ) break;
+    }
+    if ( pivot == UNREACHED ) return;        // (every page was taken out)
+
+    // 2. the pages both reachable from the pivot (the page left with the most links in times out) and reaching it are its component, most likely the largest one
+    reached = new unsigned char[num_pages];
+    memset(reached, 0, num_pages);
+    reached[pivot] = REACHED_FORWARD | REACHED_BACKWARD;
+    traverse(TRAVERSE_FORWARD, pivot);
+    traverse(TRAVERSE_BACKWARD, pivot);
+    run(STEP_SPLIT);
+    unsigned int pivot_pages = 0;
+    for (unsigned int t = 0 ; t < num_threads ; t++){
+        pivot_pages += partials[t].largest;
+        for (unsigned int part = 0 ; part < 3 ; part++){
+            part_pages[part] += partials[t].component_pages[part];
+        }
+    }
+    num_components++;
+    if ( pivot_pages == 1 ) num_single++;
+    if ( pivot_pages > largest_component ) largest_component = pivot_pages;
+
+    // 3. no component spans two of the parts left (reached only forward, only backward, or neither), so each of them is searched by its own thread
+    indices = new unsigned int[num_pages];
+    lowlinks = new unsigned int[num_pages];
+    on_stack = new unsigned char[num_pages];
+    memset(indices, 0, num_pages * sizeof(unsigned int));
+    memset(on_stack, 0, num_pages);
+    run(STEP_TARJAN);
+    for (unsigned int t = 0 ; t < num_threads ; t++){
+        num_components += partials[t].components;
+        num_single += partials[t].single;
+        if ( partials[t].largest > largest_component ) largest_component = partials[t].largest;
+    }
+}
+
+void Graph_Analytics::traverse(int traversal, unsigned int source) {
+    direction = traversal;
+    level = 0;
+    frontier[0] = source;
+    frontier_size = 1;
+    while ( frontier_size > 0 ){
+        if ( traversal == TRAVERSE_DEPTH ){
+            if ( num_levels % 64 == 0 ){     // (grown 64 levels at a time)
+                unsigned int *more = new unsigned int[num_levels + 64];
+                if ( num_levels > 0 ) memcpy(more, level_sizes, num_levels * sizeof(unsigned int));
+                delete[] level_sizes;
+                level_sizes = more;
+            }
+            level_sizes[num_levels++] = frontier_size;
+        }
+        next_size = 0;
+        if ( frontier_size < PARALLEL_FRONTIER_SIZE || num_threads == 1 ){
+            next_block = 0;
+            expand();
+        } else run(STEP_EXPAND);
+        unsigned int *previous = frontier;
+        frontier = next;
+        next = previous;
+        frontier_size = next_size;
+        level++;
+    }
+}
+
+bool Graph_Analytics::claim(unsigned int page) {
+    if ( direction == TRAVERSE_DEPTH ){
+        return __atomic_load_n(&depths[page], __ATOMIC_RELAXED) == UNREACHED && __sync_bool_compare_and_swap(&depths[page], UNREACHED, level + 1);
+    }
+    if ( __atomic_load_n(&assigned[page], __ATOMIC_RELAXED) ) return false;
+    unsigned char bit = (direction == TRAVERSE_FORWARD) ? REACHED_FORWARD : REACHED_BACKWARD;
+    return (__atomic_load_n(&reached[page], __ATOMIC_RELAXED) & bit) == 0 && (__sync_fetch_and_or(&reached[page], bit) & bit) == 0;
+}
+
+void Graph_Analytics::run(int new_step) {
+    step = new_step;
+    next_block = 0;
+    memset(partials, 0, num_threads * sizeof(partial));
+    analytics_job *jobs = new analytics_job[num_threads];
+    pthread_t *threads = new pthread_t[num_threads];
+    unsigned int created = 1;
+    for (unsigned int t = 1 ; t < num_threads ; t++){        // (if a thread cannot be created, the others take its share: the work is handed out as they ask for it)
+        jobs[created].analytics = this;
+        jobs[created].thread = created;
+        if ( pthread_create(&threads[created], NULL, step_thread, (void *) &jobs[created]) != 0 ){
+            cerr << "Warning: could not create a graph analytics thread" << endl;
+        } else created++;
+    }
+    run_step(0);
+    for (unsigned int t = 1 ; t < created ; t++){
+        pthread_join(threads[t], NULL);
+    }
+    delete[] jobs;
+    delete[] threads;
+}
+
+void Graph_Analytics::run_step(unsigned int thread) {
+    partial &p = partials[thread];
+    const unsigned int num_blocks = (num_pages + ANALYTICS_BLOCK_SIZE - 1) / ANALYTICS_BLOCK_SIZE;
+    switch (step){
+        case STEP_DEGREES:
+            for (unsigned int b ; (b = __sync_fetch_and_add(&next_block, 1)) < num_blocks ; ) degrees_of_block(b, p);
+            break;
+        case STEP_TRIM:
+            for (unsigned int b ; (b = __sync_fetch_and_add(&next_block, 1)) < num_blocks ; ) trim_block(b, p);
+            break;
+        case STEP_EXPAND:
+            expand();
+            break;
+        case STEP_SPLIT:
+            for (unsigned int b ; (b = __sync_fetch_and_add(&next_block, 1)) < num_blocks ; ) split_block(b, p);
+            break;
+        case STEP_TARJAN:
+            for (unsigned int part ; (part = __sync_fetch_and_add(&next_block, 1)) < 3 ; ) tarjan(part, p);
+            break;
+    }
+}
+
+void Graph_Analytics::degrees_of_block(unsigned int b, partial &p) {
+    const unsigned long long *in_offsets = graph.get_in_offsets(), *out_offsets = graph.get_out_offsets();
+    unsigned int end = (b + 1) * ANALYTICS_BLOCK_SIZE;
+    if ( end > num_pages ) end = num_pages;
+    for (unsigned int page = b * ANALYTICS_BLOCK_SIZE ; page < end ; page++){
+        unsigned int in = (unsigned int) (in_offsets[page + 1] - in_offsets[page]), out = (unsigned int) (out_offsets[page + 1] - out_offsets[page]);
+        p.in.pages[degree_bucket(in)]++;
+        p.out.pages[degree_bucket(out)]++;
+        if ( in > p.in.max ) p.in.max = in;
+        if ( out > p.out.max ) p.out.max = out;
+        if ( in == 0 ) p.orphans++;
+        if ( graph.is_saved(page) ) p.saved++;
+    }
+}
+
+void Graph_Analytics::trim_block(unsigned int b, partial &p) {
+    // (a page another thread takes out at the same time may still be seen as left: it is then taken out in the next pass)
+    const unsigned long long *in_offsets = graph.get_in_offsets(), *out_offsets = graph.get_out_offsets();
+    const unsigned int *in_links = graph.get_in_links(), *out_links = graph.get_out_links();
+    unsigned int end = (b + 1) * ANALYTICS_BLOCK_SIZE;
+    if ( end > num_pages ) end = num_pages;
+    for (unsigned int page = b * ANALYTICS_BLOCK_SIZE ; page < end ; page++){
+        if ( __atomic_load_n(&assigned[page], __ATOMIC_RELAXED) ) continue;
+        bool linked_to = false, links = false;
+        for (unsigned long long e = in_offsets[page] ; e < in_offsets[page + 1] && !linked_to ; e++){
+            linked_to = !__atomic_load_n(&assigned[in_links[e]], __ATOMIC_RELAXED);
+        }
+        for (unsigned long long e = out_offsets[page] ; e < out_offsets[page + 1] && linked_to && !links ; e++){
+            links = !__atomic_load_n(&assigned[out_links[e]], __ATOMIC_RELAXED);
+        }
+        if ( !linked_to || !links ){
+            __atomic_store_n(&assigned[page], 1, __ATOMIC_RELAXED);
+            p.trimmed++;
+            continue;
+        }
+        unsigned long long weight = (in_offsets[page + 1] - in_offsets[page]) * (out_offsets[page + 1] - out_offsets[page]);
+        if ( weight > p.pivot_weight ){
+            p.pivot_weight = weight;
+            p.pivot = page;
+        }
+    }
+}
+
+void Graph_Analytics::expand() {     // takes chunks of the frontier until there are none left, and appends the pages it reaches first to the next level
+    const unsigned long long *offsets = (direction == TRAVERSE_BACKWARD) ? graph.get_in_offsets() : graph.get_out_offsets();
+    const unsigned int *links = (direction == TRAVERSE_BACKWARD) ? graph.get_in_links() : graph.get_out_links();
+    const unsigned int num_chunks = (frontier_size + FRONTIER_CHUNK_SIZE - 1) / FRONTIER_CHUNK_SIZE;
+    unsigned int found[NEXT_BUFFER_SIZE];
+    unsigned int num_found = 0;
+    for (unsigned int c ; (c = __sync_fetch_and_add(&next_block, 1)) < num_chunks ; ){
+        unsigned int end = (c + 1) * FRONTIER_CHUNK_SIZE;
+        if ( end > frontier_size ) end = frontier_size;
+        for (unsigned int i = c * FRONTIER_CHUNK_SIZE ; i < end ; i++){
+            unsigned int page = frontier[i];
+            for (unsigned long long e = offsets[page] ; e < offsets[page + 1] ; e++){
+                if ( !claim(links[e]) ) continue;
+                found[num_found++] = links[e];
+                if ( num_found == NEXT_BUFFER_SIZE ){
+                    memcpy(next + __sync_fetch_and_add(&next_size, num_found), found, num_found * sizeof(unsigned int));
+                    num_found = 0;
+                }
+            }
+        }
+    }
+    if ( num_found > 0 ) memcpy(next + __sync_fetch_and_add(&next_size, num_found), found, num_found * sizeof(unsigned int));
+}
+
+void Graph_Analytics::split_block(unsigned int b, partial &p) {
+    unsigned int end = (b + 1) * ANALYTICS_BLOCK_SIZE;
+    if ( end > num_pages ) end = num_pages;
+    for (unsigned int page = b * ANALYTICS_BLOCK_SIZE ; page < end ; page++){
+        if ( assigned[page] ) continue;
+        if ( reached[page] == (REACHED_FORWARD | REACHED_BACKWARD) ){
+            assigned[page] = 1;
+            p.largest++;                     // (the pivot's component)
+        } else p.component_pages[reached[page]]++;
+    }
+}
+
+void Graph_Analytics::tarjan(unsigned int part, partial &p) {     // Tarjan's algorithm over the pages of part whose component is not known yet (without recursion: calls[] holds every page being visited and its next link)
+    const unsigned long long *out_offsets = graph.get_out_offsets();
+    const unsigned int *out_links = graph.get_out_links();
+    const unsigned int size = part_pages[part];
+    if ( size == 0 ) return;
+    unsigned int *stack = new unsigned int[size], *calls = new unsigned int[size];
+    unsigned long long *next_links = new unsigned long long[size];
+    unsigned int stack_size = 0, num_calls = 0, counter = 0;
+    for (unsigned int root = 0 ; root < num_pages ; root++){
+        if ( reached[root] != part || assigned[root] || indices[root] != 0 ) continue;
+        indices[root] = lowlinks[root] = ++counter;
+        stack[stack_size++] = root;
+        on_stack[root] = 1;
+        calls[0] = root;
+        next_links[0] = out_offsets[root];
+        num_calls = 1;
+        while ( num_calls > 0 ){
+            unsigned int page = calls[num_calls - 1];
+            if ( next_links[num_calls - 1] < out_offsets[page + 1] ){
+                unsigned int link = out_links[next_links[num_calls - 1]++];
+                if ( reached[link] != part || assigned[link] ) continue;     // (another part's pages are another thread's)
+                if ( indices[link] == 0 ){
+                    indices[link] = lowlinks[link] = ++counter;
+                    stack[stack_size++] = link;
+                    on_stack[link] = 1;
+                    calls[num_calls] = link;
+                    next_links[num_calls] = out_offsets[link];
+                    num_calls++;
+                } else if ( on_stack[link] && indices[link] < lowlinks[page] ) lowlinks[page] = indices[link];
+                continue;
+            }
+            num_calls--;
+            if ( num_calls > 0 && lowlinks[page] < lowlinks[calls[num_calls - 1]] ) lowlinks[calls[num_calls - 1]] = lowlinks[page];
+            if ( lowlinks[page] == indices[page] ){          // page is the root of a component: it is every page above it on the stack
+                unsigned int pages = 0, member;
+                do {
+                    member = stack[--stack_size];
+                    on_stack[member] = 0;
+                    assigned[member] = 1;
+                    pages++;
+                } while ( member != page );
+                p.components++;
+                if ( pages == 1 ) p.single++;
+                if ( pages > p.largest ) p.largest = pages;
+            }
+        }
+    }
+    delete[] stack;
+    delete[] calls;
+    delete[] next_links;
+}
+
+void *Graph_Analytics::step_thread(void *job) {
+    analytics_job *j = (analytics_job *) job;
+    j->analytics->run_step(j->thread);
+    return NULL;
+}
+
+
+/* Local Functions Implementation */
+unsigned int degree_bucket(unsigned long long degree) {
+    return (degree == 0) ? 0 : 64 - __builtin_clzll(degree);
+}
@@ -0,0 +1,327 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <unistd.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "../headers/HTTP_Connection.h"
+#include "../headers/Fetch_Metrics.h"
+
+
+using namespace std;
+
+
+/* connection states */
+#define CONN_CLOSED 0
+#define CONN_IDLE 1                          // open and kept alive, no request in progress
+#define CONN_CONNECTING 2
+#define CONN_SENDING 3
+#define CONN_HEADER 4
+#define CONN_BODY 5
+
+
+/* useful macros */
+#define CHECK_PERROR(call, callname, handle_code) { if ( ( call ) < 0 ) { perror(callname); handle_code } }
+
+
+HTTP_Connection::HTTP_Connection() : fd(-1), state(CONN_CLOSED), epoll_fd(-1), id(-1), watched_events(0), reused(false), keep_alive(false),
+                                     request_len(0), request_sent(0), header_len(0), leftover_len(0),
+                                     status(0), content_length(-1), body_received(0), deadline(0) {
+    memset(&server_sa, 0, sizeof(server_sa));
+    memset(&timings, 0, sizeof(timings));
+}
+
+HTTP_Connection::~HTTP_Connection() {
+    reset();
+}
+
+void HTTP_Connection::init(const struct sockaddr_in &sa, int epoll_instance, int epoll_id) {
+    server_sa = sa;
+    epoll_fd = epoll_instance;
+    id = epoll_id;
+}
+
+void HTTP_Connection::retarget(const struct sockaddr_in &sa) {
+    if ( sa.sin_addr.s_addr == server_sa.sin_addr.s_addr && sa.sin_port == server_sa.sin_port ) return;
+    reset();
+    server_sa = sa;
+}
+
+int HTTP_Connection::begin(const char *root_relative_url, const char *if_none_match, const char *if_modified_since) {
+    request_len = (size_t) snprintf(request, sizeof(request), "GET %s HTTP/1.1\nHost: mycrawler\nAccept-Language: en-us\nConnection: keep-alive\n", root_relative_url);
+    if ( request_len < sizeof(request) && if_none_match != NULL && if_none_match[0] != '\0' ){
+        request_len += (size_t) snprintf(request + request_len, sizeof(request) - request_len, "If-None-Match: %s\n", if_none_match);
+    }
+    if ( request_len < sizeof(request) && if_modified_since != NULL && if_modified_since[0] != '\0' ){
+        request_len += (size_t) snprintf(request + request_len, sizeof(request) - request_len, "If-Modified-Since: %s\n", if_modified_since);
+    }
+    if ( request_len < sizeof(request) ) request_len += (size_t) snprintf(request + request_len, sizeof(request) - request_len, "\n");
+    if ( request_len >= sizeof(request) ) { cerr << "Warning: url too long for an http request: " << root_relative_url << endl; return -1; }
+    request_sent = 0;
+    header_len = leftover_len = 0;
+    status = 0; content_length = -1; body_received = 0;
+    etag[0] = last_modified[0] = '\0';
+    keep_alive = false;
+    deadline = time(NULL) + HTTP_FETCH_TIMEOUT;
+    reused = (state == CONN_IDLE && healthy());
+    memset(&timings, 0, sizeof(timings));
+    timings.begun = monotonic_usec();
+    timings.reused = reused;
+    if ( reused ){
+        timings.connected = timings.begun;
+        state = CONN_SENDING;
+        watch(EPOLLOUT);
+        return 0;
+    }
+    reset();                                     // (in case the kept-alive socket was not healthy)
+    CHECK_PERROR( (fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) , "socket", fd = -1; return -1; )
+    if ( connect(fd, (struct sockaddr *) &server_sa, sizeof(struct sockaddr_in)) == 0 ){
+        timings.connected = monotonic_usec();
+        state = CONN_SENDING;
+    } else if ( errno == EINPROGRESS ){
+        state = CONN_CONNECTING;
+    } else {
+        perror("Connecting to server failed");
+        reset();
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = watched_events = EPOLLOUT;
+    ev.data.u32 = (unsigned int) id;
+    CHECK_PERROR( epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) , "epoll_ctl add", reset(); return -1; )
+    return 0;
+}
+
+int HTTP_Connection::step(const char *&chunk, size_t &chunk_len) {
+    for (;;) {
+        switch (state) {
+            case CONN_CLOSED:
+                return FETCH_PENDING;
+            case CONN_IDLE:                      // an idle kept-alive socket became readable: the server closed it
+                reset();
+                return FETCH_PENDING;
+            case CONN_CONNECTING: {
+                struct pollfd pfd;
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                if ( poll(&pfd, 1, 0) == 0 ) return FETCH_PENDING;    // not connected yet
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if ( getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0 ){
+                    errno = error;
+                    perror("Connecting to server failed");
+                    reset();
+                    return FETCH_FAILED;
+                }
+                timings.connected = monotonic_usec();
+                state = CONN_SENDING;
+                break;
+            }
+            case CONN_SENDING: {
+                ssize_t nbytes = write(fd, request + request_sent, request_len - request_sent);
+                if ( nbytes < 0 ){
+                    if ( errno == EAGAIN || errno == EWOULDBLOCK ) return FETCH_PENDING;
+                    if ( errno == EINTR ) break;
+                    bool retry = reused;
+                    if ( !retry ) perror("write to server's socket");
+                    reset();
+                    return (retry) ? FETCH_RETRY : FETCH_FAILED;
+                }
+                request_sent += nbytes;
+                if ( request_sent == request_len ){
+                    timings.request_sent = monotonic_usec();
+                    state = CONN_HEADER;
+                    watch(EPOLLIN);
+                }
+                break;
+            }
+            case CONN_HEADER: {
+                ssize_t nbytes = read(fd, header + header_len, HTTP_MAX_HEADER_SIZE - 1 - header_len);
+                if ( nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) return FETCH_PENDING;
+                if ( nbytes < 0 && errno == EINTR ) break;
+                if ( nbytes <= 0 ){
+                    bool retry = reused && header_len == 0;          // nothing at all came back on a reused socket
+                    if ( !retry ){
+                        if ( nbytes < 0 ) perror("read on from server's socket");
+                        else cerr << "Warning: server closed the connection before sending the whole http response header" << endl;
+                    }
+                    reset();
+                    return (retry) ? FETCH_RETRY : FETCH_FAILED;
+                }
+                // look for the "\n\n" or "\n\r\n" that ends the header (starting a little before the bytes just read, in case it was split between reads)
+                size_t from = (header_len >= 2) ? header_len - 2 : 0, end = 0;
+                header_len += nbytes;
+                for (size_t j = from ; j + 1 < header_len && end == 0 ; j++){
+                    if ( header[j] != '\n' ) continue;
+                    if ( header[j+1] == '\n' ) end = j + 2;
+                    else if ( header[j+1] == '\r' && j + 2 < header_len && header[j+2] == '\n' ) end = j + 3;
+                }
+                if ( end == 0 ){
+                    if ( header_len == HTTP_MAX_HEADER_SIZE - 1 ){
+                        cerr << "Error: http response header too big" << endl;
+                        reset();
+                        return FETCH_FAILED;
+                    }
+                    break;                       // read more
+                }
+                leftover_len = header_len - end;             // (less than HTTP_MAX_HEADER_SIZE so it fits in body[])
+                memcpy(body, header + end, leftover_len);
+                header[end] = '\0';
+                int fb = parse_header();
+                switch (fb){
+                    case -1: cerr << "Error: reading C String from string stream failed" << endl; break;
+                    case -2: cerr << "Error: Unexpected http response format from server" << endl; break;
+                    case -4: cerr << "Error: server's http response did not contain a \"Content-Length\" field" << endl; break;
+                }
+                if ( fb < 0 ){
+                    reset();
+                    return FETCH_FAILED;
+                }
+                timings.header_received = monotonic_usec();
+                state = CONN_BODY;
+                return FETCH_HEADER;
+            }
+            case CONN_BODY: {
+                if ( leftover_len > 0 ){         // report the body bytes read along with the header first
+                    chunk = body;
+                    chunk_len = ( (int) leftover_len > content_length - body_received ) ? (size_t) (content_length - body_received) : leftover_len;
+                    leftover_len = 0;
+                    body_received += chunk_len;
+                    if ( chunk_len > 0 ) return FETCH_BODY;
+                    break;
+                }
+                if ( body_received >= content_length ){
+                    if ( keep_alive ){
+                        state = CONN_IDLE;
+                        watch(EPOLLIN);
+                    } else reset();
+                    return FETCH_DONE;
+                }
+                size_t to_read = (size_t) (content_length - body_received);
+                ssize_t nbytes = read(fd, body, (to_read < HTTP_BODY_READ_SIZE) ? to_read : HTTP_BODY_READ_SIZE);
+                if ( nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) return FETCH_PENDING;
+                if ( nbytes < 0 && errno == EINTR ) break;
+                if ( nbytes <= 0 ){
+                    if ( nbytes < 0 && errno == ECONNRESET ) perror("Warning, client did not download the whole page in time. Peer reset the connection");   // our server-peer shouldn't do that
+                    else if ( nbytes < 0 ) perror("Warning, reading content from http socket");
+                    else cerr << "Warning: server closed the connection before sending the whole page" << endl;
+                    reset();
+                    return FETCH_FAILED;
+                }
+                body_received += nbytes;
+                chunk = body;
+                chunk_len = (size_t) nbytes;
+                return FETCH_BODY;
+            }
+        }
+    }
+}
+
+void HTTP_Connection::reset() {
+    if ( fd >= 0 ){
+        CHECK_PERROR( close(fd) , "closing http client socket from a thread" , )      // (closing also removes it from the epoll instance)
+    }
+    fd = -1;
+    state = CONN_CLOSED;
+    watched_events = 0;
+}
+
+bool HTTP_Connection::is_busy() const { return state >= CONN_CONNECTING; }
+
+bool HTTP_Connection::is_idle() const { return state == CONN_IDLE; }
+
+bool HTTP_Connection::has_expired(time_t now) const { return is_busy() && now > deadline; }
+
+int HTTP_Connection::get_status() const { return status; }
+
+int HTTP_Connection::get_content_length() const { return content_length; }
+
+const char *HTTP_Connection::get_etag() const { return etag; }
+
+const char *HTTP_Connection::get_last_modified() const { return last_modified; }
+
+const fetch_timings &HTTP_Connection::get_timings() const { return timings; }
+
+void HTTP_Connection::watch(unsigned int events) {
+    if ( fd < 0 || events == watched_events ) return;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.u32 = (unsigned int) id;
+    CHECK_PERROR( epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) , "epoll_ctl modify", )
+    watched_events = events;
+}
+
+int HTTP_Connection::parse_header() {            // parses header[] (which must be '\0' terminated) for the status, "Content-Length:", "Connection:" and the validators
+    char *rest = header, *line;
+    bool found_content_len = false;
+    {   // for the 1st line, get the status code of the answer
+        line = strtok_r(rest, "\r\n", &rest);
+        if ( line == NULL ) return -2;
+        stringstream linestream(line);
+        char word[256];
+        linestream >> word;
+        if ( linestream.fail() ) return -1;
+        if ( strcmp(word, "HTTP/1.1") != 0 ) return -2;
+        linestream >> status;
+        if ( linestream.fail() ) return -1;
+    }
+    while ((line = strtok_r(rest, "\r\n", &rest))){    // for each line after the 1st one in response header
+        stringstream linestream(line);
+        char word[256];
+        linestream >> word;
+        if (linestream.fail()){
+            cerr << "Warning: reading from C string to stringstream failed" << endl;
+            linestream.clear();
+            continue;
+        }
+        if (strcmp(word, "Content-Length:") == 0){
+            linestream >> content_length;
+            if ( linestream.fail() ){
+                cerr << "Warning: \"Content-Length:\" field had a no numeric value" << endl;
+                linestream.clear();
+                continue;
+            }
+            found_content_len = true;
+        } else if (strcmp(word, "Connection:") == 0){       // the server only keeps the connection open if it explicitly says so
+            linestream >> word;
+            keep_alive = !linestream.fail() && strcasecmp(word, "keep-alive") == 0;
+            linestream.clear();
+        } else if (strcasecmp(word, "ETag:") == 0){
+            copy_field_value(line + strlen("ETag:"), etag);
+        } else if (strcasecmp(word, "Last-Modified:") == 0){     // (an HTTP-date has spaces in it so the whole rest of the line is kept)
+            copy_field_value(line + strlen("Last-Modified:"), last_modified);
+        }
+    }
+    if ( status == 304 ){                        // "Not Modified" never has a body, whatever Content-Length says
+        content_length = 0;
+        return 0;
+    }
+    if ( !found_content_len ){
+        content_length = 0;
+        keep_alive = false;                      // we cannot tell where the answer ends
+        return (status == 200) ? -4 : 0;
+    }
+    return 0;
+}
+
+void HTTP_Connection::copy_field_value(const char *value, char *to) {     // value: what follows the field's name in its ('\0' terminated) line
+    while ( *value == ' ' || *value == '\t' ) value++;
+    size_t len = strlen(value);
+    while ( len > 0 && (value[len-1] == ' ' || value[len-1] == '\t') ) len--;
+    if ( len >= HTTP_VALIDATOR_SIZE ) len = 0;  // too big to be sent back: behave as if there was none
+    memcpy(to, value, len);
+    to[len] = '\0';
+}
+
+bool HTTP_Connection::healthy() const {          // an idle kept-alive socket should have nothing to read: if it is readable then the server closed it (or sent garbage)
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) == 0;
+}
@@ -0,0 +1,66 @@
+#include <cstring>
+#include "../headers/Link_Batch.h"
+#include "../headers/hash_history.h"
+
+
+Link_Batch::Link_Batch() : text(NULL), text_used(0), text_size(0), count(0) {
+    memset(table, 0, sizeof(table));
+}
+
+Link_Batch::~Link_Batch() {
+    delete[] text;
+}
+
+bool Link_Batch::add(const char *link, const char *key, int history) {
+    unsigned long long h = hash_history::hash(link);
+    unsigned int pos;
+    for (pos = (unsigned int) h & (LINK_BATCH_TABLE_SIZE - 1) ; table[pos] != 0 ; pos = (pos + 1) & (LINK_BATCH_TABLE_SIZE - 1)){     // linear probing
+        unsigned int i = table[pos] - 1;
+        if ( hashes[i] == h && strcmp(text + link_at[i], link) == 0 ) return false;
+    }
+    size_t len = strlen(link);
+    if ( text_used + len + 1 > text_size ){
+        size_t new_size = (text_size > 0) ? text_size : LINK_BATCH_INITIAL_TEXT;
+        while ( new_size < text_used + len + 1 ) new_size *= 2;
+        char *new_text = new char[new_size];
+        if ( text_used > 0 ) memcpy(new_text, text, text_used);
+        delete[] text;
+        text = new_text;
+        text_size = new_size;
+    }
+    memcpy(text + text_used, link, len + 1);
+    link_at[count] = (unsigned int) text_used;
+    key_at[count] = (unsigned int) (text_used + (key - link));
+    histories[count] = history;
+    hashes[count] = h;
+    text_used += len + 1;
+    table[pos] = (unsigned short) (++count);
+    return true;
+}
+
+bool Link_Batch::is_full() const {
+    return count == LINK_BATCH_SIZE;
+}
+
+unsigned int Link_Batch::size() const {
+    return count;
+}
+
+const char *Link_Batch::link(unsigned int i) const {
+    return text + link_at[i];
+}
+
+const char *Link_Batch::key(unsigned int i) const {
+    return text + key_at[i];
+}
+
+int Link_Batch::history(unsigned int i) const {
+    return histories[i];
+}
+
+void Link_Batch::clear() {
+    if ( count == 0 ) return;
+    memset(table, 0, sizeof(table));
+    text_used = 0;
+    count = 0;
+}
@@ -0,0 +1,388 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include "../headers/Link_Graph.h"
+
+
+using namespace std;
+
+
+struct pagerank_state {                      // shared by the threads of one PageRank run
+    Link_Graph *graph;
+    double *ranks, *next_ranks, *contributions;
+    unsigned int next_block;                 // (atomic) the next block of pages to be taken in the current step
+    double base;                             // the rank every page gets in this iteration before its links are added: (1 - d) / N plus its share of the pages without links
+    bool done;
+    unsigned int iterations;
+    struct partial{
+        double dangling, change;             // a thread's sums over the pages it took in the current step
+        char padding[48];                    // (each on its own cache line)
+    } *partials;
+    unsigned int num_threads;
+    bool ready;                              // (set once every thread has been created and the barrier knows how many there are)
+    pthread_mutex_t ready_lock;
+    pthread_cond_t readyCond;
+    pthread_barrier_t barrier;
+};
+
+struct pagerank_job {
+    pagerank_state *state;
+    unsigned int thread;                     // (0 is the thread that called pagerank)
+};
+
+
+/* Local Functions */
+int compare_ids(const void *a, const void *b);
+
+
+Edge_Buffer::Edge_Buffer() : last(NULL), num_edges(0) { }
+
+Edge_Buffer::~Edge_Buffer() {
+    free_blocks();
+}
+
+void Edge_Buffer::free_blocks() {
+    while ( last != NULL ){
+        block *previous = last->next;
+        delete last;
+        last = previous;
+    }
+}
+
+void Edge_Buffer::add(unsigned int from, unsigned int to) {
+    if ( last == NULL || last->used == EDGE_BLOCK_SIZE ){
+        block *b = new block;
+        b->used = 0;
+        b->next = last;
+        last = b;
+    }
+    last->from[last->used] = from;
+    last->to[last->used] = to;
+    last->used++;
+    __atomic_store_n(&num_edges, num_edges + 1, __ATOMIC_RELAXED);     // (only this buffer's thread writes it)
+}
+
+unsigned long long Edge_Buffer::size() const {
+    return __atomic_load_n(&num_edges, __ATOMIC_RELAXED);
+}
+
+
+Link_Graph::Link_Graph(unsigned int num_of_threads) : num_buffers(num_of_threads + 1), num_pages(0), num_links(0), out_offsets(NULL), in_offsets(NULL), out_links(NULL), in_links(NULL),
+                                                      saved(NULL), ranks(NULL), iterations(0), built(false) {
+    buffers = new Edge_Buffer[num_buffers];
+}
+
+Link_Graph::~Link_Graph() {
+    delete[] buffers;
+    delete[] out_offsets;
+    delete[] in_offsets;
+    delete[] out_links;
+    delete[] in_links;
+    delete[] saved;
+    delete[] ranks;
+}
+
+Edge_Buffer *Link_Graph::edges_of(unsigned int thread) {
+    return &buffers[thread];
+}
+
+Edge_Buffer *Link_Graph::resolved_edges() {
+    return &buffers[num_buffers - 1];
+}
+
+unsigned int Link_Graph::page_id(const char *save_url) {
+    unsigned int id;
+    pages.intern(save_url, id);
+    return id;
+}
+
+bool Link_Graph::find_page(const char *save_url, unsigned int &id) {
+    return pages.find(save_url, id);
+}
+
+const char *Link_Graph::save_url_of(unsigned int id) const {
+    return pages.url_of(id);
+}
+
+unsigned long long Link_Graph::edges_found() const {
+    unsigned long long total = 0;
+    for (unsigned int t = 0 ; t < num_buffers ; t++){
+        total += buffers[t].size();
+    }
+    return total;
+}
+
+unsigned int Link_Graph::size() const {
+    return pages.size();
+}
+
+bool Link_Graph::is_built() const {
+    return __atomic_load_n(&built, __ATOMIC_ACQUIRE);
+}
+
+void Link_Graph::build() {
+    // count the links from every page, then place them: out_offsets[p + 1] is first the number of links from p, and then where they end
+    num_pages = pages.size();
+    saved = new bool[num_pages];
+    memset(saved, 0, num_pages * sizeof(bool));
+    out_offsets = new unsigned long long[num_pages + 1];
+    memset(out_offsets, 0, (num_pages + 1) * sizeof(unsigned long long));
+    for (unsigned int t = 0 ; t < num_buffers ; t++){
+        for (Edge_Buffer::block *b = buffers[t].last ; b != NULL ; b = b->next){
+            for (unsigned int i = 0 ; i < b->used ; i++){
+                if ( b->to[i] == PAGE_SAVED ) saved[b->from[i]] = true;
+                else if ( b->from[i] != b->to[i] ) out_offsets[b->from[i] + 1]++;
+            }
+        }
+    }
+    for (unsigned int p = 0 ; p < num_pages ; p++){
+        out_offsets[p + 1] += out_offsets[p];
+    }
+    out_links = new unsigned int[out_offsets[num_pages]];
+    unsigned long long *cursor = new unsigned long long[num_pages];
+    memcpy(cursor, out_offsets, num_pages * sizeof(unsigned long long));
+    for (unsigned int t = 0 ; t < num_buffers ; t++){
+        for (Edge_Buffer::block *b = buffers[t].last ; b != NULL ; b = b->next){
+            for (unsigned int i = 0 ; i < b->used ; i++){
+                if ( b->to[i] != PAGE_SAVED && b->from[i] != b->to[i] ) out_links[cursor[b->from[i]]++] = b->to[i];
+            }
+        }
+    }
+    delete[] cursor;
+    for (unsigned int t = 0 ; t < num_buffers ; t++){
+        buffers[t].free_blocks();
+    }
+
+    // sort every page's links and drop the repeated ones (a page may link to the same page many times), moving the rows down as they shrink
+    unsigned long long begin = 0, kept = 0;
+    for (unsigned int p = 0 ; p < num_pages ; p++){
+        unsigned long long end = out_offsets[p + 1];
+        qsort(out_links + begin, end - begin, sizeof(unsigned int), compare_ids);
+        out_offsets[p] = kept;
+        for (unsigned long long i = begin ; i < end ; i++){
+            unsigned int link = out_links[i];
+            if ( kept == out_offsets[p] || link != out_links[kept - 1] ) out_links[kept++] = link;
+        }
+        begin = end;
+    }
+    out_offsets[num_pages] = num_links = kept;
+
+    // the same links the other way around: as the pages are gone through in order, every page's incoming links come out sorted too
+    in_offsets = new unsigned long long[num_pages + 1];
+    memset(in_offsets, 0, (num_pages + 1) * sizeof(unsigned long long));
+    for (unsigned long long e = 0 ; e < num_links ; e++){
+        in_offsets[out_links[e] + 1]++;
+    }
+    for (unsigned int p = 0 ; p < num_pages ; p++){
+        in_offsets[p + 1] += in_offsets[p];
+    }
+    in_links = new unsigned int[(num_links > 0) ? num_links : 1];
+    cursor = new unsigned long long[num_pages];
+    memcpy(cursor, in_offsets, num_pages * sizeof(unsigned long long));
+    for (unsigned int p = 0 ; p < num_pages ; p++){
+        for (unsigned long long e = out_offsets[p] ; e < out_offsets[p + 1] ; e++){
+            in_links[cursor[out_links[e]]++] = p;
+        }
+    }
+    delete[] cursor;
+    __atomic_store_n(&built, true, __ATOMIC_RELEASE);
+}
+
+void Link_Graph::pagerank(unsigned int num_of_threads) {
+    if ( num_pages == 0 ) return;
+    pagerank_state state;
+    state.graph = this;
+    state.ranks = new double[num_pages];
+    state.next_ranks = new double[num_pages];
+    state.contributions = new double[num_pages];
+    for (unsigned int p = 0 ; p < num_pages ; p++){
+        state.ranks[p] = 1.0 / num_pages;
+    }
+    state.next_block = 0;
+    state.done = false;
+    state.iterations = 0;
+    state.partials = new pagerank_state::partial[num_of_threads];
+    state.ready = false;
+    pthread_mutex_init(&state.ready_lock, NULL);
+    pthread_cond_init(&state.readyCond, NULL);
+
+    // the threads wait until the barrier is set up for as many of them as could be created
+    pagerank_job *jobs = new pagerank_job[num_of_threads];
+    pthread_t *threads = new pthread_t[num_of_threads];
+    unsigned int num_threads = 1;
+    pthread_mutex_lock(&state.ready_lock);
+    for (unsigned int t = 1 ; t < num_of_threads ; t++){
+        jobs[num_threads].state = &state;
+        jobs[num_threads].thread = num_threads;
+        if ( pthread_create(&threads[num_threads], NULL, pagerank_thread, (void *) &jobs[num_threads]) != 0 ){
+            cerr << "Warning: could not create a PageRank thread" << endl;
+        } else num_threads++;
+    }
+    state.num_threads = num_threads;
+    pthread_barrier_init(&state.barrier, NULL, num_threads);
+    state.ready = true;
+    pthread_cond_broadcast(&state.readyCond);
+    pthread_mutex_unlock(&state.ready_lock);
+    jobs[0].state = &state;
+    jobs[0].thread = 0;
+    pagerank_thread((void *) &jobs[0]);
+    for (unsigned int t = 1 ; t < num_threads ; t++){
+        pthread_join(threads[t], NULL);
+    }
+
+    delete[] ranks;
+    ranks = state.ranks;
+    iterations = state.iterations;
+    delete[] state.next_ranks;
+    delete[] state.contributions;
+    delete[] state.partials;
+    delete[] jobs;
+    delete[] threads;
+    pthread_barrier_destroy(&state.barrier);
+    pthread_cond_destroy(&state.readyCond);
+    pthread_mutex_destroy(&state.ready_lock);
+}
+
+bool Link_Graph::save_ranks(const char *save_dir) {
+    char path[4096], tmp_path[4096];
+    snprintf(path, sizeof(path), "%s/%s", save_dir, PAGERANK_FILE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.tmp", save_dir, PAGERANK_FILE);
+    FILE *f = fopen(tmp_path, "w");
+    if ( f == NULL ){
+        perror("fopen pagerank");
+        return false;
+    }
+    for (unsigned int p = 0 ; p < num_pages ; p++){       // "<rank>\t<save_url>" for every saved page (the ranks of all pages found sum up to 1)
+        if ( saved[p] ) fprintf(f, "%.9e\t%s\n", rank_of(p), pages.url_of(p));
+    }
+    bool ok = ( fflush(f) == 0 && fsync(fileno(f)) == 0 );
+    if ( fclose(f) != 0 ) ok = false;
+    if ( !ok ){
+        perror("writing pagerank");
+        unlink(tmp_path);
+        return false;
+    }
+    if ( rename(tmp_path, path) < 0 ){           // atomically replace the old ones
+        perror("rename pagerank");
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+unsigned int Link_Graph::get_num_pages() const {
+    return num_pages;
+}
+
+unsigned long long Link_Graph::get_num_links() const {
+    return num_links;
+}
+
+unsigned int Link_Graph::get_iterations() const {
+    return iterations;
+}
+
+const unsigned long long *Link_Graph::get_out_offsets() const {
+    return out_offsets;
+}
+
+const unsigned int *Link_Graph::get_out_links() const {
+    return out_links;
+}
+
+const unsigned long long *Link_Graph::get_in_offsets() const {
+    return in_offsets;
+}
+
+const unsigned int *Link_Graph::get_in_links() const {
+    return in_links;
+}
+
+bool Link_Graph::is_saved(unsigned int page) const {
+    return saved[page];
+}
+
+double Link_Graph::rank_of(unsigned int page) const {
+    return (ranks != NULL) ? ranks[page] : 0.0;
+}
+
+void *Link_Graph::pagerank_thread(void *job) {     // one of the threads of a power iteration: every step of an iteration is shared out in blocks of pages, with a barrier between the steps
+    pagerank_state &s = *((pagerank_job *) job)->state;
+    const unsigned int me = ((pagerank_job *) job)->thread;
+    const Link_Graph &g = *s.graph;
+    const unsigned int num_blocks = (g.num_pages + PAGERANK_BLOCK_SIZE - 1) / PAGERANK_BLOCK_SIZE;
+    pthread_mutex_lock(&s.ready_lock);
+    while ( !s.ready ){
+        pthread_cond_wait(&s.readyCond, &s.ready_lock);
+    }
+    pthread_mutex_unlock(&s.ready_lock);
+    for (;;){
+        // 1. what every page gives each page it links to, and the rank of the pages without links (which is shared by all pages)
+        double dangling = 0;
+        for (unsigned int b ; (b = __sync_fetch_and_add(&s.next_block, 1)) < num_blocks ; ){
+            unsigned int end = (b + 1) * PAGERANK_BLOCK_SIZE;
+            if ( end > g.num_pages ) end = g.num_pages;
+            for (unsigned int p = b * PAGERANK_BLOCK_SIZE ; p < end ; p++){
+                unsigned long long num_out = g.out_offsets[p + 1] - g.out_offsets[p];
+                if ( num_out == 0 ){
+                    dangling += s.ranks[p];
+                    s.contributions[p] = 0;
+                } else s.contributions[p] = s.ranks[p] / num_out;
+            }
+        }
+        s.partials[me].dangling = dangling;
+        pthread_barrier_wait(&s.barrier);
+        if ( me == 0 ){
+            dangling = 0;
+            for (unsigned int t = 0 ; t < s.num_threads ; t++){
+                dangling += s.partials[t].dangling;
+            }
+            s.base = (1.0 - PAGERANK_DAMPING) / g.num_pages + PAGERANK_DAMPING * dangling / g.num_pages;
+            s.next_block = 0;
+        }
+        pthread_barrier_wait(&s.barrier);
+
+        // 2. every page's new rank, pulled from the pages that link to it (so no two threads ever write to the same page)
+        double change = 0;
+        for (unsigned int b ; (b = __sync_fetch_and_add(&s.next_block, 1)) < num_blocks ; ){
+            unsigned int end = (b + 1) * PAGERANK_BLOCK_SIZE;
+            if ( end > g.num_pages ) end = g.num_pages;
+            for (unsigned int p = b * PAGERANK_BLOCK_SIZE ; p < end ; p++){
+                double sum = 0;
+                for (unsigned long long e = g.in_offsets[p] ; e < g.in_offsets[p + 1] ; e++){
+                    sum += s.contributions[g.in_links[e]];
+                }
+                double rank = s.base + PAGERANK_DAMPING * sum;
+                change += fabs(rank - s.ranks[p]);
+                s.next_ranks[p] = rank;
+            }
+        }
+        s.partials[me].change = change;
+        pthread_barrier_wait(&s.barrier);
+        if ( me == 0 ){
+            change = 0;
+            for (unsigned int t = 0 ; t < s.num_threads ; t++){
+                change += s.partials[t].change;
+            }
+            double *previous = s.ranks;
+            s.ranks = s.next_ranks;
+            s.next_ranks = previous;
+            s.iterations++;
+            s.done = ( change < PAGERANK_TOLERANCE || s.iterations >= PAGERANK_MAX_ITERATIONS );
+            s.next_block = 0;
+        }
+        pthread_barrier_wait(&s.barrier);
+        if ( s.done ) break;
+    }
+    return NULL;
+}
+
+
+/* Local Functions Implementation */
+int compare_ids(const void *a, const void *b) {
+    unsigned int x = *((const unsigned int *) a), y = *((const unsigned int *) b);
+    return (x > y) - (x < y);
+}
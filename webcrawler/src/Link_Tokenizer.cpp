@@ -0,0 +1,114 @@
+#include <cstring>
+#include "../headers/Link_Tokenizer.h"
+#include "../headers/simd_scan.h"
+
+
+/* tokenizer states */
+#define TOK_TEXT 0                           // looking for a '<'
+#define TOK_TAG_OPEN 1                       // just read a '<': is it an <a ...> tag?
+#define TOK_TAG_NAME_END 2                   // just read "<a": the next character (normally a space) is skipped
+#define TOK_ATTRIBUTES 3                     // looking for "href" (or for the '>' that closes the tag)
+#define TOK_HREF 4                           // after "href": looking for the '"' that starts the link
+#define TOK_LINK_START 5                     // the first character of the link: it might be the first of a "../"
+#define TOK_LINK_DOT 6                       // the link started with a '.': if the next one is also a '.' then both are skipped
+#define TOK_LINK 7                           // reading the link until the closing '"'
+#define TOK_TAG_END 8                        // ignoring the rest of the tag until it closes
+
+
+Link_Tokenizer::Link_Tokenizer() : state(TOK_TEXT), matched(0), link_len(0) {}
+
+void Link_Tokenizer::reset() {
+    state = TOK_TEXT;
+    matched = 0;
+    link_len = 0;
+}
+
+bool Link_Tokenizer::next_link(const char *&chunk, size_t &chunk_len, char *found_link) {
+    static const char href[] = "href";
+    while ( chunk_len > 0 ){
+        switch (state){                              // fast paths: jump over (or copy) whole runs of bytes that cannot change the state
+            case TOK_TEXT: skip_to(chunk, chunk_len, '<', '<'); break;
+            case TOK_ATTRIBUTES: if ( matched == 0 ) skip_to(chunk, chunk_len, 'h', '>'); break;
+            case TOK_HREF: skip_to(chunk, chunk_len, '"', '>'); break;
+            case TOK_LINK: copy_link_run(chunk, chunk_len); break;
+            case TOK_TAG_END: skip_to(chunk, chunk_len, '>', '>'); break;
+        }
+        if ( chunk_len == 0 ) break;
+        char c = *chunk;
+        chunk++;
+        chunk_len--;
+        switch (state){
+            case TOK_TEXT:
+                if ( c == '<' ) state = TOK_TAG_OPEN;
+                break;
+            case TOK_TAG_OPEN:
+                if ( c == 'a' ) state = TOK_TAG_NAME_END;
+                else if ( c != '<' ) state = TOK_TEXT;
+                break;
+            case TOK_TAG_NAME_END:
+                matched = 0;
+                state = TOK_ATTRIBUTES;
+                break;
+            case TOK_ATTRIBUTES:
+                if ( c == '>' ) state = TOK_TEXT;
+                else if ( c == href[matched] ){
+                    if ( ++matched == 4 ) state = TOK_HREF;
+                } else matched = (c == 'h') ? 1 : 0;
+                break;
+            case TOK_HREF:
+                if ( c == '>' ) state = TOK_TEXT;
+                else if ( c == '"' ) state = TOK_LINK_START;
+                break;
+            case TOK_LINK_START:
+                link_len = 0;
+                if ( c == '.' ) state = TOK_LINK_DOT;
+                else if ( link_char(c, found_link) ) return true;
+                break;
+            case TOK_LINK_DOT:
+                if ( c == '.' ){                         // skip the ".." of "../sitei/pagei_j.html"
+                    state = TOK_LINK;
+                    break;
+                }
+                link[link_len++] = '.';                  // else that '.' was part of the link after all
+                if ( link_char(c, found_link) ) return true;
+                break;
+            case TOK_LINK:
+                if ( link_char(c, found_link) ) return true;
+                break;
+            case TOK_TAG_END:
+                if ( c == '>' ) state = TOK_TEXT;
+                break;
+        }
+    }
+    return false;
+}
+
+bool Link_Tokenizer::link_char(char c, char *found_link) {       // returns true if c completed a link (which is then copied to found_link)
+    state = TOK_LINK;
+    if ( c == '>' ) state = TOK_TEXT;                // tag closed before the link did: ignore it
+    else if ( c == '"' ){
+        state = TOK_TAG_END;
+        if ( link_len > 0 ){                         // actually found a link (and not ex: "")
+            memcpy(found_link, link, link_len);
+            found_link[link_len] = '\0';
+            return true;
+        }
+    } else if ( link_len < MAX_LINK_SIZE - 1 ) link[link_len++] = c;   // (overflowing links are truncated)
+    return false;
+}
+
+void Link_Tokenizer::skip_to(const char *&chunk, size_t &chunk_len, char c1, char c2) {     // advances chunk up to (not past) the first c1 or c2
+    const char *found = scan_for(chunk, chunk + chunk_len, c1, c2);
+    chunk_len -= found - chunk;
+    chunk = found;
+}
+
+void Link_Tokenizer::copy_link_run(const char *&chunk, size_t &chunk_len) {      // same as link_char() for every byte before the next '"' or '>'
+    const char *found = scan_for(chunk, chunk + chunk_len, '"', '>');
+    size_t run = found - chunk;
+    size_t room = MAX_LINK_SIZE - 1 - link_len;
+    memcpy(link + link_len, chunk, (run < room) ? run : room);                  // (overflowing links are truncated)
+    link_len += (run < room) ? run : room;
+    chunk_len -= run;
+    chunk = found;
+}
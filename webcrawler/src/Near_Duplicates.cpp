@@ -0,0 +1,183 @@
+#include <iostream>
+#include <cstring>
+#include "../headers/Near_Duplicates.h"
+
+
+using namespace std;
+
+
+#define NO_ENTRY 0xFFFFFFFFU
+#define INDEX_INITIAL_CAPACITY 1024          // entries (the array doubles whenever it is full)
+#define MAX_LANE_COUNT 255                   // shingles that a byte of SimHash's lanes can count
+
+
+/* Local Functions */
+unsigned long long mix(unsigned long long h);
+unsigned long long spread_byte(unsigned int byte);
+
+
+SimHash::SimHash() {
+    reset();
+}
+
+void SimHash::reset() {
+    memset(ones, 0, sizeof(ones));
+    memset(lanes, 0, sizeof(lanes));
+    num_shingles = 0;
+    in_word = in_tag = false;
+    num_words = 0;
+}
+
+void SimHash::add(const char *chunk, size_t chunk_len) {
+    for (size_t i = 0 ; i < chunk_len ; i++){
+        unsigned char c = (unsigned char) chunk[i];
+        if ( in_tag ){                           // (tags and their attributes, links included, are not part of the text)
+            if ( c == '>' ) in_tag = false;
+            continue;
+        }
+        if ( c >= 'A' && c <= 'Z' ) c += 'a' - 'A';
+        if ( (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ){     // FNV-1a of the word in lower case, carried over from chunk to chunk
+            if ( !in_word ){
+                word = 14695981039346656037ULL;
+                in_word = true;
+            }
+            word ^= c;
+            word *= 1099511628211ULL;
+        } else {
+            end_word();
+            if ( c == '<' ) in_tag = true;
+        }
+    }
+}
+
+bool SimHash::fingerprint(unsigned long long &fingerprint) {
+    end_word();
+    if ( num_words < SIMHASH_SHINGLE ) return false;
+    flush_lanes();
+    fingerprint = 0;
+    for (int b = 0 ; b < SIMHASH_BITS ; b++){
+        if ( 2 * ones[b] > num_shingles ) fingerprint |= 1ULL << b;
+    }
+    return true;
+}
+
+void SimHash::end_word() {
+    if ( !in_word ) return;
+    in_word = false;
+    num_words++;
+    if ( num_words >= SIMHASH_SHINGLE ){         // the shingle that ends with this word votes
+        unsigned long long shingle = word;
+        for (int w = 0 ; w < SIMHASH_SHINGLE - 1 ; w++){
+            shingle = shingle * 31 + previous[w];
+        }
+        shingle = mix(shingle);
+        for (int i = 0 ; i < 8 ; i++){
+            lanes[i] += spread_byte((unsigned int) (shingle >> (8 * i)) & 0xFF);
+        }
+        if ( ++num_shingles % MAX_LANE_COUNT == 0 ) flush_lanes();
+    }
+    for (int w = SIMHASH_SHINGLE - 2 ; w > 0 ; w--){
+        previous[w] = previous[w - 1];
+    }
+    previous[0] = word;
+}
+
+void SimHash::flush_lanes() {
+    for (int i = 0 ; i < 8 ; i++){
+        for (int j = 0 ; j < 8 ; j++){
+            ones[8 * i + j] += (unsigned int) (lanes[i] >> (8 * j)) & 0xFF;
+        }
+        lanes[i] = 0;
+    }
+}
+
+
+Near_Duplicate_Index::Near_Duplicate_Index(int max_distance_bits) : num_entries(0), capacity(INDEX_INITIAL_CAPACITY), max_distance(max_distance_bits), num_duplicates(0) {
+    entries = new entry[capacity];
+    for (int t = 0 ; t <= MAX_NEAR_DUPLICATE_DISTANCE ; t++){
+        heads[t] = new unsigned int[1 << NEAR_DUPLICATE_BLOCK_BITS];
+        memset(heads[t], 0xFF, (1 << NEAR_DUPLICATE_BLOCK_BITS) * sizeof(unsigned int));     // (NO_ENTRY)
+    }
+    if ( pthread_mutex_init(&lock, NULL) != 0 ){
+        cerr << "Warning: pthread_mutex_init failed!" << endl;
+    }
+}
+
+Near_Duplicate_Index::~Near_Duplicate_Index() {
+    for (unsigned int e = 0 ; e < num_entries ; e++){
+        delete[] entries[e].page;
+    }
+    delete[] entries;
+    for (int t = 0 ; t <= MAX_NEAR_DUPLICATE_DISTANCE ; t++){
+        delete[] heads[t];
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+bool Near_Duplicate_Index::find_or_add(unsigned long long fingerprint, const char *page, const char *&original) {
+    unsigned int blocks[MAX_NEAR_DUPLICATE_DISTANCE + 1];
+    for (int t = 0 ; t <= MAX_NEAR_DUPLICATE_DISTANCE ; t++){
+        blocks[t] = (unsigned int) (fingerprint >> (t * NEAR_DUPLICATE_BLOCK_BITS)) & ((1 << NEAR_DUPLICATE_BLOCK_BITS) - 1);
+    }
+    pthread_mutex_lock(&lock);
+    // (any fingerprint within MAX_NEAR_DUPLICATE_DISTANCE bits of this one has at least one block that none of those bits fall in)
+    for (int t = 0 ; t <= MAX_NEAR_DUPLICATE_DISTANCE ; t++){
+        for (unsigned int e = heads[t][blocks[t]] ; e != NO_ENTRY ; e = entries[e].next[t]){
+            if ( __builtin_popcountll(entries[e].fingerprint ^ fingerprint) <= max_distance ){
+                original = entries[e].page;
+                num_duplicates++;
+                pthread_mutex_unlock(&lock);
+                return true;
+            }
+        }
+    }
+    if ( num_entries == capacity ){
+        entry *new_entries = new entry[2 * capacity];
+        memcpy(new_entries, entries, num_entries * sizeof(entry));
+        delete[] entries;
+        entries = new_entries;
+        capacity *= 2;
+    }
+    entry &added = entries[num_entries];
+    added.fingerprint = fingerprint;
+    added.page = new char[strlen(page) + 1];
+    strcpy(added.page, page);
+    for (int t = 0 ; t <= MAX_NEAR_DUPLICATE_DISTANCE ; t++){
+        added.next[t] = heads[t][blocks[t]];
+        heads[t][blocks[t]] = num_entries;
+    }
+    num_entries++;
+    pthread_mutex_unlock(&lock);
+    return false;
+}
+
+unsigned int Near_Duplicate_Index::size() const {
+    return __atomic_load_n(&num_entries, __ATOMIC_RELAXED);
+}
+
+unsigned int Near_Duplicate_Index::duplicates() const {
+    return __atomic_load_n(&num_duplicates, __ATOMIC_RELAXED);
+}
+
+int Near_Duplicate_Index::get_max_distance() const {
+    return max_distance;
+}
+
+
+/* Local Functions Implementation */
+unsigned long long mix(unsigned long long h) {   // (64-bit finalizer: every bit of a shingle's hash depends on every bit of its words')
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+unsigned long long spread_byte(unsigned int byte) {     // bit j of byte becomes bit 0 of byte j of the result
+    unsigned long long x = byte;
+    x = (x | (x << 28)) & 0x0000000F0000000FULL;
+    x = (x | (x << 14)) & 0x0003000300030003ULL;
+    x = (x | (x << 7)) & 0x0101010101010101ULL;
+    return x;
+}
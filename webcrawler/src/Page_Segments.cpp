@@ -0,0 +1,284 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../headers/Page_Segments.h"
+
+
+using namespace std;
+
+
+Segment_Store::Segment_Store() : dir(NULL), num_buckets(SEGMENT_INITIAL_BUCKETS), size(0), fds(NULL), num_segments(0), next_segment(0) {
+    buckets = new page*[num_buckets];
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        buckets[i] = NULL;
+    }
+}
+
+Segment_Store::~Segment_Store() {
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        while ( buckets[i] != NULL ){
+            page *p = buckets[i];
+            buckets[i] = p->next;
+            delete[] p->url;
+            delete p;
+        }
+    }
+    delete[] buckets;
+    for (unsigned int s = 0 ; s < num_segments ; s++){
+        if ( fds[s] >= 0 ) close(fds[s]);
+    }
+    delete[] fds;
+    delete[] dir;
+}
+
+int Segment_Store::open(const char *save_dir, bool create) {
+    dir = new char[strlen(save_dir) + strlen(SEGMENTS_DIR) + 2];
+    sprintf(dir, "%s/%s", save_dir, SEGMENTS_DIR);
+    if ( create && mkdir(dir, 0755) < 0 && errno != EEXIST ){
+        perror("mkdir segments directory");
+        return -1;
+    }
+    DIR *pdir = opendir(dir);
+    if ( pdir == NULL ){
+        perror("opendir segments directory");
+        return -1;
+    }
+    // segments are numbered in the order they were started, so loading their indexes in that order leaves every url with its latest copy
+    struct dirent *pent;
+    while ( (pent = readdir(pdir)) != NULL ){
+        unsigned int s;
+        int len = 0;
+        if ( sscanf(pent->d_name, "%u.seg%n", &s, &len) == 1 && pent->d_name[len] == '\0' && s >= num_segments ) num_segments = s + 1;
+    }
+    closedir(pdir);
+    next_segment = num_segments;
+    fds = new int[num_segments];
+    for (unsigned int s = 0 ; s < num_segments ; s++){
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%06u.seg", dir, s);
+        fds[s] = ::open(path, O_RDONLY);
+        if ( fds[s] >= 0 && load_index(s) < 0 ) cerr << "Warning: could not read the index of segment " << path << ", its pages are lost" << endl;
+    }
+    return (int) size;
+}
+
+bool Segment_Store::find(const char *url, page_location &where) const {
+    page *p = find_page(url, strlen(url));
+    if ( p != NULL ) where = p->where;
+    return p != NULL;
+}
+
+char *Segment_Store::read(const page_location &where) const {
+    if ( where.segment >= num_segments || fds[where.segment] < 0 ) return NULL;
+    char *content = new char[where.length + 1];
+    size_t total = 0;
+    while ( total < where.length ){              // (pread leaves the fd's offset alone, so threads can share it)
+        ssize_t nbytes = pread(fds[where.segment], content + total, where.length - total, (off_t) (where.offset + total));
+        if ( nbytes < 0 && errno == EINTR ) continue;
+        if ( nbytes <= 0 ) break;
+        total += (size_t) nbytes;
+    }
+    if ( total < where.length || checksum(content, where.length) != where.checksum ){
+        cerr << "Warning: a page in segment " << where.segment << " at offset " << where.offset << " is corrupted" << endl;
+        delete[] content;
+        return NULL;
+    }
+    content[where.length] = '\0';
+    return content;
+}
+
+char **Segment_Store::list(const char *prefix, int &count) const {
+    size_t prefix_len = strlen(prefix);
+    count = 0;
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        for (page *p = buckets[i] ; p != NULL ; p = p->next){
+            if ( strncmp(p->url, prefix, prefix_len) == 0 ) count++;
+        }
+    }
+    char **urls = new char*[count];
+    int k = 0;
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        for (page *p = buckets[i] ; p != NULL ; p = p->next){
+            if ( strncmp(p->url, prefix, prefix_len) != 0 ) continue;
+            urls[k] = new char[strlen(p->url) + 1];
+            strcpy(urls[k++], p->url);
+        }
+    }
+    return urls;
+}
+
+unsigned int Segment_Store::get_size() const {
+    return size;
+}
+
+const char *Segment_Store::get_dir() const {
+    return dir;
+}
+
+unsigned int Segment_Store::new_segment() {
+    return __sync_fetch_and_add(&next_segment, 1);
+}
+
+unsigned long long Segment_Store::checksum(const char *data, size_t len, unsigned long long h) {     // FNV-1a 64
+    for (size_t i = 0 ; i < len ; i++){
+        h ^= (unsigned char) data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+int Segment_Store::load_index(unsigned int segment) {     // returns the number of pages loaded or -1
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%06u.idx", dir, segment);
+    int idx_fd = ::open(path, O_RDONLY);
+    if ( idx_fd < 0 ) return -1;
+    struct stat idx_st, seg_st;
+    if ( fstat(idx_fd, &idx_st) < 0 || fstat(fds[segment], &seg_st) < 0 ){
+        close(idx_fd);
+        return -1;
+    }
+    char *records = new char[idx_st.st_size];
+    size_t total = 0;
+    while ( total < (size_t) idx_st.st_size ){
+        ssize_t nbytes = ::read(idx_fd, records + total, idx_st.st_size - total);
+        if ( nbytes < 0 && errno == EINTR ) continue;
+        if ( nbytes <= 0 ) break;
+        total += (size_t) nbytes;
+    }
+    close(idx_fd);
+    // a writer that died mid-page leaves at most one truncated record at the end, or a record whose page is not all there: both are dropped
+    int count = 0;
+    size_t pos = 0;
+    while ( pos + sizeof(index_record) <= total ){
+        index_record record;
+        memcpy(&record, records + pos, sizeof(index_record));
+        if ( pos + sizeof(index_record) + record.url_len > total || record.offset + record.length > (unsigned long long) seg_st.st_size ) break;
+        page_location where;
+        where.segment = segment;
+        where.offset = record.offset;
+        where.length = record.length;
+        where.checksum = record.checksum;
+        insert(records + pos + sizeof(index_record), record.url_len, where);
+        pos += sizeof(index_record) + record.url_len;
+        count++;
+    }
+    delete[] records;
+    return count;
+}
+
+void Segment_Store::insert(const char *url, size_t url_len, const page_location &where) {
+    page *p = find_page(url, url_len);
+    if ( p == NULL ){
+        if ( size >= num_buckets ) grow();
+        p = new page;
+        p->url = new char[url_len + 1];
+        memcpy(p->url, url, url_len);
+        p->url[url_len] = '\0';
+        unsigned int b = bucket_of(url, url_len, num_buckets);
+        p->next = buckets[b];
+        buckets[b] = p;
+        size++;
+    }
+    p->where = where;                            // (a later copy replaces an earlier one)
+}
+
+Segment_Store::page *Segment_Store::find_page(const char *url, size_t url_len) const {
+    for (page *p = buckets[bucket_of(url, url_len, num_buckets)] ; p != NULL ; p = p->next){
+        if ( strncmp(p->url, url, url_len) == 0 && p->url[url_len] == '\0' ) return p;
+    }
+    return NULL;
+}
+
+void Segment_Store::grow() {
+    unsigned int new_num_buckets = 2 * num_buckets;
+    page **new_buckets = new page*[new_num_buckets];
+    for (unsigned int i = 0 ; i < new_num_buckets ; i++){
+        new_buckets[i] = NULL;
+    }
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        while ( buckets[i] != NULL ){
+            page *p = buckets[i];
+            buckets[i] = p->next;
+            unsigned int b = bucket_of(p->url, strlen(p->url), new_num_buckets);
+            p->next = new_buckets[b];
+            new_buckets[b] = p;
+        }
+    }
+    delete[] buckets;
+    buckets = new_buckets;
+    num_buckets = new_num_buckets;
+}
+
+unsigned int Segment_Store::bucket_of(const char *url, size_t url_len, unsigned int num_buckets) {
+    return (unsigned int) checksum(url, url_len) & (num_buckets - 1);
+}
+
+
+Segment_Writer::Segment_Writer(Segment_Store &segment_store) : store(segment_store), seg_fd(-1), idx_fd(-1), seg_size(0) {}
+
+Segment_Writer::~Segment_Writer() {
+    close_segment();
+}
+
+bool Segment_Writer::append(const char *url, const char *data, size_t len) {
+    if ( seg_fd < 0 || (seg_size > 0 && seg_size + len > SEGMENT_MAX_SIZE) ){
+        if ( !rotate() ) return false;
+    }
+    index_record record;
+    record.offset = seg_size;
+    record.checksum = Segment_Store::checksum(data, len);
+    record.length = (unsigned int) len;
+    record.url_len = (unsigned int) strlen(url);
+    char *buffer = new char[sizeof(index_record) + record.url_len];     // (the record goes out in one write)
+    memcpy(buffer, &record, sizeof(index_record));
+    memcpy(buffer + sizeof(index_record), url, record.url_len);
+    bool ok = write_all(seg_fd, data, len);
+    if (ok) ok = write_all(idx_fd, buffer, sizeof(index_record) + record.url_len);
+    delete[] buffer;
+    if ( !ok ){                                  // we no longer know where the segment ends: the next page starts a new one
+        perror("appending a page to its segment");
+        close_segment();
+        return false;
+    }
+    seg_size += len;
+    return true;
+}
+
+bool Segment_Writer::rotate() {
+    close_segment();
+    unsigned int segment = store.new_segment();
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%06u.seg", store.get_dir(), segment);
+    seg_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    snprintf(path, sizeof(path), "%s/%06u.idx", store.get_dir(), segment);
+    idx_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( seg_fd < 0 || idx_fd < 0 ){
+        perror("creating a segment");
+        close_segment();
+        return false;
+    }
+    return true;
+}
+
+void Segment_Writer::close_segment() {
+    if ( seg_fd >= 0 ) close(seg_fd);
+    if ( idx_fd >= 0 ) close(idx_fd);
+    seg_fd = idx_fd = -1;
+    seg_size = 0;
+}
+
+bool Segment_Writer::write_all(int fd, const char *data, size_t len) {
+    while ( len > 0 ){
+        ssize_t nbytes = write(fd, data, len);
+        if ( nbytes < 0 && errno == EINTR ) continue;
+        if ( nbytes < 0 ) return false;
+        data += nbytes;
+        len -= (size_t) nbytes;
+    }
+    return true;
+}
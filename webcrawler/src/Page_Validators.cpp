@@ -0,0 +1,191 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "../headers/Page_Validators.h"
+
+
+using namespace std;
+
+
+#define VALIDATORS_HEADER "page validators v1"     // first line of the file, then one "<content hash (hex)>\t<url>\t<etag>\t<last modified>" line per page and "end"
+
+
+static void copy_validator(char *to, const char *from) {
+    if ( from == NULL ) from = "";
+    strncpy(to, from, HTTP_VALIDATOR_SIZE - 1);
+    to[HTTP_VALIDATOR_SIZE - 1] = '\0';
+}
+
+
+Page_Validators::Page_Validators() : num_buckets(VALIDATORS_INITIAL_BUCKETS), size(0) {
+    buckets = new page*[num_buckets];
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        buckets[i] = NULL;
+    }
+    if ( pthread_mutex_init(&lock, NULL) != 0 ){
+        cerr << "Warning: pthread_mutex_init failed!" << endl;
+    }
+}
+
+Page_Validators::~Page_Validators() {
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        while ( buckets[i] != NULL ){
+            page *p = buckets[i];
+            buckets[i] = p->next;
+            delete[] p->url;
+            delete p;
+        }
+    }
+    delete[] buckets;
+    pthread_mutex_destroy(&lock);
+}
+
+int Page_Validators::load(const char *save_dir) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", save_dir, VALIDATORS_FILE);
+    FILE *f = fopen(path, "r");
+    if ( f == NULL ) return -1;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t len;
+    int count = 0;
+    bool complete = false;
+    if ( getline(&line, &line_capacity, f) > 0 && strncmp(line, VALIDATORS_HEADER, strlen(VALIDATORS_HEADER)) == 0 ){
+        while ( (len = getline(&line, &line_capacity, f)) > 0 ){
+            if ( strcmp(line, "end\n") == 0 ){
+                complete = true;
+                break;
+            }
+            if ( line[len - 1] != '\n' ) break;
+            line[len - 1] = '\0';
+            char *url = strchr(line, '\t');
+            if ( url == NULL ) break;
+            *url++ = '\0';
+            char *etag = strchr(url, '\t');
+            if ( etag == NULL ) break;
+            *etag++ = '\0';
+            char *last_modified = strchr(etag, '\t');
+            if ( last_modified == NULL ) break;
+            *last_modified++ = '\0';
+            set(url, etag, last_modified, strtoull(line, NULL, 16));
+            count++;
+        }
+    }
+    // (pages loaded before a corrupted line are kept: at worst the rest of them are downloaded again)
+    if ( !complete ) cerr << "Warning: " << path << " is corrupted, only " << count << " pages' validators could be loaded" << endl;
+    free(line);
+    fclose(f);
+    return count;
+}
+
+bool Page_Validators::save(const char *save_dir) {
+    char path[4096], tmp_path[4096];
+    snprintf(path, sizeof(path), "%s/%s", save_dir, VALIDATORS_FILE);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.tmp", save_dir, VALIDATORS_FILE);
+    FILE *f = fopen(tmp_path, "w");
+    if ( f == NULL ){
+        perror("fopen page validators");
+        return false;
+    }
+    pthread_mutex_lock(&lock);
+    fprintf(f, "%s\n", VALIDATORS_HEADER);
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        for (page *p = buckets[i] ; p != NULL ; p = p->next){
+            fprintf(f, "%016llx\t%s\t%s\t%s\n", p->content_hash, p->url, p->etag, p->last_modified);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    fprintf(f, "end\n");
+    bool ok = ( fflush(f) == 0 && fsync(fileno(f)) == 0 );
+    if ( fclose(f) != 0 ) ok = false;
+    if ( !ok ){
+        perror("writing page validators");
+        unlink(tmp_path);
+        return false;
+    }
+    if ( rename(tmp_path, path) < 0 ){           // atomically replace the old ones
+        perror("rename page validators");
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+bool Page_Validators::get(const char *url, char *etag, char *last_modified, unsigned long long &content_hash) {
+    pthread_mutex_lock(&lock);
+    page *p = find(url);
+    if ( p != NULL ){
+        strcpy(etag, p->etag);
+        strcpy(last_modified, p->last_modified);
+        content_hash = p->content_hash;
+    }
+    pthread_mutex_unlock(&lock);
+    return p != NULL;
+}
+
+void Page_Validators::set(const char *url, const char *etag, const char *last_modified, unsigned long long content_hash) {
+    pthread_mutex_lock(&lock);
+    page *p = find(url);
+    if ( p == NULL ){
+        if ( size >= num_buckets ) grow();
+        p = new page;
+        p->url = new char[strlen(url) + 1];
+        strcpy(p->url, url);
+        unsigned int b = bucket_of(url, num_buckets);
+        p->next = buckets[b];
+        buckets[b] = p;
+        size++;
+    }
+    copy_validator(p->etag, etag);
+    copy_validator(p->last_modified, last_modified);
+    p->content_hash = content_hash;
+    pthread_mutex_unlock(&lock);
+}
+
+unsigned int Page_Validators::get_size() {
+    pthread_mutex_lock(&lock);
+    unsigned int result = size;
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+unsigned long long Page_Validators::hash(const char *data, size_t len, unsigned long long h) {     // FNV-1a 64
+    for (size_t i = 0 ; i < len ; i++){
+        h ^= (unsigned char) data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+Page_Validators::page *Page_Validators::find(const char *url) const {
+    for (page *p = buckets[bucket_of(url, num_buckets)] ; p != NULL ; p = p->next){
+        if ( strcmp(p->url, url) == 0 ) return p;
+    }
+    return NULL;
+}
+
+void Page_Validators::grow() {
+    unsigned int new_num_buckets = 2 * num_buckets;
+    page **new_buckets = new page*[new_num_buckets];
+    for (unsigned int i = 0 ; i < new_num_buckets ; i++){
+        new_buckets[i] = NULL;
+    }
+    for (unsigned int i = 0 ; i < num_buckets ; i++){
+        while ( buckets[i] != NULL ){
+            page *p = buckets[i];
+            buckets[i] = p->next;
+            unsigned int b = bucket_of(p->url, new_num_buckets);
+            p->next = new_buckets[b];
+            new_buckets[b] = p;
+        }
+    }
+    delete[] buckets;
+    buckets = new_buckets;
+    num_buckets = new_num_buckets;
+}
+
+unsigned int Page_Validators::bucket_of(const char *url, unsigned int num_buckets) {
+    return (unsigned int) hash(url, strlen(url)) & (num_buckets - 1);
+}
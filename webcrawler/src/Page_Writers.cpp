@@ -0,0 +1,178 @@
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../headers/Page_Writers.h"
+
+
+using namespace std;
+
+
+/* useful macros */
+#define CHECK_PERROR(call, callname, handle_code) { if ( ( call ) < 0 ) { perror(callname); handle_code } }
+
+
+Page_Writers::Page_Writers(unsigned int num_of_threads, Crawl_Checkpoint *crawl_checkpoint) : first(0), count(0), queued_bytes(0), num_busy(0), pages_written(0), full_waits(0), must_stop(false), num_threads(0), checkpoint(crawl_checkpoint) {
+    queue = new page_write[WRITE_QUEUE_SIZE];
+    if ( pthread_mutex_init(&lock, NULL) != 0 || pthread_cond_init(&notFull, NULL) != 0 || pthread_cond_init(&notEmpty, NULL) != 0 || pthread_cond_init(&idle, NULL) != 0 ){
+        cerr << "Warning: page writers' lock initialization failed!" << endl;
+    }
+    threads = new pthread_t[num_of_threads];
+    for (unsigned int i = 0 ; i < num_of_threads ; i++){
+        if ( pthread_create(&threads[num_threads], NULL, write_pages, (void *) this) != 0 ){
+            cerr << "Warning: could not create a page writer thread" << endl;
+        } else num_threads++;
+    }
+    if ( num_threads == 0 ) cerr << "Warning: no page writer thread could be created, pages will not be saved!" << endl;
+}
+
+Page_Writers::~Page_Writers() {
+    pthread_mutex_lock(&lock);
+    must_stop = true;
+    pthread_cond_broadcast(&notEmpty);
+    pthread_mutex_unlock(&lock);
+    for (unsigned int i = 0 ; i < num_threads ; i++){
+        if ( pthread_join(threads[i], NULL) != 0 ) cerr << "Warning: pthread_join on a page writer thread failed!" << endl;
+    }
+    for ( ; count > 0 ; count--, first = (first + 1) % WRITE_QUEUE_SIZE ){     // (only if there was no writer thread at all)
+        delete[] queue[first].path;
+        delete[] queue[first].final_path;
+        delete[] queue[first].data;
+        delete[] queue[first].done_url;
+    }
+    delete[] threads;
+    delete[] queue;
+    pthread_cond_destroy(&idle);
+    pthread_cond_destroy(&notEmpty);
+    pthread_cond_destroy(&notFull);
+    pthread_mutex_destroy(&lock);
+}
+
+void Page_Writers::push(char *path, char *final_path, char *data, size_t len, char *done_url) {
+    pthread_mutex_lock(&lock);
+    if ( count == WRITE_QUEUE_SIZE || (count > 0 && queued_bytes + len > WRITE_QUEUE_MAX_BYTES) ){
+        full_waits++;
+        do {
+            pthread_cond_wait(&notFull, &lock);
+        } while ( count == WRITE_QUEUE_SIZE || (count > 0 && queued_bytes + len > WRITE_QUEUE_MAX_BYTES) );
+    }
+    page_write &page = queue[(first + count) % WRITE_QUEUE_SIZE];
+    page.path = path;
+    page.final_path = final_path;
+    page.data = data;
+    page.len = len;
+    page.done_url = done_url;
+    count++;
+    queued_bytes += len;
+    pthread_cond_signal(&notEmpty);
+    pthread_mutex_unlock(&lock);
+}
+
+void Page_Writers::drain() {
+    pthread_mutex_lock(&lock);
+    while ( (count > 0 || num_busy > 0) && num_threads > 0 ){
+        pthread_cond_wait(&idle, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+unsigned int Page_Writers::queued(unsigned long long &bytes) {
+    pthread_mutex_lock(&lock);
+    unsigned int pages = count;
+    bytes = queued_bytes;
+    pthread_mutex_unlock(&lock);
+    return pages;
+}
+
+unsigned long long Page_Writers::written() {
+    pthread_mutex_lock(&lock);
+    unsigned long long pages = pages_written;
+    pthread_mutex_unlock(&lock);
+    return pages;
+}
+
+unsigned long long Page_Writers::waits() {
+    pthread_mutex_lock(&lock);
+    unsigned long long n = full_waits;
+    pthread_mutex_unlock(&lock);
+    return n;
+}
+
+unsigned int Page_Writers::size() const {
+    return num_threads;
+}
+
+void *Page_Writers::write_pages(void *writers) {     // a writer thread: takes up to WRITE_BATCH_SIZE pages at a time and writes them without holding the lock, until it must stop and the queue is empty
+    Page_Writers *w = (Page_Writers *) writers;
+    page_write batch[WRITE_BATCH_SIZE];
+    unsigned long long usec[WRITE_BATCH_SIZE];
+    pthread_mutex_lock(&w->lock);
+    for (;;){
+        while ( w->count == 0 && !w->must_stop ){
+            pthread_cond_wait(&w->notEmpty, &w->lock);
+        }
+        if ( w->count == 0 ) break;          // (must stop, and every page has been written)
+        unsigned int n = 0;
+        while ( n < WRITE_BATCH_SIZE && w->count > 0 ){
+            batch[n] = w->queue[w->first];
+            w->queued_bytes -= batch[n].len;
+            w->first = (w->first + 1) % WRITE_QUEUE_SIZE;
+            w->count--;
+            n++;
+        }
+        w->num_busy++;
+        pthread_cond_broadcast(&w->notFull);
+        pthread_mutex_unlock(&w->lock);
+
+        for (unsigned int i = 0 ; i < n ; i++){
+            unsigned long long started = monotonic_usec();
+            bool saved = write_page(batch[i]);
+            usec[i] = monotonic_usec() - started;
+            if ( saved && batch[i].done_url != NULL ) w->checkpoint->done(batch[i].done_url);     // (its links were logged before it was handed over)
+            delete[] batch[i].path;
+            delete[] batch[i].final_path;
+            delete[] batch[i].data;
+            delete[] batch[i].done_url;
+        }
+
+        pthread_mutex_lock(&w->lock);
+        for (unsigned int i = 0 ; i < n ; i++){
+            w->write_times.add(usec[i]);
+        }
+        w->pages_written += n;
+        w->num_busy--;
+        if ( w->count == 0 && w->num_busy == 0 ) pthread_cond_broadcast(&w->idle);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+bool Page_Writers::write_page(const page_write &page) {
+    int fd = open(page.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( fd < 0 ){
+        perror("Warning: A page writer thread could not create a page file");
+        return false;
+    }
+    size_t done = 0;
+    while ( done < page.len ){
+        ssize_t n = write(fd, page.data + done, page.len - done);
+        if ( n < 0 && errno == EINTR ) continue;
+        if ( n <= 0 ){
+            perror("Warning: A page writer thread did not write all bytes");
+            break;
+        }
+        done += (size_t) n;
+    }
+    // start writing the page back to the disk now, without waiting for it: the kernel then never has many pages' worth of dirty memory to flush at once
+    if ( done > 0 ) sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+    if ( close(fd) < 0 ) perror("Warning: close of a page file failed");
+    bool saved = ( done == page.len );
+    if ( page.final_path != NULL ){              // (if the page could not be written whole, the old copy is kept)
+        if ( saved ){
+            CHECK_PERROR( rename(page.path, page.final_path), "rename downloaded page over its old copy", saved = false; )
+        }
+        if ( !saved ) unlink(page.path);
+    }
+    return saved;
+}
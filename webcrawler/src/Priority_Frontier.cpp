@@ -0,0 +1,253 @@
+#include <iostream>
+#include <cstring>
+#include "../headers/Priority_Frontier.h"
+
+
+using namespace std;
+
+
+/* Scorers: */
+static unsigned int score_by_depth(const url_info &info) {       // breadth first: the fewer links away from starting_url, the sooner
+    return PRIORITY_LEVELS - 1 - ( (info.depth < PRIORITY_LEVELS - 1) ? info.depth : PRIORITY_LEVELS - 1 );
+}
+
+static unsigned int score_by_inlinks(const url_info &info) {     // the most linked pages (so far) first
+    return (info.inlinks < PRIORITY_LEVELS - 1) ? info.inlinks : PRIORITY_LEVELS - 1;
+}
+
+static unsigned int score_by_site(const url_info &info) {        // site round-robin: the k-th url of every site before the (k+1)-th url of any site
+    return PRIORITY_LEVELS - 1 - ( (info.site_rank < PRIORITY_LEVELS - 1) ? info.site_rank : PRIORITY_LEVELS - 1 );
+}
+
+static const struct { const char *name; url_scorer scorer; } scorers[] = {
+    { "depth", score_by_depth },
+    { "inlinks", score_by_inlinks },
+    { "sites", score_by_site }
+};
+
+
+static size_t site_len(const char *url) {        // a url's site is everything up to the end of the first directory of its root-relative part (ex: "http://host:8080/site0" or "/site0")
+    const char *root_relative = url;
+    if ( strncmp(url, "http://", strlen("http://")) == 0 ){
+        root_relative = strchr(url + strlen("http://"), '/');
+        if ( root_relative == NULL ) return strlen(url);
+    }
+    const char *end = strchr(root_relative + 1, '/');
+    return (end != NULL) ? (size_t) (end - url) : strlen(url);
+}
+
+
+Priority_Frontier::Priority_Frontier(url_scorer url_scorer) : scorer(url_scorer), table_size(PRIORITY_INITIAL_BUCKETS), count(0) {
+    for (unsigned int s = 0 ; s < PRIORITY_LEVELS ; s++){
+        heads[s] = tails[s] = NULL;
+    }
+    for (unsigned int w = 0 ; w < PRIORITY_WORDS ; w++){
+        nonempty[w] = 0;
+    }
+    table = new entry*[table_size];
+    for (unsigned int i = 0 ; i < table_size ; i++){
+        table[i] = NULL;
+    }
+    sites = new site*[PRIORITY_SITE_BUCKETS];
+    for (unsigned int i = 0 ; i < PRIORITY_SITE_BUCKETS ; i++){
+        sites[i] = NULL;
+    }
+    if ( pthread_mutex_init(&lock, NULL) != 0 ){
+        cerr << "Warning: pthread_mutex_init failed!" << endl;
+    }
+}
+
+Priority_Frontier::~Priority_Frontier() {
+    for (unsigned int s = 0 ; s < PRIORITY_LEVELS ; s++){
+        while ( heads[s] != NULL ){
+            entry *e = heads[s];
+            heads[s] = e->next;
+            delete[] e->url;
+            delete e;
+        }
+    }
+    delete[] table;
+    for (unsigned int i = 0 ; i < PRIORITY_SITE_BUCKETS ; i++){
+        while ( sites[i] != NULL ){
+            site *st = sites[i];
+            sites[i] = st->hnext;
+            delete[] st->name;
+            delete st;
+        }
+    }
+    delete[] sites;
+    pthread_mutex_destroy(&lock);
+}
+
+void Priority_Frontier::push(const char *url, unsigned int depth) {
+    entry *e = new entry;
+    e->url = new char[strlen(url) + 1];
+    strcpy(e->url, url);
+    e->info.url = e->url;
+    e->info.depth = depth;
+    e->info.inlinks = 1;                         // (the link that got it queued)
+    pthread_mutex_lock(&lock);
+    insert(e);
+    pthread_mutex_unlock(&lock);
+}
+
+void Priority_Frontier::link_seen(const char *url) {
+    pthread_mutex_lock(&lock);
+    rescore(url);
+    pthread_mutex_unlock(&lock);
+}
+
+void Priority_Frontier::push_batch(const char *const *urls, unsigned int num_of_urls, unsigned int depth, const char *const *seen_urls, unsigned int num_seen) {
+    entry **entries = new entry*[(num_of_urls > 0) ? num_of_urls : 1];
+    for (unsigned int i = 0 ; i < num_of_urls ; i++){      // (allocated before locking)
+        entries[i] = new entry;
+        entries[i]->url = new char[strlen(urls[i]) + 1];
+        strcpy(entries[i]->url, urls[i]);
+        entries[i]->info.url = entries[i]->url;
+        entries[i]->info.depth = depth;
+        entries[i]->info.inlinks = 1;
+    }
+    pthread_mutex_lock(&lock);
+    for (unsigned int i = 0 ; i < num_of_urls ; i++){
+        insert(entries[i]);
+    }
+    for (unsigned int i = 0 ; i < num_seen ; i++){
+        rescore(seen_urls[i]);
+    }
+    pthread_mutex_unlock(&lock);
+    delete[] entries;
+}
+
+void Priority_Frontier::insert(entry *e) {
+    e->info.site_rank = site_rank(e->url);
+    e->score = scorer(e->info);
+    if ( count >= table_size ) grow();
+    unsigned int b = hash(e->url, strlen(e->url)) & (table_size - 1);
+    e->hnext = table[b];
+    table[b] = e;
+    link(e);
+    __atomic_store_n(&count, count + 1, __ATOMIC_RELAXED);
+}
+
+void Priority_Frontier::rescore(const char *url) {
+    entry *e = find(url);
+    if ( e != NULL ){                            // (else it has already been popped: nothing to do)
+        e->info.inlinks++;
+        unsigned int score = scorer(e->info);
+        if ( score != e->score ){                // move it to the end of its new bucket
+            unlink(e);
+            e->score = score;
+            link(e);
+        }
+    }
+}
+
+bool Priority_Frontier::pop(char *url, size_t url_size, unsigned int &depth) {
+    pthread_mutex_lock(&lock);
+    int w;
+    for (w = PRIORITY_WORDS - 1 ; w >= 0 && nonempty[w] == 0 ; w--) ;
+    if ( w < 0 ){
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+    unsigned int s = (unsigned int) w * 64 + 63 - (unsigned int) __builtin_clzll(nonempty[w]);      // the highest non-empty bucket
+    entry *e = heads[s];
+    unlink(e);
+    entry **pos = &table[hash(e->url, strlen(e->url)) & (table_size - 1)];
+    while ( *pos != e ) pos = &(*pos)->hnext;
+    *pos = e->hnext;
+    __atomic_store_n(&count, count - 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+    strncpy(url, e->url, url_size - 1);
+    url[url_size - 1] = '\0';
+    depth = e->info.depth;
+    delete[] e->url;
+    delete e;
+    return true;
+}
+
+unsigned int Priority_Frontier::size() const {
+    return __atomic_load_n(&count, __ATOMIC_RELAXED);
+}
+
+url_scorer Priority_Frontier::scorer_named(const char *name) {
+    for (size_t i = 0 ; i < sizeof(scorers) / sizeof(scorers[0]) ; i++){
+        if ( strcmp(name, scorers[i].name) == 0 ) return scorers[i].scorer;
+    }
+    return NULL;
+}
+
+void Priority_Frontier::link(entry *e) {         // append e to the list of its score
+    unsigned int s = (e->score < PRIORITY_LEVELS) ? e->score : PRIORITY_LEVELS - 1;
+    e->score = s;
+    e->next = NULL;
+    e->prev = tails[s];
+    if ( tails[s] != NULL ) tails[s]->next = e;
+    else heads[s] = e;
+    tails[s] = e;
+    nonempty[s / 64] |= 1ULL << (s % 64);
+}
+
+void Priority_Frontier::unlink(entry *e) {
+    unsigned int s = e->score;
+    if ( e->prev != NULL ) e->prev->next = e->next;
+    else heads[s] = e->next;
+    if ( e->next != NULL ) e->next->prev = e->prev;
+    else tails[s] = e->prev;
+    if ( heads[s] == NULL ) nonempty[s / 64] &= ~(1ULL << (s % 64));
+}
+
+Priority_Frontier::entry *Priority_Frontier::find(const char *url) const {
+    for (entry *e = table[hash(url, strlen(url)) & (table_size - 1)] ; e != NULL ; e = e->hnext){
+        if ( strcmp(e->url, url) == 0 ) return e;
+    }
+    return NULL;
+}
+
+void Priority_Frontier::grow() {
+    unsigned int new_size = 2 * table_size;
+    entry **new_table = new entry*[new_size];
+    for (unsigned int i = 0 ; i < new_size ; i++){
+        new_table[i] = NULL;
+    }
+    for (unsigned int i = 0 ; i < table_size ; i++){
+        while ( table[i] != NULL ){
+            entry *e = table[i];
+            table[i] = e->hnext;
+            unsigned int b = hash(e->url, strlen(e->url)) & (new_size - 1);
+            e->hnext = new_table[b];
+            new_table[b] = e;
+        }
+    }
+    delete[] table;
+    table = new_table;
+    table_size = new_size;
+}
+
+unsigned int Priority_Frontier::site_rank(const char *url) {     // returns how many urls of url's site were queued before it (and counts url)
+    size_t len = site_len(url);
+    unsigned int b = hash(url, len) & (PRIORITY_SITE_BUCKETS - 1);
+    site *st;
+    for (st = sites[b] ; st != NULL ; st = st->hnext){
+        if ( strlen(st->name) == len && strncmp(st->name, url, len) == 0 ) break;
+    }
+    if ( st == NULL ){
+        st = new site;
+        st->name = new char[len + 1];
+        memcpy(st->name, url, len);
+        st->name[len] = '\0';
+        st->num_queued = 0;
+        st->hnext = sites[b];
+        sites[b] = st;
+    }
+    return st->num_queued++;
+}
+
+unsigned int Priority_Frontier::hash(const char *str, size_t len) {     // FNV-1a
+    unsigned int h = 2166136261u;
+    for (size_t i = 0 ; i < len ; i++){
+        h ^= (unsigned char) str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
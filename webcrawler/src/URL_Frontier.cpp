@@ -0,0 +1,270 @@
+#include <iostream>
+#include <pthread.h>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include "../headers/URL_Frontier.h"
+
+
+using namespace std;
+
+
+#define RUN_PATH_SIZE 4096
+
+
+URL_Frontier::segment::segment(size_t size) : arena_size(size), arena_used(0), head(0), tail(0), next(NULL) {
+    arena = new char[size];
+}
+
+URL_Frontier::segment::~segment() {
+    delete[] arena;
+}
+
+bool URL_Frontier::segment::fits(size_t len) const {
+    return tail < FRONTIER_SEGMENT_SLOTS && arena_used + len + 1 <= arena_size;
+}
+
+
+URL_Frontier::URL_Frontier() : first(NULL), last(NULL), spare(NULL), count(0), memory_used(0), max_memory(0), spill_dir(NULL), writing(NULL), reading(NULL),
+                               first_run(0), last_run(0), run_size(0), spilled(0), run_urls(NULL), run_urls_size(0), parked(0) {
+    if ( pthread_mutex_init(&lock, NULL) < 0 ){
+        cerr << "Warning: pthread_mutex_init failed!" << endl;
+    }
+    if ( pthread_cond_init(&notEmpty, NULL) < 0 ){
+        cerr << "Warning: pthread_cond_init failed!" << endl;
+    }
+}
+
+URL_Frontier::~URL_Frontier() {
+    while ( first != NULL ){
+        segment *temp = first->next;
+        delete first;
+        first = temp;
+    }
+    delete spare;
+    if ( writing != NULL ) fclose(writing);
+    if ( reading != NULL ) fclose(reading);
+    char path[RUN_PATH_SIZE];
+    for (unsigned int run = first_run ; run < last_run ; run++){      // (the runs are only good for this crawl: a checkpoint keeps the urls that were not done)
+        run_path(run, path, sizeof(path));
+        unlink(path);
+    }
+    delete[] run_urls;
+    delete[] spill_dir;
+    if ( pthread_cond_destroy(&notEmpty) < 0 ){
+        cerr << "Warning: pthread_cond_destroy failed!" << endl;
+    }
+    if ( pthread_mutex_destroy(&lock) < 0 ){
+        cerr << "Warning: pthread_mutex_destroy failed!" << endl;
+    }
+}
+
+bool URL_Frontier::limit_memory(size_t max_bytes, const char *dir) {
+    if ( strlen(dir) + 32 > RUN_PATH_SIZE ) return false;
+    max_memory = max_bytes;
+    spill_dir = new char[strlen(dir) + 1];
+    strcpy(spill_dir, dir);
+    return true;
+}
+
+unsigned int URL_Frontier::get_spilled() const { return __atomic_load_n(&spilled, __ATOMIC_RELAXED); }
+
+bool URL_Frontier::isEmpty() const { return (count == 0); }
+
+unsigned int URL_Frontier::size() const { return count; }
+
+bool URL_Frontier::looks_empty() const { return __atomic_load_n(&count, __ATOMIC_RELAXED) == 0; }
+
+void URL_Frontier::push(const char *url) {        // O(1)
+    if ( url == NULL ) { cerr << "Warning: NULL url pushed in URL Frontier?" << endl; return; }
+    append(url);
+    wake(1);
+}
+
+void URL_Frontier::push_batch(const char *const *urls, int num_of_urls) {   // O(num_of_urls) - but only one wake up call
+    for (int i = 0 ; i < num_of_urls ; i++){
+        if ( urls[i] != NULL ) append(urls[i]);
+    }
+    if ( num_of_urls > 0 ) wake((unsigned int) num_of_urls);
+}
+
+void URL_Frontier::append(const char *url) {
+    size_t len = strlen(url);
+    // with limited memory, a url that needs a new segment that would go over it is spilled, and so is every url after it until the runs are read back (to keep them in order)
+    bool spilling = ( max_memory > 0 && (spilled > 0 || ((last == NULL || !last->fits(len)) && spare == NULL && memory_used + sizeof(segment) + FRONTIER_SEGMENT_ARENA > max_memory)) );
+    if ( !spilling || !spill(url, len) ) append_to_memory(url, len);
+    __atomic_store_n(&count, count + 1, __ATOMIC_RELAXED);       // (so that looks_empty() can read it without the lock)
+}
+
+void URL_Frontier::append_to_memory(const char *url, size_t len) {
+    if ( last == NULL || !last->fits(len) ){      // need a new segment at the end of the ring
+        segment *seg;
+        if ( spare != NULL && len + 1 <= spare->arena_size ){
+            seg = spare;
+            spare = NULL;
+        } else {
+            seg = new segment( (len + 1 > FRONTIER_SEGMENT_ARENA) ? len + 1 : FRONTIER_SEGMENT_ARENA );
+            memory_used += sizeof(segment) + seg->arena_size;
+        }
+        if ( last == NULL ) first = last = seg;
+        else { last->next = seg; last = seg; }
+    }
+    last->offsets[last->tail++] = (unsigned int) last->arena_used;
+    memcpy(last->arena + last->arena_used, url, len + 1);
+    last->arena_used += len + 1;
+}
+
+bool URL_Frontier::spill(const char *url, size_t len) {
+    if ( writing == NULL ){                       // start a new run
+        char path[RUN_PATH_SIZE];
+        run_path(last_run, path, sizeof(path));
+        if ( (writing = fopen(path, "w")) == NULL ){
+            perror("Warning: could not spill the frontier to disk, keeping the url in memory");
+            return false;
+        }
+        if ( last_run == run_urls_size ){         // (one counter per run ever started: 4 bytes per FRONTIER_RUN_SIZE of urls)
+            unsigned int new_size = (run_urls_size == 0) ? 64 : 2 * run_urls_size;
+            unsigned int *temp = new unsigned int[new_size];
+            if ( run_urls != NULL ) memcpy(temp, run_urls, run_urls_size * sizeof(unsigned int));
+            delete[] run_urls;
+            run_urls = temp;
+            run_urls_size = new_size;
+        }
+        run_urls[last_run++] = 0;
+        run_size = 0;
+    }
+    if ( fwrite(url, 1, len + 1, writing) != len + 1 ){        // ('\0' terminated, one after the other)
+        perror("Warning: could not spill the frontier to disk, keeping the url in memory");
+        return false;
+    }
+    run_size += len + 1;
+    run_urls[last_run - 1]++;
+    __atomic_store_n(&spilled, spilled + 1, __ATOMIC_RELAXED);
+    if ( run_size >= FRONTIER_RUN_SIZE ){
+        fclose(writing);
+        writing = NULL;
+    }
+    return true;
+}
+
+void URL_Frontier::refill() {                     // (only called when the segments are empty) fill up to half of max_memory with the oldest spilled urls
+    char path[RUN_PATH_SIZE];
+    char *url = NULL;
+    size_t url_capacity = 0;
+    while ( spilled > 0 && first_run < last_run && (first == NULL || memory_used < max_memory / 2) ){
+        if ( reading == NULL ){
+            if ( first_run == last_run - 1 && writing != NULL ){      // the run being written is read back as it is: the next url spilled starts a new one
+                fclose(writing);
+                writing = NULL;
+            }
+            run_path(first_run, path, sizeof(path));
+            if ( (reading = fopen(path, "r")) == NULL ){
+                perror("Warning: could not read a spilled run of the frontier back");
+                drop_first_run();
+                continue;
+            }
+        }
+        ssize_t n = getdelim(&url, &url_capacity, '\0', reading);
+        if ( n <= 0 ){                            // run done: on to the next one
+            if ( ferror(reading) ) perror("Warning: could not read a spilled run of the frontier back");
+            drop_first_run();
+            continue;
+        }
+        append_to_memory(url, (size_t) n - 1);
+        run_urls[first_run]--;
+        __atomic_store_n(&spilled, spilled - 1, __ATOMIC_RELAXED);
+    }
+    free(url);
+}
+
+void URL_Frontier::drop_first_run() {
+    char path[RUN_PATH_SIZE];
+    if ( reading != NULL ){
+        fclose(reading);
+        reading = NULL;
+    }
+    run_path(first_run, path, sizeof(path));
+    unlink(path);
+    unsigned int lost = run_urls[first_run++];
+    if ( lost > 0 ){                              // (so that count does not keep promising urls that pop() can never give)
+        cerr << "Warning: " << lost << " spilled urls of the frontier could not be read back and are lost: " << path << endl;
+        __atomic_store_n(&spilled, spilled - lost, __ATOMIC_RELAXED);
+        __atomic_store_n(&count, count - lost, __ATOMIC_RELAXED);
+    }
+}
+
+void URL_Frontier::run_path(unsigned int run, char *path, size_t size) const {
+    snprintf(path, size, "%s/frontier_%u", spill_dir, run);
+}
+
+bool URL_Frontier::pop(char *url, size_t url_size) {     // O(1) (+ the copy of the url)
+    if ( count == 0 ) return false;
+    if ( first == NULL ) refill();                // (the rest of the urls were spilled)
+    if ( first == NULL ) return false;            // (the runs could not be read back: their urls are no longer counted)
+    const char *str = first->arena + first->offsets[first->head++];
+    strncpy(url, str, url_size - 1);
+    url[url_size - 1] = '\0';
+    __atomic_store_n(&count, count - 1, __ATOMIC_RELAXED);
+    if ( first->head == first->tail ){            // segment drained: unlink it and keep it as spare if we don't have one already
+        segment *drained = first;
+        if ( first == last ){                     // it was the only one
+            first = last = NULL;
+        } else first = first->next;
+        drained->head = drained->tail = 0;
+        drained->arena_used = 0;
+        drained->next = NULL;
+        if ( spare == NULL && drained->arena_size == FRONTIER_SEGMENT_ARENA ) spare = drained;
+        else {
+            memory_used -= sizeof(segment) + drained->arena_size;
+            delete drained;
+        }
+    }
+    return true;
+}
+
+void URL_Frontier::begin_parking() {               // lock MUST be held
+    __sync_fetch_and_add(&parked, 1);             // (a full barrier: whatever is checked after this call is read after parked is seen as increased)
+}
+
+void URL_Frontier::wait() {                        // lock MUST be held
+    if ( pthread_cond_wait(&notEmpty, &lock) != 0 ){
+        cerr << "Warning: pthread_cond_wait failed!" << endl;
+    }
+}
+
+void URL_Frontier::end_parking() {                 // lock MUST be held
+    __sync_fetch_and_sub(&parked, 1);
+}
+
+unsigned int URL_Frontier::num_parked() const { return __atomic_load_n(&parked, __ATOMIC_SEQ_CST); }
+
+void URL_Frontier::wake_all() {
+    if ( pthread_cond_broadcast(&notEmpty) != 0 ){
+        cerr << "Warning: pthread_cond_broadcast failed!" << endl;
+    }
+}
+
+void URL_Frontier::wake(unsigned int num_of_urls) {  // wake up at most one parked thread for each new url - and no one if no one is parked
+    if ( parked == 0 ) return;
+    if ( num_of_urls >= parked ){
+        wake_all();
+    } else {
+        for (unsigned int i = 0 ; i < num_of_urls ; i++){
+            if ( pthread_cond_signal(&notEmpty) != 0 ){
+                cerr << "Warning: pthread_cond_signal failed!" << endl;
+            }
+        }
+    }
+}
+
+void URL_Frontier::acquire() {
+    if ( pthread_mutex_lock(&lock) < 0 ){
+        cerr << "Warning: failed to lock the mutex!" << endl;
+    }
+}
+
+void URL_Frontier::release() {
+    if ( pthread_mutex_unlock(&lock) < 0 ){
+        cerr << "Warning: failed to unlock the mutex!" << endl;
+    }
+}
@@ -0,0 +1,233 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <strings.h>
+#include "../headers/URL_Interner.h"
+#include "../headers/hash_history.h"
+
+
+using namespace std;
+
+
+bool canonicalize_url(const char *url, char *canonical, size_t size, unsigned short default_port) {
+    size_t len = 0;
+    const char *path = url;
+    if ( strncasecmp(url, "http://", 7) == 0 ){
+        // "http://<host>[:<port>]": the host in lower case and the port always given
+        const char *host = url + 7, *host_end = host;
+        while ( *host_end != '\0' && *host_end != ':' && *host_end != '/' ) host_end++;
+        unsigned long port = default_port;
+        path = host_end;
+        if ( *path == ':' ){
+            const char *digits = ++path;
+            port = 0;
+            while ( isdigit((unsigned char) *path) && port <= 65535 ){
+                port = 10 * port + (unsigned long) (*path - '0');
+                path++;
+            }
+            if ( path == digits ) port = default_port;          // ("http://host:/page")
+            if ( port > 65535 || (*path != '\0' && *path != '/') ){     // (not a port: leave it as it is, it will be found invalid when popped)
+                if ( strlen(url) >= size ) return false;
+                strcpy(canonical, url);
+                return true;
+            }
+        }
+        if ( 7 + (size_t) (host_end - host) + 7 >= size ) return false;
+        strcpy(canonical, "http://");
+        len = 7;
+        for (const char *c = host ; c < host_end ; c++){
+            canonical[len++] = (char) tolower((unsigned char) *c);
+        }
+        len += (size_t) sprintf(canonical + len, ":%lu", port);
+        if ( *path == '\0' ) path = "/";                         // ("http://host:port" is its root)
+    } else if ( url[0] != '/' ){                                 // (not a link we can crawl: it is found invalid when popped)
+        if ( strlen(url) >= size ) return false;
+        strcpy(canonical, url);
+        return true;
+    }
+
+    // the path: its segments are copied one by one, dropping "." and empty ones and taking the last one copied back for ".." (never going above the root)
+    const size_t root = len;
+    bool trailing_slash = false;
+    const char *segment = path + 1;
+    for (;;){
+        const char *end = segment;
+        while ( *end != '\0' && *end != '/' && *end != '?' && *end != '#' ) end++;
+        size_t n = (size_t) (end - segment);
+        bool last = ( *end != '/' );
+        if ( n == 0 || (n == 1 && segment[0] == '.') ){
+            trailing_slash = last;
+        } else if ( n == 2 && segment[0] == '.' && segment[1] == '.' ){
+            while ( len > root && canonical[len - 1] != '/' ) len--;
+            if ( len > root ) len--;
+            trailing_slash = last;
+        } else {
+            if ( len + 1 + n >= size ) return false;
+            canonical[len++] = '/';
+            memcpy(canonical + len, segment, n);
+            len += n;
+            trailing_slash = false;
+        }
+        segment = end;
+        if ( last ) break;
+        segment++;
+    }
+    if ( trailing_slash || len == root ){
+        if ( len + 1 >= size ) return false;
+        canonical[len++] = '/';
+    }
+    if ( *segment == '?' ){                                      // the query as it is, without the fragment
+        const char *end = strchr(segment, '#');
+        size_t n = (end != NULL) ? (size_t) (end - segment) : strlen(segment);
+        if ( len + n >= size ) return false;
+        memcpy(canonical + len, segment, n);
+        len += n;
+    }
+    canonical[len] = '\0';
+    return true;
+}
+
+
+URL_Interner::URL_Interner() : next_id(0), arena_bytes(0) {
+    for (int i = 0 ; i < INTERNER_STRIPES ; i++){
+        if ( pthread_mutex_init(&stripes[i].lock, NULL) < 0 ){
+            cerr << "Warning: pthread_mutex_init failed!" << endl;
+        }
+        stripes[i].capacity = INTERNER_STRIPE_INITIAL_CAPACITY;
+        stripes[i].size = 0;
+        stripes[i].table = new unsigned long long[INTERNER_STRIPE_INITIAL_CAPACITY];
+        memset(stripes[i].table, 0, INTERNER_STRIPE_INITIAL_CAPACITY * sizeof(unsigned long long));
+        stripes[i].block = NULL;
+        stripes[i].block_used = stripes[i].block_size = 0;
+    }
+    for (int c = 0 ; c < INTERNER_MAX_CHUNKS ; c++){
+        chunks[c] = NULL;
+    }
+}
+
+URL_Interner::~URL_Interner() {
+    for (int i = 0 ; i < INTERNER_STRIPES ; i++){
+        delete[] stripes[i].table;
+        char *block = stripes[i].block;
+        while ( block != NULL ){
+            char *previous;
+            memcpy(&previous, block, sizeof(char *));
+            delete[] block;
+            block = previous;
+        }
+        if ( pthread_mutex_destroy(&stripes[i].lock) < 0 ){
+            cerr << "Warning: pthread_mutex_destroy failed!" << endl;
+        }
+    }
+    for (int c = 0 ; c < INTERNER_MAX_CHUNKS ; c++){
+        delete[] chunks[c];
+    }
+}
+
+bool URL_Interner::intern(const char *url, unsigned int &id) {      // O(1) expected
+    unsigned long long h = hash_history::hash(url);
+    unsigned int tag = (unsigned int) h;
+    stripe &s = stripes[h >> 58];                                    // top 6 bits pick the stripe (INTERNER_STRIPES == 64)
+    if ( pthread_mutex_lock(&s.lock) < 0 ){
+        cerr << "Warning: failed to lock the mutex!" << endl;
+    }
+    unsigned int pos;
+    bool found = probe(s, tag, url, pos);
+    if ( found ){
+        id = (unsigned int) (s.table[pos] & 0xFFFFFFFFULL) - 1;
+    } else {
+        id = __sync_fetch_and_add(&next_id, 1);
+        publish(id, store(s, url, strlen(url)));                     // (before the id can be found by anyone else)
+        s.table[pos] = ((unsigned long long) tag << 32) | (unsigned long long) (id + 1);
+        s.size++;
+        if ( 10 * s.size > 7 * s.capacity ) grow(s);                 // keep load factor under 0.7
+    }
+    if ( pthread_mutex_unlock(&s.lock) < 0 ){
+        cerr << "Warning: failed to unlock the mutex!" << endl;
+    }
+    return !found;
+}
+
+bool URL_Interner::find(const char *url, unsigned int &id) {
+    unsigned long long h = hash_history::hash(url);
+    stripe &s = stripes[h >> 58];
+    if ( pthread_mutex_lock(&s.lock) < 0 ){
+        cerr << "Warning: failed to lock the mutex!" << endl;
+    }
+    unsigned int pos;
+    bool found = probe(s, (unsigned int) h, url, pos);
+    if ( found ) id = (unsigned int) (s.table[pos] & 0xFFFFFFFFULL) - 1;
+    if ( pthread_mutex_unlock(&s.lock) < 0 ){
+        cerr << "Warning: failed to unlock the mutex!" << endl;
+    }
+    return found;
+}
+
+const char *URL_Interner::url_of(unsigned int id) const {
+    const char **chunk = __atomic_load_n(&chunks[id / INTERNER_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&chunk[id % INTERNER_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+}
+
+unsigned int URL_Interner::size() const {
+    return __atomic_load_n(&next_id, __ATOMIC_RELAXED);
+}
+
+unsigned long long URL_Interner::memory() const {
+    return __atomic_load_n(&arena_bytes, __ATOMIC_RELAXED);
+}
+
+char *URL_Interner::store(stripe &s, const char *url, size_t url_len) {
+    if ( s.block == NULL || s.block_used + url_len + 1 > s.block_size ){      // start a new block (a url longer than a whole block gets one of its own)
+        size_t block_size = sizeof(char *) + url_len + 1;
+        if ( block_size < INTERNER_ARENA_BLOCK_SIZE ) block_size = INTERNER_ARENA_BLOCK_SIZE;
+        char *block = new char[block_size];
+        memcpy(block, &s.block, sizeof(char *));
+        s.block = block;
+        s.block_used = sizeof(char *);
+        s.block_size = block_size;
+        __sync_fetch_and_add(&arena_bytes, (unsigned long long) block_size);
+    }
+    char *copy = s.block + s.block_used;
+    memcpy(copy, url, url_len + 1);
+    s.block_used += url_len + 1;
+    return copy;
+}
+
+void URL_Interner::publish(unsigned int id, const char *url) {
+    const char ***chunk = &chunks[id / INTERNER_CHUNK_SIZE];
+    const char **c = __atomic_load_n(chunk, __ATOMIC_ACQUIRE);
+    if ( c == NULL ){                                                // the first id to need this chunk allocates it (stripes are locked independently, so others may race for it)
+        const char **new_chunk = new const char*[INTERNER_CHUNK_SIZE];
+        if ( __atomic_compare_exchange_n(chunk, &c, new_chunk, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ){
+            c = new_chunk;
+            __sync_fetch_and_add(&arena_bytes, (unsigned long long) INTERNER_CHUNK_SIZE * sizeof(const char *));
+        } else delete[] new_chunk;                                   // (c is the winner's chunk)
+    }
+    __atomic_store_n(&c[id % INTERNER_CHUNK_SIZE], url, __ATOMIC_RELEASE);
+}
+
+bool URL_Interner::probe(const stripe &s, unsigned int tag, const char *url, unsigned int &pos) const {      // linear probing
+    unsigned int mask = s.capacity - 1;
+    for (pos = tag & mask ; s.table[pos] != 0 ; pos = (pos + 1) & mask){
+        if ( (unsigned int) (s.table[pos] >> 32) == tag && strcmp(url_of((unsigned int) (s.table[pos] & 0xFFFFFFFFULL) - 1), url) == 0 ) return true;
+    }
+    return false;
+}
+
+void URL_Interner::grow(stripe &s) {                                 // double the stripe's capacity and rehash (stripe's lock must be held)
+    unsigned long long *old_table = s.table;
+    unsigned int old_capacity = s.capacity;
+    s.capacity *= 2;
+    s.table = new unsigned long long[s.capacity];
+    memset(s.table, 0, s.capacity * sizeof(unsigned long long));
+    unsigned int mask = s.capacity - 1;
+    for (unsigned int i = 0 ; i < old_capacity ; i++){
+        if ( old_table[i] != 0 ){                                    // (all entries are distinct: only an empty slot is looked for)
+            unsigned int pos = (unsigned int) (old_table[i] >> 32) & mask;
+            while ( s.table[pos] != 0 ) pos = (pos + 1) & mask;
+            s.table[pos] = old_table[i];
+        }
+    }
+    delete[] old_table;
+}
@@ -0,0 +1,86 @@
+#include <iostream>
+#include "../headers/Work_Deque.h"
+
+
+using namespace std;
+
+
+Work_Deque::Work_Deque() : capacity(DEQUE_INITIAL_CAPACITY), top(0), bottom(0), count(0) {
+    ring = new unsigned int[capacity];
+    if ( pthread_mutex_init(&lock, NULL) != 0 ){
+        cerr << "Warning: pthread_mutex_init failed!" << endl;
+    }
+}
+
+Work_Deque::~Work_Deque() {
+    delete[] ring;
+    pthread_mutex_destroy(&lock);
+}
+
+void Work_Deque::push(unsigned int url_id) {
+    pthread_mutex_lock(&lock);
+    push_owned(url_id);
+    pthread_mutex_unlock(&lock);
+}
+
+void Work_Deque::push_batch(const unsigned int *url_ids, unsigned int num_of_urls) {
+    pthread_mutex_lock(&lock);
+    for (unsigned int i = 0 ; i < num_of_urls ; i++){
+        push_owned(url_ids[i]);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+bool Work_Deque::pop(unsigned int &url_id) {
+    pthread_mutex_lock(&lock);
+    if ( bottom == top ){
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+    bottom--;
+    url_id = ring[bottom & (capacity - 1)];
+    __atomic_store_n(&count, bottom - top, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+unsigned int Work_Deque::steal_into(Work_Deque &thief) {
+    if ( size() == 0 || &thief == this ) return 0;      // (do not even lock a victim that has nothing)
+    unsigned int stolen[STEAL_BATCH_MAX];
+    pthread_mutex_lock(&lock);
+    unsigned int num = (bottom - top + 1) / 2;           // (a single url can be stolen too)
+    if ( num > STEAL_BATCH_MAX ) num = STEAL_BATCH_MAX;
+    for (unsigned int i = 0 ; i < num ; i++){
+        stolen[i] = ring[(top + i) & (capacity - 1)];
+    }
+    top += num;
+    __atomic_store_n(&count, bottom - top, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+    if ( num == 0 ) return 0;
+    // the oldest url ends up at thief's bottom, so that thief starts with it
+    pthread_mutex_lock(&thief.lock);
+    for (unsigned int i = num ; i > 0 ; i--){
+        thief.push_owned(stolen[i - 1]);
+    }
+    pthread_mutex_unlock(&thief.lock);
+    return num;
+}
+
+unsigned int Work_Deque::size() const {
+    return __atomic_load_n(&count, __ATOMIC_RELAXED);
+}
+
+void Work_Deque::push_owned(unsigned int url_id) {
+    if ( bottom - top == capacity ){             // full: double the ring, keeping the urls in order
+        unsigned int *new_ring = new unsigned int[2 * capacity];
+        for (unsigned int i = top ; i != bottom ; i++){
+            new_ring[i & (2 * capacity - 1)] = ring[i & (capacity - 1)];
+        }
+        delete[] ring;
+        ring = new_ring;
+        capacity *= 2;
+    }
+    ring[bottom & (capacity - 1)] = url_id;
+    bottom++;
+    __atomic_store_n(&count, bottom - top, __ATOMIC_RELAXED);
+}
@@ -4,24 +4,44 @@
 #include <cstdio>
 #include <unistd.h>
 #include <cstring>
-#include <sstream>
 #include <sys/stat.h>
 #include <cerrno>
 #include <cstdlib>
 #include <arpa/inet.h>
 #include <netdb.h>
-#include "../headers/FIFO_Queue.h"
+#include <sys/epoll.h>
+#include "../headers/URL_Frontier.h"
 #include "../headers/crawl.h"
 #include "../headers/str_history.h"
+#include "../headers/hash_history.h"
+#include "../headers/HTTP_Connection.h"
+#include "../headers/Link_Tokenizer.h"
+#include "../headers/DNS_Cache.h"
+#include "../headers/Crawl_Checkpoint.h"
+#include "../headers/Page_Validators.h"
+#include "../headers/Work_Deque.h"
+#include "../headers/Priority_Frontier.h"
+#include "../headers/Page_Segments.h"
+#include "../headers/crawling_monitoring.h"
+#include "../headers/Fetch_Metrics.h"
+#include "../headers/Crawl_Hosts.h"
+#include "../headers/URL_Interner.h"
+#include "../headers/Near_Duplicates.h"
+#include "../headers/Page_Writers.h"
+#include "../headers/Concurrency_Controller.h"
+#include "../headers/Link_Graph.h"
+#include "../headers/Fetch_Retries.h"
+#include "../headers/Link_Batch.h"
 
 
 using namespace std;
 
 
-#define MAX_LINK_SIZE 512                    // the maximum size a link can have. Overflowing links will not be saved in their entirety so set this wisely
-#define BUFFER_SIZE 1024                     // buffer size for both: 1. reading from the socket to download a page, 2. reading from a page we just downloaded as a file
-#define HEADER_READ_BUF_SIZE 128             // buffer size for reading the http header. We do not want this too high so as to not get much of the content along with the header
-#define MAX_HEADER_SIZE 1024                 // the maximum size an http response header can have for us to support it. Overflown headers will not be saved in their entirety
+#define EPOLL_MAX_EVENTS 64                  // the maximum number of socket events a thread handles after each epoll_wait
+#define FRONTIER_RECHECK_INTERVAL 10         // ms a thread with free fetch slots waits for socket events before looking at the urlQueue again
+#define SAVED_PAGE_READ_SIZE 65536           // how much of a saved page (that did not change since the last crawl) is read at a time to crawl it for links
+#define PAGE_BUFFER_INITIAL_SIZE 16384       // (--segments, --pipeline) bytes: a page is kept in memory until it is complete, in a buffer that doubles whenever it is full
+#define TIMEOUT_CHECK_INTERVAL 1000          // ms a thread with all of its fetch slots busy waits for socket events before checking for timed out downloads
 
 
 /* useful macros */
@@ -35,323 +55,701 @@ extern pthread_mutex_t stat_lock;
 extern unsigned int total_pages_downloaded;
 extern unsigned int total_bytes_downloaded;
 extern char *save_dir;
-extern pthread_cond_t QueueIsEmpty;
-extern FIFO_Queue *urlQueue;
+extern URL_Frontier *urlQueue;
 extern bool threads_must_terminate;
-extern int num_of_threads_blocked;
-extern str_history *urlHistory;
+extern hash_history *urlHistory;
 extern bool crawling_has_finished;
 extern pthread_cond_t crawlingFinished;
 extern pthread_mutex_t crawlingFinishedLock;
 extern str_history *alldirs;
+extern DNS_Cache *dnsCache;
+extern Crawl_Checkpoint *checkpoint;
+extern Page_Validators *validators;
+extern bool recrawl;
+extern unsigned int pages_changed, pages_unchanged, pages_new;
+extern Work_Deque *localQueues;
+extern unsigned int pending_urls;
+extern Priority_Frontier *priorityQueue;
+extern int max_pages;
+extern int pages_budget;
+extern Segment_Store *segmentStore;
+extern bool pipelined;
+extern Fetch_Metrics *fetchMetrics;
+extern Crawl_Hosts *crawlHosts;
+extern URL_Interner *urlIds;
+extern unsigned long long memory_limit;
+extern Near_Duplicate_Index *nearDuplicates;
+extern Page_Writers *pageWriters;
+extern Concurrency_Controller *concurrency;
+extern Link_Graph *linkGraph;
+extern Fetch_Retries *fetchRetries;
+
+
+struct download {                            // one of a thread's fetch slots: the url being downloaded, the file it is being saved to and the links found in it so far
+    char possibly_full_url[MAX_LINK_SIZE];
+    char *root_relative_url;                 // points inside possibly_full_url
+    crawl_host *host;                        // the host the url is fetched from (NULL until it is known)
+    bool has_connection;                     // one of host's connections was taken for this download (see Crawl_Hosts)
+    char save_url[HOST_DIR_SIZE + MAX_LINK_SIZE];   // where the page is saved, relative to save_dir: the host's directory followed by root_relative_url (also the page's key for validators and segments)
+    char *filepath;
+    char *part_path;                         // if we already have a copy of the page, the new one is written here first (it only replaces the copy if it is different)
+    FILE *page;                              // NULL until the answer's header says that the page exists (and always with --segments or pageWriters)
+    char *body;                              // (--segments, --pipeline, pageWriters) the page received so far, which goes to writer, pageWriters and/or the jobExecutor once it is complete (the buffer is kept between downloads, unless pageWriters takes it)
+    size_t body_len, body_capacity;
+    Segment_Writer *writer;                  // (--segments) the segment writer of the thread that owns this slot (NULL when every page gets its own file)
+    bool receiving;                          // the answer's header said that the page exists: its body is being saved
+    int total_bytes_read;
+    bool has_copy;                           // (re-crawl) a copy of the page from a previous crawl is in save_dir: the GET is conditional
+    bool not_modified;                       // the server answered 304: our copy is still valid
+    char etag[HTTP_VALIDATOR_SIZE], last_modified[HTTP_VALIDATOR_SIZE];     // the copy's validators (until the answer's header replaces them)
+    unsigned long long copy_hash, content_hash;
+    Link_Tokenizer tokenizer;                // picks up the page's links as its chunks arrive
+    Link_Batch links;                        // the page's links that have not been added yet (they are added together once the page is done, or the batch is full)
+    SimHash simhash;                         // (--near-duplicates) the page's fingerprint, built as its chunks arrive
+    Work_Deque *local;                       // the localQueue of the thread that owns this slot: the page's links are pushed there (unless there is a priorityQueue)
+    Edge_Buffer *edges;                      // (--link-graph) the edge buffer of the thread that owns this slot: the page's links are recorded there (NULL without --link-graph)
+    unsigned int page_id;                    // (--link-graph) the page's id in linkGraph
+    unsigned int depth;                      // number of links followed from starting_url to get to this page
+    Latency_Histogram *phases;               // the NUM_PHASES latency histograms of the thread that owns this slot
+    unsigned long long disk_usec, parse_usec;    // spent so far saving the page and picking up its links
+    bool saved;                              // the page was saved (so it counts towards max_pages)
+    bool busy;
+};
 
 
 /* Local Functions */
-int parse_http_response(const char *response, int &content_length);
-void create_subdir_if_necessary(const char *url);
-int parse_url(const char *possibly_full_url,char *&root_relative_url, char *&host_or_IP, char *&port_number_str);
-void crawl_for_links(char *filepath, const sockaddr_in &server_sa);
-sockaddr_in look_up_addr_r(const char *host_or_IP, int port);
+int resolve_url(char *possibly_full_url, const sockaddr_in &server_sa, char *&root_relative_url, crawl_host *&host);
+void start_download(HTTP_Connection &connection, struct download &d, const sockaddr_in &server_sa, unsigned int &in_flight);
+void advance_download(HTTP_Connection &connection, struct download &d, const sockaddr_in &server_sa, unsigned int &in_flight);
+void finish_download(struct download &d, unsigned int &in_flight, bool complete);
+void finish_not_modified(struct download &d, const sockaddr_in &server_sa, unsigned int &in_flight);
+void append_to_body(struct download &d, const char *chunk, size_t chunk_len);
+void record_header_timings(struct download &d, const fetch_timings &timings);
+void hand_to_writers(struct download &d, bool log_done);
+bool is_near_duplicate(struct download &d, const char *&original);
+char *page_filepath(const char *root_relative_url);
+bool hash_file(const char *filepath, unsigned long long &content_hash);
+void release_download(struct download &d, unsigned int &in_flight);
+void create_subdir_if_necessary(const char *save_url, const crawl_host *host);
+bool next_url(Work_Deque *locals, unsigned int me, unsigned int num_of_threads, char *url, unsigned int &depth, crawl_host *&host);
+bool pop_url(Work_Deque *locals, unsigned int me, unsigned int num_of_threads, char *url, unsigned int &depth, crawl_host *&host);
+bool copy_url(const char *interned_url, char *url);
+bool work_to_steal(Work_Deque *locals, unsigned int num_of_threads);
+void add_link(char *link, const sockaddr_in &server_sa, Link_Batch &batch, Work_Deque *local, unsigned int depth, const crawl_host *found_on, Edge_Buffer *edges, unsigned int from);
+void add_links(Link_Batch &batch, Work_Deque *local, unsigned int depth);
+void page_saved();
+void crawl_finished();
+void more_pending(unsigned int num_of_urls);
+void less_pending();
+void requeue_url(char *url, bool resolved, void *);
+void requeue_timed_out(struct download &d);
+bool link_save_url(const char *link, const char *root_relative_link, int history, char *save_url, size_t size);
+void add_resolved_link(char *link, bool resolved, void *source);
 
 
 void *crawl(void *arguement){
     const struct sockaddr_in &server_sa = *(((struct args *) arguement)->server_sa);    // this is a reference to server_sa from this thread's arguements
+    const unsigned int max_fetches = (unsigned int) ((struct args *) arguement)->max_fetches;   // the maximum number of fetches this thread may have in flight at the same time
+    const unsigned int num_of_threads = (unsigned int) ((struct args *) arguement)->num_of_threads;
+    static unsigned int next_thread_id = 0;
+    const unsigned int me = __sync_fetch_and_add(&next_thread_id, 1);     // which of the localQueues is this thread's own
+    int epoll_fd;
+    CHECK_PERROR( (epoll_fd = epoll_create1(0)), "epoll_create1", cerr << "Error: a crawler thread could not be started" << endl; return NULL; )
+    // each fetch slot has its own (non-blocking) connection to server_sa which is kept alive between the fetches of that slot
+    HTTP_Connection *connections = new HTTP_Connection[max_fetches];
+    Segment_Writer *writer = (segmentStore != NULL) ? new Segment_Writer(*segmentStore) : NULL;     // (--segments) all of this thread's pages go to its own segment
+    struct download *downloads = new struct download[max_fetches];
+    for (unsigned int k = 0 ; k < max_fetches ; k++){
+        connections[k].init(server_sa, epoll_fd, (int) k);
+        downloads[k].busy = false;
+        downloads[k].host = NULL;
+        downloads[k].has_connection = false;
+        downloads[k].page = NULL;
+        downloads[k].filepath = NULL;
+        downloads[k].part_path = NULL;
+        downloads[k].body = NULL;
+        downloads[k].body_capacity = 0;
+        downloads[k].writer = writer;
+        downloads[k].local = &localQueues[me];
+        downloads[k].edges = (linkGraph != NULL) ? linkGraph->edges_of(me) : NULL;
+        downloads[k].phases = fetchMetrics->histograms_of(me);
+    }
+    unsigned int *popped = new unsigned int[max_fetches];       // slots that got a url from the urlQueue in the current loop
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    unsigned int in_flight = 0;                                  // number of busy slots
+    time_t last_timeout_check = time(NULL);
+
     while (!threads_must_terminate) {                            // this check is inportant in case threads must terminate before web crawling has finished
-        char *root_relative_url, *possibly_full_url = NULL;      // urls in the Queue could be both full http://... links and root relaive links depending on what we find
+        // get a url for as many free slots as we can (from our own localQueue first, then the urlQueue, then by stealing), preferring the slots whose connection is still kept alive
+        unsigned int num_popped = 0;
+        bool out_of_urls = false, held_back = false;
+        for (int pass = 0 ; pass < 2 && !out_of_urls && !held_back ; pass++){
+            for (unsigned int k = 0 ; k < max_fetches ; k++){
+                if ( downloads[k].busy || connections[k].is_idle() != (pass == 0) ) continue;
+                if ( concurrency != NULL && !concurrency->acquire() ){      // (--adaptive) as many fetches as the server can take are in flight already
+                    held_back = true;
+                    break;
+                }
+                if ( !next_url(localQueues, me, num_of_threads, downloads[k].possibly_full_url, downloads[k].depth, downloads[k].host) ){
+                    if ( concurrency != NULL ) concurrency->release();
+                    out_of_urls = true;
+                    break;
+                }
+                downloads[k].busy = true;
+                popped[num_popped++] = k;
+                in_flight++;
+            }
+        }
+        if ( num_popped == 0 && in_flight == 0 && held_back ){      // (--adaptive) the other threads' fetches take the whole window: wait for one of them to be over
+            concurrency->wait(FRONTIER_RECHECK_INTERVAL);
+            continue;
+        }
+        // (!) a thread only parks if it has nothing in flight, since the pages it is downloading may add more urls to its localQueue
+        if ( num_popped == 0 && in_flight == 0 ){
+            // do not park with kept-alive connections: each one keeps one of the server's serving threads waiting for nothing
+            for (unsigned int k = 0 ; k < max_fetches ; k++){
+                if ( connections[k].is_idle() ) connections[k].reset();
+            }
+            // A url pushed to a localQueue between our last look and wait() would not wake us up if its pusher did not see us parking, so:
+            // begin_parking() (a full barrier) -> check everything again -> wait(), while a pusher does push -> full barrier -> num_parked() > 0 ? wake.
+            // Either we see its url or it sees us parking (and it can only wake us up once we are in wait(), since it needs the urlQueue's lock to).
+            // The same goes for wake_all from the monitor thread: it happens with the urlQueue's mutex locked, after threads_must_terminate is set.
+            urlQueue->acquire();
+            urlQueue->begin_parking();
+            // (with a crawl budget, we also park while all of it is taken by fetches in flight: one of them may give its share back, see release_download)
+            // (urls waiting for a connection to their host only count if one is free: a fetch that gives a connection back wakes us up, see release_download)
+            bool no_urls = urlQueue->isEmpty() && !work_to_steal(localQueues, num_of_threads) && (priorityQueue == NULL || priorityQueue->size() == 0) && !crawlHosts->has_ready();
+            if ( !threads_must_terminate && (no_urls || (max_pages > 0 && pages_budget <= 0)) ){
+                urlQueue->wait();                                // block until a url shows up (or we have to terminate)
+            }
+            urlQueue->end_parking();
+            urlQueue->release();
+            continue;
+        }
+        for (unsigned int p = 0 ; p < num_popped ; p++){
+            start_download(connections[popped[p]], downloads[popped[p]], server_sa, in_flight);
+        }
+        // a kept-alive connection that did not get a new request keeps one of the server's serving threads waiting for nothing, so close it
+        for (unsigned int k = 0 ; k < max_fetches ; k++){
+            if ( !downloads[k].busy && connections[k].is_idle() ) connections[k].reset();
+        }
+        if (in_flight == 0) continue;                            // (ex: all urls popped were for other servers)
 
-        urlQueue->acquire();                                     // lock urlQueue's mutex
-        while (urlQueue->isEmpty() && !threads_must_terminate) {
-            num_of_threads_blocked++;                            // increase num_of_threads_blocked before we block
+        // wait for any of our sockets to be ready and advance the corresponding downloads as far as possible
+        // (!) urls pushed by other threads do not wake us up, so if we have free slots do not wait for too long before checking for urls again
+        int num_events = epoll_wait(epoll_fd, events, EPOLL_MAX_EVENTS, (in_flight < max_fetches) ? FRONTIER_RECHECK_INTERVAL : TIMEOUT_CHECK_INTERVAL);
+        if ( num_events < 0 && errno != EINTR ) perror("epoll_wait");
+        for (int e = 0 ; e < num_events ; e++){
+            unsigned int k = events[e].data.u32;
+            advance_download(connections[k], downloads[k], server_sa, in_flight);
+        }
 
-            // calculate if crawling has finished in order to signal the monitor thread (will only be true for the last thread to block on cond_wait)
-            CHECK( pthread_mutex_lock(&crawlingFinishedLock) , "pthread_mutex_lock", )         // lock crawling_has_finished's mutex
-            crawling_has_finished = urlQueue->isEmpty() && num_of_threads_blocked == ((struct args *) arguement)->num_of_threads;
-            if (crawling_has_finished) {                         // only signal if it web crawling has actually finished
-                CHECK(pthread_cond_signal(&crawlingFinished), "pthread_cond_signal to crawlingFinished cond_t",)
+        // abandon any download that takes too long (ex: server is not responding)
+        time_t now = time(NULL);
+        if ( now != last_timeout_check ){
+            for (unsigned int k = 0 ; k < max_fetches ; k++){
+                if ( downloads[k].busy && connections[k].has_expired(now) ){
+                    if ( concurrency != NULL ) concurrency->error();
+                    connections[k].reset();
+                    requeue_timed_out(downloads[k]);
+                    release_download(downloads[k], in_flight);
+                }
             }
-            CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )     // unlock crawling_has_finished's mutex
+            last_timeout_check = now;
+        }
+    }
 
-            // What if broadcast (from the monitor thread) happens after condition "!threads_must_terminate" and before pthread_cond_wait?
-            // Would we be stuck on cond_wait? -> NO because broadcast happens with the urlQueue's mutex locked!
-            CHECK(pthread_cond_wait(&QueueIsEmpty, &urlQueue->lock), "pthread_cond_wait",)     // block on cond_wait until signaled
+    // if forced to terminate, abandon whatever is still in flight
+    for (unsigned int k = 0 ; k < max_fetches ; k++){
+        if ( downloads[k].busy ) release_download(downloads[k], in_flight);
+    }
+    delete[] popped;
+    for (unsigned int k = 0 ; k < max_fetches ; k++){
+        delete[] downloads[k].body;
+    }
+    delete[] downloads;
+    delete writer;
+    delete[] connections;                                        // (this closes their sockets)
+    CHECK_PERROR( close(epoll_fd), "closing epoll instance", )
+    return NULL;
+}
 
-            num_of_threads_blocked--;                   // when unblocked and whilst holding the mutex decrease this value
-            if (threads_must_terminate) {
-                urlQueue->release();                    // unlock urlQueue's mutex
-                break;
-            }
+
+
+/* Local Functions Implementation */
+int resolve_url(char *possibly_full_url, const sockaddr_in &server_sa, char *&root_relative_url, crawl_host *&host){     // returns 0 if possibly_full_url is to be downloaded from host, -1 if it must be ignored, -2 if it will be pushed back to the urlQueue later
+    // parse possibly_full_url to make root_relative_url point to the root_relative part of the first one
+    char *host_or_IP = NULL, *port_str = NULL;
+    int result;
+    host = NULL;
+    CHECK((result = parse_url(possibly_full_url, root_relative_url, host_or_IP, port_str)), "could not parse a url in the urlQueue", return -1; )
+    if (result == 1) {
+        cerr << "Warning: popped an url from the urlQueue which is neither root relative nor an http:// link. Ignoring it..." << endl;
+        return -1;
+    }
+
+    // if possibly_full_url contained a host (name or IP) and a port (no port means 8080) then we have to check if it refers to server_sa or a different server
+    // 1. If it refers to server_sa, then we go ahead and we download and crawl this page normally
+    // 2. If it refers to another server that is allowed (see --allow), then it is downloaded and crawled the same way, over that host's own connections
+    // 3. If it refers to any other server, then we do not download nor crawl that page, rather we just print a "crawler found this link" message and ignore it
+    if (host_or_IP == NULL) {                        // if link is root-relative then assume this link is for our server (the one got from command line)
+        if (port_str != NULL) delete[] port_str;
+        host = crawlHosts->server();
+        return 0;
+    }
+    struct sockaddr_in host_sa;                      // the sockaddr_in for the server in possibly_full_url
+    memset(&host_sa, 0, sizeof(host_sa));
+    host_sa.sin_family = AF_INET;
+    int port_num;
+    if (port_str == NULL) {
+        port_num = DEFAULT_HTTP_PORT;
+    }
+    else {
+        port_num = atoi(port_str);
+        delete[] port_str;
+    }
+    host_sa.sin_port = htons(port_num);
+    // never block on DNS here: if host_or_IP has not been resolved yet then this url is pushed back to the urlQueue once it is (see requeue_url)
+    int lookup = dnsCache->lookup(host_or_IP, host_sa.sin_addr, possibly_full_url, requeue_url, NULL);
+    if (lookup == DNS_FAILED) {                      // if DNS is unsuccessful then the link we just popped was probably invalid, hence ignore it
+        cout << "Could not find host (DNS failed) for host: " << host_or_IP << endl;
+        delete[] host_or_IP;
+        return -1;
+    } else if (lookup == DNS_PENDING) {
+        more_pending(1);                             // (!) crawling has not finished while it waits
+        delete[] host_or_IP;
+        return -2;
+    }
+    if ( host_sa.sin_addr.s_addr == server_sa.sin_addr.s_addr && host_sa.sin_port == server_sa.sin_port ){
+        host = crawlHosts->server();
+    } else if ( crawlHosts->is_allowed(host_or_IP, (unsigned short) port_num) ){
+        host = crawlHosts->get(host_or_IP, host_sa);     // (NULL if there are too many hosts already)
+    } else {
+        cout << "> Web crawler found an http URL for a server that it was not allowed to crawl: " << possibly_full_url << endl
+             << "  This link will NOT be downloaded nor crawled as this crawler only supports links for the given server and port, and for the hosts given with --allow" << endl;
+    }
+    delete[] host_or_IP;
+    return (host != NULL) ? 0 : -1;
+}
+
+
+void start_download(HTTP_Connection &connection, struct download &d, const sockaddr_in &server_sa, unsigned int &in_flight){
+    d.page = NULL;
+    d.filepath = NULL;
+    d.part_path = NULL;
+    d.total_bytes_read = 0;
+    d.body_len = 0;
+    d.receiving = false;
+    d.saved = false;
+    d.has_copy = d.not_modified = false;
+    d.etag[0] = d.last_modified[0] = '\0';
+    d.copy_hash = d.content_hash = CONTENT_HASH_SEED;
+    d.disk_usec = d.parse_usec = 0;
+    d.has_connection = (d.host != NULL);         // (a url that waited for its host got one of its connections along with it)
+    crawl_host *host = NULL;
+    int resolved = resolve_url(d.possibly_full_url, server_sa, d.root_relative_url, host);
+    if ( d.has_connection && host != d.host ){   // (should not happen: the host's address changed while the url was waiting)
+        crawlHosts->release(d.host);
+        d.has_connection = false;
+    }
+    d.host = host;
+    if ( resolved < 0 ){                         // url must not be downloaded (ex: it is for a host that is not allowed) or at least not yet (its host is being resolved)
+        if ( resolved == -1 ) checkpoint->done(d.possibly_full_url);
+        release_download(d, in_flight);
+        return;
+    }
+    if ( !d.has_connection ){
+        if ( !crawlHosts->acquire(d.host) ){     // every connection this host may have is taken: the url waits for one in the host's own queue, so that it does not hold up the other hosts
+            crawlHosts->defer(d.host, d.possibly_full_url);
+            more_pending(1);                     // (!) it is still pending, but this slot is not
+            release_download(d, in_flight);
+            return;
         }
-        if (threads_must_terminate) break;              // break again to exit the outer while loop
-        possibly_full_url = urlQueue->pop();            // pop a possible full http url (or a root-relative one) from the urlQueue which is guaranteed not to be empty
-        urlQueue->release();                            // unlock urlQueue's mutex
-        if ( possibly_full_url == NULL ){               // should not happen
-            cerr << "Warning: A thread tried to pop from empty FIFO Queue" << endl;
-        } else {
-            // parse possibly_full_url to make root_relative_url point to the root_relative part of the first one
-            char *host_or_IP = NULL, *port_str = NULL;
-            int result;
-            CHECK((result = parse_url(possibly_full_url, root_relative_url, host_or_IP, port_str)), "could not parse a url in the urlQueue", delete[] possibly_full_url; continue; )
-            if (result == 1) {
-                cerr << "Warning: popped an url from the urlQueue which is neither root relative nor an http:// link. Ignoring it..." << endl;
-                delete[] possibly_full_url;
-                continue;
-            }
+        d.has_connection = true;
+    }
+    if ( snprintf(d.save_url, sizeof(d.save_url), "%s%s", d.host->dir, d.root_relative_url) >= (int) sizeof(d.save_url) ){
+        cerr << "Warning: url too long to be saved, ignoring it: " << d.possibly_full_url << endl;
+        checkpoint->done(d.possibly_full_url);
+        release_download(d, in_flight);
+        return;
+    }
+    if ( d.edges != NULL ) d.page_id = linkGraph->page_id(d.save_url);
+    // on a re-crawl, a page we still have a copy of is only sent again if it changed since (as far as the validators the server gave us for it can tell)
+    if ( recrawl && d.writer != NULL ){
+        page_location copy;
+        d.has_copy = segmentStore->find(d.save_url, copy);
+        if ( d.has_copy ){
+            validators->get(d.save_url, d.etag, d.last_modified, d.copy_hash);
+            d.copy_hash = copy.checksum;         // (the segment's own checksum of the copy is the same hash)
+        }
+    } else if ( recrawl ){
+        d.filepath = page_filepath(d.save_url);
+        d.has_copy = ( access(d.filepath, F_OK) == 0 );
+        if ( d.has_copy && !validators->get(d.save_url, d.etag, d.last_modified, d.copy_hash) ){
+            d.has_copy = hash_file(d.filepath, d.copy_hash);     // (saved by a crawl that did not keep validators: it can still be compared with what the server sends)
+        }
+    }
+    // send http get request for root_relative_url (which we got from parsing possibly_full_url) to its host, reusing the slot's kept-alive connection if it is still healthy (and to the same host)
+    connection.retarget(d.host->sa);
+    if ( connection.begin(d.root_relative_url, d.etag, d.last_modified) < 0 ){
+        release_download(d, in_flight);
+        return;
+    }
+    advance_download(connection, d, server_sa, in_flight);      // (no need to wait for epoll to write the request on an already connected socket)
+}
+
 
-            // if possibly_full_url contained a host (name or IP) and a port (no port means 8080) then we have to check if it refers to server_sa or a different server
-            // 1. If it refers to server_sa, then we go ahead and we download and crawl this page normally
-            // 2. If it refers to another server, then for the purposes of this exercise we do not download nor crawl that page, rather we just print a "crawler found this link" message and ignore it
-            struct sockaddr_in *server_to_query = NULL;      // the server to which we will have to query (this will end up pointing to server_sa if we are to download the page)
-            struct sockaddr_in host_sa;                      // the sockaddr_in for the server in possibly_full_url
-            host_sa.sin_family = AF_INET;
-            if (host_or_IP != NULL) {                        // if link is a full http link, then redo address resolution
-                int port_num;
-                if (port_str == NULL) {
-                    port_num = 8080;
+void advance_download(HTTP_Connection &connection, struct download &d, const sockaddr_in &server_sa, unsigned int &in_flight){
+    if ( !d.busy ){                              // an event on an idle kept-alive connection means that the server closed it
+        const char *chunk;
+        size_t chunk_len;
+        connection.step(chunk, chunk_len);
+        return;
+    }
+    for (;;) {
+        const char *chunk = NULL;
+        size_t chunk_len = 0;
+        switch ( connection.step(chunk, chunk_len) ){
+            case FETCH_PENDING:                  // wait for epoll
+                return;
+            case FETCH_RETRY:                    // a reused connection failed before any answer (the server most likely closed it meanwhile) so retry ONCE on a brand new connection
+                if ( connection.begin(d.root_relative_url, d.etag, d.last_modified) < 0 ){
+                    release_download(d, in_flight);
+                    return;
                 }
-                else {
-                    port_num = atoi(port_str);
-                    delete[] port_str;
+                break;
+            case FETCH_FAILED:
+                if ( concurrency != NULL ) concurrency->error();
+                if ( d.receiving ){              // keep whatever we got from the page
+                    d.phases[PHASE_TRANSFER].add(monotonic_usec() - connection.get_timings().header_received);
+                    cerr << "Warning: did not download the whole page: " << d.possibly_full_url << endl;
+                    finish_download(d, in_flight, false);
+                } else release_download(d, in_flight);
+                return;
+            case FETCH_HEADER:
+                record_header_timings(d, connection.get_timings());
+                if ( connection.get_status() == 304 && d.has_copy ){      // our copy is still valid: it has no body so FETCH_DONE comes next (and the connection stays alive)
+                    d.not_modified = true;
+                    break;
                 }
-                host_sa.sin_port = htons(port_num);
-                struct in_addr in;
-                memset(&in, 0, sizeof(in));
-                if (inet_aton(host_or_IP, &in) == 1) {       // try parsing host_or_IP as an IP
-                    host_sa.sin_addr = in;
-                } else {                                     // else if unsuccessful then host_or_IP must be a host and not an IP after all
-                    // because multiple threads are running we have to use the thread_safe version of gethostbyname here
-                    struct hostent *lookup;
-                    struct hostent hostent;
-                    int h_errnop = 0, ret_val;
-                    size_t bufferlen = 1024;
-                    char *work_buffer = new char[bufferlen];
-                    do {
-                        ret_val = gethostbyname_r(host_or_IP, &hostent, work_buffer, bufferlen, &lookup, &h_errnop);
-                        if (h_errnop == ERANGE) {           // double buffer's size and try again
-                            bufferlen *= 2;
-                            delete[] work_buffer;
-                            work_buffer = new char[bufferlen];
-                        }
-                    } while ((h_errnop == TRY_AGAIN || h_errnop == ERANGE));
-                    if (lookup == NULL || ret_val < 0) {    // if DNS is unsuccessful then the link we just popped was probably invalid, hence ignore it
-                        cout << "Could not find host (DNS failed) for host: " << host_or_IP << endl;
-                        delete[] work_buffer;
-                        delete[] possibly_full_url;
-                        delete[] host_or_IP;
-                        continue;
-                    } else{
-                        host_sa.sin_addr = *((struct in_addr *) lookup->h_addr);     // arbitrarily pick the first address
-                    }
-                    delete[] work_buffer;
+                // if server could not give us the requested page then close the connection (its unread error page is still on it) and free the slot
+                if ( connection.get_status() != 200 ){
+                    if ( concurrency != NULL && connection.get_status() >= 500 ) concurrency->error();     // (the server is struggling, unlike with a 404)
+                    cout << "A thread requested a root_relative_url from the server that does not exist or the server cannot access it: " << d.root_relative_url << endl;   // can happen
+                    checkpoint->done(d.possibly_full_url);
+                    connection.reset();
+                    release_download(d, in_flight);
+                    return;
                 }
-                delete[] host_or_IP;
-                server_to_query = &host_sa;
-                // if this link was for a different server than the one we got from the command line
-                if ( server_to_query->sin_addr.s_addr != server_sa.sin_addr.s_addr || server_to_query->sin_port != server_sa.sin_port ){
-                    cout << "> Web crawler found an http URL for a different server (or a different port) than the one in its arguments: " << possibly_full_url << endl
-                         << "  This link will NOT be downloaded nor crawled as this crawler only supports links for the given server and port" << endl;
-                    delete[] possibly_full_url;
-                    continue;
-                }      // else server_to_query must be == to &server_sa
-            } else {   // else if link is root-relative then assume this link is for our server (the one got from command line)
-                if (port_str != NULL) delete[] port_str;
-                server_to_query = (struct sockaddr_in *) &server_sa;
-            }
+                // Note: if we continue here then the page we requested exists, is accessible and will be downloaded from the server
 
-            // After this points any HTTP GET request will be done to our server (this check just makes sure of that)
-            if ( server_to_query->sin_addr.s_addr != server_sa.sin_addr.s_addr || server_to_query->sin_port != server_sa.sin_port ){    // should not happen
-                cerr << "Unexpected warning: server_to_query was not server_sa!!!" << endl;
-                server_to_query->sin_addr.s_addr = server_sa.sin_addr.s_addr;
-                server_to_query->sin_port = server_sa.sin_port;
-            }
+                // create the directory where the page will be saved if it doesn't already exists (if it exists we will NOT purge it, we will just overwrite that page file if it also exists)
+                create_subdir_if_necessary(d.save_url, d.host);        // Note: this function also adds directory found to the alldirs struct, which is used to pass to jobExecutor's the folders he will have to distribute to its workers
+                d.tokenizer.reset();
+                d.simhash.reset();
+                strcpy(d.etag, connection.get_etag());                  // remembered for the next re-crawl
+                strcpy(d.last_modified, connection.get_last_modified());
+                d.receiving = true;
+                if ( d.writer != NULL || pageWriters != NULL ) break;      // (--segments or writer threads) the page is kept in memory until it is complete (see finish_download)
 
-            // make a TCP connection and send http get request for root_relative_url (which we got from parsing possibly_full_url) to the server_to_query
-            int http_socket;
-            CHECK_PERROR( (http_socket = socket(AF_INET, SOCK_STREAM, 0)) , "socket", delete[] possibly_full_url; continue; )
-            CHECK_PERROR( connect(http_socket, (struct sockaddr *) server_to_query, sizeof(struct sockaddr_in)) , "Connecting to server failed", delete[] possibly_full_url; close(http_socket); continue; )
-            char request[512];
-            sprintf(request, "GET %s HTTP/1.1\nHost: mycrawler\nAccept-Language: en-us\nConnection: Close\n\n", root_relative_url);
-            CHECK_PERROR( write(http_socket, request, strlen(request)), "write", delete[] possibly_full_url; close(http_socket); continue; )
-            CHECK_PERROR( shutdown(http_socket, SHUT_WR), "shutdown write end of http socket", )    // wont write any more data into socket
-
-            // read http response header (should not be more than MAX_HEADER_SIZE Bytes)
-            char response_header[MAX_HEADER_SIZE];
-            size_t i = 0, finish_pos = 0;        // if we read (part of or the whole of) content along with the header, then that starts from response_header[finish_pos]
-            ssize_t nbytes = 0;
-            bool header_finished = false, previous_chunk_ends_in_endl = false;
-            while ( !header_finished && i < MAX_HEADER_SIZE - 1 && (nbytes = read(http_socket, response_header + i, MIN(HEADER_READ_BUF_SIZE, MAX_HEADER_SIZE - i))) > 0 ){
-                if (previous_chunk_ends_in_endl && response_header[i] == '\n' ) {
-                    finish_pos = i+1;
-                    i += nbytes;
-                    break;
-                } else if ( previous_chunk_ends_in_endl && response_header[i] == '\r' && nbytes > 1 && response_header[i+1] == '\n' ) {
-                    finish_pos = i+2;
-                    i += nbytes;
-                    break;
-                } else if (nbytes > 1) previous_chunk_ends_in_endl = false;   // reset this
-                // check nbytes read for "/n/n" or "/n/r/n"
-                for (size_t j = i ; j < i + nbytes - 1 ; j++){
-                    if ( response_header[j] == '\n' && response_header[j+1] == '\n' ){
-                        header_finished = true;
-                        finish_pos = j+2;
-                        break;
-                    } else if ( response_header[j] == '\n' && response_header[j+1] == '\r' && j < i + nbytes - 2 && response_header[j+2] == '\n' ){
-                        header_finished = true;
-                        finish_pos = j+3;
-                        break;
-                    }
+                // figure out the filepath (including its file name) for the page we will download and open it for writing
+                if ( d.filepath == NULL ) d.filepath = page_filepath(d.save_url);
+                if ( d.has_copy ){                       // do not touch our copy until we know that the page changed
+                    d.part_path = new char[strlen(d.filepath) + strlen(".part") + 1];
+                    strcpy(d.part_path, d.filepath);
+                    strcat(d.part_path, ".part");
                 }
-                if ( response_header[i+nbytes-1] == '\n' || (nbytes > 1 && response_header[i+nbytes-2] == '\n' && response_header[i+nbytes-1] == '\r') ){
-                    previous_chunk_ends_in_endl = true;
+                d.page = fopen((d.part_path != NULL) ? d.part_path : d.filepath, "w");    // fopen is thread safe - file is created if it doesnt exist, else overwritten
+                if ( d.page == NULL ){
+                    perror("Warning: A thread could not create a page file");
+                    connection.reset();
+                    release_download(d, in_flight);
+                    return;
                 }
-                i += nbytes;
-            }
-            response_header[i] = '\0';
-            if ( i == MAX_HEADER_SIZE ) { cerr << "Warning: crawler thread might not have read the entire http response header" << endl; }
-            if ( nbytes < 0 ){ perror("read on from server's socket"); delete[] possibly_full_url; close(http_socket); continue; }
-
-            // check if we got part (or all) of the content along with the header and handle it if true
-            char first_content[HEADER_READ_BUF_SIZE];    // can't be more than HEADER_READ_BUF_SIZE
-            first_content[0] = '\0';
-            // if finish_pos == i  then we have read the whole header and nothing from the content, else if:
-            if ( finish_pos < i ){                       // then we have read some (or all) of the content whilst reading the header
-                strcpy(first_content, response_header + finish_pos);          // copy that content to first_content char[]
-                response_header[finish_pos] = '\0';      // and "remove" it from response_header
+                break;
+            case FETCH_BODY: {                   // write the next chunk of the page to its file as soon as it arrives and crawl it for links while it is still in memory
+                d.total_bytes_read += chunk_len;
+                d.content_hash = Page_Validators::hash(chunk, chunk_len, d.content_hash);
+                if ( d.page == NULL || pipelined ) append_to_body(d, chunk, chunk_len);
+                unsigned long long started = monotonic_usec();
+                if ( d.page != NULL && fwrite(chunk, 1, chunk_len, d.page) < chunk_len ) { cerr << "Warning fwrite did not write all bytes" << endl; }
+                unsigned long long written = monotonic_usec();
+                // find any "<a" + "href" + "<link>" + ">" in this chunk (or that started in a previous one) and add each <link> to the urlQueue (so that it can be fetched before this download finishes)
+                char link[MAX_LINK_SIZE];
+                if ( nearDuplicates != NULL ) d.simhash.add(chunk, chunk_len);     // (before the tokenizer consumes the chunk)
+                while ( !threads_must_terminate && d.tokenizer.next_link(chunk, chunk_len, link) ){    // (avoid crawling if we have to exit before crawling has finished)
+                    add_link(link, server_sa, d.links, d.local, d.depth + 1, d.host, d.edges, d.page_id);
+                }
+                d.disk_usec += written - started;
+                d.parse_usec += monotonic_usec() - written;
+                break;
             }
+            case FETCH_DONE:                     // (the connection is now idle, or closed if the server did not keep it alive)
+                if ( d.receiving ) d.phases[PHASE_TRANSFER].add(monotonic_usec() - connection.get_timings().header_received);
+                if ( d.not_modified ) finish_not_modified(d, server_sa, in_flight);
+                else finish_download(d, in_flight, true);
+                return;
+        }
+    }
+}
 
-            // parse response
-            int content_length = -1;
-            int fb = parse_http_response(response_header, content_length);    // this parsing will give us content_length, assuming the response was valid
-            switch (fb){
-                case -1: cerr << "Error: reading C String from string stream failed" << endl; break;
-                case -2: cerr << "Error: Unexpected http response format from server" << endl; break;
-                case -3: cout << "A thread requested a root_relative_url from the server that does not exist or the server cannot access it: " << root_relative_url << endl; break;
-                case -4: cerr << "Error: server's http response did not contain a \"Content-Length\" field" << endl; break;
-            }
-            // if server could not give us the requested page then close the connection and go to the next loop
-            if (fb == -3) { delete[] possibly_full_url; close(http_socket); continue; }     // can happen
-            else if (fb < 0){    // should not happen from our server
-                cerr << "Unexpected error parsing http get response. Aborting download of url: " << possibly_full_url << endl;
-                delete[] possibly_full_url; close(http_socket); continue;
-            }
 
-            // Note: if thread continues here then the page we requested exists, is accessible and will be downloaded from the server
-
-            // create the directory where the page will be saved if it doesn't already exists (if it exists we will NOT purge it, we will just overwrite that page file if it also exists)
-            create_subdir_if_necessary(root_relative_url);       // Note: this function also adds directory found to the alldirs struct, which is used to pass to jobExecutor's the folders he will have to distribute to its workers
-
-            // figure out the filepath (including its file name) for the page we will download and open it for writing
-            char *filepath = new char[strlen(save_dir) + strlen(root_relative_url) + 1];
-            strcpy(filepath, save_dir);                    // save dir is guaranted NOT to have a '/' at the end
-            strcat(filepath, root_relative_url);           // whilst "str" SHOULD have a '/' at the start, since it is a root-relative link
-            delete[] possibly_full_url;                    // don't need popped url any more
-            FILE *page = fopen(filepath, "w");             // fopen is thread safe - file is created if it doesnt exist, else overwritten
-            int total_bytes_read = 0;                      // we will have downloaded the whole page when total_bytes_read == content_length
-            // read all content from the socket and write it to the filepath file
-            if (page != NULL) {
-                // if a starting part of the content was read whilst reading the header then write that part to the file first
-                if ( first_content[0] != '\0' ){
-                    size_t first_content_len = strlen(first_content);
-                    total_bytes_read += first_content_len;
-                    if ( fwrite(first_content, 1, first_content_len, page) < first_content_len ) { cerr << "Warning fwrite did not write all bytes" << endl; }
-                }
-                // then continue to read from the socket and write to the file BUFFER_SIZE sized chunks until all the file has been downloaded aka total_bytes_read == content_length
-                char buffer[BUFFER_SIZE];
-                ssize_t bytes_read;
-                while ( total_bytes_read < content_length  && (bytes_read = read(http_socket, buffer, BUFFER_SIZE)) > 0) {
-                    total_bytes_read += bytes_read;
-                    if ( fwrite(buffer, 1, bytes_read, page) < bytes_read ) { cerr << "Warning fwrite did not write all bytes" << endl; }
+void finish_download(struct download &d, unsigned int &in_flight, bool complete){     // complete: the whole page was received
+    // (--near-duplicates) a page within the given distance of one saved already is neither saved nor indexed: only its links are followed (which they have been by now)
+    const char *original;
+    bool near_duplicate = ( nearDuplicates != NULL && complete && is_near_duplicate(d, original) );
+    if ( near_duplicate ) cout << "Not saving a near-duplicate of " << original << ": " << d.save_url << endl;
+    // a page that was sent again replaces our copy only if it is different (else the copy and its modification time are left alone)
+    bool different = !near_duplicate && (!d.has_copy || (complete && d.content_hash != d.copy_hash));
+    unsigned long long started = monotonic_usec();
+    if ( d.writer != NULL ){                     // (--segments) a different page is appended: it replaces the copy in the index
+        if ( different ){
+            if ( !d.writer->append(d.save_url, d.body, d.body_len) ) cerr << "Warning: could not save a page to its segment: " << d.possibly_full_url << endl;
+        }
+    } else if ( pageWriters == NULL ){           // (else a different page is handed to the writer threads below, once the jobExecutor has it too)
+        CHECK_PERROR( fclose(d.page), "fclose", )
+        d.page = NULL;
+        if ( near_duplicate && d.part_path == NULL ) unlink(d.filepath);
+    }
+    if ( d.part_path != NULL ){
+        bool changed = complete && !near_duplicate && d.content_hash != d.copy_hash;
+        if ( changed ){
+            CHECK_PERROR( rename(d.part_path, d.filepath), "rename downloaded page over its old copy", changed = false; )
+        }
+        if ( !changed ) unlink(d.part_path);
+    }
+    if ( pageWriters == NULL ) d.phases[PHASE_DISK_WRITE].add(d.disk_usec + (monotonic_usec() - started));    // (else the writer threads time their own writes)
+    d.phases[PHASE_LINK_PARSE].add(d.parse_usec);
+    if ( complete && !near_duplicate ){          // (a partial page must not be taken for a valid copy by the next re-crawl)
+        validators->set(d.save_url, d.etag, d.last_modified, d.content_hash);
+    }
+    // (--pipeline) the page is indexed right away, unless what we received is a part of a page whose previous copy was kept
+    if ( pipelined && !near_duplicate && (!d.has_copy || complete) ) send_page_to_jobExecutor(d.save_url, d.body, d.body_len);
+    // update stats (consistently using their lock)
+    CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
+    total_pages_downloaded++;
+    total_bytes_downloaded += d.total_bytes_read;   // should be equal with content_length if everything goes well
+    if ( !d.has_copy ) pages_new++;
+    else if ( complete && d.content_hash == d.copy_hash ) pages_unchanged++;
+    else pages_changed++;
+    CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
+    fetchMetrics->page_saved(time(NULL));
+
+    // (!) if threads have to terminate then the page's links may not have all been added, so a resumed crawl has to download it again
+    add_links(d.links, d.local, d.depth + 1);    // (the page's links are queued, and logged, before the page is logged as done)
+    if ( pageWriters != NULL && d.writer == NULL && different ) hand_to_writers(d, !threads_must_terminate);
+    else if (!threads_must_terminate) checkpoint->done(d.possibly_full_url);
+    d.saved = !near_duplicate;
+    if ( d.edges != NULL && d.saved ) d.edges->add(d.page_id, PAGE_SAVED);
+    release_download(d, in_flight);              // (the page has already been crawled for links while it was being downloaded)
+}
+
+
+void finish_not_modified(struct download &d, const sockaddr_in &server_sa, unsigned int &in_flight){
+    // the page is not written again, but it still belongs to this crawl: its directory goes to the jobExecutor and its links have to be followed (they are read from our copy)
+    create_subdir_if_necessary(d.save_url, d.host);
+    char link[MAX_LINK_SIZE];
+    d.tokenizer.reset();
+    d.simhash.reset();
+    if ( d.writer != NULL ){                     // (--segments) the whole copy is read at once
+        page_location where;
+        char *copy = (segmentStore->find(d.save_url, where)) ? segmentStore->read(where) : NULL;
+        if ( copy == NULL ){
+            cerr << "Warning: could not read the saved copy of a page that did not change: " << d.possibly_full_url << endl;
+        } else {
+            if (pipelined) send_page_to_jobExecutor(d.save_url, copy, where.length);
+            const char *chunk = copy;
+            size_t chunk_len = where.length;
+            unsigned long long started = monotonic_usec();
+            if ( nearDuplicates != NULL ) d.simhash.add(chunk, chunk_len);
+            while ( !threads_must_terminate && d.tokenizer.next_link(chunk, chunk_len, link) ){
+                add_link(link, server_sa, d.links, d.local, d.depth + 1, d.host, d.edges, d.page_id);
+            }
+            d.parse_usec += monotonic_usec() - started;
+            delete[] copy;
+        }
+    } else {
+        FILE *copy = fopen(d.filepath, "r");
+        if ( copy == NULL ){
+            perror("Warning: could not open the saved copy of a page that did not change");
+        } else {
+            char *buffer = new char[SAVED_PAGE_READ_SIZE];
+            size_t nbytes;
+            while ( !threads_must_terminate && (nbytes = fread(buffer, 1, SAVED_PAGE_READ_SIZE, copy)) > 0 ){
+                if (pipelined) append_to_body(d, buffer, nbytes);
+                const char *chunk = buffer;
+                size_t chunk_len = nbytes;
+                unsigned long long started = monotonic_usec();
+                if ( nearDuplicates != NULL ) d.simhash.add(chunk, chunk_len);
+                while ( !threads_must_terminate && d.tokenizer.next_link(chunk, chunk_len, link) ){
+                    add_link(link, server_sa, d.links, d.local, d.depth + 1, d.host, d.edges, d.page_id);
                 }
-                if (bytes_read < 0 && errno == ECONNRESET ) { perror("Warning, client did not download the whole page in time. Peer reset the connection"); }   // our server-peer shouldn't do that
-                else if (bytes_read < 0){ perror("Warning, reading content from http socket"); }
-                CHECK_PERROR(fclose(page), "fclose",)
-            } else {
-                perror("Warning: A thread could not create a page file");
+                d.parse_usec += monotonic_usec() - started;
             }
+            if ( pipelined && feof(copy) ) send_page_to_jobExecutor(d.save_url, d.body, d.body_len);
+            delete[] buffer;
+            fclose(copy);
+        }
+    }
 
-            // close TCP connection
-            CHECK_PERROR( close(http_socket) , "closing http client socket from a thread" , )
+    d.phases[PHASE_LINK_PARSE].add(d.parse_usec);
+    // (our copy was saved by a previous crawl, so it stays even if it is a near-duplicate: its fingerprint is only added for the pages still to come)
+    const char *original;
+    if ( nearDuplicates != NULL && !threads_must_terminate ) is_near_duplicate(d, original);
 
-            // update stats (consistently using their lock)
-            CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
-            total_pages_downloaded++;
-            total_bytes_downloaded += total_bytes_read;   // should be equal with content_length if everything goes well
-            CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
+    CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
+    pages_unchanged++;
+    CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
+    fetchMetrics->page_saved(time(NULL));
 
-            if (threads_must_terminate){                  // avoid crawling if we have to exit before crawling has finished
-                delete[] filepath;
-                break;
-            }
+    add_links(d.links, d.local, d.depth + 1);
+    if (!threads_must_terminate) checkpoint->done(d.possibly_full_url);
+    d.saved = true;
+    if ( d.edges != NULL ) d.edges->add(d.page_id, PAGE_SAVED);
+    release_download(d, in_flight);
+}
 
-            // crawl for more links in the page we just downloaded and add them to urlQueue while signalling one thread for each link added
-            crawl_for_links(filepath, server_sa);
 
-            delete[] filepath;
+void release_download(struct download &d, unsigned int &in_flight){      // free the slot of a finished or abandoned download
+    add_links(d.links, d.local, d.depth + 1);    // (the links found in an abandoned download are still followed)
+    if ( d.page != NULL ){
+        CHECK_PERROR( fclose(d.page), "fclose", )
+        d.page = NULL;
+    }
+    if ( d.part_path != NULL ){                  // (the copy of an abandoned download is kept)
+        unlink(d.part_path);
+        delete[] d.part_path;
+        d.part_path = NULL;
+    }
+    delete[] d.filepath;
+    d.filepath = NULL;
+    if ( d.has_connection ){                     // give the host's connection back, to a parked thread if a url is waiting for one
+        if ( crawlHosts->release(d.host) && urlQueue->num_parked() > 0 ) {
+            urlQueue->acquire();
+            urlQueue->wake(1);
+            urlQueue->release();
         }
+        d.has_connection = false;
     }
-    return NULL;
+    d.host = NULL;
+    d.busy = false;
+    in_flight--;
+    if ( concurrency != NULL ) concurrency->release();
+    if ( max_pages > 0 ){
+        if ( d.saved ) page_saved();
+        else {                                   // a fetch that did not save a page gives its share of the budget back, to a parked thread if there is one
+            __sync_fetch_and_add(&pages_budget, 1);
+            if (urlQueue->num_parked() > 0) {
+                urlQueue->acquire();
+                urlQueue->wake(1);
+                urlQueue->release();
+            }
+        }
+    }
+    less_pending();                              // (the page's links, if any, have all been counted by now)
 }
 
 
+void append_to_body(struct download &d, const char *chunk, size_t chunk_len) {     // (--segments, --pipeline) keep the next chunk of the page in memory
+    if ( d.body_len + chunk_len > d.body_capacity ){
+        size_t new_capacity = (d.body_capacity > 0) ? d.body_capacity : PAGE_BUFFER_INITIAL_SIZE;
+        while ( new_capacity < d.body_len + chunk_len ) new_capacity *= 2;
+        char *new_body = new char[new_capacity];
+        memcpy(new_body, d.body, d.body_len);
+        delete[] d.body;
+        d.body = new_body;
+        d.body_capacity = new_capacity;
+    }
+    memcpy(d.body + d.body_len, chunk, chunk_len);
+    d.body_len += chunk_len;
+}
 
-/* Local Functions Implementation */
-int parse_http_response(const char *response, int &content_length){
-    char *copy = new char[strlen(response) + 1];
-    strcpy(copy, response);
-    char *rest = copy, *line;
-    bool found_content_len = false;
-    {   // for the 1st line, check that the answer was "200 OK", else return error
-        line = strtok_r(rest, "\r\n", &rest);
-        stringstream linestream(line);
-        char word[256];
-        linestream >> word;
-        if ( linestream.fail() ) { delete[] copy; return -1; }
-        if ( strcmp(word, "HTTP/1.1") != 0 ) { delete[] copy; return -2; }
-        linestream >> word;
-        if ( linestream.fail() ) { delete[] copy; return -1; }
-        if ( strcmp(word, "200") != 0 ) { delete[] copy; return -3; }
-        linestream >> word;
-        if ( linestream.fail() ) { delete[] copy; return -1; }
-        if ( strcmp(word, "OK") != 0 ) { delete[] copy; return -3; }
-    }
-    while ((line = strtok_r(rest, "\r\n", &rest))){    // for each line after the 1st one in response header
-        stringstream linestream(line);
-        char word[256];
-        linestream >> word;
-        if (linestream.fail()){
-            cerr << "Warning: reading from C string to stringstream failed" << endl;
-            linestream.clear();
-            continue;
-        }
-        if (strcmp(word, "Content-Length:") == 0){
-            linestream >> content_length;
-            if ( linestream.fail() ){
-                cerr << "Warning: \"Content-Length:\" field had a no numeric value" << endl;
-                linestream.clear();
-                continue;
-            }
-            found_content_len = true;
-        }
+
+void record_header_timings(struct download &d, const fetch_timings &timings) {     // (the answer's header was just received)
+    if ( !timings.reused ) d.phases[PHASE_CONNECT].add(timings.connected - timings.begun);
+    d.phases[PHASE_FIRST_BYTE].add(timings.header_received - timings.request_sent);
+    if ( concurrency != NULL ) concurrency->sample(timings.header_received - timings.request_sent);
+}
+
+
+void hand_to_writers(struct download &d, bool log_done) {     // the page (a complete one, or the part we got of one we have no copy of) is saved by a writer thread: its buffers are the writers' from now on
+    if ( d.filepath == NULL ) d.filepath = page_filepath(d.save_url);
+    char *path = d.filepath, *final_path = NULL;
+    if ( d.has_copy ){                           // (our copy is only replaced once the new one has been written whole)
+        path = new char[strlen(d.filepath) + strlen(".part") + 1];
+        strcpy(path, d.filepath);
+        strcat(path, ".part");
+        final_path = d.filepath;
+    }
+    char *done_url = NULL;                       // (log_done: the writer thread logs the page as done once it is on disk, not before)
+    if (log_done){
+        done_url = new char[strlen(d.possibly_full_url) + 1];
+        strcpy(done_url, d.possibly_full_url);
     }
-    delete[] copy;
-    return (found_content_len ? 0 : -4);
+    pageWriters->push(path, final_path, d.body, d.body_len, done_url);     // (waits if the writer threads have fallen too far behind)
+    d.filepath = NULL;
+    d.body = NULL;
+    d.body_len = d.body_capacity = 0;
 }
 
 
-void create_subdir_if_necessary(const char *url) {      // find out and create dir if it doesn't exist - urls MUST be root relative and of the form "/site/page" for this function to work!
-    // figure out the site directory for given root-relative url
-    size_t k, url_len = strlen(url), save_dir_len = strlen(save_dir);
+bool is_near_duplicate(struct download &d, const char *&original) {     // (--near-duplicates) true if a page within nearDuplicates' distance of this one was saved already (original), else its fingerprint is added
+    unsigned long long fingerprint;
+    if ( !d.simhash.fingerprint(fingerprint) ) return false;         // (too few words to tell)
+    return nearDuplicates->find_or_add(fingerprint, d.save_url, original);
+}
+
+
+char *page_filepath(const char *save_url) {     // where the page is saved (the caller has to delete[] it)
+    char *filepath = new char[strlen(save_dir) + strlen(save_url) + 1];
+    strcpy(filepath, save_dir);                  // save dir is guaranted NOT to have a '/' at the end
+    strcat(filepath, save_url);                  // whilst "str" SHOULD have a '/' at the start, since it is a root-relative link
+    return filepath;
+}
+
+
+bool hash_file(const char *filepath, unsigned long long &content_hash) {     // false if filepath could not be read
+    FILE *f = fopen(filepath, "r");
+    if ( f == NULL ) return false;
+    char *buffer = new char[SAVED_PAGE_READ_SIZE];
+    size_t nbytes;
+    content_hash = CONTENT_HASH_SEED;
+    while ( (nbytes = fread(buffer, 1, SAVED_PAGE_READ_SIZE, f)) > 0 ){
+        content_hash = Page_Validators::hash(buffer, nbytes, content_hash);
+    }
+    bool ok = !ferror(f);
+    delete[] buffer;
+    fclose(f);
+    return ok;
+}
+
+
+void create_subdir_if_necessary(const char *save_url, const crawl_host *host) {      // find out and create dir if it doesn't exist - save_url MUST be host's directory followed by a root relative url of the form "/site/page" for this function to work!
+    // figure out the site directory for given url (in its host's directory, if it has one)
+    size_t k, url_len = strlen(save_url), save_dir_len = strlen(save_dir), host_dir_len = strlen(host->dir);
     char *subdir = new char[url_len + save_dir_len + 1];
     strcpy(subdir, save_dir);
-    subdir[save_dir_len] = '/';
-    for (k = 1 ; k < url_len && url[k] != '/' ; k++){   // k = 1 -> skip first '/'
-        subdir[k + save_dir_len] = url[k];
+    strcpy(subdir + save_dir_len, host->dir);
+    subdir[save_dir_len + host_dir_len] = '/';
+    for (k = host_dir_len + 1 ; k < url_len && save_url[k] != '/' ; k++){   // k = host_dir_len + 1 -> skip the host's directory and the first '/'
+        subdir[k + save_dir_len] = save_url[k];
     }
     subdir[k + save_dir_len] = '\0';
 
     // ATOMICALLY add subdir to alldirs but only if it's not already in it (add ensures that - no need to search separately)
-    alldirs->add(subdir);
+    if ( alldirs->add(subdir) ) checkpoint->new_dir(subdir);
+    if ( segmentStore != NULL ){                       // (--segments) the site directory only exists in the urls of the segments' index: nothing to create
+        delete[] subdir;
+        return;
+    }
 
-    struct stat st = {0};
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    if ( host_dir_len > 0 ){                           // the host's own directory first
+        subdir[save_dir_len + host_dir_len] = '\0';
+        if (stat(subdir, &st) == -1 && mkdir(subdir, 0755) < 0 && errno != EEXIST) perror("mkdir");
+        subdir[save_dir_len + host_dir_len] = '/';
+    }
     if (stat(subdir, &st) == -1) {                     // if dir does not exist, then create it
         CHECK_PERROR( mkdir(subdir, 0755), "mkdir", )
     }
@@ -468,142 +866,239 @@ int findRootRelativeUrl(const char *possibly_full_url, char *&root_relative_url)
     return 0;
 }
 
-void crawl_for_links(char *filepath, const sockaddr_in &server_sa) {
-    FILE *page = fopen(filepath, "r");
-    if (page == NULL){
-        cerr << "Error: could not open a page that was just downloaded and saved" << endl;
-        return;
-    }
-    // get file's size
-    long pos = ftell(page);              // current position
-    fseek(page, 0, SEEK_END);            // go to end of file
-    long int file_length = ftell(page);  // read the position which is the size of the file
-    char *webpage = new char[file_length + 1];
-    fseek(page, pos, SEEK_SET);          // restore original position
-    {   // load the entire webpage onto memory using a buffer (this allows for simpler - and, therefore, safer - parsing of the page)
-        char buffer[BUFFER_SIZE];
-        size_t bytes_read, k = 0;
-        for (;;) {                                // read file using a buffer and create a list of chunks that make up the requested page
-            CHECK_PERROR((bytes_read = fread(buffer, 1, BUFFER_SIZE, page)), "read from page's html file", break;)
-            if (bytes_read > 0) {
-                for (int i = 0; i < bytes_read; i++) {
-                    webpage[k + i] = buffer[i];
-                }
-                k += bytes_read;
+void add_link(char *link, const sockaddr_in &server_sa, Link_Batch &batch, Work_Deque *local, unsigned int depth, const crawl_host *found_on, Edge_Buffer *edges, unsigned int from) {     // add a link found in a page of found_on (depth links away from starting_url, page from in the linkGraph) to the page's batch, which add_links queues once it is full or the page is done
+    // first rewrite it in its canonical form, so that the different spellings of a page are all queued (and added to urlHistory) as the same url
+    char canonical[MAX_LINK_SIZE];
+    if ( !canonicalize_url(link, canonical, sizeof(canonical), DEFAULT_HTTP_PORT) ) return;
+    link = canonical;
+    // then examine it to see to which server and which port it refers to
+    int history = IN_HISTORY;                   // because if it does not refer to our server then we must not add its root-relative part to urlHistory
+    char full_link[MAX_LINK_SIZE];              // the urls of the other allowed hosts are always queued as "http://<host>:<port>/<root_relative_url>", and added to urlHistory as such
+    char *root_relative_link;
+    findRootRelativeUrl(link, root_relative_link);      // find the root-relative part of this possibly full http link
+    if (root_relative_link == NULL) {          // should not happen
+        cerr << "Unexpected failure for finding the root relative link of the url: " << link << endl;
+        root_relative_link = link;              //Adding itself to history instead..
+    } else if (root_relative_link == link && found_on != NULL && found_on != crawlHosts->server()) {    // a root-relative link in a page of another host is for that host
+        if ( snprintf(full_link, sizeof(full_link), "http://%s:%hu%s", found_on->name, found_on->port, link) >= (int) sizeof(full_link) ) return;
+        link = root_relative_link = full_link;
+        history = IN_HISTORY_AS_IS;
+    } else if (root_relative_link != link) {    // if link was not root_relative then examine it
+        int port, res;
+        char *host_or_IP, *port_num_str;
+        CHECK((res = parse_url(link, root_relative_link, host_or_IP, port_num_str)), "parse url while crawling for links",)   // parse full http url
+        if (res == 1) {                         // found an invalid link
+            // it's ok to add this link to urlQueue, it will be recognized as a false link when we pop it
+            history = NOT_IN_HISTORY;           // but do not add it to urlHistory
+        } else if (host_or_IP != NULL) {
+            if (port_num_str == NULL) port = DEFAULT_HTTP_PORT;     // default port
+            else port = atoi(port_num_str);
+            struct in_addr host_addr;           // look up the address of host_or_IP (without blocking on DNS)
+            unsigned int *source = (edges != NULL) ? new unsigned int(from) : NULL;     // (--link-graph) so that its edge is recorded once it is resolved
+            int lookup = dnsCache->lookup(host_or_IP, host_addr, link, add_resolved_link, (void *) source);
+            if (lookup != DNS_PENDING) delete source;
+            if (lookup == DNS_PENDING) {        // this link will be given back to add_link once its host has been resolved (see add_resolved_link)
+                more_pending(1);                // (!) crawling has not finished while it waits
+                delete[] host_or_IP;
+                delete[] port_num_str;
+                return;
             }
-            if (bytes_read < BUFFER_SIZE) {
-                break;
+            if (lookup == DNS_FAILED || htons(port) != server_sa.sin_port || host_addr.s_addr != server_sa.sin_addr.s_addr) {
+                // The root-relative links for URLS refering to OTHER servers should NOT be added to the urlHistory
+                // in case they conflict with the root_relative links for our server
+                history = NOT_IN_HISTORY;
+                if (lookup == DNS_RESOLVED && crawlHosts->is_allowed(host_or_IP, (unsigned short) port)
+                    && snprintf(full_link, sizeof(full_link), "http://%s:%d%s", host_or_IP, port, root_relative_link) < (int) sizeof(full_link)) {
+                    link = root_relative_link = full_link;     // (so that the same page is always queued, and added to urlHistory, as the same url)
+                    history = IN_HISTORY_AS_IS;
+                }
             }
+            delete[] host_or_IP;
+            delete[] port_num_str;
         }
-        if (k > file_length) {
-            cerr << "Warning: file size calculation was off" << endl;
-            delete[] webpage;
-            return;
-        }
-        else webpage[k] = '\0';
     }
-    // parse page file in order to find: "<a" + "href" + "<link>" + ">" and add each <link> to the urlQueue,
-    // but only if it does not exists on urlHistory (aka it's not been put into the urlQueue before)
-    char link[MAX_LINK_SIZE];
-    for (int i = 0 ; i < file_length && webpage[i] != '\0' ; i++) {  // iterate over the file's characters
-        if ( webpage[i] == '<' && i + 1 < file_length && webpage[i+1] == 'a' ){   // if came across an "<a" from an <a ...> tag
-            i += 3;                        // skip "<a "
-            while ( i < file_length && webpage[i] != '>' && !(i + 4 < file_length && webpage[i] == 'h' && webpage[i + 1] == 'r' && webpage[i + 2] == 'e' && webpage[i + 3] == 'f') )
-                i++;                       // advance until href or '>'
-            if (webpage[i] != '>') {       // "href" detected
-                i += 4;                    // skip "href"
-                while (i < file_length && webpage[i] != '>' && webpage[i] != '"') i++;               // advance until '>' or '"'
-                if (webpage[i] != '>' && i+1 < file_length) {       // link starts at webpage[i+1] !
-                    i++;                   // skip '"'
-                    int j = 0;
-                    if (webpage[i] == '.' && i+1 < file_length && webpage[i+1] == '.') i += 2;       // if link starts as "../sitei/pagei_j.html" then skip those ".."
-                    while (i + j < file_length && webpage[i + j] != '"' && webpage[i + j] != '>' && j < MAX_LINK_SIZE) {   // read link (could be root_relative or a full http url)
-                        link[j] = webpage[i+j];
-                        j++;
-                    }
-                    link[j] = '\0';
-                    if ( webpage[i + j] != '>' ) {                      // if <a > tag was not closed before the link ended, then:
-                        if (j > 0) {                                    // if actually found a link (and not ex: "")
-                            // first examine link found to see to which server and which port it refers to
-                            bool add_link_to_history = true;            // because if it does not refer to our server then we must not add it to urlHistory
-                            char *root_relative_link;
-                            findRootRelativeUrl(link, root_relative_link);      // find the root-relative part of this possibly full http link
-                            if (root_relative_link == NULL) {          // should not happen
-                                cerr << "Unexpected failure for finding the root relative link of the url: " << link << endl;
-                                root_relative_link = link;              //Adding itself to history instead..
-                            } else if (root_relative_link != link) {    // if link was not root_relative then examine it
-                                int port, res;
-                                char *host_or_IP, *port_num_str;
-                                CHECK((res = parse_url(link, root_relative_link, host_or_IP, port_num_str)), "parse url while crawling for links",)   // parse full http url
-                                if (res == 1) {                         // found an invalid link
-                                    // it's ok to add this link to urlQueue, it will be recognized as a false link when we pop it
-                                    add_link_to_history = false;        // but do not add it to urlHistory
-                                } else if (host_or_IP != NULL) {
-                                    if (port_num_str == NULL) port = 8080;     // default port
-                                    else port = atoi(port_num_str);
-                                    sockaddr_in lookedUpAddr = look_up_addr_r(host_or_IP, port);    // look up sockadrr_in address for host_or_IP, port found
-                                    if (lookedUpAddr.sin_port != server_sa.sin_port || lookedUpAddr.sin_addr.s_addr != server_sa.sin_addr.s_addr) {
-                                        // The root-relative links for URLS refering to OTHER servers should NOT be added to the urlHistory
-                                        // in case they conflict with the root_relative links for our server
-                                        add_link_to_history = false;
-                                    }
-                                    delete[] host_or_IP;
-                                    delete[] port_num_str;
-                                }
-                            }
-
-                            // then (atomically) add the link to urlQueue  and, if the host of the link is the given server, to urlHistrory as well
-                            urlQueue->acquire();
-                            // IMPORTANT: acquiring Queue's lock BEFORE the next if-check avoids the race condition of two threads finding the same link simultaneously!
-                            if (!urlHistory->search(root_relative_link)) {                          // add link to urlQueue ONLY if it doesn't exist on our urlHistory structure (aka this link has not been added to the urlQueue before)
-                                if (add_link_to_history) urlHistory->add(root_relative_link);       // ATOMICALLY add new found link to our urlHistory struct if above-stated conditions are met
-                                urlQueue->push(link);                                               // push new link to the urlQueue
-                                CHECK(pthread_cond_signal(&QueueIsEmpty), "pthread_cond_signal",)   // signal ONE thread to read the new link from the urlQueue
-                                cout << "added a link: " << link << endl;                           // print a corresponding message (this is not printed for starting_url onbiously)
-                            }
-                            urlQueue->release();
-                        }
-
-                        i += j;       // skip link and the 2nd '"' (or the '>')
-                        while (i < file_length && webpage[i] != '>') i++;       // ignore the rest of the tag until it closes
-                    }
-                }
+
+    // (--link-graph) a link to a page that may be crawled is recorded whether it is new or not, by the url its page is saved as
+    if ( edges != NULL && history != NOT_IN_HISTORY ){
+        char target[HOST_DIR_SIZE + MAX_LINK_SIZE];
+        if ( link_save_url(link, root_relative_link, history, target, sizeof(target)) ) edges->add(from, linkGraph->page_id(target));
+    }
+
+    // then add it to the batch, unless the page had the same link already (its key for urlHistory is root_relative_link, which is a part of it)
+    if ( batch.add(link, root_relative_link, history) && batch.is_full() ) add_links(batch, local, depth);
+}
+
+void add_links(Link_Batch &batch, Work_Deque *local, unsigned int depth) {     // add the links of batch (depth links away from starting_url) to the priorityQueue, local or the urlQueue if both are NULL, but only those that do not exist on urlHistory (aka have not been queued before)
+    unsigned int num_of_links = batch.size();
+    if ( num_of_links == 0 ) return;
+    // IMPORTANT: insert_batch_if_absent is atomic for each link, so if two threads find the same link simultaneously only one of them will push it
+    unsigned long long hashes[LINK_BATCH_SIZE];
+    bool insert[LINK_BATCH_SIZE], absent[LINK_BATCH_SIZE];
+    for (unsigned int i = 0 ; i < num_of_links ; i++){
+        hashes[i] = hash_history::hash(batch.key(i));
+        insert[i] = ( batch.history(i) != NOT_IN_HISTORY );    // if the host of the link is the given server (or an allowed one) then add it to urlHistory as well
+    }
+    urlHistory->insert_batch_if_absent(hashes, insert, num_of_links, absent);
+    const char *new_links[LINK_BATCH_SIZE], *seen_links[LINK_BATCH_SIZE];
+    int new_histories[LINK_BATCH_SIZE];
+    unsigned int num_new = 0, num_seen = 0;
+    for (unsigned int i = 0 ; i < num_of_links ; i++){
+        if ( absent[i] ){
+            new_links[num_new] = batch.link(i);
+            new_histories[num_new++] = batch.history(i);
+        } else seen_links[num_seen++] = batch.link(i);
+    }
+    if ( num_new > 0 ){
+        checkpoint->queued_batch(new_links, new_histories, num_new);     // (!) logged before they can be popped, so that they are always logged before they are done
+        more_pending(num_new);                                          // (!) counted before they can be popped, so that they are always counted before they are done
+    }
+    // (with --memory-limit, once urlIds has taken its share of it the links go to the urlQueue instead, which can spill them to disk)
+    if (local != NULL && memory_limit > 0 && urlIds->memory() >= memory_limit / 4) local = NULL;
+    if (priorityQueue != NULL || local != NULL) {
+        if (priorityQueue != NULL) priorityQueue->push_batch(new_links, num_new, depth, seen_links, num_seen);     // (the seen ones may be rescored if they are still queued)
+        else if (num_new > 0) {
+            unsigned int link_ids[LINK_BATCH_SIZE];
+            for (unsigned int i = 0 ; i < num_new ; i++){
+                urlIds->intern(new_links[i], link_ids[i]);                  // (the localQueues only hold the url's id)
             }
+            local->push_batch(link_ids, num_new);                           // no lock shared by all threads here: only local's own, which is only contended by a thief
+        }
+        // wake up a parked thread per new link, if any, to steal them (the barrier pairs with the one in begin_parking, see crawl())
+        __sync_synchronize();
+        if (num_new > 0 && urlQueue->num_parked() > 0) {
+            urlQueue->acquire();
+            urlQueue->wake(num_new);
+            urlQueue->release();
         }
+    } else if (num_new > 0) {
+        urlQueue->acquire();
+        urlQueue->push_batch(new_links, num_new);                           // push the new links to the urlQueue (this wakes up a parked thread per link, if any, to read them)
+        urlQueue->release();
     }
-    delete[] webpage;
-    CHECK_PERROR(fclose(page), "fclose",)
+    for (unsigned int i = 0 ; i < num_new ; i++){                           // print a corresponding message (this is not printed for starting_url onbiously)
+        cout << "added a link: " << new_links[i] << endl;
+    }
+    batch.clear();
 }
 
-sockaddr_in look_up_addr_r(const char *host_or_IP,int port){   // look up a sockaddr_in for given host_or_IP, port but thread safely
-    sockaddr_in resolved_address;
-    resolved_address.sin_family = AF_INET;
-    resolved_address.sin_port = htons(port);
-    struct in_addr in;
-    memset(&in, 0, sizeof(in));
-    if (inet_aton(host_or_IP, &in) == 1) {       // try parsing host_or_IP as an IP
-        resolved_address.sin_addr = in;
-    } else {                                     // else if unsuccessful then host_or_IP must be a host and not an IP after all
-        struct hostent *lookup;
-        struct hostent hostent;
-        int h_errnop = 0, ret_val;
-        size_t bufferlen = 1024;
-        char *work_buffer = new char[bufferlen];
-        do {
-            ret_val = gethostbyname_r(host_or_IP, &hostent, work_buffer, bufferlen, &lookup, &h_errnop);
-            if (h_errnop == ERANGE) {
-                bufferlen *= 2;
-                delete[] work_buffer;
-                work_buffer = new char[bufferlen];
-            }
-        } while ((h_errnop == TRY_AGAIN || h_errnop == ERANGE));
-        if (lookup == NULL || ret_val < 0) {
-            cout << "Could not find host (DNS failed) for host: " << host_or_IP << endl;
-            resolved_address.sin_addr.s_addr = 0;
-        } else{
-            resolved_address.sin_addr = *((struct in_addr *) lookup->h_addr);        // arbitrarily pick the first address
+bool link_save_url(const char *link, const char *root_relative_link, int history, char *save_url, size_t size){     // where the page of a link that may be crawled is (or would be) saved, relative to save_dir - false if it does not fit
+    if ( history == IN_HISTORY ) return snprintf(save_url, size, "%s%s", crawlHosts->server()->dir, root_relative_link) < (int) size;
+    // (IN_HISTORY_AS_IS) the whole link is "http://<host>:<port>/<path>", and it is saved in the host's directory "/<host>_<port>" (see Crawl_Hosts)
+    const char *host = link + strlen("http://");
+    const char *colon = strchr(host, ':'), *path = strchr(host, '/');
+    if ( colon == NULL || path == NULL || colon > path ) return false;
+    return snprintf(save_url, size, "/%.*s_%.*s%s", (int) (colon - host), host, (int) (path - colon - 1), colon + 1, path) < (int) size;
+}
+
+void requeue_url(char *url, bool resolved, void *){                // (DNS resolver thread) a popped url whose host had not been resolved yet (the url is all it needs)
+    if (!resolved) {
+        cout << "Could not find host (DNS failed) for url: " << url << endl;
+        checkpoint->done(url);
+        less_pending();
+        return;
+    }
+    urlQueue->acquire();
+    urlQueue->push(url);                        // (it is still counted as pending from when it was handed to the DNS cache)
+    urlQueue->release();
+}
+
+void requeue_timed_out(struct download &d){     // (before the download is released) a url whose download timed out is queued again at the end of the urlQueue, at most FETCH_MAX_RETRIES times
+    unsigned int attempt;
+    if ( threads_must_terminate ) return;       // (it is not logged as done, so a resumed crawl fetches it again)
+    if ( !fetchRetries->retry(d.possibly_full_url, attempt) ){
+        cerr << "Warning: download timed out " << attempt << " times, giving up on url: " << d.possibly_full_url << endl;
+        return;                                 // (not logged as done either)
+    }
+    cerr << "Warning: download timed out, queueing url again (retry " << attempt << " of " << FETCH_MAX_RETRIES << "): " << d.possibly_full_url << endl;
+    more_pending(1);                            // (counted again before release_download uncounts its download)
+    urlQueue->acquire();
+    urlQueue->push(d.possibly_full_url);        // (the checkpoint still has it as queued and not done)
+    urlQueue->release();
+}
+
+void add_resolved_link(char *link, bool resolved, void *source){   // (DNS resolver thread) a link found in a page whose host had not been resolved yet - source is the page's id in the linkGraph (NULL without --link-graph)
+    if (!resolved) {                            // same as a link for another server: it would never be downloaded anyway
+        cout << "Could not find host (DNS failed) for link: " << link << endl;
+    } else {                                    // (this thread has no localQueue, and the link's depth is not known anymore - a link that had to be resolved is a full one anyway)
+        Link_Batch batch;
+        Edge_Buffer *edges = (source != NULL) ? linkGraph->resolved_edges() : NULL;
+        add_link(link, crawlHosts->server()->sa, batch, NULL, 1, NULL, edges, (source != NULL) ? *((unsigned int *) source) : 0);
+        add_links(batch, NULL, 1);
+    }
+    delete (unsigned int *) source;
+    less_pending();                             // (after add_links has counted the link itself, if it was queued)
+}
+
+
+bool next_url(Work_Deque *locals, unsigned int me, unsigned int num_of_threads, char *url, unsigned int &depth, crawl_host *&host){
+    if ( max_pages <= 0 ) return pop_url(locals, me, num_of_threads, url, depth, host);
+    // with a crawl budget, every fetch takes a share of it first (and gives it back if it does not end up saving a page, see release_download)
+    if ( __sync_fetch_and_sub(&pages_budget, 1) <= 0 ){
+        __sync_fetch_and_add(&pages_budget, 1);
+        return false;
+    }
+    if ( pop_url(locals, me, num_of_threads, url, depth, host) ) return true;
+    __sync_fetch_and_add(&pages_budget, 1);
+    return false;
+}
+
+
+bool pop_url(Work_Deque *locals, unsigned int me, unsigned int num_of_threads, char *url, unsigned int &depth, crawl_host *&host){     // copies the next url for this thread into url[MAX_LINK_SIZE] - false if there is none anywhere
+    depth = 0;                                  // (only the priorityQueue keeps track of depths)
+    host = NULL;                                // (unless it is a url that waited for a connection to its host, which comes with one)
+    if ( crawlHosts->pop_deferred(url, MAX_LINK_SIZE, host) ) return true;
+    unsigned int url_id;
+    if ( priorityQueue == NULL && locals[me].pop(url_id) ) return copy_url(urlIds->url_of(url_id), url);
+    if ( !urlQueue->looks_empty() ){            // (the starting_url, the urls of a resumed crawl and those given back by the DNS resolver thread)
+        urlQueue->acquire();
+        bool popped = urlQueue->pop(url, MAX_LINK_SIZE);
+        urlQueue->release();
+        if ( popped ) return true;
+    }
+    if ( priorityQueue != NULL ) return priorityQueue->pop(url, MAX_LINK_SIZE, depth);      // (all links go there, no localQueue is used)
+    for (unsigned int i = 1 ; i < num_of_threads ; i++){       // steal from the others, starting from our neighbour so that thieves spread out
+        if ( locals[(me + i) % num_of_threads].steal_into(locals[me]) > 0 ){
+            return locals[me].pop(url_id) && copy_url(urlIds->url_of(url_id), url);
         }
-        delete[] work_buffer;
     }
-    return resolved_address;
+    return false;
+}
+
+
+bool copy_url(const char *interned_url, char *url){         // copies an interned url into url[MAX_LINK_SIZE] (interned urls always fit, see add_link) - always true
+    strncpy(url, interned_url, MAX_LINK_SIZE - 1);
+    url[MAX_LINK_SIZE - 1] = '\0';
+    return true;
+}
+
+
+bool work_to_steal(Work_Deque *locals, unsigned int num_of_threads){
+    for (unsigned int i = 0 ; i < num_of_threads ; i++){
+        if ( locals[i].size() > 0 ) return true;
+    }
+    return false;
+}
+
+
+// Termination: pending_urls counts every url that has been queued (in any localQueue, the priorityQueue or the urlQueue), is being downloaded or is waiting for its host to be resolved.
+// A url is counted before it is queued and uncounted only after its page has been crawled (and its links counted), so pending_urls drops to 0 exactly once: when crawling has finished.
+void more_pending(unsigned int num_of_urls){
+    __sync_fetch_and_add(&pending_urls, num_of_urls);
+}
+
+void less_pending(){
+    if ( __sync_sub_and_fetch(&pending_urls, 1) == 0 ) crawl_finished();
+}
+
+// With a crawl budget, crawling also finishes once max_pages pages have been saved (no more fetches are started by then, see next_url)
+void page_saved(){
+    static unsigned int num_saved = 0;
+    if ( __sync_add_and_fetch(&num_saved, 1) == (unsigned int) max_pages ) crawl_finished();
+}
+
+void crawl_finished(){
+    CHECK( pthread_mutex_lock(&crawlingFinishedLock) , "pthread_mutex_lock", )         // lock crawling_has_finished's mutex
+    crawling_has_finished = true;
+    CHECK( pthread_cond_signal(&crawlingFinished), "pthread_cond_signal to crawlingFinished cond_t", )    // wake up the monitor thread
+    CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )     // unlock crawling_has_finished's mutex
 }
@@ -6,9 +6,16 @@
 #include <cstdlib>
 #include <csignal>
 #include <sys/ioctl.h>
-#include "../headers/FIFO_Queue.h"
+#include <fcntl.h>
+#include <cerrno>
+#include "../headers/URL_Frontier.h"
 #include "../headers/crawling_monitoring.h"
 #include "../headers/str_history.h"
+#include "../headers/Page_Validators.h"
+#include "../headers/Page_Segments.h"
+#include "../headers/Page_Writers.h"
+#include "../headers/Link_Graph.h"
+#include "../headers/Fetch_Metrics.h"
 #include "../headers/executables_paths.h"
 
 
@@ -20,24 +27,39 @@ using namespace std;
 #define CHECK(call, callname, handle_code) { if ( ( call ) < 0 ) { cerr << (callname) << " failed" << endl; handle_code } }
 
 
+#define PIPELINE_PIPE_SIZE (1024 * 1024)     // (--pipeline) bytes: the pipe to the jobExecutor is enlarged so that the crawling threads only block on it when the workers fall that far behind
+
+
 /* Global Variables (explained at webcrawler.cpp) */
 extern bool crawling_has_finished;
 extern pthread_cond_t crawlingFinished;
 extern pthread_mutex_t crawlingFinishedLock;
-extern int num_of_threads_blocked;
 extern char *save_dir;
-extern FIFO_Queue *urlQueue;
+extern URL_Frontier *urlQueue;
 extern bool threads_must_terminate;
-extern pthread_cond_t QueueIsEmpty;
 extern bool monitor_forced_exit;
 extern bool jobExecutorReadyForCommands;
 extern pid_t jobExecutor_pid;
 extern str_history *alldirs;
+extern Page_Validators *validators;
+extern bool recrawl;
+extern Segment_Store *segmentStore;
+extern pthread_mutex_t stat_lock;
+extern unsigned int pages_changed, pages_unchanged, pages_new;
+extern bool pipelined;
+extern Page_Writers *pageWriters;
+extern Link_Graph *linkGraph;
+extern char *graphReport;
 int toJobExecutor_pipe = -1, fromJobExecutor_pipe = -1;
+pthread_mutex_t toJobExecutor_lock = PTHREAD_MUTEX_INITIALIZER;     // (--pipeline) the crawling threads' pages and the commands are sent to the jobExecutor through the same pipe, one whole message at a time
+
+
+/* Functions (explained at webcrawler.cpp) */
+char *graph_report(int num_of_threads, const char *starting_url);
 
 
 /* Local Functions */
-void init_jobExecutor(int numOfWorkers);
+bool write_all(int fd, const char *data, size_t len);
 
 
 void *monitor_crawling(void *args){
@@ -51,10 +73,8 @@ void *monitor_crawling(void *args){
 
     // Step1: block on cond_wait until crawling has finished
     CHECK( pthread_mutex_lock(&crawlingFinishedLock) , "pthread_mutex_lock", )        // lock crawling_has_finished's mutex
-    // webcrawling has finished when:
-    // 1) urlQueue is empty, and
-    // 2) all threads are blocked on cond_wait, aka num_of_threads_blocked == num_of_threads
-    // This is computed in crawl.cpp by those threads and if the last one finds out it's true, it will signal us
+    // webcrawling has finished when no url is queued (in the urlQueue or any localQueue), being downloaded or waiting for DNS, aka pending_urls == 0
+    // This is counted in crawl.cpp by the crawling threads and the one that drops it to 0 will signal us
     while (!crawling_has_finished){
         CHECK( pthread_cond_wait(&crawlingFinished, &crawlingFinishedLock) , "pthread_cond_wait on crawling finish", )
         if ( monitor_forced_exit ) break;          // if forced to exit before crawling has finished
@@ -65,10 +85,10 @@ void *monitor_crawling(void *args){
     cout << "monitor thread: " << ((monitor_forced_exit) ? "Web crawling did not finish in time but forced to shutdown..." : "Web crawling finished!") << endl;
 
     // Step2: join with the num_of_threads threads, whose job is either finished or forced to finish prematurely via early SHUTDOWN command
-    // Note: that if a thread is not blocked on cond_wait then it will have to finish its job for that loop and then stop at outer while loop check because threads_must_terminate == true
+    // Note: that if a thread is not parked then it will have to finish its job for that loop and then stop at outer while loop check because threads_must_terminate == true
     threads_must_terminate = true;
-    urlQueue->acquire();                           // (!) locking urlQueue's lock before the broadcast is important to avoid a thread missing it!
-    CHECK( pthread_cond_broadcast(&QueueIsEmpty), "pthread_cond_broadcast",  )        // broadcast all threads so they can get unstuck from cond_wait and terminate
+    urlQueue->acquire();                           // (!) locking urlQueue's lock before waking them up is important to avoid a thread missing it!
+    urlQueue->wake_all();                          // wake up all parked threads so they can terminate
     urlQueue->release();
     void *status;
     for (int i = 0; i < arguements->num_of_threads; i++) {
@@ -76,8 +96,33 @@ void *monitor_crawling(void *args){
         if (status != NULL) { cerr << "thread terminated with an unexpected status" << endl; }
     }
 
-    // Step3: initiate the jobExecutor, but only if there are directories for him to index
-    if (!monitor_forced_exit && alldirs->get_size() > 0){                             // web crawling has finished here so get_size() is "atomic"
+    // the writer threads may still be saving the last pages: the jobExecutor must not look for them before they are in save_dir
+    if ( pageWriters != NULL ) pageWriters->drain();
+
+    // no thread downloads anything anymore: keep the validators of the pages saved for the next re-crawl
+    if ( !validators->save(save_dir) ) cerr << "Warning: could not save the pages' validators, the next re-crawl will download every page again" << endl;
+    if (recrawl){
+        CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
+        cout << "monitor thread: re-crawl found " << pages_changed << " changed, " << pages_unchanged << " unchanged and " << pages_new << " new pages" << endl;
+        CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
+    }
+
+    // (--link-graph) no crawler thread adds links anymore: build the graph they found and rank its pages (the threads that crawled are the ones that run PageRank)
+    if ( linkGraph != NULL && !monitor_forced_exit ){
+        unsigned long long started = monotonic_usec();
+        linkGraph->build();
+        linkGraph->pagerank((unsigned int) arguements->num_of_threads);
+        if ( !linkGraph->save_ranks(save_dir) ) cerr << "Warning: could not save the pages' PageRank" << endl;
+        cout << "monitor thread: link graph of " << linkGraph->get_num_pages() << " pages and " << linkGraph->get_num_links() << " links, PageRank after "
+             << linkGraph->get_iterations() << " iterations (" << (monotonic_usec() - started) / 1000 << " ms)" << endl;
+        // GRAPH's answer is computed once, here, so that the command server never runs the analysis on its own thread
+        __atomic_store_n(&graphReport, graph_report(arguements->num_of_threads, arguements->starting_url), __ATOMIC_RELEASE);
+    }
+
+    // Step3: initiate the jobExecutor, but only if there are directories for him to index (and it was not started along with the crawl)
+    if (pipelined && jobExecutor_pid != -1){
+        cout << "monitor thread: jobExecutor has already indexed every page while crawling" << endl;
+    } else if (!monitor_forced_exit && alldirs->get_size() > 0){                             // web crawling has finished here so get_size() is "atomic"
         init_jobExecutor(arguements->num_of_workers);
         cout << "monitor thread: jobExecutor ready for commands" << endl;
         jobExecutorReadyForCommands = true;
@@ -89,7 +134,7 @@ void *monitor_crawling(void *args){
 }
 
 
-void init_jobExecutor(int numOfWorkers) {        // called by monitor thead when it's time to initiate the jobExecutor
+void init_jobExecutor(int numOfWorkers) {        // called by monitor thead when it's time to initiate the jobExecutor (or by main before crawling with --pipeline)
     int crawler_to_jobExectutor_pipe[2];
     int jobExectutor_to_crawler_pipe[2];
     CHECK_PERROR( pipe(crawler_to_jobExectutor_pipe) , "pipe creation", return; )
@@ -106,7 +151,16 @@ void init_jobExecutor(int numOfWorkers) {        // called by monitor thead when
         dup2(jobExectutor_to_crawler_pipe[1], STDOUT_FILENO);       // make stdoit the 2nd pipe's write end for the about-to-be-execed process
         close(jobExectutor_to_crawler_pipe[0]);
         close(jobExectutor_to_crawler_pipe[1]);
-        execl(JOBEXECUTOR_PATH, "jobExecutor", numWorkers_str, NULL);
+        // (--segments) the jobExecutor's workers read the pages of their site directories from save_dir's segments instead of from the directories themselves
+        // (--pipeline) the jobExecutor expects "/page" messages between commands
+        char *jobExecutor_argv[] = { (char *) "jobExecutor", numWorkers_str, NULL, NULL, NULL, NULL };
+        int argc = 2;
+        if ( segmentStore != NULL ){
+            jobExecutor_argv[argc++] = (char *) "-s";
+            jobExecutor_argv[argc++] = save_dir;
+        }
+        if (pipelined) jobExecutor_argv[argc++] = (char *) "-p";
+        execv(JOBEXECUTOR_PATH, jobExecutor_argv);
         /* Code continues to run only if exec fails: (most likely because the executable file could not be found) */
         perror("exec() failed");
         // flow should never reach here! JOBEXECUTOR_PATH should be valid as checked at the start of main!
@@ -122,6 +176,7 @@ void init_jobExecutor(int numOfWorkers) {        // called by monitor thead when
         fromJobExecutor_pipe = dup(jobExectutor_to_crawler_pipe[0]);
         close(jobExectutor_to_crawler_pipe[0]);
         close(jobExectutor_to_crawler_pipe[1]);
+        if ( pipelined && fcntl(toJobExecutor_pipe, F_SETPIPE_SZ, PIPELINE_PIPE_SIZE) < 0 ) perror("Warning: could not enlarge the pipe to the jobExecutor");
 
         // send jobExecutor terminal width (only possible at start) for him to use for /search, since he hasn't have access to the "real" stdout
         struct winsize wsize;
@@ -130,7 +185,7 @@ void init_jobExecutor(int numOfWorkers) {        // called by monitor thead when
         CHECK_PERROR(write(toJobExecutor_pipe, &term_width, sizeof(int)), "write to jobExecutor", )
 
         // send jobExecutor the directories he ll be responsible for
-        cout << "monitor thread: " << "Initializing jobExecutor with " << alldirs->get_size() << " site directories:" << endl;    // web crawling has finished here so get_size() is "atomic"
+        cout << "monitor thread: " << "Initializing jobExecutor with " << alldirs->get_size() << " site directories:" << endl;    // web crawling has finished (or not started yet) here so get_size() is "atomic"
         char **directories = alldirs->get_all_strings_as_table();
         int dirsize = alldirs->get_size();
         CHECK_PERROR(write(toJobExecutor_pipe, &dirsize, sizeof(int)), "write to jobExecutor", )
@@ -153,3 +208,28 @@ void init_jobExecutor(int numOfWorkers) {        // called by monitor thead when
         }
     }
 }
+
+
+void send_page_to_jobExecutor(const char *root_relative_url, const char *content, size_t len) {     // (--pipeline) as "/page <path_len> <content_len>\n" + the page's filepath + its content
+    if ( toJobExecutor_pipe < 0 ) return;
+    char header[128];
+    size_t path_len = strlen(save_dir) + strlen(root_relative_url);
+    int header_len = sprintf(header, "/page %zu %zu\n", path_len, len);
+    CHECK( pthread_mutex_lock(&toJobExecutor_lock), "pthread_mutex_lock", return; )
+    bool ok = write_all(toJobExecutor_pipe, header, (size_t) header_len) && write_all(toJobExecutor_pipe, save_dir, strlen(save_dir)) &&
+              write_all(toJobExecutor_pipe, root_relative_url, strlen(root_relative_url)) && write_all(toJobExecutor_pipe, content, len);
+    CHECK( pthread_mutex_unlock(&toJobExecutor_lock), "pthread_mutex_unlock", )
+    if ( !ok ) cerr << "Warning: could not send a page to the jobExecutor: " << root_relative_url << endl;
+}
+
+
+bool write_all(int fd, const char *data, size_t len) {
+    while ( len > 0 ){
+        ssize_t nbytes = write(fd, data, len);
+        if ( nbytes < 0 && errno == EINTR ) continue;
+        if ( nbytes < 0 ) return false;
+        data += nbytes;
+        len -= (size_t) nbytes;
+    }
+    return true;
+}
@@ -0,0 +1,323 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../headers/hash_history.h"
+
+
+using namespace std;
+
+
+#define BLOOM_HASH_FUNCTIONS 4
+#define SPILL_PATH_SIZE 4096
+
+
+/* Local Functions */
+int compare_hashes(const void *a, const void *b);
+
+
+hash_history::hash_history() : bloom_bits(HISTORY_BLOOM_BITS), total_size(0), max_capacity(0), spill_dir(NULL) {
+    for (int i = 0 ; i < HISTORY_STRIPES ; i++){
+        if ( pthread_mutex_init(&stripes[i].lock, NULL) < 0 ){
+            cerr << "Warning: pthread_mutex_init failed!" << endl;
+        }
+        stripes[i].capacity = HISTORY_STRIPE_INITIAL_CAPACITY;
+        stripes[i].size = 0;
+        stripes[i].table = new unsigned long long[HISTORY_STRIPE_INITIAL_CAPACITY];
+        memset(stripes[i].table, 0, HISTORY_STRIPE_INITIAL_CAPACITY * sizeof(unsigned long long));
+        stripes[i].spill_fd = -1;
+        stripes[i].spilled = 0;
+        stripes[i].spill_index = NULL;
+    }
+    bloom = new unsigned long long[bloom_bits / 64];
+    memset(bloom, 0, (bloom_bits / 64) * sizeof(unsigned long long));
+}
+
+hash_history::~hash_history() {
+    char path[SPILL_PATH_SIZE];
+    for (int i = 0 ; i < HISTORY_STRIPES ; i++){
+        delete[] stripes[i].table;
+        delete[] stripes[i].spill_index;
+        if ( stripes[i].spill_fd >= 0 ){             // (the spill files are only good for this crawl)
+            close(stripes[i].spill_fd);
+            snprintf(path, sizeof(path), "%s/history_%d", spill_dir, i);
+            unlink(path);
+        }
+        if ( pthread_mutex_destroy(&stripes[i].lock) < 0 ){
+            cerr << "Warning: pthread_mutex_destroy failed!" << endl;
+        }
+    }
+    delete[] bloom;
+    delete[] spill_dir;
+}
+
+bool hash_history::limit_memory(size_t max_memory, const char *dir) {
+    if ( strlen(dir) + 32 > SPILL_PATH_SIZE ) return false;
+    // half of it for the bloom filter (~1% false positives at 1 url per 10 bits), the other half for the stripes' tables
+    delete[] bloom;
+    bloom_bits = 64 * 1024;
+    while ( 2 * bloom_bits <= (unsigned long long) (max_memory / 2) * 8 ) bloom_bits *= 2;      // (a power of 2, so that a bit is picked with a mask)
+    bloom = new unsigned long long[bloom_bits / 64];
+    memset(bloom, 0, (bloom_bits / 64) * sizeof(unsigned long long));
+    size_t per_stripe = max_memory / 2 / HISTORY_STRIPES;
+    max_capacity = HISTORY_STRIPE_INITIAL_CAPACITY;
+    while ( 2 * max_capacity * sizeof(unsigned long long) <= per_stripe ) max_capacity *= 2;
+    spill_dir = new char[strlen(dir) + 1];
+    strcpy(spill_dir, dir);
+    return true;
+}
+
+unsigned long long hash_history::hash(const char *str) {     // FNV-1a followed by a 64-bit finalizer so that both the high (stripe) and low (slot) bits are well mixed
+    unsigned long long h = 14695981039346656037ULL;
+    for ( ; *str != '\0' ; str++){
+        h ^= (unsigned char) *str;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (h == 0) ? 1 : h;     // 0 marks empty slots
+}
+
+bool hash_history::insert_if_absent(const char *str) {      // O(1) expected
+    return insert_hash_if_absent(hash(str));
+}
+
+bool hash_history::insert_hash_if_absent(unsigned long long h) {
+    stripe &s = stripes[h >> 58];                            // top 6 bits pick the stripe (HISTORY_STRIPES == 64)
+    if ( pthread_mutex_lock(&s.lock) < 0 ){
+        cerr << "Warning: failed to lock the mutex!" << endl;
+    }
+    bool inserted = insert_locked(s, h);
+    if ( pthread_mutex_unlock(&s.lock) < 0 ){
+        cerr << "Warning: failed to unlock the mutex!" << endl;
+    }
+    return inserted;
+}
+
+void hash_history::insert_batch_if_absent(const unsigned long long *hashes, const bool *insert, unsigned int num_of_hashes, bool *absent) {    // O(num_of_hashes) expected
+    // go through the hashes stripe by stripe (in their order within each stripe, so that a hash is found if it was inserted earlier in the batch)
+    unsigned int starts[HISTORY_STRIPES + 1];
+    memset(starts, 0, sizeof(starts));
+    for (unsigned int i = 0 ; i < num_of_hashes ; i++){
+        starts[(hashes[i] >> 58) + 1]++;
+    }
+    for (int st = 0 ; st < HISTORY_STRIPES ; st++){
+        starts[st + 1] += starts[st];
+    }
+    unsigned int *order = new unsigned int[num_of_hashes];
+    unsigned int next[HISTORY_STRIPES];
+    memcpy(next, starts, sizeof(next));
+    for (unsigned int i = 0 ; i < num_of_hashes ; i++){
+        order[next[hashes[i] >> 58]++] = i;
+    }
+    for (int st = 0 ; st < HISTORY_STRIPES ; st++){
+        stripe &s = stripes[st];
+        bool locked = false;
+        for (unsigned int k = starts[st] ; k < starts[st + 1] ; k++){
+            unsigned int i = order[k];
+            if ( !insert[i] && !bloom_may_contain(hashes[i]) ){     // definitely not inserted (yet): no need to lock for it
+                absent[i] = true;
+                continue;
+            }
+            if ( !locked ){
+                if ( pthread_mutex_lock(&s.lock) < 0 ){
+                    cerr << "Warning: failed to lock the mutex!" << endl;
+                }
+                locked = true;
+            }
+            if ( insert[i] ) absent[i] = insert_locked(s, hashes[i]);
+            else {
+                unsigned int pos;
+                absent[i] = !(probe(s, hashes[i], pos) || spilled_contains(s, hashes[i]));
+            }
+        }
+        if ( locked && pthread_mutex_unlock(&s.lock) < 0 ){
+            cerr << "Warning: failed to unlock the mutex!" << endl;
+        }
+    }
+    delete[] order;
+}
+
+bool hash_history::insert_locked(stripe &s, unsigned long long h) {
+    unsigned int pos;
+    bool found = false;
+    if ( bloom_may_contain(h) ){                             // only probe the table (and the spill file) if the bloom filter is not sure str is new
+        found = probe(s, h, pos) || spilled_contains(s, h);
+    } else {
+        probe(s, h, pos);                                    // just find the empty slot for it
+    }
+    if ( !found ){
+        s.table[pos] = h;
+        s.size++;
+        bloom_add(h);
+        __sync_fetch_and_add(&total_size, 1);
+        if ( 10 * s.size > 7 * s.capacity ){                 // keep load factor under 0.7
+            if ( max_capacity > 0 && s.capacity >= max_capacity ) spill(s);
+            else grow(s);
+        }
+    }
+    return !found;
+}
+
+bool hash_history::contains(const char *str) {              // O(1) expected
+    unsigned long long h = hash(str);
+    if ( !bloom_may_contain(h) ) return false;               // definitely not inserted (yet)
+    stripe &s = stripes[h >> 58];
+    if ( pthread_mutex_lock(&s.lock) < 0 ){
+        cerr << "Warning: failed to lock the mutex!" << endl;
+    }
+    unsigned int pos;
+    bool found = probe(s, h, pos) || spilled_contains(s, h);
+    if ( pthread_mutex_unlock(&s.lock) < 0 ){
+        cerr << "Warning: failed to unlock the mutex!" << endl;
+    }
+    return found;
+}
+
+void hash_history::add(const char *str) {
+    insert_if_absent(str);
+}
+
+unsigned int hash_history::get_size() const {
+    return total_size;
+}
+
+unsigned long long hash_history::get_spilled() const {
+    unsigned long long spilled = 0;
+    for (int i = 0 ; i < HISTORY_STRIPES ; i++){
+        spilled += __atomic_load_n(&stripes[i].spilled, __ATOMIC_RELAXED);
+    }
+    return spilled;
+}
+
+bool hash_history::bloom_may_contain(unsigned long long h) const {
+    unsigned long long h2 = (h >> 32) | 1;                   // double hashing: bit_i = h + i * h2
+    for (int i = 0 ; i < BLOOM_HASH_FUNCTIONS ; i++){
+        unsigned long long bit = (h + i * h2) & (bloom_bits - 1);
+        if ( (__atomic_load_n(&bloom[bit / 64], __ATOMIC_RELAXED) & (1ULL << (bit % 64))) == 0 ) return false;
+    }
+    return true;
+}
+
+void hash_history::bloom_add(unsigned long long h) {
+    unsigned long long h2 = (h >> 32) | 1;
+    for (int i = 0 ; i < BLOOM_HASH_FUNCTIONS ; i++){
+        unsigned long long bit = (h + i * h2) & (bloom_bits - 1);
+        __atomic_fetch_or(&bloom[bit / 64], 1ULL << (bit % 64), __ATOMIC_RELAXED);
+    }
+}
+
+bool hash_history::probe(const stripe &s, unsigned long long h, unsigned int &pos) {     // linear probing
+    unsigned int mask = s.capacity - 1;
+    for (pos = (unsigned int) h & mask ; s.table[pos] != 0 ; pos = (pos + 1) & mask){
+        if ( s.table[pos] == h ) return true;
+    }
+    return false;
+}
+
+void hash_history::grow(stripe &s) {                         // double the stripe's capacity and rehash (stripe's lock must be held)
+    unsigned long long *old_table = s.table;
+    unsigned int old_capacity = s.capacity;
+    s.capacity *= 2;
+    s.table = new unsigned long long[s.capacity];
+    memset(s.table, 0, s.capacity * sizeof(unsigned long long));
+    for (unsigned int i = 0 ; i < old_capacity ; i++){
+        if ( old_table[i] != 0 ){
+            unsigned int pos;
+            probe(s, old_table[i], pos);
+            s.table[pos] = old_table[i];
+        }
+    }
+    delete[] old_table;
+}
+
+bool hash_history::spilled_contains(const stripe &s, unsigned long long h) const {      // one pread of the 4KB block of the spill file that h would be in
+    if ( s.spilled == 0 ) return false;
+    unsigned long long num_blocks = (s.spilled + HISTORY_SPILL_INDEX_INTERVAL - 1) / HISTORY_SPILL_INDEX_INTERVAL;
+    if ( h < s.spill_index[0] ) return false;
+    unsigned long long low = 0, high = num_blocks - 1;       // the last block whose first hash is <= h
+    while ( low < high ){
+        unsigned long long mid = (low + high + 1) / 2;
+        if ( s.spill_index[mid] <= h ) low = mid;
+        else high = mid - 1;
+    }
+    unsigned long long block[HISTORY_SPILL_INDEX_INTERVAL];
+    unsigned long long first = low * HISTORY_SPILL_INDEX_INTERVAL;
+    size_t count = (size_t) ((s.spilled - first < HISTORY_SPILL_INDEX_INTERVAL) ? s.spilled - first : HISTORY_SPILL_INDEX_INTERVAL);
+    ssize_t n = pread(s.spill_fd, block, count * sizeof(unsigned long long), (off_t) (first * sizeof(unsigned long long)));
+    if ( n != (ssize_t) (count * sizeof(unsigned long long)) ){
+        perror("Warning: reading a spilled history block failed");
+        return false;
+    }
+    return bsearch(&h, block, count, sizeof(unsigned long long), compare_hashes) != NULL;
+}
+
+void hash_history::spill(stripe &s) {                        // merge the stripe's table into its spill file (both sorted) and empty the table
+    int stripe_number = (int) (&s - stripes);
+    char path[SPILL_PATH_SIZE], new_path[SPILL_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/history_%d", spill_dir, stripe_number);
+    snprintf(new_path, sizeof(new_path), "%s/history_%d.tmp", spill_dir, stripe_number);
+    unsigned long long *fresh = new unsigned long long[s.size];
+    unsigned int num_fresh = 0;
+    for (unsigned int i = 0 ; i < s.capacity ; i++){
+        if ( s.table[i] != 0 ) fresh[num_fresh++] = s.table[i];
+    }
+    qsort(fresh, num_fresh, sizeof(unsigned long long), compare_hashes);
+    FILE *old_file = (s.spill_fd >= 0) ? fopen(path, "r") : NULL;
+    FILE *new_file = fopen(new_path, "w");
+    if ( new_file == NULL || (s.spill_fd >= 0 && old_file == NULL) ){
+        perror("Warning: could not spill the url history to disk, keeping it in memory");
+        if ( old_file != NULL ) fclose(old_file);
+        if ( new_file != NULL ) fclose(new_file);
+        delete[] fresh;
+        grow(s);
+        return;
+    }
+    unsigned long long total = s.spilled + num_fresh;
+    unsigned long long *index = new unsigned long long[(total + HISTORY_SPILL_INDEX_INTERVAL - 1) / HISTORY_SPILL_INDEX_INTERVAL];
+    unsigned long long written = 0, old_hash = 0;
+    bool has_old = ( old_file != NULL && fread(&old_hash, sizeof(old_hash), 1, old_file) == 1 );
+    unsigned int f = 0;
+    bool ok = true;
+    while ( ok && (has_old || f < num_fresh) ){              // (the two are disjoint: a fresh hash was looked up in the file before it was inserted)
+        unsigned long long next;
+        if ( has_old && (f == num_fresh || old_hash < fresh[f]) ){
+            next = old_hash;
+            has_old = ( fread(&old_hash, sizeof(old_hash), 1, old_file) == 1 );
+        } else next = fresh[f++];
+        if ( written % HISTORY_SPILL_INDEX_INTERVAL == 0 ) index[written / HISTORY_SPILL_INDEX_INTERVAL] = next;
+        ok = ( fwrite(&next, sizeof(next), 1, new_file) == 1 );
+        written++;
+    }
+    if ( old_file != NULL ) fclose(old_file);
+    delete[] fresh;
+    ok = ( fclose(new_file) == 0 ) && ok && written == total;
+    int fd = -1;
+    if ( ok && rename(new_path, path) == 0 ) fd = open(path, O_RDONLY);
+    if ( fd < 0 ){                                           // the old file (if any) is still good, but the table has to keep its hashes
+        perror("Warning: could not spill the url history to disk, keeping it in memory");
+        unlink(new_path);
+        delete[] index;
+        grow(s);
+        return;
+    }
+    if ( s.spill_fd >= 0 ) close(s.spill_fd);
+    s.spill_fd = fd;
+    delete[] s.spill_index;
+    s.spill_index = index;
+    __atomic_store_n(&s.spilled, total, __ATOMIC_RELAXED);
+    memset(s.table, 0, s.capacity * sizeof(unsigned long long));
+    s.size = 0;
+}
+
+
+/* Local Functions Implementation */
+int compare_hashes(const void *a, const void *b) {
+    unsigned long long x = *((const unsigned long long *) a), y = *((const unsigned long long *) b);
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../headers/Link_Tokenizer.h"
+#include "../headers/simd_scan.h"
+#include "../headers/HTTP_Connection.h"
+
+
+using namespace std;
+
+
+struct page {
+    char *content;
+    size_t length;
+};
+
+
+/* Local Functions */
+int parse_arguements(int argc, char *const *argv, char *&root_dir, int &repetitions, size_t &chunk_size);
+int load_pages(const char *root_dir, struct page *&pages, size_t &total_bytes);
+void scan_pages(const struct page *pages, int num_of_pages, size_t chunk_size, long long &links, unsigned long long &checksum);
+long long monotonic_ns();
+
+
+/* usage: ./linkbench -d <root_dir> [-r repetitions] [-c chunk_size] */
+// times Link_Tokenizer with every scan_for() implementation this cpu supports on the pages of a webcreator root directory
+int main(int argc, char *argv[]) {
+    char *root_dir = NULL;
+    int repetitions;
+    size_t chunk_size;
+    if ( parse_arguements(argc, argv, root_dir, repetitions, chunk_size) < 0 ){
+        cerr << "Invalid link benchmark parameters" << endl
+             << "usage: ./linkbench -d <root_dir> [-r repetitions] [-c chunk_size]" << endl;
+        delete[] root_dir;
+        return -1;
+    }
+
+    // load every page in memory so that only the scanning is timed
+    struct page *pages = NULL;
+    size_t total_bytes = 0;
+    int num_of_pages = load_pages(root_dir, pages, total_bytes);
+    if ( num_of_pages <= 0 ){
+        cerr << "Could not find any pages under root directory " << root_dir << endl;
+        delete[] root_dir; return -2;
+    }
+    cout << num_of_pages << " pages, " << total_bytes / (1024.0 * 1024.0) << " MB, given in chunks of " << chunk_size << " bytes, "
+         << repetitions << " repetitions" << endl;
+
+    int default_method = get_scan_method();
+    bool results_differ = false, have_reference = false;
+    long long reference_links = 0;
+    unsigned long long reference_checksum = 0;
+    double scalar_s = 0;
+    for (int method = SCAN_SCALAR ; method <= SCAN_AVX2 ; method++){
+        if ( !set_scan_method(method) ){
+            cout << scan_method_name(method) << ": not supported by this cpu" << endl;
+            continue;
+        }
+        long long links = 0;
+        unsigned long long checksum = 0;
+        scan_pages(pages, num_of_pages, chunk_size, links, checksum);      // warm up (and the links found)
+        long long start_ns = monotonic_ns();
+        for (int r = 0 ; r < repetitions ; r++){
+            long long l = 0;
+            unsigned long long c = 0;
+            scan_pages(pages, num_of_pages, chunk_size, l, c);
+        }
+        double elapsed_s = (monotonic_ns() - start_ns) / 1e9;
+        if ( method == SCAN_SCALAR ) scalar_s = elapsed_s;
+        printf("%-7s %8.1f MB/s  %10lld links  (%.2fx scalar)%s\n", scan_method_name(method), (total_bytes / (1024.0 * 1024.0)) * repetitions / elapsed_s,
+               links, (scalar_s > 0) ? scalar_s / elapsed_s : 0.0, (method == default_method) ? "  <- used by the crawler" : "");
+        if ( !have_reference ){
+            have_reference = true;
+            reference_links = links;
+            reference_checksum = checksum;
+        } else if ( links != reference_links || checksum != reference_checksum ) results_differ = true;
+    }
+    if ( results_differ ) cerr << "Warning: the scan methods did not find the same links!" << endl;
+
+    // clean up
+    for (int i = 0 ; i < num_of_pages ; i++){
+        delete[] pages[i].content;
+    }
+    delete[] pages;
+    delete[] root_dir;
+    return results_differ ? -3 : 0;
+}
+
+
+/* Local Functions Implementation */
+int parse_arguements(int argc, char *const *argv, char *&root_dir, int &repetitions, size_t &chunk_size) {
+    // default values
+    repetitions = 10;
+    chunk_size = HTTP_BODY_READ_SIZE;                // what the crawler gets from each read()
+    for (int i = 1 ; i < argc ; i += 2){
+        if ( i + 1 >= argc ) return -1;
+        else if ( strcmp(argv[i], "-d") == 0 ){
+            delete[] root_dir;
+            size_t len = strlen(argv[i+1]);
+            root_dir = new char[len + 1];
+            strcpy(root_dir, argv[i+1]);
+            if ( len > 1 && root_dir[len - 1] == '/' ) root_dir[len - 1] = '\0';    // remove a '/' at the end
+        }
+        else if ( strcmp(argv[i], "-r") == 0 ) repetitions = atoi(argv[i+1]);
+        else if ( strcmp(argv[i], "-c") == 0 ) chunk_size = (size_t) atol(argv[i+1]);
+        else return -1;
+    }
+    if ( root_dir == NULL || repetitions <= 0 || chunk_size == 0 ) return -2;
+    return 0;
+}
+
+
+int load_pages(const char *root_dir, struct page *&pages, size_t &total_bytes) {     // loads every "root_dir/site/page" - returns the number of pages loaded (or < 0 on error)
+    DIR *root = opendir(root_dir);
+    if ( root == NULL ){ perror("opendir root directory"); return -1; }
+    int capacity = 1024, count = 0;
+    pages = new struct page[capacity];
+    struct dirent *site;
+    while ( (site = readdir(root)) != NULL ){
+        if ( site->d_name[0] == '.' ) continue;
+        char site_path[1024];
+        snprintf(site_path, sizeof(site_path), "%s/%s", root_dir, site->d_name);
+        DIR *site_dir = opendir(site_path);
+        if ( site_dir == NULL ) continue;                   // not a directory
+        struct dirent *entry;
+        while ( (entry = readdir(site_dir)) != NULL ){
+            if ( entry->d_name[0] == '.' ) continue;
+            char page_path[2048];
+            snprintf(page_path, sizeof(page_path), "%s/%s", site_path, entry->d_name);
+            FILE *f = fopen(page_path, "r");
+            if ( f == NULL ) continue;
+            struct stat st;
+            if ( fstat(fileno(f), &st) < 0 || !S_ISREG(st.st_mode) ){ fclose(f); continue; }
+            if ( count == capacity ){
+                struct page *temp = new struct page[2 * capacity];
+                memcpy(temp, pages, count * sizeof(struct page));
+                delete[] pages;
+                pages = temp;
+                capacity *= 2;
+            }
+            pages[count].content = new char[st.st_size + 1];
+            pages[count].length = fread(pages[count].content, 1, st.st_size, f);
+            total_bytes += pages[count].length;
+            count++;
+            fclose(f);
+        }
+        closedir(site_dir);
+    }
+    closedir(root);
+    return count;
+}
+
+
+void scan_pages(const struct page *pages, int num_of_pages, size_t chunk_size, long long &links, unsigned long long &checksum) {
+    Link_Tokenizer tokenizer;
+    char link[MAX_LINK_SIZE];
+    for (int i = 0 ; i < num_of_pages ; i++){
+        tokenizer.reset();
+        for (size_t offset = 0 ; offset < pages[i].length ; offset += chunk_size){
+            const char *chunk = pages[i].content + offset;
+            size_t chunk_len = (pages[i].length - offset < chunk_size) ? pages[i].length - offset : chunk_size;
+            while ( tokenizer.next_link(chunk, chunk_len, link) ){
+                links++;
+                for (const char *c = link ; *c != '\0' ; c++) checksum = checksum * 31 + (unsigned char) *c;
+            }
+        }
+    }
+}
+
+
+long long monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
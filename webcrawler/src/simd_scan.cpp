@@ -0,0 +1,94 @@
+#include <cstring>
+#include "../headers/simd_scan.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+
+typedef const char *(*scan_function)(const char *, const char *, char, char);
+
+
+/* Local Functions */
+static const char *scan_scalar(const char *from, const char *end, char c1, char c2);
+#ifdef HAVE_X86_SIMD
+static const char *scan_sse2(const char *from, const char *end, char c1, char c2);
+static const char *scan_avx2(const char *from, const char *end, char c1, char c2);
+#endif
+static int best_scan_method();
+
+
+static int method = SCAN_SCALAR;
+static scan_function scanner = scan_scalar;
+static bool method_picked = set_scan_method(best_scan_method());    // (!) done during static initialization, that is before any threads are created
+
+
+const char *scan_for(const char *from, const char *end, char c1, char c2) {
+    return scanner(from, end, c1, c2);
+}
+
+bool set_scan_method(int new_method) {
+    switch (new_method){
+        case SCAN_SCALAR: scanner = scan_scalar; break;
+#ifdef HAVE_X86_SIMD
+        case SCAN_SSE2: if ( !__builtin_cpu_supports("sse2") ) return false; scanner = scan_sse2; break;
+        case SCAN_AVX2: if ( !__builtin_cpu_supports("avx2") ) return false; scanner = scan_avx2; break;
+#endif
+        default: return false;
+    }
+    method = new_method;
+    return true;
+}
+
+int get_scan_method() { return method; }
+
+const char *scan_method_name(int m) {
+    switch (m){
+        case SCAN_SCALAR: return "scalar";
+        case SCAN_SSE2: return "sse2";
+        case SCAN_AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+
+/* Local Functions Implementation */
+static int best_scan_method() {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") ) return SCAN_AVX2;
+    if ( __builtin_cpu_supports("sse2") ) return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+static const char *scan_scalar(const char *from, const char *end, char c1, char c2) {
+    for ( ; from < end ; from++){
+        if ( *from == c1 || *from == c2 ) return from;
+    }
+    return end;
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static const char *scan_sse2(const char *from, const char *end, char c1, char c2) {
+    const __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2);
+    for ( ; from + 16 <= end ; from += 16){             // compare 16 bytes at a time against both characters
+        __m128i block = _mm_loadu_si128((const __m128i *) from);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, v1), _mm_cmpeq_epi8(block, v2)));
+        if ( mask != 0 ) return from + __builtin_ctz((unsigned int) mask);
+    }
+    return scan_scalar(from, end, c1, c2);               // the last (less than 16) bytes
+}
+
+__attribute__((target("avx2")))
+static const char *scan_avx2(const char *from, const char *end, char c1, char c2) {
+    const __m256i v1 = _mm256_set1_epi8(c1), v2 = _mm256_set1_epi8(c2);
+    for ( ; from + 32 <= end ; from += 32){             // compare 32 bytes at a time against both characters
+        __m256i block = _mm256_loadu_si256((const __m256i *) from);
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, v1), _mm256_cmpeq_epi8(block, v2)));
+        if ( mask != 0 ) return from + __builtin_ctz(mask);
+    }
+    return scan_sse2(from, end, c1, c2);                 // the last (less than 32) bytes
+}
+#endif
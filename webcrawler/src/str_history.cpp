@@ -30,8 +30,9 @@ str_history::~str_history() {
     }
 }
 
-void str_history::add(const char *str) {        // O(logn)
+bool str_history::add(const char *str) {        // O(logn)
     this->acquire();            // lock the mutex
+    unsigned int old_size = size;
     if (head == NULL){
         size++;
         head = new histNode(str);
@@ -57,7 +58,9 @@ void str_history::add(const char *str) {        // O(logn)
             }
         }
     }
+    bool added = (size > old_size);
     this->release();           // unlock the mutex
+    return added;
 }
 
 bool str_history::search(const char *str) {      // O(logn)
@@ -92,7 +95,7 @@ void str_history::rec_get_all_strings(histNode *p, char **table) {
 
 char **str_history::get_all_strings_as_table() {
     this->acquire();          // lock the mutex
-    if ( head == NULL ) return NULL;
+    if ( head == NULL ) { this->release(); return NULL; }
     char **table = new char*[this->size];
     rec_get_all_strings(head, table);
     this->release();          // unlock the mutex
@@ -14,10 +14,29 @@
 #include <poll.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-#include "../headers/FIFO_Queue.h"
+#include <cstdarg>
+#include "../headers/URL_Frontier.h"
 #include "../headers/crawl.h"
 #include "../headers/str_history.h"
+#include "../headers/hash_history.h"
 #include "../headers/crawling_monitoring.h"
+#include "../headers/DNS_Cache.h"
+#include "../headers/Crawl_Checkpoint.h"
+#include "../headers/Page_Validators.h"
+#include "../headers/Work_Deque.h"
+#include "../headers/Priority_Frontier.h"
+#include "../headers/Page_Segments.h"
+#include "../headers/Fetch_Metrics.h"
+#include "../headers/Crawl_Hosts.h"
+#include "../headers/URL_Interner.h"
+#include "../headers/Near_Duplicates.h"
+#include "../headers/Fetch_Retries.h"
+#include "../headers/Page_Writers.h"
+#include "../headers/Concurrency_Controller.h"
+#include "../headers/Link_Graph.h"
+#include "../headers/Graph_Analytics.h"
+#include "../headers/Link_Tokenizer.h"
+#include "../headers/Command_Server.h"
 #include "../headers/executables_paths.h"
 
 
@@ -25,10 +44,15 @@ using namespace std;
 
 
 #define NUM_OF_WORKERS 5                     // number of workers for jobExecutor
-#define COMMAND_QUEUE_SIZE 20                // size of the queue for incoming TCP command connections (only one will be handled at a time)
+#define COMMAND_QUEUE_SIZE 20                // size of the queue for incoming TCP command connections (they are accepted as soon as the command server gets to them)
 #define MAX_COMMAND_WORD_SIZE 256            // maximum size for a word in a command (for bigger words we will only keep the first 256 characters)
-#define BUFFER_SIZE 2048                     // size of the buffer used to read the jobExecutor's answers to commands
 #define MAX_ARGUMENT_WORD_SIZE 256           // the maximum size of a word argument for a jobExecutor command (used to estimate the buffer size for reading from the socket)
+#define DEFAULT_NUM_OF_THREADS 4             // crawling threads, unless -t says otherwise
+#define DEFAULT_MAX_FETCHES 32               // default maximum number of concurrent fetches (connections to the server) per crawling thread
+#define STATS_RESPONSE_SIZE 8192             // STATS' answer (a few lines plus one per fetch phase and one per host)
+#define METRICS_RESPONSE_SIZE 8192           // METRICS' answer (a JSON object with every fetch phase's histogram)
+#define GRAPH_RESPONSE_SIZE 16384            // GRAPH's answer (a few lines plus one per degree bucket, orphan page listed and depth - whatever does not fit is cut off)
+#define SPILL_DIR ".spill"                   // (--memory-limit) the directory in save_dir where the urlQueue and urlHistory spill what does not fit in memory
 
 
 /* useful macros */
@@ -42,27 +66,73 @@ time_t time_crawler_started;
 pthread_mutex_t stat_lock;                   // mutex protecting stats' variables
 unsigned int total_pages_downloaded = 0;
 unsigned int total_bytes_downloaded = 0;
+unsigned int pages_changed = 0, pages_unchanged = 0, pages_new = 0;     // pages downloaded (or 304'ed) by this crawl, split by how they compare with the copy a previous crawl left in save_dir
+Fetch_Metrics *fetchMetrics = NULL;          // how long each phase of a fetch takes (per thread latency histograms, updated without locks) and how many pages are saved per second
+Fetch_Retries *fetchRetries = NULL;          // how many times the download of each url that timed out did, so that it is queued again only a few times
 /* web crawling: */
 char *save_dir = NULL;
-pthread_cond_t QueueIsEmpty;                 // condition variable for whether or not the Queue of URLs is empty
 bool threads_must_terminate = false;         // used by the crawling_monitoring.cpp thread (along with a broadcast) to notify the other threads that they have to exit prematurely
-int num_of_threads_blocked = 0;              // number of threads blocked on cond_t QueueIsEmpty
-FIFO_Queue *urlQueue = NULL;                 // common URL Queue for all threads: stores both full http URLS and root-relative URLS
-str_history *urlHistory = NULL;              // common URL History for all threads: stores only the root-relative version of URLS concerning our server. This data structure is a search tree allowing for an O(logn) search and insertion
+URL_Frontier *urlQueue = NULL;               // common URL Queue (FIFO) for all threads: stores both full http URLS and root-relative URLS (the starting_url, a resumed crawl's urls and urls whose host had to be resolved first). Threads with nothing to do park on it
+Work_Deque *localQueues = NULL;              // one per thread: the links found in the pages a thread downloads go to its own localQueue, and threads that run out of urls steal from the others'
+URL_Interner *urlIds = NULL;                 // every url queued to a localQueue is interned once here (in an arena) and the localQueues only hold its dense 32-bit id
+Priority_Frontier *priorityQueue = NULL;     // (--order) if given, it replaces the localQueues: links are fetched in the order of its scorer instead of as soon as possible by the thread that found them
+int max_pages = -1;                          // (--max-pages) the crawl's budget: crawling finishes once this many pages have been saved (-1 for no limit)
+int pages_budget = 0;                        // (atomic) how many more fetches may be started without going over max_pages (fetches that do not save a page give theirs back)
+unsigned long long memory_limit = 0;         // (--memory-limit) bytes the urlQueue, urlHistory and urlIds may take together (a quarter each, the rest is left for everything else) - 0 for no limit
+Link_Graph *linkGraph = NULL;                // (--link-graph) every page found and every link between them, turned into a graph that PageRank runs on once crawling is over (NULL: links are not recorded)
+char *graphReport = NULL;                    // (atomic, --link-graph) GRAPH's answer, computed once by the monitor thread right after the graph is built and ranked (NULL until then)
+Concurrency_Controller *concurrency = NULL;  // (--adaptive) how many fetches all threads may have in flight together, raised and lowered with the server's time to first byte and errors (NULL: threads * fetches)
+Page_Writers *pageWriters = NULL;            // (--writers) the threads that save the pages to their files behind the crawler threads' backs (NULL if the crawler threads save them themselves, and always with --segments)
+Near_Duplicate_Index *nearDuplicates = NULL;  // (--near-duplicates) the SimHash fingerprints of the pages saved so far: a page within the given number of bits of one of them is not saved (nor indexed)
+unsigned int pending_urls = 0;               // (atomic) urls queued anywhere, being downloaded or waiting for DNS: crawling has finished when this drops to 0 (see crawl.cpp)
+Crawl_Hosts *crawlHosts = NULL;              // the crawled server and the other hosts that may be crawled (--allow, --seed), each with its own connection limit (--host-connections) and queue of urls waiting for a connection
+DNS_Cache *dnsCache = NULL;                  // common host -> address cache for all threads: lookups never block, hosts not yet known are resolved by its own thread (the server's host is added at start up)
+hash_history *urlHistory = NULL;             // common URL History for all threads: stores only the root-relative version of URLS concerning our server. This data structure is a lock-striped hash set allowing for an O(1) search and insertion
 /* thread monitoring: */
-bool crawling_has_finished = false;          // will be set to true by the last crawl.cpp thread when it's about to block with an empty urlQueue along with a signal to crawlingHasFinished cond_t
+bool crawling_has_finished = false;          // will be set to true by the crawl.cpp thread that drops pending_urls to 0 along with a signal to crawlingHasFinished cond_t
 pthread_cond_t crawlingFinished;             // The crawling_monitoring.cpp thread will block waiting on this cond_t. When notified that crawling has finished then it will in turn notify all threads to exit and initialize the jobExecutor
 pthread_mutex_t crawlingFinishedLock;        // mutex that protects boolean "crawling_has_finished"  and cond_t "crawlingFinished"
 bool monitor_forced_exit = false;            // set to true if and when we receive a SHUTDOWN command before crawling has finished along with a signal to cond_t crawlingFinished so that the crawling_monitoring.cpp thread (and the other ones) will exit.
 /* jobExecutor connection: */
 bool jobExecutorReadyForCommands = false;    // will be set to true by the crawling_monitoring.cpp thread when (webcrawling has finished and) jobExecutor has been initialized.
 pid_t jobExecutor_pid = -1;                  // jobExecutor's pid, will be updated after fork + exec by the crawling_monitoring.cpp thread
-str_history *alldirs = NULL;                 // we keep track of all directories that the crawler has downloaded here. This way only directories downloaded in this execution will be sent to jobExecutor
+str_history *alldirs = NULL;                 // we keep track of all directories that the crawler has downloaded here. This way only directories downloaded in this execution (or in the crawl it resumed) will be sent to jobExecutor
+Crawl_Checkpoint *checkpoint = NULL;         // keeps the urlQueue, urlHistory and alldirs on disk (in save_dir) as they change, so that a crawl that dies or is shut down can be resumed with --resume
+Page_Validators *validators = NULL;          // the ETag, Last-Modified and content hash of every page saved in save_dir (kept in save_dir between crawls)
+bool recrawl = false;                        // (--recrawl) pages already saved in save_dir are only downloaded (and rewritten) again if they changed
+Segment_Store *segmentStore = NULL;          // (--segments) if given, pages are appended to a few big segment files in save_dir (one being written per thread) instead of each being saved to its own file
+bool pipelined = false;                      // (--pipeline) the jobExecutor is started before crawling and every page is sent to it as soon as it is saved, so that it is indexed (and can be searched) while crawling goes on
 extern int toJobExecutor_pipe, fromJobExecutor_pipe;   // file descriptors for write and read end respectivelly of the two pipes used for communication with the jobExecutor
+extern pthread_mutex_t toJobExecutor_lock;             // (--pipeline) a command must not be written to the jobExecutor in the middle of a page (see crawling_monitoring.cpp)
+
+
+struct crawl_options {                      // what the command line asked for: parse_arguments fills in the options given, the others keep their defaults
+    char *host_or_IP, *save_dir, *starting_url;     // (new[]'ed by parse_arguments)
+    uint16_t server_port, command_port;
+    int num_of_threads, max_fetches;
+    bool resume, recrawl, segments, pipelined, adaptive, link_graph;
+    url_scorer scorer;                       // (--order) NULL: breadth-first
+    int max_pages;                           // -1 for no limit
+    char **allowed, **seeds;                 // (argc places each, pointing into argv)
+    int num_allowed, num_seeds;
+    int host_connections;                    // 0 for no limit
+    int memory_limit_mb;                     // 0 for no limit
+    int near_duplicate_bits;                 // -1: near-duplicates are saved
+    int num_of_writers;
+    crawl_options(int argc) : host_or_IP(NULL), save_dir(NULL), starting_url(NULL), server_port(0), command_port(0), num_of_threads(DEFAULT_NUM_OF_THREADS), max_fetches(DEFAULT_MAX_FETCHES),
+                              resume(false), recrawl(false), segments(false), pipelined(false), adaptive(false), link_graph(false), scorer(NULL), max_pages(-1),
+                              allowed(new char*[argc]), seeds(new char*[argc]), num_allowed(0), num_seeds(0), host_connections(0), memory_limit_mb(0), near_duplicate_bits(-1), num_of_writers(DEFAULT_WRITERS) {}
+};
 
 
 /* Local Functions */
-int parse_arguments(int argc, char *const *argv, char *&host_or_IP, uint16_t &server_port, uint16_t &command_port, int &num_of_threads, char *&save_dir, char *&starting_url);
+int parse_arguments(int argc, char *const *argv, crawl_options &options);
+unsigned int frontier_size(int num_of_threads);
+void stats_report(char *response, size_t size, int num_of_threads);
+void metrics_report(char *response, size_t size, int num_of_threads);
+char *graph_report(int num_of_threads, const char *starting_url);
+void degrees_report(char *response, size_t size, size_t &len, const char *title, const degree_summary &degrees);
+void append_to_report(char *response, size_t size, size_t &len, const char *format, ...);
 
 
 int main(int argc, char *argv[]) {
@@ -73,15 +143,18 @@ int main(int argc, char *argv[]) {
         return -1;
     }
     // parse main's parameters
-    char *host_or_IP = NULL, *starting_url = NULL;
-    uint16_t server_port = 0, command_port = 0;
-    int num_of_threads = -1;
-    if (parse_arguments(argc, argv, host_or_IP, server_port, command_port, num_of_threads, save_dir, starting_url) < 0 ){
+    crawl_options options(argc);
+    if (parse_arguments(argc, argv, options) < 0 ){
         cerr << "Invalid web crawler parameters" << endl;
+        delete[] options.allowed; delete[] options.seeds;
         return -1;
     }
-    cout << "Web crawler initialized with:\n - host_or_IP: " << host_or_IP << "\n - server port: " << server_port << "\n - command port: " << command_port
-         << "\n - num_of_threads: " << num_of_threads << "\n - save directory: " << save_dir << "\n - starting_url: " << starting_url << endl << endl;
+    save_dir = options.save_dir;                  // (the options the other threads need are kept in globals)
+    recrawl = options.recrawl;
+    pipelined = options.pipelined;
+    max_pages = options.max_pages;
+    cout << "Web crawler initialized with:\n - host_or_IP: " << options.host_or_IP << "\n - server port: " << options.server_port << "\n - command port: " << options.command_port
+         << "\n - num_of_threads: " << options.num_of_threads << "\n - max fetches per thread: " << options.max_fetches << "\n - save directory: " << save_dir << "\n - starting_url: " << options.starting_url << endl << endl;
 
     // threads should ignore SIGPIPE in case connection is closed by the server and they are blocked on read
     struct sigaction act;
@@ -92,274 +165,307 @@ int main(int argc, char *argv[]) {
     // Find out server's socket address
     struct sockaddr_in server_sa;
     server_sa.sin_family = AF_INET;
-    server_sa.sin_port = htons(server_port);
+    server_sa.sin_port = htons(options.server_port);
     struct in_addr in;
     memset(&in, 0, sizeof(in));
-    if ( inet_aton(host_or_IP, &in) == 1) {       // try parsing host_or_IP as an IP
+    if ( inet_aton(options.host_or_IP, &in) == 1) {       // try parsing host_or_IP as an IP
         server_sa.sin_addr = in;
     }
     else {                                        // else if unsuccessful then host_or_IP must be a host and not an IP after all
-        struct hostent *lookup = gethostbyname(host_or_IP);
+        struct hostent *lookup = gethostbyname(options.host_or_IP);
         if ( lookup  == NULL ){
             cout << "Could not find host (DNS failed)" << endl;
-            delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -2;
+            delete[] options.allowed; delete[] options.seeds; delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -2;
         } else {
             server_sa.sin_addr = *((struct in_addr *) lookup->h_addr);    // arbitrarily pick the first address
         }
     }
 
+    // the crawled server is always crawled, any other host only if it matches the allow-list (a seed's host is added to it)
+    crawlHosts = new Crawl_Hosts(options.host_or_IP, server_sa, (unsigned int) options.host_connections);
+    for (int a = 0 ; a < options.num_allowed ; a++){
+        crawlHosts->allow(options.allowed[a]);
+    }
+    delete[] options.allowed;
+
     // Create command socket
     struct sockaddr_in command_sa;
     command_sa.sin_family = AF_INET;
-    command_sa.sin_port = htons(command_port);
+    command_sa.sin_port = htons(options.command_port);
     command_sa.sin_addr.s_addr = htonl(INADDR_ANY);
     int command_socket_fd;
-    CHECK_PERROR( (command_socket_fd = socket(AF_INET, SOCK_STREAM, 0)) , "socket" , delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -4; )
-    CHECK_PERROR( bind(command_socket_fd, (struct sockaddr *) &command_sa, sizeof(command_sa)) , "bind" , close(command_socket_fd); delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -4; )
-    CHECK_PERROR( listen(command_socket_fd, COMMAND_QUEUE_SIZE) , "listen" , close(command_socket_fd); delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -4; )
+    CHECK_PERROR( (command_socket_fd = socket(AF_INET, SOCK_STREAM, 0)) , "socket" , delete[] options.seeds; delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -4; )
+    CHECK_PERROR( bind(command_socket_fd, (struct sockaddr *) &command_sa, sizeof(command_sa)) , "bind" , close(command_socket_fd); delete[] options.seeds; delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -4; )
+    CHECK_PERROR( listen(command_socket_fd, COMMAND_QUEUE_SIZE) , "listen" , close(command_socket_fd); delete[] options.seeds; delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -4; )
 
     // init threadpool here
-    pthread_t *threadpool = new pthread_t[num_of_threads];
-    for (int i = 0 ; i < num_of_threads ; i++){
+    pthread_t *threadpool = new pthread_t[options.num_of_threads];
+    for (int i = 0 ; i < options.num_of_threads ; i++){
         threadpool[i] = 0;
     }
 
-    // create the FIFO Queue that will be used by all threads and push starting url into it. This Queue can contain both: root relative urls and full http urls
-    urlQueue = new FIFO_Queue();
-    urlQueue->push(starting_url);                   // locking is not necessary yet - only one thread
-
-    // create the URL History search tree (empty at start): it will contain ONLY the root relative urls for ALL the pages that were added to the urlQueue and are asked from our host_or_IP server, in order to we make sure they're added only once
-    urlHistory = new str_history();
-    char *root_relative_starting_url;
-    findRootRelativeUrl(starting_url, root_relative_starting_url);    // Note: starting_url should be for host_or_IP server, but even if it is not, it's ok to add it to urlHistory here since no crawling will be done whatsoever
-    if ( root_relative_starting_url == NULL ){      // should not happen
-        cerr << "Unexpected failure for finding the root relative link of the starting_url: " << link << endl;
-        root_relative_starting_url = starting_url;
+    // create the URL Frontier that will be used by all threads. This Queue can contain both: root relative urls and full http urls
+    urlQueue = new URL_Frontier();
+
+    // create the URL History hash set: it will contain ONLY the root relative urls for ALL the pages that were added to the urlQueue and are asked from our host_or_IP server, in order to we make sure they're added only once
+    urlHistory = new hash_history();
+
+    // with --memory-limit, both of them keep what does not fit in their share of it in <save_dir>/.spill (only for as long as this crawl runs)
+    char *spill_dir = NULL;
+    if ( options.memory_limit_mb > 0 ){
+        memory_limit = (unsigned long long) options.memory_limit_mb << 20;
+        spill_dir = new char[strlen(save_dir) + strlen(SPILL_DIR) + 2];
+        sprintf(spill_dir, "%s/%s", save_dir, SPILL_DIR);
+        if ( (mkdir(spill_dir, 0755) < 0 && errno != EEXIST) || !urlQueue->limit_memory(memory_limit / 4, spill_dir) || !urlHistory->limit_memory(memory_limit / 4, spill_dir) ){
+            perror("Warning: could not set up spilling to disk, the memory is not limited");
+            memory_limit = 0;
+        } else cout << "Keeping at most " << options.memory_limit_mb << "MB of urls in memory (the rest is spilled to " << spill_dir << ")" << endl;
     }
-    urlHistory->add(root_relative_starting_url);    // (atomically although not necessary yet) add the first url to our urlHistory struct
 
     // create the directories search tree struct, where we store all site directories downloaded for the jobExecutor to use (if empty the jobExecutor should not be initialized nor used)
     alldirs = new str_history();
 
+    // either reload the crawl checkpointed in save_dir (if asked to) or start a new one from starting_url
+    checkpoint = new Crawl_Checkpoint(save_dir);
+    int num_resumed = (options.resume) ? checkpoint->resume(urlQueue, urlHistory, alldirs) : -1;
+    if ( num_resumed >= 0 ){
+        cout << "Resuming the crawl checkpointed in " << save_dir << ": " << num_resumed << " urls left in the urlQueue, " << urlHistory->get_size() << " urls seen, "
+             << alldirs->get_size() << " site directories downloaded" << endl;
+    } else {
+        if (options.resume) cout << "No checkpoint to resume from in " << save_dir << ", starting from starting_url" << endl;
+        urlQueue->push(options.starting_url);               // locking is not necessary yet - only one thread
+        char *root_relative_starting_url;
+        findRootRelativeUrl(options.starting_url, root_relative_starting_url);    // Note: starting_url should be for host_or_IP server, but even if it is not, it's ok to add it to urlHistory here since no crawling will be done whatsoever
+        if ( root_relative_starting_url == NULL ){      // should not happen
+            cerr << "Unexpected failure for finding the root relative link of the starting_url: " << link << endl;
+            root_relative_starting_url = options.starting_url;
+        }
+        urlHistory->add(root_relative_starting_url);    // (atomically although not necessary yet) add the first url to our urlHistory struct
+    }
+    // load what we know about the pages a previous crawl saved in save_dir (a re-crawl asks the server for those conditionally)
+    validators = new Page_Validators();
+    int num_validators = validators->load(save_dir);
+    if (recrawl) cout << "Re-crawling into " << save_dir << ": validators of " << ((num_validators > 0) ? num_validators : 0) << " saved pages loaded" << endl;
+    // with --segments, the pages a previous crawl appended to save_dir's segments are indexed here (for a re-crawl) and this crawl's pages go to new segments
+    if (options.segments){
+        segmentStore = new Segment_Store();
+        int num_pages = segmentStore->open(save_dir, true);
+        if ( num_pages < 0 ){
+            cerr << "Error: could not open the segments in " << save_dir << endl;
+            delete segmentStore; delete validators; delete checkpoint; delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] options.seeds; delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -5;
+        }
+        cout << "Saving pages to segments in " << segmentStore->get_dir() << " (" << num_pages << " pages already there)" << endl;
+    }
+    if ( !checkpoint->start(num_resumed < 0) ){
+        cerr << "Warning: could not start checkpointing, this crawl will not be resumable" << endl;
+    } else if ( num_resumed < 0 ) checkpoint->queued(options.starting_url, IN_HISTORY);
+    // every seed is queued after starting_url (unless the crawl was resumed), as "http://<host>:<port>/<root_relative_url>" just like the links to its host found while crawling
+    for (int s = 0 ; s < options.num_seeds ; s++){
+        char *root_relative_seed = NULL, *seed_host = NULL, *seed_port = NULL;
+        char canonical_seed[MAX_LINK_SIZE];
+        if ( !canonicalize_url(options.seeds[s], canonical_seed, sizeof(canonical_seed), DEFAULT_HTTP_PORT) || parse_url(canonical_seed, root_relative_seed, seed_host, seed_port) != 0 || seed_host == NULL ){
+            cerr << "Warning: ignoring seed that is not a full http url: " << options.seeds[s] << endl;
+            delete[] seed_port;
+            continue;
+        }
+        int port = (seed_port != NULL) ? atoi(seed_port) : DEFAULT_HTTP_PORT;
+        char seed[MAX_LINK_SIZE];
+        snprintf(seed, sizeof(seed), "%s:%d", seed_host, port);
+        crawlHosts->allow(seed);
+        if ( snprintf(seed, sizeof(seed), "http://%s:%d%s", seed_host, port, root_relative_seed) < (int) sizeof(seed) && num_resumed < 0 && urlHistory->insert_if_absent(seed) ){
+            urlQueue->push(seed);
+            checkpoint->queued(seed, IN_HISTORY_AS_IS);
+        }
+        delete[] seed_host;
+        delete[] seed_port;
+    }
+    delete[] options.seeds;
+
+    // with --pipeline, the jobExecutor is started now (with the site directories of the crawl we resumed, if any) and gets every page as soon as it is saved
+    if (pipelined){
+        init_jobExecutor(NUM_OF_WORKERS);
+        if ( jobExecutor_pid != -1 ){
+            cout << "jobExecutor ready for commands (pages are indexed while crawling)" << endl;
+            jobExecutorReadyForCommands = true;
+        }
+    }
+
     // create one thread to monitor EXACTLY when the web crawling has finished
     cout << "Creating monitor thread..." << endl;
     struct monitor_args margs;
-    margs.num_of_threads = num_of_threads;
+    margs.num_of_threads = options.num_of_threads;
     margs.threadpool = threadpool;
     margs.num_of_workers = NUM_OF_WORKERS;
-    CHECK( pthread_cond_init(&crawlingFinished, NULL) , "pthread_cond_init", delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -5; )
-    CHECK( pthread_mutex_init(&crawlingFinishedLock, NULL) , "pthread_mutex_init" , delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -5; )
+    margs.starting_url = options.starting_url;
+    CHECK( pthread_cond_init(&crawlingFinished, NULL) , "pthread_cond_init", delete segmentStore; delete validators; delete checkpoint; delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -5; )
+    CHECK( pthread_mutex_init(&crawlingFinishedLock, NULL) , "pthread_mutex_init" , delete segmentStore; delete validators; delete checkpoint; delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -5; )
     pthread_t monitor_tid = 0;
-    CHECK( pthread_create(&monitor_tid, NULL, monitor_crawling, (void *) &margs), "pthread_create monitor thread" , delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -5; )
-
-    // create num_of_thread threads
+    CHECK( pthread_create(&monitor_tid, NULL, monitor_crawling, (void *) &margs), "pthread_create monitor thread" , delete segmentStore; delete validators; delete checkpoint; delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -5; )
+
+    // create the DNS cache (and its resolver thread) before any thread that may look up a host, and teach it our server's address
+    dnsCache = new DNS_Cache();
+    dnsCache->add(options.host_or_IP, server_sa.sin_addr);
+
+    // every thread times the phases of its fetches in its own histograms, and the DNS cache's resolver thread times its lookups
+    fetchMetrics = new Fetch_Metrics((unsigned int) options.num_of_threads);
+    fetchRetries = new Fetch_Retries();
+    fetchMetrics->attach(PHASE_DNS, &dnsCache->lookup_times);
+
+    // create num_of_thread threads, each with its own localQueue
+    urlIds = new URL_Interner();
+    if ( options.near_duplicate_bits >= 0 ){
+        nearDuplicates = new Near_Duplicate_Index(options.near_duplicate_bits);
+        cout << "Not saving pages within " << options.near_duplicate_bits << " bits of the SimHash of a page saved already" << endl;
+    }
+    // (--adaptive) the fetches in flight start from one per thread and follow the server's latency, up to what the threads' slots allow
+    if (options.adaptive){
+        concurrency = new Concurrency_Controller((unsigned int) options.num_of_threads, 1, (unsigned int) (options.num_of_threads * options.max_fetches));
+        cout << "Adapting the number of fetches in flight to the server's latency (at most " << concurrency->get_max() << ")" << endl;
+    }
+    // (--link-graph) every crawler thread records the links it finds in its own buffer, and PageRank runs on them once crawling is over (see crawling_monitoring)
+    if (options.link_graph){
+        linkGraph = new Link_Graph((unsigned int) options.num_of_threads);
+        cout << "Recording the link graph (its PageRank is saved in " << save_dir << "/" << PAGERANK_FILE << ")" << endl;
+    }
+    // the pages are saved by their own writer threads, so that the crawler threads do not wait for the disk (segments are appended to by the crawler threads themselves)
+    if ( options.num_of_writers > 0 && !options.segments ){
+        pageWriters = new Page_Writers((unsigned int) options.num_of_writers, checkpoint);
+        fetchMetrics->attach(PHASE_DISK_WRITE, &pageWriters->write_times);
+        cout << "Saving pages with " << pageWriters->size() << " writer threads" << endl;
+    }
+    localQueues = new Work_Deque[options.num_of_threads];
+    if ( options.scorer != NULL ) priorityQueue = new Priority_Frontier(options.scorer);
+    pages_budget = max_pages;
+    pending_urls = urlQueue->size();                 // (no thread runs yet)
+    if ( pending_urls == 0 ){                        // (ex: a resumed crawl that had already finished) no thread would ever drop pending_urls to 0
+        CHECK( pthread_mutex_lock(&crawlingFinishedLock) , "pthread_mutex_lock", )
+        crawling_has_finished = true;
+        CHECK( pthread_cond_signal(&crawlingFinished), "pthread_cond_signal to crawlingFinished cond_t", )
+        CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )
+    }
     cout << "Creating num_of_threads threads..." << endl;
-    CHECK( pthread_cond_init(&QueueIsEmpty, NULL) , "pthread_cond_init", delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -6; )
-    CHECK( pthread_mutex_init(&stat_lock, NULL) , "pthread_mutex_init" , delete urlQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] host_or_IP; delete[] starting_url; return -6; )
-    struct args arguements(&server_sa, num_of_threads);
-    for (int i = 0 ; i < num_of_threads ; i++){
+    CHECK( pthread_mutex_init(&stat_lock, NULL) , "pthread_mutex_init" , delete segmentStore; delete validators; delete checkpoint; delete urlQueue; delete[] localQueues; delete urlIds; delete nearDuplicates; delete pageWriters; delete concurrency; delete fetchRetries; delete linkGraph; delete priorityQueue; delete urlHistory; delete alldirs; delete[] threadpool; close(command_socket_fd); delete[] save_dir; delete[] options.host_or_IP; delete[] options.starting_url; return -6; )
+    struct args arguements(&server_sa, options.num_of_threads, options.max_fetches);
+    for (int i = 0 ; i < options.num_of_threads ; i++){
         CHECK( pthread_create(&threadpool[i], NULL, crawl, (void *) &arguements) , "pthread_create" , threadpool[i] = 0; )   // (!) threadpool[i] = 0 signifies that this thread was not created
     }
 
     cout << "Ready to receive commands from the command socket..." << endl;
-    // repeatedly block and wake up to handle a command from the command socket
-    struct pollfd *pfds = new struct pollfd[1];
-    pfds[0].fd = command_socket_fd;
-    pfds[0].events =  POLLIN;
-    pfds[0].revents = 0;
-    int retval;
+    // serve any number of command connections at once: the crawler's own commands are answered right away, while the jobExecutor's are queued for it and relayed back as it answers them
+    Command_Server *commandServer = new Command_Server(command_socket_fd);
+    bool shutting_down = false;                      // (no more connections are accepted, but the answers the jobExecutor still owes are relayed before exiting)
     for (;;) {
-        retval = poll(pfds, 1, -1);                 // wait indefinitely until a TCP connection request comescheck_if_webcrawling_finished(num_of_threads, threadpool);
-        if ( retval < 0 ){
+        if ( commandServer->serve() < 0 ){
             if ( errno == EINTR ) {    // terminating signal?
                 cerr << "poll interrupted by a signal! webcrawling exiting..." << endl;
                 CHECK( pthread_mutex_lock(&crawlingFinishedLock) , "pthread_mutex_lock", )           // lock crawling_has_finished's mutex
-                if ( !crawling_has_finished ){      // if webcrawling has not finished yet then force it to
+                if ( !crawling_has_finished && !monitor_forced_exit ){      // if webcrawling has not finished yet then force it to
                     monitor_forced_exit = true;     // by setting this boolean to true
                     CHECK ( pthread_cond_signal(&crawlingFinished), "pthread_cond_signal", )         // and signaling the monitor thread to exit (this thread will join all the other ones)
-                    CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )   // unlock crawling_has_finished's mutex
                     cout << "Exiting before web crawling finished..." << endl;
                 }
                 CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )       // unlock crawling_has_finished's mutex
-                break;
+                shutting_down = true;
+                commandServer->stop_accepting();
             } else {
                 perror("poll() failed");
             }
-        } else if ( retval == 0 ){
-            cerr << "Unexpected return 0 from poll" << endl;
-        } else {
-            if ( pfds[0].revents & POLLIN ){
-                pfds[0].revents = 0;                // reset revents field
-                int new_connection;
-                struct sockaddr_in incoming_sa;
-                socklen_t len = sizeof(incoming_sa);
-                CHECK_PERROR((new_connection = accept(command_socket_fd, (struct sockaddr *) &incoming_sa, &len)), "accept on command socket failed unexpectedly", break; )
-                cout << "> Crawler accepted a (command) connection from " << inet_ntoa(incoming_sa.sin_addr) << " : " << incoming_sa.sin_port << endl;
-                // read char-by-char (should be fine, worst case is 128 reads) until " " or "\n" and consider this a command
-                bool noMoreInput = false;
-                char command[128];
-                char prev = ' ';
-                int i = 0;
-                while ( i < 128 ) {
-                    CHECK_PERROR( read(new_connection, command + i, 1), "read from accepted command socket", continue; )
-                    if ( (prev != ' ' && command[i] == ' ') || command[i] == '\n' ){
-                        if ( command[i] == '\n' ) noMoreInput = true;
-                        if ( i > 0 && command[i-1] == '\r' ) command[i-1] = '\0';
-                        else command[i] = '\0';
-                        break;
-                    } else if ( prev == ' ' && command[i] == ' ' ){   // ignore continuous white space at start
-                        continue;
-                    }
-                    prev = command[i];
-                    i++;
+        }
+        int client;
+        char *command, *arguments;
+        bool has_arguments;
+        while ( (client = commandServer->next_command(command, arguments, has_arguments)) >= 0 ){
+            if ( shutting_down ){
+                commandServer->reply(client, "the crawler is shutting down\n");
+            }
+            else if ( strcmp(command, "SHUTDOWN") == 0 ){
+                cout << "> Received SHUTDOWN command" << endl;
+                CHECK( pthread_mutex_lock(&crawlingFinishedLock) , "pthread_mutex_lock", )           // lock crawling_has_finished's mutex
+                if ( !crawling_has_finished ){        // if web crawling has not finished yet then force it to
+                    monitor_forced_exit = true;       // by setting this boolean to true
+                    CHECK ( pthread_cond_signal(&crawlingFinished), "pthread_cond_signal", )         // and signaling the monitor thread to exit (this thread will join all the other ones)
+                    cout << "Exiting before web crawling finished..." << endl;
                 }
-                if ( i == 128 ) command[127] = '\0';      // if command was too big it's not going to be legal anyway
-                if ( strcmp(command, "SHUTDOWN") == 0 ){
-                    cout << "> Received SHUTDOWN command" << endl;
-                    CHECK( pthread_mutex_lock(&crawlingFinishedLock) , "pthread_mutex_lock", )           // lock crawling_has_finished's mutex
-                    if ( !crawling_has_finished ){        // if web crawling has not finished yet then force it to
-                        monitor_forced_exit = true;       // by setting this boolean to true
-                        CHECK ( pthread_cond_signal(&crawlingFinished), "pthread_cond_signal", )         // and signaling the monitor thread to exit (this thread will join all the other ones)
-                        CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )   // unlock crawling_has_finished's mutex
-                        cout << "Exiting before web crawling finished..." << endl;
-                    }
-                    CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )       // unlock crawling_has_finished's mutex
-                    if (!monitor_forced_exit && alldirs->get_size() > 0 && !jobExecutorReadyForCommands){    // if jobExecutor is not ready to receive "/exit" command yet
-                        char msg[] = "jobExecutor is initialized but not ready to receive \"/exit\" command yet\nCrawler will have to wait for him to be ready (example: finish text file parsing) in order to properly shutdown\n";
-                        CHECK_PERROR( write(new_connection, msg, strlen(msg)), "write to accepted command socket", );
-                        cout << "Exiting before jobExecutor has finished getting ready for commands..." << endl;
-                    }
-                    CHECK_PERROR( close(new_connection), "closing accepted command connection", )
-                    break;
+                CHECK( pthread_mutex_unlock(&crawlingFinishedLock) , "pthread_mutex_unlock", )       // unlock crawling_has_finished's mutex
+                if (!monitor_forced_exit && alldirs->get_size() > 0 && !jobExecutorReadyForCommands){    // if jobExecutor is not ready to receive "/exit" command yet
+                    commandServer->reply(client, "jobExecutor is initialized but not ready to receive \"/exit\" command yet\nCrawler will have to wait for him to be ready (example: finish text file parsing) in order to properly shutdown\n");
+                    cout << "Exiting before jobExecutor has finished getting ready for commands..." << endl;
                 }
-                else if ( strcmp(command, "STATS") == 0 ){
-                    cout << "> Received STATS command" << endl;
-                    time_t Dt = time(NULL) - time_crawler_started;
-                    char response[256];
-                    CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
-                    sprintf(response, "Crawler has been up for %.2zu:%.2zu:%.2zu, downloaded %u pages, %u bytes\n", Dt / 3600, (Dt % 3600) / 60 , (Dt % 60), total_pages_downloaded, total_bytes_downloaded);
-                    CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
-                    CHECK_PERROR( write(new_connection , response, strlen(response)), "write to accepted command socket", )
+                else commandServer->reply(client, "");
+                shutting_down = true;
+                commandServer->stop_accepting();
+            }
+            else if ( strcmp(command, "STATS") == 0 ){
+                cout << "> Received STATS command" << endl;
+                char response[STATS_RESPONSE_SIZE];
+                stats_report(response, sizeof(response), options.num_of_threads);
+                commandServer->reply(client, response);
+            }
+            else if ( strcmp(command, "METRICS") == 0 ){
+                cout << "> Received METRICS command" << endl;
+                char *response = new char[METRICS_RESPONSE_SIZE];
+                metrics_report(response, METRICS_RESPONSE_SIZE, options.num_of_threads);
+                commandServer->reply(client, response);
+                delete[] response;
+            }
+            else if ( strcmp(command, "GRAPH") == 0 ){
+                cout << "> Received GRAPH command" << endl;
+                const char *report = __atomic_load_n(&graphReport, __ATOMIC_ACQUIRE);      // (the analysis itself is never run on this thread, see crawling_monitoring)
+                if ( linkGraph == NULL ) commandServer->reply(client, "the link graph is not recorded (the crawler must be started with --link-graph)\n");
+                else if ( report == NULL ) commandServer->reply(client, "the link graph is built once web crawling has finished\n");
+                else commandServer->reply(client, report);
+            }
+            else if ( strcmp(command, "SEARCH") == 0 || strcmp(command, "MAXCOUNT") == 0 || strcmp(command, "MINCOUNT") == 0 || strcmp(command, "WORDCOUNT") == 0 ) {
+                if ( !crawling_has_finished && !pipelined ){     // if web crawling has not finished yet (no need to lock its mutex here - we do not affect any common data)
+                    commandServer->reply(client, "web crawling is still in progress\n");
                 }
-                else if ( strcmp(command, "SEARCH") == 0 || strcmp(command, "MAXCOUNT") == 0 || strcmp(command, "MINCOUNT") == 0 || strcmp(command, "WORDCOUNT") == 0 ) {
-                    if ( !crawling_has_finished ){          // if web crawling has not finished yet (no need to lock its mutex here - we do not affect any common data)
-                        char msg[] = "web crawling is still in progress\n";
-                        CHECK_PERROR( write(new_connection, msg, strlen(msg)), "write to accepted command socket", );
-                    }
-                    else if (alldirs->get_size() == 0){     // get_size is not atomic, but this should be safe since we only read the size variable (it will not affect other threads)
-                        char msg[] = "web crawler found and downloaded 0 pages, hence jobExecutor commands cannot be used\n";   // jobExecutor will not be initialized if this is the case
-                        CHECK_PERROR( write(new_connection, msg, strlen(msg)), "write to accepted command socket", );
-                    }
-                    else if (!jobExecutorReadyForCommands){
-                        char msg[] = "jobExecutor is not ready for commands yet\nWorkers are probably still parsing their text files\n";
-                        CHECK_PERROR( write(new_connection, msg, strlen(msg)), "write to accepted command socket", );
-                    }
-                    else if (noMoreInput && (strcmp(command, "SEARCH") == 0 || strcmp(command, "MAXCOUNT") == 0 || strcmp(command, "MINCOUNT") == 0)){
-                        CHECK_PERROR( write(new_connection , "No arguments given\n", strlen("No arguments given\n")), "write to accepted command socket", )
-                    }
-                    else {
-                        if ( strcmp(command, "SEARCH") == 0 ){
-                            cout << "> Received SEARCH command" << endl;
-                            // send /search command along with any word arguments to the jobExecutor
-                            CHECK_PERROR(write(toJobExecutor_pipe, "/search ", strlen("/search ")), "write to jobExecutor", )         // send "/search" command
-                            char arguments[MAX_ARGUMENT_WORD_SIZE * 10 + 64];   // + 64 just in case there is a lot of whitespace between the words
-                            ssize_t bytes_read = 0, total_bytes_read = 0;
-                            bool stop = false;
-                            while( total_bytes_read < MAX_ARGUMENT_WORD_SIZE * 10 + 64 && !stop ){                // while not read '\n'
-                                CHECK_PERROR((bytes_read = read(new_connection, arguments + total_bytes_read, MAX_ARGUMENT_WORD_SIZE * 10 + 64 - total_bytes_read)), "read from accepted command socket", break; )
-                                for (int j = (int) total_bytes_read ; j < total_bytes_read + bytes_read ; j++){   // if found '\n' on data just read
-                                    if ( arguments[j] == '\n' ){
-                                        if ( j > 0 && arguments[j-1] == '\r') total_bytes_read = j - 1;
-                                        else total_bytes_read = j;
-                                        stop = true;                                                              // then stop reading
-                                        break;
-                                    }
-                                }
-                                if (!stop) total_bytes_read += bytes_read;
-                            }
-                            if ( total_bytes_read == MAX_ARGUMENT_WORD_SIZE * 10 + 64 ){
-                                cerr << "Warning: might not have read the whole arguments for this command (arguments too big)" << endl;
-                                if (arguments[MAX_ARGUMENT_WORD_SIZE * 10 + 64 - 1] == '\r') arguments[MAX_ARGUMENT_WORD_SIZE * 10 + 64 - 1] = ' ';
-                            }
-                            CHECK_PERROR( write(toJobExecutor_pipe, arguments, total_bytes_read), "write to jobExecutor", )
-                            CHECK_PERROR( write(toJobExecutor_pipe, "\n", 1), "write to jobExecutor", )
-                        }
-                        else if ( strcmp(command, "MAXCOUNT") == 0 || strcmp(command, "MINCOUNT") == 0){
-                            cout << "> Received " << ((strcmp(command, "MAXCOUNT") == 0) ? "MAXCOUNT" : "MINCOUNT") << " command" << endl;
-                            // send /maxcount or /mincount command along with any word arguments to jobExecutor (if there are more than one words then jobExecutor will ignore any but the first)
-                            CHECK_PERROR(write(toJobExecutor_pipe, ((strcmp(command, "MAXCOUNT") == 0) ? "/maxcount " : "/mincount "), strlen("/maxcount ")), "write to jobExecutor", )         // send "/maxcount" or "/mincount" command
-                            char arguments[MAX_ARGUMENT_WORD_SIZE + 8];   // + 8 just in case there is a lot of whitespace before the first word
-                            ssize_t bytes_read = 0, total_bytes_read = 0;
-                            bool stop = false;
-                            while( total_bytes_read < MAX_ARGUMENT_WORD_SIZE + 8 && !stop ){                      // while not read '\n'
-                                CHECK_PERROR((bytes_read = read(new_connection, arguments + total_bytes_read, MAX_ARGUMENT_WORD_SIZE + 8 - total_bytes_read)), "read from accepted command socket", break; )
-                                for (int j = (int) total_bytes_read ; j < total_bytes_read + bytes_read ; j++){   // if found '\n' on data just read
-                                    if ( arguments[j] == '\n' ){
-                                        if ( j > 0 && arguments[j-1] == '\r') total_bytes_read = j - 1;
-                                        else total_bytes_read = j;
-                                        stop = true;                                                              // then stop reading
-                                        break;
-                                    }
-                                }
-                                if (!stop) total_bytes_read += bytes_read;
-                            }
-                            if ( total_bytes_read == MAX_ARGUMENT_WORD_SIZE + 8 ){
-                                cerr << "Warning: might not have read the whole arguments for this command (arguments too big)" << endl;
-                                if (arguments[MAX_ARGUMENT_WORD_SIZE + 8 - 1] == '\r') arguments[MAX_ARGUMENT_WORD_SIZE + 8 - 1] = ' ';
-                            }
-                            CHECK_PERROR( write(toJobExecutor_pipe, arguments, total_bytes_read), "write to jobExecutor", )
-                            CHECK_PERROR( write(toJobExecutor_pipe, "\n", 1), "write to jobExecutor", )
-                        }
-                        else if ( strcmp(command, "WORDCOUNT") == 0 ){
-                            cout << "> Received WORDCOUNT command" << endl;
-                            // send /worcount command to jobExecutor
-                            CHECK_PERROR(write(toJobExecutor_pipe, "/wc\n", strlen("/wc\n")), "write to jobExecutor", )         // send "/wordcount" command
+                else if (alldirs->get_size() == 0){     // get_size is not atomic, but this should be safe since we only read the size variable (it will not affect other threads)
+                    commandServer->reply(client, "web crawler found and downloaded 0 pages, hence jobExecutor commands cannot be used\n");   // jobExecutor will not be initialized if this is the case
+                }
+                else if (!jobExecutorReadyForCommands){
+                    commandServer->reply(client, "jobExecutor is not ready for commands yet\nWorkers are probably still parsing their text files\n");
+                }
+                else if (!has_arguments && (strcmp(command, "SEARCH") == 0 || strcmp(command, "MAXCOUNT") == 0 || strcmp(command, "MINCOUNT") == 0)){
+                    commandServer->reply(client, "No arguments given\n");
+                }
+                else {
+                    // queue the command for the jobExecutor (it answers the requests in the order they are written to it, and its answer is relayed to this connection only)
+                    cout << "> Received " << command << " command" << endl;
+                    char request[COMMAND_LINE_SIZE];
+                    if ( strcmp(command, "SEARCH") == 0 ){
+                        // send /search command along with any word arguments to the jobExecutor
+                        if ( strlen(arguments) > MAX_ARGUMENT_WORD_SIZE * 10 + 64 ){    // + 64 just in case there is a lot of whitespace between the words
+                            cerr << "Warning: might not have read the whole arguments for this command (arguments too big)" << endl;
+                            arguments[MAX_ARGUMENT_WORD_SIZE * 10 + 64] = '\0';
                         }
-                        // read and send to socket jobExecutor's answer, whatever it was
-                        // IMPORTANT: jobExecutor must print (\n)"<\n" after each command's output so that we know here when to stop reading! Since html tags are ignored, this message wont be anywhere else in its answer!
-                        char buffer[BUFFER_SIZE];
-                        bool previous_chunk_ends_in_tag = false;
-                        for (;;) {
-                            ssize_t bytes_read;
-                            CHECK_PERROR((bytes_read = read(fromJobExecutor_pipe, buffer, BUFFER_SIZE)), "read from jobExecutor", break;)
-                            if (previous_chunk_ends_in_tag && bytes_read > 0 && buffer[0] == '\n'){
-                                if (bytes_read > 1) cerr << "Warning: jobExecutor sent more stuff after agreed upon \"<endl\"" << endl;
-                                break;
-                            }
-                            else previous_chunk_ends_in_tag = false;    // not really necessary since the only way to find "<" is followed by an "\n"
-                            if ( bytes_read >= 2 && buffer[bytes_read-2] == '<' && buffer[bytes_read-1] == '\n' ){   // if this was the last read from the jobExecutor's answer
-                                bytes_read -= 2;      // do not write "<\n" on output to socket
-                                if (bytes_read > 0){
-                                    CHECK_PERROR( write(new_connection, buffer, bytes_read), "write to accepted command socket", );
-                                }
-                                break;
-                            }
-                            else if ( bytes_read >= 1 && buffer[bytes_read-1] == '<' ){
-                                bytes_read--;        // do not write "<" on output socket
-                                previous_chunk_ends_in_tag = true;
-                            }
-                            CHECK_PERROR( write(new_connection, buffer, bytes_read), "write to accepted command socket", );
+                        snprintf(request, sizeof(request), "/search %s", arguments);
+                    }
+                    else if ( strcmp(command, "MAXCOUNT") == 0 || strcmp(command, "MINCOUNT") == 0){
+                        // send /maxcount or /mincount command along with any word arguments to jobExecutor (if there are more than one words then jobExecutor will ignore any but the first)
+                        if ( strlen(arguments) > MAX_ARGUMENT_WORD_SIZE + 8 ){     // + 8 just in case there is a lot of whitespace before the first word
+                            cerr << "Warning: might not have read the whole arguments for this command (arguments too big)" << endl;
+                            arguments[MAX_ARGUMENT_WORD_SIZE + 8] = '\0';
                         }
+                        snprintf(request, sizeof(request), "%s %s", (strcmp(command, "MAXCOUNT") == 0) ? "/maxcount" : "/mincount", arguments);
                     }
+                    else strcpy(request, "/wc");     // send /wordcount command to jobExecutor
+                    commandServer->forward(client, request);
                 }
-                else{
-                    cout << "> Received illegal command: " << command << endl;     // (!) keep in mind that white spaces sent at start are also considered illegal
-                    CHECK_PERROR( write(new_connection, "illegal command\n", strlen("illegal command\n")) , "write to accepted command socket", )
-                }
-                CHECK_PERROR( close(new_connection), "closing accepted command connection", )
             }
-            else cerr << "Unexpected return >0 from poll: command socket had no data ready" << endl;
+            else{
+                cout << "> Received illegal command: " << command << endl;
+                commandServer->reply(client, "illegal command\n");
+            }
         }
+        if ( shutting_down && commandServer->idle() ) break;      // (every answer the jobExecutor owed has been relayed: it can be told to exit)
     }
 
-    delete[] pfds;
+    delete commandServer;
 
     CHECK_PERROR( close(command_socket_fd), "closing command socket", )
 
 
-    delete urlHistory;
-    delete[] host_or_IP;
-    delete[] starting_url;
+    delete[] options.host_or_IP;
 
     cout << "Waiting for monitoring thread to exit.." << endl;
     if (!monitor_forced_exit && alldirs->get_size() > 0) cout << "(monitor thread will wait for the jobExecutor to be ready for an \"/exit\" command before exiting)" << endl;
@@ -373,13 +479,33 @@ int main(int argc, char *argv[]) {
 
     // used by monitor thread:
     delete[] save_dir;
+    delete[] options.starting_url;
+    delete[] graphReport;
+    delete fetchMetrics;                             // (before dnsCache and pageWriters: it reads their histograms)
+    delete pageWriters;                              // (the monitor thread has waited for every page to be written)
+    delete concurrency;
+    delete fetchRetries;
+    delete dnsCache;                                 // (this joins the resolver thread, which may still be adding links: before anything add_resolved_link uses)
+    delete linkGraph;                                // (the resolver thread records its links' edges in it)
+    delete crawlHosts;
+    delete checkpoint;                               // (this makes whatever was logged until now durable)
+    delete validators;                               // (saved by the monitor thread)
+    delete segmentStore;                             // (each thread closed its own segment writer)
     delete urlQueue;
+    delete[] localQueues;
+    delete urlIds;
+    delete nearDuplicates;
+    delete priorityQueue;
+    delete urlHistory;
+    if ( spill_dir != NULL ){                        // (urlQueue and urlHistory removed their spill files)
+        rmdir(spill_dir);
+        delete[] spill_dir;
+    }
     delete[] threadpool;
 
     CHECK( pthread_mutex_destroy(&stat_lock) , "pthread_mutex_destroy" , )
-    CHECK( pthread_cond_destroy(&QueueIsEmpty), "pthread_cond_destroy", )
 
-    if (!monitor_forced_exit && alldirs->get_size() > 0) {          // if jobExecutor was initialized in the first place
+    if (jobExecutor_pid != -1) {                     // if jobExecutor was initialized in the first place
         cout << "Waiting for jobExecutor to exit..." << endl;
         // tell jobExecutor to stop
         CHECK_PERROR(write(toJobExecutor_pipe, "/exit\n", strlen("/exit\n")), "write \"/exit\" to jobExecutor failed", )
@@ -399,25 +525,80 @@ int main(int argc, char *argv[]) {
 
 
 /* Local Function Implementation */
-int parse_arguments(int argc, char *const *argv, char *&host_or_IP, uint16_t &server_port, uint16_t &command_port, int &num_of_threads, char *&save_dir, char *&starting_url) {
-    bool vital_params_given[4] = {false, false, false, false} , num_of_threads_given = false;
+int parse_arguments(int argc, char *const *argv, crawl_options &options) {
+    bool vital_params_given[4] = {false, false, false, false};
     for (int i = 1 ; i < argc - 1 ; i += 2){
-        if ( strcmp(argv[i], "-h") == 0 && i + 1 < argc && argv[i+1][0] != '-' ){
-            host_or_IP = new char[strlen(argv[i+1]) + 1];
-            strcpy(host_or_IP, argv[i+1]);
+        if ( strcmp(argv[i], "--resume") == 0 ){   // flags without a value
+            options.resume = true;
+            i--;
+        }
+        else if ( strcmp(argv[i], "--recrawl") == 0 ){
+            options.recrawl = true;
+            i--;
+        }
+        else if ( strcmp(argv[i], "--segments") == 0 ){
+            options.segments = true;
+            i--;
+        }
+        else if ( strcmp(argv[i], "--pipeline") == 0 ){
+            options.pipelined = true;
+            i--;
+        }
+        else if ( strcmp(argv[i], "--adaptive") == 0 ){
+            options.adaptive = true;
+            i--;
+        }
+        else if ( strcmp(argv[i], "--link-graph") == 0 ){
+            options.link_graph = true;
+            i--;
+        }
+        else if ( strcmp(argv[i], "-h") == 0 && i + 1 < argc && argv[i+1][0] != '-' ){
+            options.host_or_IP = new char[strlen(argv[i+1]) + 1];
+            strcpy(options.host_or_IP, argv[i+1]);
             vital_params_given[0] = true;
         }
         else if ( strcmp(argv[i], "-p") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
-            server_port = (uint16_t) atoi(argv[i+1]);
+            options.server_port = (uint16_t) atoi(argv[i+1]);
             vital_params_given[1] = true;
         }
         else if ( strcmp(argv[i], "-c") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
-            command_port = (uint16_t) atoi(argv[i+1]);
+            options.command_port = (uint16_t) atoi(argv[i+1]);
             vital_params_given[2] = true;
         }
         else if ( strcmp(argv[i], "-t") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
-            num_of_threads = atoi(argv[i+1]);
-            num_of_threads_given = true;
+            options.num_of_threads = atoi(argv[i+1]);
+        }
+        else if ( strcmp(argv[i], "-f") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.max_fetches = atoi(argv[i+1]);
+        }
+        else if ( strcmp(argv[i], "--order") == 0 && i + 1 < argc - 1 && (options.scorer = Priority_Frontier::scorer_named(argv[i+1])) != NULL ){
+            // (depth, inlinks or sites)
+        }
+        else if ( strcmp(argv[i], "--allow") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.allowed[options.num_allowed++] = argv[i+1];  // <host>[:<port>], with wildcards
+        }
+        else if ( strcmp(argv[i], "--seed") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.seeds[options.num_seeds++] = argv[i+1];      // http://<host>[:<port>]/<root_relative_url>
+        }
+        else if ( strcmp(argv[i], "--host-connections") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.host_connections = atoi(argv[i+1]);
+            if ( options.host_connections <= 0 ) options.host_connections = -1;     // (invalid: caught below)
+        }
+        else if ( strcmp(argv[i], "--memory-limit") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.memory_limit_mb = atoi(argv[i+1]);  // MB
+            if ( options.memory_limit_mb <= 0 ) options.memory_limit_mb = -1;       // (invalid: caught below)
+        }
+        else if ( strcmp(argv[i], "--near-duplicates") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.near_duplicate_bits = atoi(argv[i+1]);     // 0 (identical text) to MAX_NEAR_DUPLICATE_DISTANCE
+            if ( options.near_duplicate_bits < 0 || options.near_duplicate_bits > MAX_NEAR_DUPLICATE_DISTANCE ) options.near_duplicate_bits = -2;   // (invalid: caught below)
+        }
+        else if ( strcmp(argv[i], "--writers") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.num_of_writers = atoi(argv[i+1]);    // 0: every crawler thread saves its own pages
+            if ( options.num_of_writers < 0 ) options.num_of_writers = -1;       // (invalid: caught below)
+        }
+        else if ( strcmp(argv[i], "--max-pages") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
+            options.max_pages = atoi(argv[i+1]);
+            if ( options.max_pages <= 0 ) options.max_pages = 0;     // (invalid: caught below)
         }
         else if ( strcmp(argv[i], "-d") == 0 && i + 1 < argc - 1 && argv[i+1][0] != '-' ){
             int add_extra_byte = 1;
@@ -425,35 +606,32 @@ int parse_arguments(int argc, char *const *argv, char *&host_or_IP, uint16_t &se
                 argv[i+1][strlen(argv[i+1]) - 1] = '\0';          // remove it
                 add_extra_byte = 0;
             }
-            save_dir = new char[strlen(argv[i+1]) + add_extra_byte];
-            strcpy(save_dir, argv[i+1]);
+            options.save_dir = new char[strlen(argv[i+1]) + add_extra_byte];
+            strcpy(options.save_dir, argv[i+1]);
             vital_params_given[3] = true;
         }
         else{
-            if (vital_params_given[0]){ delete[] host_or_IP; }
-            if (vital_params_given[3]){ delete[] save_dir; }
+            if (vital_params_given[0]){ delete[] options.host_or_IP; }
+            if (vital_params_given[3]){ delete[] options.save_dir; }
             return -1;
         }
     }
-    if ( !num_of_threads_given ){
-        num_of_threads = 4;                // default value
-    }
-    if ( !vital_params_given[0] || !vital_params_given[1] || !vital_params_given[2] || !vital_params_given[3] || (num_of_threads_given && num_of_threads <= 0) ){
-        if (vital_params_given[0]){ delete[] host_or_IP; }
-        if (vital_params_given[3]){ delete[] save_dir; }
+    if ( !vital_params_given[0] || !vital_params_given[1] || !vital_params_given[2] || !vital_params_given[3] || options.num_of_threads <= 0 || options.max_fetches <= 0 || options.max_pages == 0 || options.host_connections < 0 || options.memory_limit_mb < 0 || options.near_duplicate_bits < -1 || options.num_of_writers < 0 ){
+        if (vital_params_given[0]){ delete[] options.host_or_IP; }
+        if (vital_params_given[3]){ delete[] options.save_dir; }
         return -2;
     }
     // check if save_dir exists
     struct stat info;
-    if( stat(save_dir, &info ) != 0 ) {
+    if( stat(options.save_dir, &info ) != 0 ) {
         cerr << "cannot access save directory" << endl;
-        delete[] save_dir;
-        delete[] host_or_IP;
+        delete[] options.save_dir;
+        delete[] options.host_or_IP;
         return -3;
     }else if( ! ( info.st_mode & S_IFDIR ) ){
         cerr << "given save directory is not a directory" << endl;
-        delete[] save_dir;
-        delete[] host_or_IP;
+        delete[] options.save_dir;
+        delete[] options.host_or_IP;
         return -4;
     }
     // Now read last command line argument as starting str
@@ -463,17 +641,182 @@ int parse_arguments(int argc, char *const *argv, char *&host_or_IP, uint16_t &se
     }
     if (argv[argc-1][0] == '/' && slash_counter != 2){  // root relative links must have 2 '/'s in total: /sitei/pagei_j.html
         cerr << "starting url is root relative but is incorect. Should be of type: /site/page.html" << endl;
-        delete[] save_dir;
-        delete[] host_or_IP;
+        delete[] options.save_dir;
+        delete[] options.host_or_IP;
         return -5;
     }
     else if (argv[argc-1][0] != '/' && slash_counter != 4 ) {                      // full http urls must have 4 '/'s in total: http://linux01.di.uoa.gr/sitei/pagei_j_html
         cerr << "starting url is a full http URL but is incorect. Should be of type: http://hostname[:port]/site/page.html" << endl;
-        delete[] save_dir;
-        delete[] host_or_IP;
+        delete[] options.save_dir;
+        delete[] options.host_or_IP;
         return -5;
     }
-    starting_url = new char[strlen(argv[argc - 1]) + 1];
-    strcpy(starting_url, argv[argc - 1]);
+    options.starting_url = new char[strlen(argv[argc - 1]) + 1];
+    strcpy(options.starting_url, argv[argc - 1]);
     return 0;
 }
+
+
+unsigned int frontier_size(int num_of_threads) {     // urls queued anywhere (read without locking, so only a snapshot)
+    unsigned int size = urlQueue->size();
+    for (int i = 0 ; i < num_of_threads ; i++){
+        size += localQueues[i].size();
+    }
+    if ( priorityQueue != NULL ) size += priorityQueue->size();
+    return size + crawlHosts->deferred();
+}
+
+
+void stats_report(char *response, size_t size, int num_of_threads) {     // STATS' answer
+    time_t now = time(NULL);
+    time_t Dt = now - time_crawler_started;
+    size_t len = 0;
+    CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
+    append_to_report(response, size, len, "Crawler has been up for %.2zu:%.2zu:%.2zu, downloaded %u pages, %u bytes\n", Dt / 3600, (Dt % 3600) / 60 , (Dt % 60), total_pages_downloaded, total_bytes_downloaded);
+    if (recrawl) append_to_report(response, size, len, "Re-crawl: %u pages changed, %u unchanged, %u new\n", pages_changed, pages_unchanged, pages_new);
+    CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
+    append_to_report(response, size, len, "Pages per second: %.1f (last 10s), %.1f (last 60s), %.1f (last 300s)\n",
+                     fetchMetrics->pages_per_second(10, now), fetchMetrics->pages_per_second(60, now), fetchMetrics->pages_per_second(300, now));
+    append_to_report(response, size, len, "Frontier: %u urls queued, %u urls seen, %u waiting for DNS\n", frontier_size(num_of_threads), urlHistory->get_size(), dnsCache->waiting());
+    append_to_report(response, size, len, "Timed out downloads: %llu urls queued again, %llu given up on (after %d retries)\n", fetchRetries->get_retried(), fetchRetries->get_given_up(), FETCH_MAX_RETRIES);
+    if ( memory_limit > 0 ) append_to_report(response, size, len, "Spilled to disk: %u queued urls, %llu seen urls\n", urlQueue->get_spilled(), urlHistory->get_spilled());
+    append_to_report(response, size, len, "URL ids: %u urls interned in %llu KB\n", urlIds->size(), urlIds->memory() / 1024);
+    if ( concurrency != NULL ){
+        unsigned long long mean_usec, baseline_usec, num_increases, num_decreases;
+        concurrency->get_latencies(mean_usec, baseline_usec);
+        concurrency->get_adjustments(num_increases, num_decreases);
+        append_to_report(response, size, len, "Concurrency: %u fetches in flight of %u allowed (between %u and %u), first byte in %llu us (baseline %llu us), raised %llu times, lowered %llu times\n",
+                         concurrency->get_in_flight(), concurrency->get_window(), concurrency->get_min(), concurrency->get_max(), mean_usec, baseline_usec, num_increases, num_decreases);
+    }
+    if ( pageWriters != NULL ){
+        unsigned long long queued_bytes;
+        unsigned int queued = pageWriters->queued(queued_bytes);
+        append_to_report(response, size, len, "Writer threads: %u, %u pages (%llu KB) waiting to be written, %llu written, crawler threads waited for them %llu times\n",
+                         pageWriters->size(), queued, queued_bytes / 1024, pageWriters->written(), pageWriters->waits());
+    }
+    if ( linkGraph != NULL ){
+        append_to_report(response, size, len, "Link graph: %u pages, %llu links found", linkGraph->size(), linkGraph->edges_found());
+        if ( linkGraph->is_built() ) append_to_report(response, size, len, " (%llu distinct), PageRank after %u iterations", linkGraph->get_num_links(), linkGraph->get_iterations());
+        append_to_report(response, size, len, "\n");
+    }
+    if ( nearDuplicates != NULL ) append_to_report(response, size, len, "Near-duplicates: %u pages not saved, %u fingerprints kept (within %d bits)\n", nearDuplicates->duplicates(), nearDuplicates->size(), nearDuplicates->get_max_distance());
+    if ( crawlHosts->size() > 1 ){
+        append_to_report(response, size, len, "Hosts: %u", crawlHosts->size());
+        if ( crawlHosts->get_max_connections() > 0 ) append_to_report(response, size, len, " (at most %u connections each)", crawlHosts->get_max_connections());
+        append_to_report(response, size, len, "\n");
+        for (unsigned int h = 0 ; h < crawlHosts->size() ; h++){
+            const crawl_host *host = crawlHosts->host(h);
+            append_to_report(response, size, len, "  %s:%hu  %u connections, %u urls waiting for one\n", host->name, host->port, host->connections, host->deferred->size());
+        }
+    }
+    append_to_report(response, size, len, "Fetch phases (microseconds):\n");
+    for (int p = 0 ; p < NUM_PHASES ; p++){
+        phase_summary summary;
+        fetchMetrics->summarize(p, summary);
+        append_to_report(response, size, len, "  %-10s %8llu times, mean %8llu, p50 < %8llu, p90 < %8llu, p99 < %8llu\n", Fetch_Metrics::phase_name(p),
+                         summary.samples, summary.mean_usec, summary.p50_usec, summary.p90_usec, summary.p99_usec);
+    }
+}
+
+
+void metrics_report(char *response, size_t size, int num_of_threads) {   // METRICS' answer: the same as STATS' (plus the histograms) as a single JSON object
+    time_t now = time(NULL);
+    size_t len = 0;
+    CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
+    append_to_report(response, size, len, "{\"uptime_seconds\": %ld, \"pages\": %u, \"bytes\": %u, ", (long) (now - time_crawler_started), total_pages_downloaded, total_bytes_downloaded);
+    CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
+    append_to_report(response, size, len, "\"frontier\": %u, \"seen\": %u, \"dns_waiting\": %u, ", frontier_size(num_of_threads), urlHistory->get_size(), dnsCache->waiting());
+    append_to_report(response, size, len, "\"url_ids\": %u, \"url_ids_bytes\": %llu, ", urlIds->size(), urlIds->memory());
+    append_to_report(response, size, len, "\"spilled_queued\": %u, \"spilled_seen\": %llu, ", urlQueue->get_spilled(), urlHistory->get_spilled());
+    if ( concurrency != NULL ){
+        unsigned long long mean_usec, baseline_usec, num_increases, num_decreases;
+        concurrency->get_latencies(mean_usec, baseline_usec);
+        concurrency->get_adjustments(num_increases, num_decreases);
+        append_to_report(response, size, len, "\"concurrency\": {\"in_flight\": %u, \"window\": %u, \"min\": %u, \"max\": %u, \"first_byte_us\": %llu, \"baseline_us\": %llu, \"raised\": %llu, \"lowered\": %llu}, ",
+                         concurrency->get_in_flight(), concurrency->get_window(), concurrency->get_min(), concurrency->get_max(), mean_usec, baseline_usec, num_increases, num_decreases);
+    }
+    unsigned long long write_queue_bytes = 0;
+    unsigned int write_queue = (pageWriters != NULL) ? pageWriters->queued(write_queue_bytes) : 0;
+    append_to_report(response, size, len, "\"write_queue\": %u, \"write_queue_bytes\": %llu, \"pages_written\": %llu, \"write_waits\": %llu, ", write_queue, write_queue_bytes,
+                     (pageWriters != NULL) ? pageWriters->written() : 0ULL, (pageWriters != NULL) ? pageWriters->waits() : 0ULL);
+    append_to_report(response, size, len, "\"graph_pages\": %u, \"graph_links_found\": %llu, \"graph_links\": %llu, \"pagerank_iterations\": %u, ",
+                     (linkGraph != NULL) ? linkGraph->size() : 0, (linkGraph != NULL) ? linkGraph->edges_found() : 0ULL,
+                     (linkGraph != NULL && linkGraph->is_built()) ? linkGraph->get_num_links() : 0ULL, (linkGraph != NULL && linkGraph->is_built()) ? linkGraph->get_iterations() : 0);
+    append_to_report(response, size, len, "\"near_duplicates\": %u, \"fingerprints\": %u, ", (nearDuplicates != NULL) ? nearDuplicates->duplicates() : 0, (nearDuplicates != NULL) ? nearDuplicates->size() : 0);
+    append_to_report(response, size, len, "\"pages_per_second\": {\"10s\": %.2f, \"60s\": %.2f, \"300s\": %.2f}, \"phases\": {",
+                     fetchMetrics->pages_per_second(10, now), fetchMetrics->pages_per_second(60, now), fetchMetrics->pages_per_second(300, now));
+    for (int p = 0 ; p < NUM_PHASES ; p++){
+        phase_summary summary;
+        fetchMetrics->summarize(p, summary);
+        // (bucket b counts the samples of [2^b - 1, 2^(b+1) - 1) microseconds, so trailing empty buckets are left out)
+        int num_buckets = METRICS_BUCKETS;
+        while ( num_buckets > 0 && summary.counts[num_buckets - 1] == 0 ) num_buckets--;
+        append_to_report(response, size, len, "%s\"%s\": {\"count\": %llu, \"mean_us\": %llu, \"p50_us\": %llu, \"p90_us\": %llu, \"p99_us\": %llu, \"buckets\": [", (p > 0) ? ", " : "",
+                         Fetch_Metrics::phase_name(p), summary.samples, summary.mean_usec, summary.p50_usec, summary.p90_usec, summary.p99_usec);
+        for (int b = 0 ; b < num_buckets ; b++){
+            append_to_report(response, size, len, (b > 0) ? ", %llu" : "%llu", summary.counts[b]);
+        }
+        append_to_report(response, size, len, "]}");
+    }
+    append_to_report(response, size, len, "}}\n");
+}
+
+
+char *graph_report(int num_of_threads, const char *starting_url) {     // (monitor thread, once linkGraph is built) GRAPH's answer: the connectivity of the link graph, computed by as many threads as crawled (the caller has to delete[] it)
+    size_t size = GRAPH_RESPONSE_SIZE, len = 0;
+    char *response = new char[size];
+    response[0] = '\0';
+    // the starting_url's page is saved as its root-relative part (it is on the crawled server, whose pages are saved directly in save_dir)
+    char *root_relative_starting_url;
+    findRootRelativeUrl(starting_url, root_relative_starting_url);
+    if ( root_relative_starting_url == NULL ) root_relative_starting_url = (char *) starting_url;
+    unsigned int start_page;
+    if ( !linkGraph->find_page(root_relative_starting_url, start_page) || start_page >= linkGraph->get_num_pages() ) start_page = UNREACHED;
+    unsigned long long started = monotonic_usec();
+    Graph_Analytics analytics(*linkGraph, (unsigned int) num_of_threads);
+    analytics.analyze(start_page);
+    unsigned int num_pages = analytics.get_num_pages();
+    append_to_report(response, size, len, "Link graph: %u pages (%u saved, %u linked to but not saved), %llu links, analyzed by %d threads in %llu ms\n", num_pages, analytics.get_num_saved(),
+                     num_pages - analytics.get_num_saved(), linkGraph->get_num_links(), num_of_threads, (monotonic_usec() - started) / 1000);
+    degrees_report(response, size, len, "Out-degree", analytics.get_out_degrees());
+    degrees_report(response, size, len, "In-degree", analytics.get_in_degrees());
+    append_to_report(response, size, len, "Orphan pages (no page links to them): %u\n", analytics.get_num_orphans());
+    for (unsigned int i = 0 ; i < analytics.get_num_orphans() && i < MAX_ORPHANS_LISTED ; i++){
+        append_to_report(response, size, len, "  %s\n", linkGraph->save_url_of(analytics.get_orphan(i)));
+    }
+    if ( analytics.get_num_orphans() > MAX_ORPHANS_LISTED ) append_to_report(response, size, len, "  ...\n");
+    append_to_report(response, size, len, "Strongly connected components: %u, the largest of %u pages, %u of a single page\n",
+                     analytics.get_num_components(), analytics.get_largest_component(), analytics.get_num_single());
+    if ( start_page == UNREACHED ){
+        append_to_report(response, size, len, "Depth from %s: it is not in the link graph\n", root_relative_starting_url);
+        return response;
+    }
+    append_to_report(response, size, len, "Depth from %s: %u pages reached, %u not reached\n", root_relative_starting_url, analytics.get_num_reached(), num_pages - analytics.get_num_reached());
+    for (unsigned int d = 0 ; d < analytics.get_num_levels() ; d++){
+        append_to_report(response, size, len, "  %-12u %10u pages\n", d, analytics.get_level_size(d));
+    }
+    return response;
+}
+
+
+void degrees_report(char *response, size_t size, size_t &len, const char *title, const degree_summary &degrees) {     // one line per power of 2 that some page's degree falls in
+    append_to_report(response, size, len, "%s (max %u):\n", title, degrees.max);
+    for (unsigned int b = 0 ; b < DEGREE_BUCKETS ; b++){
+        if ( degrees.pages[b] == 0 ) continue;
+        char range[32];
+        if ( b < 2 ) snprintf(range, sizeof(range), "%u", b);
+        else snprintf(range, sizeof(range), "%llu-%llu", 1ULL << (b - 1), (1ULL << b) - 1);
+        append_to_report(response, size, len, "  %-12s %10llu pages\n", range, degrees.pages[b]);
+    }
+}
+
+
+void append_to_report(char *response, size_t size, size_t &len, const char *format, ...) {     // (whatever does not fit in response[size] is cut off)
+    if ( len >= size ) return;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(response + len, size - len, format, args);
+    va_end(args);
+    if ( n > 0 ) len += (size_t) n;
+    if ( len >= size ) len = size - 1;
+}
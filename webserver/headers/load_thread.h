@@ -0,0 +1,46 @@
+#ifndef LOAD_THREAD_H
+#define LOAD_THREAD_H
+
+#include <netinet/in.h>
+
+
+struct load_config{                      // common (read-only) configuration shared by all load generating threads
+    struct sockaddr_in server_sa;
+    char **pages;                        // root-relative urls of all the pages found in root_dir ("/sitei/pagei_j.html")
+    int num_of_pages;
+    double *page_cdf;                    // cumulative distribution over pages (uniform or zipfian), used for sampling which page to request next
+    bool keep_alive;                     // if true then connections are reused for as long as the server allows it
+    double rate;                         // requests per second for THIS thread (<= 0 means closed loop without pacing)
+    long long deadline_ns;               // CLOCK_MONOTONIC time after which no more requests are sent
+    long long timeout_ns;                // a request that has not been fully answered after this much time counts as a timeout
+};
+
+
+struct load_stats{                       // per thread results, merged by main after all threads have been joined
+    long long requests_sent, responses_ok;
+    long long connect_errors, write_errors, read_errors, parse_errors, timeouts, http_4xx, http_5xx, http_other;
+    long long connections_opened;
+    unsigned long long bytes_received;   // content bytes only (not headers)
+    unsigned int *latencies_us;          // latency of every successful request in microseconds
+    long long num_latencies, latencies_capacity;
+    load_stats();
+    ~load_stats();
+    void add_latency(unsigned int us);
+};
+
+
+struct load_args{
+    const struct load_config *config;
+    int num_of_connections;              // concurrent connections driven by this thread
+    unsigned int seed;                   // seed for this thread's page sampling
+    long long max_requests;              // requests for this thread (< 0 means run until the deadline)
+    struct load_stats stats;
+};
+
+
+void *generate_load(void *arguements);
+
+long long monotonic_ns();
+
+
+#endif //LOAD_THREAD_H
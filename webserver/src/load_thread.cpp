@@ -0,0 +1,334 @@
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "../headers/load_thread.h"
+
+
+using namespace std;
+
+
+#define MAX_RESPONSE_HEADER_SIZE 2048      // the server's response headers are way smaller than this. Bigger headers are considered a parse error
+#define BODY_READ_BUF_SIZE 16384           // content is read (and discarded) in chunks of this size
+#define MAX_EPOLL_EVENTS 64
+#define MAX_POLL_WAIT_MS 100               // upper bound for epoll_wait's timeout so that deadlines and time-outs are checked often enough
+
+/* useful macros */
+#define CHECK_PERROR(call, callname, handle_code) { if ( ( call ) < 0 ) { perror(callname); handle_code } }
+
+
+/* Connection states */
+enum conn_state { IDLE, CONNECTING, SENDING, RECEIVING };
+
+struct connection{
+    int fd;                                // -1 if there is no open socket for this connection
+    conn_state state;
+    bool reused;                           // true if the current request is sent on a kept-alive socket (if the server closed it meanwhile this is not counted as an error)
+    char request[1024];
+    size_t request_len, request_sent;
+    char header[MAX_RESPONSE_HEADER_SIZE];
+    size_t header_len;
+    bool header_done, server_keeps_alive;
+    long content_length, body_read;
+    int status;
+    long long start_ns, timeout_at_ns;
+    connection() : fd(-1), state(IDLE), reused(false), request_len(0), request_sent(0), header_len(0), header_done(false),
+                   server_keeps_alive(false), content_length(-1), body_read(0), status(0), start_ns(0), timeout_at_ns(0) {}
+};
+
+
+/* Local functions */
+static int pick_page(const struct load_config *config, unsigned long long &rng);
+static void start_request(int epfd, connection &conn, int conn_index, const struct load_config *config, unsigned long long &rng, long long intended_ns, struct load_stats &stats);
+static bool open_connection(int epfd, connection &conn, int conn_index, const struct load_config *config, struct load_stats &stats);
+static void close_connection(int epfd, connection &conn);
+static void continue_sending(int epfd, connection &conn, struct load_stats &stats);
+static void continue_receiving(int epfd, connection &conn, const struct load_config *config, struct load_stats &stats, char *scratch);
+static bool parse_response_header(connection &conn);
+
+
+long long monotonic_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+load_stats::load_stats() : requests_sent(0), responses_ok(0), connect_errors(0), write_errors(0), read_errors(0), parse_errors(0), timeouts(0),
+                           http_4xx(0), http_5xx(0), http_other(0), connections_opened(0), bytes_received(0),
+                           latencies_us(NULL), num_latencies(0), latencies_capacity(0) {}
+
+load_stats::~load_stats() {
+    delete[] latencies_us;
+}
+
+void load_stats::add_latency(unsigned int us) {     // amortized O(1)
+    if ( num_latencies == latencies_capacity ){
+        long long new_capacity = (latencies_capacity == 0) ? 4096 : 2 * latencies_capacity;
+        unsigned int *temp = new unsigned int[new_capacity];
+        if ( latencies_us != NULL ) memcpy(temp, latencies_us, num_latencies * sizeof(unsigned int));
+        delete[] latencies_us;
+        latencies_us = temp;
+        latencies_capacity = new_capacity;
+    }
+    latencies_us[num_latencies++] = us;
+}
+
+
+void *generate_load(void *arguements){
+    struct load_args *args = (struct load_args *) arguements;
+    const struct load_config *config = args->config;
+    struct load_stats &stats = args->stats;
+    unsigned long long rng = args->seed * 2654435761ULL + 1;     // xorshift state (must not be 0)
+
+    int epfd;
+    CHECK_PERROR( (epfd = epoll_create1(0)), "epoll_create1", return NULL; )
+    connection *conns = new connection[args->num_of_connections];
+    char *scratch = new char[BODY_READ_BUF_SIZE];
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    // when paced, requests are issued on a fixed schedule and latency is measured from the time each request SHOULD have been sent
+    // (otherwise a slow server would also slow down the rate at which we measure it and hide its own latency)
+    double interval_ns = (config->rate > 0) ? 1e9 / config->rate : 0;
+    long long next_send_ns = monotonic_ns();
+
+    for (;;) {
+        long long now = monotonic_ns();
+        bool may_send = now < config->deadline_ns && (args->max_requests < 0 || stats.requests_sent < args->max_requests);
+
+        // 1. put every idle connection to work (as long as pacing allows it)
+        for (int i = 0 ; i < args->num_of_connections && may_send ; i++){
+            if ( conns[i].state != IDLE ) continue;
+            if ( interval_ns > 0 && next_send_ns > now ) break;
+            long long intended = (interval_ns > 0) ? next_send_ns : now;
+            start_request(epfd, conns[i], i, config, rng, intended, stats);
+            if ( interval_ns > 0 ) next_send_ns += (long long) interval_ns;
+            may_send = args->max_requests < 0 || stats.requests_sent < args->max_requests;
+        }
+        int in_flight = 0;
+        for (int i = 0 ; i < args->num_of_connections ; i++){
+            if ( conns[i].state != IDLE ) in_flight++;
+        }
+        if ( !may_send && in_flight == 0 ) break;         // nothing more to send and every answer has been received
+
+        // 2. wait for socket events but not for longer than the next pacing slot or MAX_POLL_WAIT_MS
+        int wait_ms = MAX_POLL_WAIT_MS;
+        if ( interval_ns > 0 && may_send ){
+            long long until_next = (next_send_ns - now) / 1000000;
+            if ( until_next < wait_ms ) wait_ms = (until_next < 0) ? 0 : (int) until_next;
+        }
+        int n;
+        CHECK_PERROR( (n = epoll_wait(epfd, events, MAX_EPOLL_EVENTS, wait_ms)), "epoll_wait", if (errno == EINTR) continue; else break; )
+
+        // 3. advance the state machine of every connection that got an event
+        for (int e = 0 ; e < n ; e++){
+            connection &conn = conns[events[e].data.u32];
+            if ( conn.state == IDLE ){                           // an idle kept-alive socket got an event: check if the server closed it
+                char byte;
+                if ( conn.fd >= 0 && (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) &&
+                     !(recv(conn.fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ){
+                    close_connection(epfd, conn);                // EOF, error or unexpected data: it cannot be reused
+                }
+                continue;
+            }
+            if ( conn.state == CONNECTING ){
+                int err = 0;
+                socklen_t len = sizeof(err);
+                if ( getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0 ){
+                    stats.connect_errors++;
+                    close_connection(epfd, conn);
+                    continue;
+                }
+                conn.state = SENDING;
+            }
+            if ( conn.state == SENDING ) continue_sending(epfd, conn, stats);
+            if ( conn.state == RECEIVING ) continue_receiving(epfd, conn, config, stats, scratch);
+        }
+
+        // 4. time out any requests that took too long
+        now = monotonic_ns();
+        for (int i = 0 ; i < args->num_of_connections ; i++){
+            if ( conns[i].state != IDLE && now > conns[i].timeout_at_ns ){
+                stats.timeouts++;
+                close_connection(epfd, conns[i]);
+            }
+        }
+    }
+
+    for (int i = 0 ; i < args->num_of_connections ; i++){
+        if ( conns[i].fd >= 0 ) close_connection(epfd, conns[i]);
+    }
+    delete[] scratch;
+    delete[] conns;
+    CHECK_PERROR( close(epfd), "close epoll fd", )
+    return NULL;
+}
+
+
+
+/* Local Functions Implementation */
+static int pick_page(const struct load_config *config, unsigned long long &rng){     // O(logn) - binary search on the pages' CDF
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    double u = (rng >> 11) * (1.0 / 9007199254740992.0);     // uniform in [0, 1)
+    int low = 0, high = config->num_of_pages - 1;
+    while ( low < high ){
+        int mid = (low + high) / 2;
+        if ( config->page_cdf[mid] > u ) high = mid;
+        else low = mid + 1;
+    }
+    return low;
+}
+
+
+static void start_request(int epfd, connection &conn, int conn_index, const struct load_config *config, unsigned long long &rng, long long intended_ns, struct load_stats &stats){
+    const char *page = config->pages[pick_page(config, rng)];
+    conn.request_len = (size_t) snprintf(conn.request, sizeof(conn.request), "GET %s HTTP/1.1\r\nHost: loadgen\r\nConnection: %s\r\n\r\n", page, config->keep_alive ? "keep-alive" : "close");
+    conn.request_sent = 0;
+    conn.header_len = 0;
+    conn.header_done = false;
+    conn.server_keeps_alive = false;
+    conn.content_length = -1;
+    conn.body_read = 0;
+    conn.status = 0;
+    conn.start_ns = intended_ns;
+    conn.timeout_at_ns = monotonic_ns() + config->timeout_ns;
+    stats.requests_sent++;
+    conn.reused = (conn.fd >= 0);
+    if ( !conn.reused ){
+        if ( !open_connection(epfd, conn, conn_index, config, stats) ) return;
+        if ( conn.state == CONNECTING ) return;             // will continue when the socket becomes writable
+    }
+    conn.state = SENDING;
+    continue_sending(epfd, conn, stats);
+}
+
+
+static bool open_connection(int epfd, connection &conn, int conn_index, const struct load_config *config, struct load_stats &stats){
+    CHECK_PERROR( (conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)), "socket", stats.connect_errors++; conn.fd = -1; conn.state = IDLE; return false; )
+    stats.connections_opened++;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;    // registered once (edge triggered): the state of the connection decides which events matter
+    ev.data.u32 = (unsigned int) conn_index;
+    CHECK_PERROR( epoll_ctl(epfd, EPOLL_CTL_ADD, conn.fd, &ev), "epoll_ctl add", close(conn.fd); conn.fd = -1; conn.state = IDLE; stats.connect_errors++; return false; )
+    if ( connect(conn.fd, (const struct sockaddr *) &config->server_sa, sizeof(config->server_sa)) < 0 ){
+        if ( errno != EINPROGRESS ){
+            stats.connect_errors++;
+            close_connection(epfd, conn);
+            return false;
+        }
+        conn.state = CONNECTING;
+    } else conn.state = SENDING;
+    return true;
+}
+
+
+static void close_connection(int epfd, connection &conn){
+    if ( conn.fd >= 0 ){
+        epoll_ctl(epfd, EPOLL_CTL_DEL, conn.fd, NULL);
+        CHECK_PERROR( close(conn.fd), "close connection", )
+    }
+    conn.fd = -1;
+    conn.state = IDLE;
+}
+
+
+static void continue_sending(int epfd, connection &conn, struct load_stats &stats){
+    while ( conn.request_sent < conn.request_len ){
+        ssize_t nbytes = write(conn.fd, conn.request + conn.request_sent, conn.request_len - conn.request_sent);
+        if ( nbytes < 0 ){
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) return;       // EPOLLOUT will bring us back here
+            if ( conn.reused ) stats.requests_sent--;                    // kept-alive socket was closed by the server meanwhile: retry on a new one
+            else stats.write_errors++;
+            close_connection(epfd, conn);
+            return;
+        }
+        conn.request_sent += nbytes;
+    }
+    conn.state = RECEIVING;                                              // whole request sent: from now on we only care about the answer
+}
+
+
+static void continue_receiving(int epfd, connection &conn, const struct load_config *config, struct load_stats &stats, char *scratch){
+    for (;;) {                                                           // edge triggered: read until EAGAIN
+        ssize_t nbytes;
+        if ( !conn.header_done ){
+            nbytes = read(conn.fd, conn.header + conn.header_len, MAX_RESPONSE_HEADER_SIZE - 1 - conn.header_len);
+        } else {
+            nbytes = read(conn.fd, scratch, BODY_READ_BUF_SIZE);
+        }
+        if ( nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) return;     // wait for more data
+        if ( nbytes == 0 && conn.header_done && conn.content_length < 0 ) break;    // no Content-Length: content ends with the connection
+        if ( nbytes <= 0 ){
+            if ( conn.reused && conn.header_len == 0 ) stats.requests_sent--;       // kept-alive socket was closed by the server before answering: retry on a new one
+            else stats.read_errors++;
+            close_connection(epfd, conn);
+            return;
+        }
+        if ( !conn.header_done ){
+            conn.header_len += nbytes;
+            conn.header[conn.header_len] = '\0';
+            if ( !parse_response_header(conn) ){
+                if ( conn.header_len >= MAX_RESPONSE_HEADER_SIZE - 1 ){
+                    stats.parse_errors++;
+                    close_connection(epfd, conn);
+                    return;
+                }
+                continue;                                                // header not complete yet
+            }
+        } else {
+            conn.body_read += nbytes;
+        }
+        if ( conn.header_done && conn.content_length >= 0 && conn.body_read >= conn.content_length ) break;
+    }
+
+    // a whole response has been received
+    if ( conn.status == 200 ){
+        stats.responses_ok++;
+        stats.bytes_received += conn.body_read;
+        long long latency_us = (monotonic_ns() - conn.start_ns) / 1000;
+        stats.add_latency((unsigned int) ((latency_us > 0xFFFFFFFFLL) ? 0xFFFFFFFFLL : latency_us));
+    } else if ( conn.status >= 400 && conn.status < 500 ) stats.http_4xx++;
+    else if ( conn.status >= 500 && conn.status < 600 ) stats.http_5xx++;
+    else stats.http_other++;
+
+    if ( config->keep_alive && conn.server_keeps_alive && conn.content_length >= 0 && conn.body_read == conn.content_length ){
+        conn.state = IDLE;                                               // keep the socket open for the next request
+    } else {
+        close_connection(epfd, conn);
+    }
+}
+
+
+static bool parse_response_header(connection &conn){     // returns true if the whole header has been read (and parsed)
+    char *end = strstr(conn.header, "\r\n\r\n");
+    size_t end_len = 4;
+    char *end_lf = strstr(conn.header, "\n\n");          // our server ends its lines with a plain '\n'
+    if ( end == NULL || (end_lf != NULL && end_lf < end) ){ end = end_lf; end_len = 2; }
+    if ( end == NULL ) return false;
+    size_t header_size = (end - conn.header) + end_len;
+
+    // status line: "HTTP/1.1 <status> <reason>"
+    if ( sscanf(conn.header, "HTTP/%*s %d", &conn.status) != 1 ) conn.status = 0;
+    // then the only fields we care about
+    for (char *line = strchr(conn.header, '\n') ; line != NULL && line < end ; line = strchr(line + 1, '\n')){
+        const char *field = line + 1;
+        if ( strncasecmp(field, "Content-Length:", strlen("Content-Length:")) == 0 ){
+            conn.content_length = atol(field + strlen("Content-Length:"));
+        } else if ( strncasecmp(field, "Connection:", strlen("Connection:")) == 0 ){
+            const char *value = field + strlen("Connection:");
+            while ( *value == ' ' || *value == '\t' ) value++;
+            conn.server_keeps_alive = (strncasecmp(value, "keep-alive", strlen("keep-alive")) == 0);
+        }
+    }
+    conn.header_done = true;
+    conn.body_read = (long) (conn.header_len - header_size);     // content read along with the header
+    return true;
+}
@@ -0,0 +1,309 @@
+#include <iostream>
+#include <cstdio>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <csignal>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "../headers/load_thread.h"
+
+
+using namespace std;
+
+
+/* useful macros */
+#define CHECK(call, callname, handle_code) { if ( ( call ) < 0 ) { cerr << (callname) << " failed" << endl; handle_code } }
+
+
+/* Local Functions */
+int parse_arguements(int argc, char *const *argv, char *&host_or_IP, uint16_t &port, char *&root_dir, int &num_of_threads, int &num_of_connections,
+                     double &seconds, long long &max_requests, bool &keep_alive, double &rate, bool &zipf, double &zipf_exponent, double &timeout, char *&output_file);
+int find_pages(const char *root_dir, char **&pages);
+double *create_page_cdf(int num_of_pages, bool zipf, double zipf_exponent, unsigned int seed);
+int compare_uint(const void *a, const void *b);
+void print_json_string(FILE *out, const char *str);
+void print_report(FILE *out, struct load_args *args, int num_of_threads, double elapsed_s, const char *host_or_IP, uint16_t port, int num_of_pages,
+                  int num_of_connections, bool keep_alive, double rate, bool zipf, double zipf_exponent);
+
+
+/* usage: ./loadgen -h <host_or_IP> -p <port> -d <root_dir> [-t threads] [-c connections] [-s seconds] [-n requests] [-k] [-r rate] [-z exponent] [-T timeout] [-o json_file] */
+int main(int argc, char *argv[]) {
+    char *host_or_IP = NULL, *root_dir = NULL, *output_file = NULL;
+    uint16_t port = 0;
+    int num_of_threads, num_of_connections;
+    double seconds, rate, zipf_exponent, timeout;
+    long long max_requests;
+    bool keep_alive, zipf;
+    if ( parse_arguements(argc, argv, host_or_IP, port, root_dir, num_of_threads, num_of_connections, seconds, max_requests, keep_alive, rate, zipf, zipf_exponent, timeout, output_file) < 0 ){
+        cerr << "Invalid load generator parameters" << endl
+             << "usage: ./loadgen -h <host_or_IP> -p <port> -d <root_dir> [-t threads] [-c connections] [-s seconds] [-n requests] [-k] [-r rate] [-z exponent] [-T timeout] [-o json_file]" << endl;
+        return -1;
+    }
+
+    // a server closing a connection we are writing to should not kill us
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &act, NULL);
+
+    struct load_config config;
+    memset(&config, 0, sizeof(config));
+    config.server_sa.sin_family = AF_INET;
+    config.server_sa.sin_port = htons(port);
+    if ( inet_aton(host_or_IP, &config.server_sa.sin_addr) != 1 ){      // if host_or_IP is not an IP then it must be a host
+        struct hostent *lookup = gethostbyname(host_or_IP);
+        if ( lookup == NULL ){
+            cerr << "Could not find host (DNS failed)" << endl;
+            delete[] host_or_IP; delete[] root_dir; delete[] output_file; return -2;
+        }
+        config.server_sa.sin_addr = *((struct in_addr *) lookup->h_addr);    // arbitrarily pick the first address
+    }
+
+    // the page mix is made of every page under root_dir (as the web server would serve them)
+    config.num_of_pages = find_pages(root_dir, config.pages);
+    if ( config.num_of_pages <= 0 ){
+        cerr << "Could not find any pages under root directory " << root_dir << endl;
+        delete[] host_or_IP; delete[] root_dir; delete[] output_file; return -3;
+    }
+    config.page_cdf = create_page_cdf(config.num_of_pages, zipf, zipf_exponent, 42);
+    config.keep_alive = keep_alive;
+    config.rate = (rate > 0) ? rate / num_of_threads : 0;
+    config.timeout_ns = (long long) (timeout * 1e9);
+    long long start_ns = monotonic_ns();
+    config.deadline_ns = (max_requests > 0 && seconds <= 0) ? start_ns + 365LL * 24 * 3600 * 1000000000LL : start_ns + (long long) (seconds * 1e9);
+
+    cerr << "Load generator: " << num_of_threads << " threads, " << num_of_connections << " connections, " << config.num_of_pages << " pages ("
+         << (zipf ? "zipfian" : "uniform") << " mix)" << (keep_alive ? ", keep-alive" : "") << endl;
+
+    // spread the connections over the threads
+    struct load_args *args = new struct load_args[num_of_threads];
+    pthread_t *threadpool = new pthread_t[num_of_threads];
+    for (int i = 0 ; i < num_of_threads ; i++){
+        args[i].config = &config;
+        args[i].num_of_connections = num_of_connections / num_of_threads + ((i < num_of_connections % num_of_threads) ? 1 : 0);
+        args[i].seed = (unsigned int) (i + 1);
+        args[i].max_requests = (max_requests > 0) ? max_requests / num_of_threads + ((i < max_requests % num_of_threads) ? 1 : 0) : -1;     // (exactly max_requests in total)
+        CHECK( pthread_create(&threadpool[i], NULL, generate_load, (void *) &args[i]) , "pthread_create" , threadpool[i] = 0; )   // (!) threadpool[i] = 0 signifies that this thread was not created
+    }
+    for (int i = 0 ; i < num_of_threads ; i++){
+        if ( threadpool[i] == 0 ) continue;
+        CHECK( pthread_join(threadpool[i], NULL) , "pthread_join" , )
+    }
+    double elapsed_s = (monotonic_ns() - start_ns) / 1e9;
+
+    // report as JSON (on stdout, unless an output file was given)
+    FILE *out = stdout;
+    if ( output_file != NULL && (out = fopen(output_file, "w")) == NULL ){
+        perror("fopen output file");
+        out = stdout;
+    }
+    print_report(out, args, num_of_threads, elapsed_s, host_or_IP, port, config.num_of_pages, num_of_connections, keep_alive, rate, zipf, zipf_exponent);
+    if ( out != stdout ) fclose(out);
+
+    // clean up
+    for (int i = 0 ; i < config.num_of_pages ; i++){
+        delete[] config.pages[i];
+    }
+    delete[] config.pages;
+    delete[] config.page_cdf;
+    delete[] args;
+    delete[] threadpool;
+    delete[] host_or_IP;
+    delete[] root_dir;
+    delete[] output_file;
+    return 0;
+}
+
+
+/* Local Functions Implementation */
+int parse_arguements(int argc, char *const *argv, char *&host_or_IP, uint16_t &port, char *&root_dir, int &num_of_threads, int &num_of_connections,
+                     double &seconds, long long &max_requests, bool &keep_alive, double &rate, bool &zipf, double &zipf_exponent, double &timeout, char *&output_file) {
+    bool vital_params_given[3] = {false, false, false}, seconds_given = false;
+    // default values
+    num_of_threads = 4;
+    num_of_connections = 16;
+    seconds = 10;
+    max_requests = 0;
+    keep_alive = false;
+    rate = 0;
+    zipf = false;
+    zipf_exponent = 1.0;
+    timeout = 5;
+    for (int i = 1 ; i < argc ; i += 2){
+        if ( strcmp(argv[i], "-k") == 0 ){          // the only flag without a value
+            keep_alive = true;
+            i--;
+        }
+        else if ( i + 1 >= argc ) return -1;
+        else if ( strcmp(argv[i], "-h") == 0 ){
+            host_or_IP = new char[strlen(argv[i+1]) + 1];
+            strcpy(host_or_IP, argv[i+1]);
+            vital_params_given[0] = true;
+        }
+        else if ( strcmp(argv[i], "-p") == 0 ){
+            port = (uint16_t) atoi(argv[i+1]);
+            vital_params_given[1] = true;
+        }
+        else if ( strcmp(argv[i], "-d") == 0 ){
+            size_t len = strlen(argv[i+1]);
+            root_dir = new char[len + 1];
+            strcpy(root_dir, argv[i+1]);
+            if ( len > 1 && root_dir[len - 1] == '/' ) root_dir[len - 1] = '\0';    // remove a '/' at the end
+            vital_params_given[2] = true;
+        }
+        else if ( strcmp(argv[i], "-t") == 0 ) num_of_threads = atoi(argv[i+1]);
+        else if ( strcmp(argv[i], "-c") == 0 ) num_of_connections = atoi(argv[i+1]);
+        else if ( strcmp(argv[i], "-s") == 0 ){ seconds = atof(argv[i+1]); seconds_given = true; }
+        else if ( strcmp(argv[i], "-n") == 0 ) max_requests = atoll(argv[i+1]);
+        else if ( strcmp(argv[i], "-r") == 0 ) rate = atof(argv[i+1]);
+        else if ( strcmp(argv[i], "-z") == 0 ){ zipf = true; zipf_exponent = atof(argv[i+1]); }
+        else if ( strcmp(argv[i], "-T") == 0 ) timeout = atof(argv[i+1]);
+        else if ( strcmp(argv[i], "-o") == 0 ){
+            output_file = new char[strlen(argv[i+1]) + 1];
+            strcpy(output_file, argv[i+1]);
+        }
+        else return -1;
+    }
+    if ( max_requests > 0 && !seconds_given ) seconds = 0;      // -n alone means "run until n requests have been answered"
+    if ( !vital_params_given[0] || !vital_params_given[1] || !vital_params_given[2] || num_of_threads <= 0 || num_of_connections < num_of_threads || timeout <= 0 || (seconds <= 0 && max_requests <= 0) ){
+        return -2;
+    }
+    return 0;
+}
+
+
+int find_pages(const char *root_dir, char **&pages) {      // finds every "/site/page" under root_dir - returns the number of pages found (or < 0 on error)
+    DIR *root = opendir(root_dir);
+    if ( root == NULL ){ perror("opendir root directory"); return -1; }
+    int capacity = 1024, count = 0;
+    pages = new char*[capacity];
+    struct dirent *site;
+    while ( (site = readdir(root)) != NULL ){
+        if ( site->d_name[0] == '.' ) continue;
+        char site_path[1024];
+        snprintf(site_path, sizeof(site_path), "%s/%s", root_dir, site->d_name);
+        DIR *site_dir = opendir(site_path);
+        if ( site_dir == NULL ) continue;                   // not a directory
+        struct dirent *page;
+        while ( (page = readdir(site_dir)) != NULL ){
+            if ( page->d_name[0] == '.' ) continue;
+            if ( count == capacity ){
+                char **temp = new char*[2 * capacity];
+                memcpy(temp, pages, count * sizeof(char *));
+                delete[] pages;
+                pages = temp;
+                capacity *= 2;
+            }
+            pages[count] = new char[strlen(site->d_name) + strlen(page->d_name) + 3];
+            sprintf(pages[count], "/%s/%s", site->d_name, page->d_name);
+            count++;
+        }
+        closedir(site_dir);
+    }
+    closedir(root);
+    return count;
+}
+
+
+double *create_page_cdf(int num_of_pages, bool zipf, double zipf_exponent, unsigned int seed) {
+    // with a zipfian mix page ranks are assigned in a (seeded) random order so that the popular pages are not all on the same site
+    int *rank = new int[num_of_pages];
+    for (int i = 0 ; i < num_of_pages ; i++) rank[i] = i;
+    for (int i = num_of_pages - 1 ; i > 0 ; i--){
+        int j = (int) (rand_r(&seed) % (i + 1));
+        int temp = rank[i]; rank[i] = rank[j]; rank[j] = temp;
+    }
+    double *cdf = new double[num_of_pages];
+    double sum = 0;
+    for (int i = 0 ; i < num_of_pages ; i++){
+        cdf[i] = zipf ? 1.0 / pow((double) (rank[i] + 1), zipf_exponent) : 1.0;
+        sum += cdf[i];
+    }
+    double acc = 0;
+    for (int i = 0 ; i < num_of_pages ; i++){
+        acc += cdf[i] / sum;
+        cdf[i] = acc;
+    }
+    cdf[num_of_pages - 1] = 1.0;                            // guard against rounding errors
+    delete[] rank;
+    return cdf;
+}
+
+
+int compare_uint(const void *a, const void *b) {
+    unsigned int x = *((const unsigned int *) a), y = *((const unsigned int *) b);
+    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+
+void print_json_string(FILE *out, const char *str) {     // the characters of str as they go between the quotes of a JSON string
+    for ( ; *str != '\0' ; str++){
+        if ( *str == '"' || *str == '\\' ) fprintf(out, "\\%c", *str);
+        else if ( (unsigned char) *str < 0x20 ) fprintf(out, "\\u%04x", (unsigned int) (unsigned char) *str);
+        else fputc(*str, out);
+    }
+}
+
+void print_report(FILE *out, struct load_args *args, int num_of_threads, double elapsed_s, const char *host_or_IP, uint16_t port, int num_of_pages,
+                  int num_of_connections, bool keep_alive, double rate, bool zipf, double zipf_exponent) {
+    // merge all threads' stats
+    struct load_stats total;
+    long long num_latencies = 0;
+    for (int i = 0 ; i < num_of_threads ; i++){
+        struct load_stats &s = args[i].stats;
+        total.requests_sent += s.requests_sent;
+        total.responses_ok += s.responses_ok;
+        total.connect_errors += s.connect_errors;
+        total.write_errors += s.write_errors;
+        total.read_errors += s.read_errors;
+        total.parse_errors += s.parse_errors;
+        total.timeouts += s.timeouts;
+        total.http_4xx += s.http_4xx;
+        total.http_5xx += s.http_5xx;
+        total.http_other += s.http_other;
+        total.connections_opened += s.connections_opened;
+        total.bytes_received += s.bytes_received;
+        num_latencies += s.num_latencies;
+    }
+    unsigned int *latencies = new unsigned int[num_latencies + 1];
+    long long k = 0;
+    double latency_sum = 0;
+    for (int i = 0 ; i < num_of_threads ; i++){
+        for (long long j = 0 ; j < args[i].stats.num_latencies ; j++){
+            latencies[k++] = args[i].stats.latencies_us[j];
+            latency_sum += args[i].stats.latencies_us[j];
+        }
+    }
+    qsort(latencies, (size_t) num_latencies, sizeof(unsigned int), compare_uint);
+    #define PERCENTILE(p) ( (num_latencies == 0) ? 0 : latencies[(long long) ((p) * (num_latencies - 1))] )
+    long long errors = total.connect_errors + total.write_errors + total.read_errors + total.parse_errors + total.timeouts + total.http_4xx + total.http_5xx + total.http_other;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"config\": {\"server\": \"");
+    print_json_string(out, host_or_IP);
+    fprintf(out, ":%u\", \"pages\": %d, \"threads\": %d, \"connections\": %d, \"keep_alive\": %s, \"rate\": %.1f, \"mix\": \"%s\", \"zipf_exponent\": %.3f},\n",
+            port, num_of_pages, num_of_threads, num_of_connections, keep_alive ? "true" : "false", rate, zipf ? "zipf" : "uniform", zipf ? zipf_exponent : 0.0);
+    fprintf(out, "  \"duration_s\": %.3f,\n", elapsed_s);
+    fprintf(out, "  \"requests\": %lld,\n", total.requests_sent);
+    fprintf(out, "  \"responses_ok\": %lld,\n", total.responses_ok);
+    fprintf(out, "  \"connections_opened\": %lld,\n", total.connections_opened);
+    fprintf(out, "  \"bytes\": %llu,\n", total.bytes_received);
+    fprintf(out, "  \"throughput_rps\": %.1f,\n", (elapsed_s > 0) ? total.responses_ok / elapsed_s : 0.0);
+    fprintf(out, "  \"throughput_MBps\": %.3f,\n", (elapsed_s > 0) ? total.bytes_received / elapsed_s / (1024.0 * 1024.0) : 0.0);
+    fprintf(out, "  \"latency_us\": {\"min\": %u, \"mean\": %.1f, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u},\n",
+            (num_latencies == 0) ? 0 : latencies[0], (num_latencies == 0) ? 0.0 : latency_sum / num_latencies,
+            PERCENTILE(0.50), PERCENTILE(0.90), PERCENTILE(0.99), PERCENTILE(0.999), (num_latencies == 0) ? 0 : latencies[num_latencies - 1]);
+    fprintf(out, "  \"errors\": {\"total\": %lld, \"connect\": %lld, \"write\": %lld, \"read\": %lld, \"parse\": %lld, \"timeout\": %lld, \"http_4xx\": %lld, \"http_5xx\": %lld, \"http_other\": %lld}\n",
+            errors, total.connect_errors, total.write_errors, total.read_errors, total.parse_errors, total.timeouts, total.http_4xx, total.http_5xx, total.http_other);
+    fprintf(out, "}\n");
+    #undef PERCENTILE
+    delete[] latencies;
+}
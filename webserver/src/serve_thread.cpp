@@ -4,7 +4,13 @@
 #include <unistd.h>
 #include <cerrno>
 #include <cstring>
+#include <strings.h>
+#include <poll.h>
+#include <ctime>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include "../headers/serve_thread.h"
 #include "../headers/ServeRequestBuffer.h"
 
@@ -15,6 +21,9 @@ using namespace std;
 #define MAX_GET_REQUEST_BUFFER_LEN 1024    // code assumes that no request bigger than this will be received. If we do get a bigger one, we will ignore any "overflown" data
 #define BUFFER_SIZE 4096                   // size of the buffer used tp read from files chunk-by-chunk
 #define HTTP_GET_READ_BUF_SIZE 256         // size of the buffer used to read the http get header
+#define KEEP_ALIVE_TIMEOUT 5               // seconds a kept-alive connection may stay idle before we close it (a thread is dedicated to it meanwhile)
+#define KEEP_ALIVE_MAX_REQUESTS 1000       // maximum number of requests served on one connection
+#define VALIDATOR_LEN 128                  // size of the buffers that hold an ETag or an HTTP-date (from the request or for the response)
 
 /* useful macros */
 #define CHECK_PERROR(call, callname, handle_code) { if ( ( call ) < 0 ) { perror(callname); handle_code } }
@@ -32,8 +41,15 @@ extern unsigned long long int total_bytes_returned;
 
 
 /* Local functions */
+ssize_t read_http_request(int fd, char *buf, size_t &buffered);        // reads from fd until buf holds a whole http request header - returns its length (0 on EOF, < 0 on error). buffered is how many bytes buf holds (before and after the call)
+bool wants_keep_alive(const char *http_request_str);                   // true if the request contains a "Connection: keep-alive" field
+bool get_header_field(const char *http_request_str, const char *field, char *value, size_t size);     // copies the value of field (ex "If-None-Match:") into value - false if the request has no such field
+bool serve_request(int request_fd, char *http_request_str, bool keep_alive, const char *if_none_match, const char *if_modified_since, struct tm *timestamp, char *date_and_time);
+                                                                        // answers one request (the if_* validators are NULL if the request had none) - returns false if the connection must be closed after it
+bool not_modified(const struct stat &info, const char *etag, const char *if_none_match, const char *if_modified_since);     // true if the client's copy of the page is still valid (=> 304 Not Modified)
 bool check_if_valid(char *http_request_str, char *&filename);           // checks if http get request header is valid (<=> 1. 1st line is "HTTP/1.1 GET <link>", 2. There is a "Host:" field, 3. Every field header ends in ':')
 char *get_current_time(struct tm *timestamp, char *date_and_time);      // returns a pointer to date_and_time argument which is filled with current time information according to the RFC protocol for TCP
+char *format_http_date(time_t t, struct tm *timestamp, char *date_and_time);    // same as above for any point in time t
 size_t bufferlen(const char *buf);                      // returns BUFFER_SIZE except if it comes across a '\0' in which case it returns the size of the string before it without it
 
 
@@ -56,109 +72,209 @@ void *handle_http_requests(void *arguements){
         if ( request_fd < 0 ) cerr << "Warning: could not pop an element from the request buffer even though it should not be empty" << endl;
         serve_request_buffer->release();                // unlock the mutex
 
-        // read http get request from popped file descriptor
+        // serve requests from this connection for as long as the client keeps it alive (at most KEEP_ALIVE_MAX_REQUESTS)
         char http_request_str[MAX_GET_REQUEST_BUFFER_LEN];
-        int i = 0;
-        ssize_t nbytes = 0;
-        bool stop = false, previous_chunk_ends_in_endl = false;       // the 2nd one is in case our "buffering" "cuts" the "\n\n" or "\n\r\n" in different chunks
-        while ( !stop && i < MAX_GET_REQUEST_BUFFER_LEN - 1 && ( nbytes = read(request_fd, http_request_str + i, HTTP_GET_READ_BUF_SIZE) ) > 0 ){
-            if (previous_chunk_ends_in_endl && ( http_request_str[i] == '\n' || (http_request_str[i] == '\r' && nbytes > 1 && http_request_str[i+1] == '\n') ) ){
-                i += nbytes;
-                break;
-            } else if (nbytes > 1) previous_chunk_ends_in_endl = false;   // reset this
-            // search bytes read for "\n\n" or (\r)"\n\r\n", which signals the end of the HTTP GET request
-            for (int j = 0 ; j < nbytes - 1 ; j++){
-                if ( http_request_str[i+j] == '\n' && (http_request_str[i+j+1] == '\n' || (http_request_str[i+j+1] == '\r' && j < nbytes - 2 && http_request_str[i+j+2] == '\n') ) ){
-                    stop = true;
-                    break;
-                }
-            }
-            if ( http_request_str[i+nbytes-1] == '\n' || (nbytes > 1 && http_request_str[i+nbytes-2] == '\n' && http_request_str[i+nbytes-1] == '\r') ){
-                previous_chunk_ends_in_endl = true;
+        size_t buffered = 0;                            // bytes in http_request_str which belong to the next request (a client might send it before getting our answer)
+        for (int served = 0 ; served < KEEP_ALIVE_MAX_REQUESTS && !server_must_terminate ; served++){
+            if ( served > 0 && buffered == 0 ){         // wait (for a while) for the next request on a kept-alive connection
+                struct pollfd pfd;
+                pfd.fd = request_fd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                if ( poll(&pfd, 1, KEEP_ALIVE_TIMEOUT * 1000) <= 0 ) break;    // idle for too long (or poll failed): close the connection
             }
-            i += nbytes;
+            ssize_t request_len = read_http_request(request_fd, http_request_str, buffered);
+            if ( request_len < 0 ){ perror("read on serve socket"); break; }
+            if ( request_len == 0 ) break;              // client closed the connection
+            char saved = http_request_str[request_len];
+            http_request_str[request_len] = '\0';
+            bool keep_alive = wants_keep_alive(http_request_str);
+            char if_none_match[VALIDATOR_LEN], if_modified_since[VALIDATOR_LEN];       // a conditional GET (from a re-crawl) is answered with 304 if the page has not changed
+            bool has_if_none_match = get_header_field(http_request_str, "If-None-Match:", if_none_match, VALIDATOR_LEN);
+            bool has_if_modified_since = get_header_field(http_request_str, "If-Modified-Since:", if_modified_since, VALIDATOR_LEN);
+            // (!) serve_request modifies the request string so it has to be called last
+            bool keep_open = serve_request(request_fd, http_request_str, keep_alive, has_if_none_match ? if_none_match : NULL,
+                                           has_if_modified_since ? if_modified_since : NULL, &timestamp, date_and_time);
+            // move any bytes of the next request at the start of the buffer
+            http_request_str[request_len] = saved;
+            buffered -= request_len;
+            memmove(http_request_str, http_request_str + request_len, buffered);
+            if ( !keep_alive || !keep_open ) break;
         }
-        http_request_str[i] = '\0';
-        if ( i == MAX_GET_REQUEST_BUFFER_LEN ){ cerr << "Warning: Might not have read full HTTP GET request due to buffer size overflow" << endl; }
-        if ( nbytes < 0 ){ perror("read on serve socket"); close(request_fd); continue; }
+
+        // close the accepted TCP serving connection
         CHECK_PERROR( shutdown(request_fd, SHUT_RD), "shutdown read from accepted serving socket", )   // wont read any more data
+        CHECK_PERROR(close(request_fd) , "closing serving socket from a thread" , )
+    }
+    return NULL;
+}
+
+
+/* Local Functions Implementation */
+ssize_t read_http_request(int fd, char *buf, size_t &buffered){
+    size_t searched = 0;
+    for (;;) {
+        // search what we have for "\n\n" or "\n\r\n", which signals the end of the HTTP GET request
+        for ( ; searched + 1 < buffered ; searched++){
+            if ( buf[searched] != '\n' ) continue;
+            if ( buf[searched+1] == '\n' ) return (ssize_t) searched + 2;
+            if ( buf[searched+1] == '\r' ){
+                if ( searched + 2 >= buffered ) break;                     // can't tell yet: read more
+                if ( buf[searched+2] == '\n' ) return (ssize_t) searched + 3;
+            }
+        }
+        if ( buffered >= MAX_GET_REQUEST_BUFFER_LEN - 1 ){
+            cerr << "Warning: Might not have read full HTTP GET request due to buffer size overflow" << endl;
+            return (ssize_t) buffered;
+        }
+        size_t to_read = MAX_GET_REQUEST_BUFFER_LEN - 1 - buffered;
+        ssize_t nbytes = read(fd, buf + buffered, (to_read < HTTP_GET_READ_BUF_SIZE) ? to_read : HTTP_GET_READ_BUF_SIZE);
+        if ( nbytes < 0 ) return -1;
+        if ( nbytes == 0 ) return (ssize_t) buffered;                      // EOF: whatever we have is the request (0 if nothing)
+        buffered += nbytes;
+    }
+}
+
 
-        // handle http get request gotten
-        char *filename = NULL;
-        bool valid = check_if_valid(http_request_str, filename);    // this also returns the filename to be used if valid
-        if ( !valid ){           // invalid HTTP GET request
-            // answer with a 400 bad request response
-            char message[1024];
-            sprintf(message, "HTTP/1.1 400 Bad Request\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nConnection: Closed\n\n<html>Sorry bro, I can only handle HTTP GET requests.</html>\n", get_current_time(&timestamp, date_and_time), sizeof("<html>Sorry bro, I can only handle HTTP GET requests.</html>\n"));
-            CHECK_PERROR( write(request_fd, message, strlen(message) + 1) , "write to serving socket" , )
+bool wants_keep_alive(const char *http_request_str){
+    for (const char *line = strchr(http_request_str, '\n') ; line != NULL ; line = strchr(line + 1, '\n')){
+        if ( strncasecmp(line + 1, "Connection:", strlen("Connection:")) == 0 ){
+            const char *value = line + 1 + strlen("Connection:");
+            while ( *value == ' ' || *value == '\t' ) value++;
+            return strncasecmp(value, "keep-alive", strlen("keep-alive")) == 0;
         }
-        else {
-            char *filepath = new char[strlen(root_dir) + strlen(filename) + 1];
-            strcpy(filepath, root_dir);                    // (!) root_dir should NOT have a "/" at the end (dealt with at command line parameter parsing)
-            strcat(filepath, filename);                    // because filename should have a "/" at the start
-            delete[] filename;
-            cout << "serving port received a request for " << filepath << endl;
-            FILE *page = fopen(filepath, "r");             // fopen is thread safe
-            if (page == NULL) {
-                if (errno == EACCES) {                     // did not have permission for the requested file
-                    // answer with a 403 http response
-                    char message[512];
-                    sprintf(message, "HTTP/1.1 403 Forbidden\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nConnection: Closed\n\n<html>Trying to access this file but I do not think can make it.</html>\n", get_current_time(&timestamp, date_and_time), sizeof("<html>Trying to access this file but I do not think can make it.</html>\n"));
-                    CHECK_PERROR(write(request_fd, message, strlen(message)), "write to serving socket",)
-                } else if (errno == ENOENT) {              // requested file does not exist
-                    // answer with a 404 http response
-                    char message[512];
-                    sprintf(message, "HTTP/1.1 404 Not Found\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nConnection: Closed\n\n<html>Sorry dude, could not find this file.</html>\n", get_current_time(&timestamp, date_and_time), sizeof("<html>Sorry dude, could not find this file.</html>\n"));
-                    CHECK_PERROR(write(request_fd, message, strlen(message)), "write to serving socket",)
-                } else {
-                    perror("Error at fopening a requested page");
-                }
-            } else {
-                // get html's file size
-                long content_length = 0;
-                long pos = ftell(page);              // current position
-                fseek(page, 0, SEEK_END);            // go to end of file
-                content_length = ftell(page);        // read the position which is the size of the file
-                fseek(page, pos, SEEK_SET);          // restore original position
-                // write the 200 OK response header with the appropriate content_length
-                char header[1024];
-                sprintf(header, "HTTP/1.1 200 OK\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nConnection: Closed\n\n", get_current_time(&timestamp, date_and_time), content_length);
-                CHECK_PERROR( write(request_fd, header, strlen(header)), "write to serving socket", break; );
-                // write the page itself chunk-by-chunk using a buffer
-                char buffer[BUFFER_SIZE];
-                size_t bytes_read;
-                for (;;) {                                // read file using a buffer and create a list of chunks that make up the requested page
-                    CHECK_PERROR( (bytes_read = fread(buffer, 1, BUFFER_SIZE, page)), "read from page's html file", break; )
-                    if ( bytes_read < BUFFER_SIZE )  // if read less than BUFFER_SIZE data then
-                        buffer[bytes_read] = '\0';   // put a '\0' at the end so that bufferlen will "save us" from writting garbage from a previous read (useful for last write)
-                    if ( bytes_read > 0 ) {
-                        // bufferlen guarantees that (nor the firsts nor) the last following writes will contain a '\0' at the end. We do not want a '\0' sent over the socket.
-                        CHECK_PERROR( write(request_fd, buffer, bufferlen(buffer)), "write to serving socket", break; )
-                    }
-                    if ( bytes_read < BUFFER_SIZE ) {
-                        break;
-                    }
-                }
+    }
+    return false;                                       // persistent connections are opt-in
+}
 
-                // update statistics (consistently using their lock)
-                CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
-                total_pages_returned++;
-                total_bytes_returned += content_length;
-                CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
 
-                fclose(page);
-            }
+bool get_header_field(const char *http_request_str, const char *field, char *value, size_t size){
+    size_t field_len = strlen(field);
+    for (const char *line = strchr(http_request_str, '\n') ; line != NULL ; line = strchr(line + 1, '\n')){
+        if ( strncasecmp(line + 1, field, field_len) == 0 ){
+            const char *start = line + 1 + field_len;
+            while ( *start == ' ' || *start == '\t' ) start++;
+            size_t len = strcspn(start, "\r\n");
+            while ( len > 0 && (start[len-1] == ' ' || start[len-1] == '\t') ) len--;
+            if ( len >= size ) len = size - 1;
+            memcpy(value, start, len);
+            value[len] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool serve_request(int request_fd, char *http_request_str, bool keep_alive, const char *if_none_match, const char *if_modified_since, struct tm *timestamp, char *date_and_time){
+    const char *connection = keep_alive ? "keep-alive" : "Closed";
+    char *filename = NULL;
+    bool valid = check_if_valid(http_request_str, filename);    // this also returns the filename to be used if valid
+    if ( !valid ){           // invalid HTTP GET request
+        // answer with a 400 bad request response (and always close the connection after it)
+        char message[1024];
+        sprintf(message, "HTTP/1.1 400 Bad Request\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nConnection: Closed\n\n<html>Sorry bro, I can only handle HTTP GET requests.</html>\n", get_current_time(timestamp, date_and_time), strlen("<html>Sorry bro, I can only handle HTTP GET requests.</html>\n"));
+        CHECK_PERROR( write(request_fd, message, strlen(message)) , "write to serving socket" , )
+        return false;
+    }
+    char *filepath = new char[strlen(root_dir) + strlen(filename) + 1];
+    strcpy(filepath, root_dir);                    // (!) root_dir should NOT have a "/" at the end (dealt with at command line parameter parsing)
+    strcat(filepath, filename);                    // because filename should have a "/" at the start
+    delete[] filename;
+    cout << "serving port received a request for " << filepath << endl;
+    bool keep_open = true;
+    FILE *page = fopen(filepath, "r");             // fopen is thread safe
+    if (page == NULL) {
+        if (errno == EACCES) {                     // did not have permission for the requested file
+            // answer with a 403 http response
+            char message[512];
+            sprintf(message, "HTTP/1.1 403 Forbidden\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nConnection: %s\n\n<html>Trying to access this file but I do not think can make it.</html>\n", get_current_time(timestamp, date_and_time), strlen("<html>Trying to access this file but I do not think can make it.</html>\n"), connection);
+            CHECK_PERROR(write(request_fd, message, strlen(message)), "write to serving socket", keep_open = false; )
+        } else if (errno == ENOENT) {              // requested file does not exist
+            // answer with a 404 http response
+            char message[512];
+            sprintf(message, "HTTP/1.1 404 Not Found\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nConnection: %s\n\n<html>Sorry dude, could not find this file.</html>\n", get_current_time(timestamp, date_and_time), strlen("<html>Sorry dude, could not find this file.</html>\n"), connection);
+            CHECK_PERROR(write(request_fd, message, strlen(message)), "write to serving socket", keep_open = false; )
+        } else {
+            perror("Error at fopening a requested page");
+            keep_open = false;                     // we did not answer at all
+        }
+    } else {
+        // get html's file size
+        long content_length = 0;
+        long pos = ftell(page);              // current position
+        fseek(page, 0, SEEK_END);            // go to end of file
+        content_length = ftell(page);        // read the position which is the size of the file
+        fseek(page, pos, SEEK_SET);          // restore original position
+        // validators of this version of the page: a client that sends one of them back gets a 304 (with no body) if the page has not changed since
+        struct stat info;
+        char etag[VALIDATOR_LEN], last_modified[VALIDATOR_LEN];
+        struct tm modified_timestamp;
+        CHECK_PERROR( fstat(fileno(page), &info), "fstat on requested page", memset(&info, 0, sizeof(info)); )
+        sprintf(etag, "\"%lx-%lx\"", (unsigned long) info.st_size, (unsigned long) info.st_mtime);
+        format_http_date(info.st_mtime, &modified_timestamp, last_modified);
+        if ( not_modified(info, etag, if_none_match, if_modified_since) ){
+            char header[1024];
+            sprintf(header, "HTTP/1.1 304 Not Modified\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nETag: %s\nLast-Modified: %s\nConnection: %s\n\n", get_current_time(timestamp, date_and_time), etag, last_modified, connection);
+            CHECK_PERROR( write(request_fd, header, strlen(header)), "write to serving socket", keep_open = false; );
+            fclose(page);
             delete[] filepath;
+            return keep_open;
+        }
+        // cork the socket so that the header and the page leave in full-sized segments and the last one is not held back by Nagle's algorithm
+        // waiting for a (delayed) ACK from a kept-alive client - uncorking at the end flushes whatever is left
+        int cork = 1;
+        CHECK_PERROR( setsockopt(request_fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork)), "setsockopt TCP_CORK", )
+        // write the 200 OK response header with the appropriate content_length
+        char header[1024];
+        sprintf(header, "HTTP/1.1 200 OK\nDate: %s\nServer: myhttpd/1.0.0 (Ubuntu64)\nContent-Length: %zu\nContent-Type: text/html\nETag: %s\nLast-Modified: %s\nConnection: %s\n\n", get_current_time(timestamp, date_and_time), content_length, etag, last_modified, connection);
+        CHECK_PERROR( write(request_fd, header, strlen(header)), "write to serving socket", keep_open = false; );
+        // write the page itself chunk-by-chunk using a buffer
+        char buffer[BUFFER_SIZE];
+        size_t bytes_read;
+        while (keep_open) {                       // read file using a buffer and create a list of chunks that make up the requested page
+            CHECK_PERROR( (bytes_read = fread(buffer, 1, BUFFER_SIZE, page)), "read from page's html file", keep_open = false; break; )
+            if ( bytes_read < BUFFER_SIZE )  // if read less than BUFFER_SIZE data then
+                buffer[bytes_read] = '\0';   // put a '\0' at the end so that bufferlen will "save us" from writting garbage from a previous read (useful for last write)
+            if ( bytes_read > 0 ) {
+                // bufferlen guarantees that (nor the firsts nor) the last following writes will contain a '\0' at the end. We do not want a '\0' sent over the socket.
+                CHECK_PERROR( write(request_fd, buffer, bufferlen(buffer)), "write to serving socket", keep_open = false; break; )
+            }
+            if ( bytes_read < BUFFER_SIZE ) {
+                break;
+            }
         }
+        cork = 0;
+        CHECK_PERROR( setsockopt(request_fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork)), "setsockopt TCP_CORK", )
 
-        // close the accepted TCP serving connection
-        CHECK_PERROR(close(request_fd) , "closing serving socket from a thread" , )
+        // update statistics (consistently using their lock)
+        CHECK( pthread_mutex_lock(&stat_lock), "pthread_mutex_lock",  )
+        total_pages_returned++;
+        total_bytes_returned += content_length;
+        CHECK( pthread_mutex_unlock(&stat_lock), "pthread_mutex_unlock",  )
+
+        fclose(page);
     }
-    return NULL;
+    delete[] filepath;
+    return keep_open;
+}
+
+
+bool not_modified(const struct stat &info, const char *etag, const char *if_none_match, const char *if_modified_since){
+    if ( if_none_match != NULL ){                        // (takes precedence over If-Modified-Since) may be "*" or a list of etags
+        return strcmp(if_none_match, "*") == 0 || strstr(if_none_match, etag) != NULL;
+    }
+    if ( if_modified_since != NULL ){
+        struct tm since;
+        memset(&since, 0, sizeof(since));
+        const char *end = strptime(if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &since);
+        if ( end == NULL ) return false;                 // a date we do not understand is ignored
+        return info.st_mtime <= timegm(&since);
+    }
+    return false;
 }
 
 
-/* Local Functions Implementation */
 bool check_if_valid(char *http_request_str, char *&filename) {   // This function is a bit messy but it works for all scenarios I checked it on
     char *rest = http_request_str;
     bool host_field_exists = false;
@@ -282,8 +398,12 @@ const char *getMonthName(int num){
 
 
 char *get_current_time(struct tm *timestamp, char *date_and_time) {    // follows the RFC prototype
-    time_t now = time(NULL);
-    struct tm *timeptr = gmtime_r(&now, timestamp);                    // thread safe version of gmtime_r
+    return format_http_date(time(NULL), timestamp, date_and_time);
+}
+
+
+char *format_http_date(time_t t, struct tm *timestamp, char *date_and_time) {
+    struct tm *timeptr = gmtime_r(&t, timestamp);                      // thread safe version of gmtime_r
     sprintf(date_and_time, "%s, %.2u %s %.4u %.2u:%.2u:%.2u GMT", getDayName(timeptr->tm_wday), timeptr->tm_mday, getMonthName(timeptr->tm_mon),
             1900 + timeptr->tm_year, timeptr->tm_hour, timeptr->tm_min, timeptr->tm_sec);
     return date_and_time;